@@ -23,6 +23,17 @@
  *                                     Removed VAPOR_BPASS, VAPOR_PROBE_ERROR
  *                                     Removed unused "touch chip" variables
  * 1.6.34  07/08/16  DHP    Added probe_type[]
+ * 1.6.38  10/19/26  AGT    Added parallel probe classifier class_* variables
+ *                          Added IDLE arrival watch arrive_* variables
+ *                          Added modbus_t15_time and modbus_eom
+ *                          Added ENA_TIM_PACKED (EnaSftFeatures2)
+ *                          Added monotimer
+ *                          Added thresh_stale
+ *                          Added depart_latency
+ *                          Added jumper_now/jumper_seq jumper snapshot
+ *                          Added LJ_ line jumper taps
+ *                          Added probe_q_lost, probe_q_peak
+ *                          Added modbus_tx_timeout
  ****************************************************************************/
 #ifndef COMDAT_H
 #define COMDAT_H
@@ -37,6 +48,8 @@ extern unsigned char    dry_once;           /* FogBugz 108 */
 extern unsigned long    cycle_timeout;      /* FogBugz 108 */
 extern unsigned int     high_3[];           /* QCCC 53 */
 extern unsigned int     high_8[];           /* QCCC 53 */
+extern volatile unsigned char thresh_stale; /* Rebuild convert_to_binary() thresholds */
+extern unsigned int     depart_latency;     /* ms to declare GONE, last departure */
 extern unsigned int     unit_type;
 extern unsigned int     Ground_Reference;
 extern unsigned int     gnd_retry;
@@ -136,6 +149,18 @@ extern unsigned char    ConfigA;                    /* System configuration
 extern unsigned char    ConfigC;                    /* System configuration */
 extern unsigned char    enable_jumpers;             /* Hardware jumpers/enable byte;
                                                         1=TRUE (hardware invert) */
+extern unsigned int     jumper_now;                 /* Jumpers as last read, see
+                                                        read_jumpers() */
+extern unsigned int     jumper_seq;                 /* Bumped when jumper_now changes */
+#define     JMP_DEBUG       0x0100      /* jumper_now: DEBUG jumper in */
+
+/* ModBus line jumper taps, latched once at power up (see line_jumper_mv()) */
+#define     LJ_ADDR10       0           /* Address "tens" */
+#define     LJ_ADDR1        1           /* Address "ones" */
+#define     LJ_BAUD         2           /* Baud rate */
+#define     LJ_PARITY       3           /* Parity */
+#define     LJ_CSIZE        4           /* 7/8 data bits */
+#define     LJ_TAPS         5
 
 /******************************* 8/26/2008 8:54AM ****************************
  * io expander definitions
@@ -171,6 +196,7 @@ extern   char     enable_soft;          /* Software features/enable byte;
 #define     ENA_CPT_COUNT       0x80
 
 #define     ENA_AUTO_FUEL_TYPE_WRITE    0x01
+#define     ENA_TIM_PACKED              0x02    /* Packed Truck ID format on erase */
 
 extern char     Ena_INTL_ShortNV;       /* Temp. Enable Shorts Test Flag READ ONLY */
 extern char     Ena_Debug_Func_1;       /* Temp. Enable General Debug Pulse READ ONLY */
@@ -301,6 +327,7 @@ extern   int probe_result_flag;             /* ADC interrupt flag */
 extern   int dma_result_flag;               /* ADC interrupt flag */
 extern   unsigned short mstimer;            /* Like TCNT, but milliseconds */
 extern   unsigned long  freetimer;          /* timer 1 ms count */
+extern   volatile unsigned long long monotimer; /* 1 ms count since reset */
 extern   unsigned short service_time;
 extern   unsigned long  dry_timer;          /* timer of dry probe attachment */
 //UK >>>
@@ -334,6 +361,8 @@ extern   unsigned int   probe_volt[COMPART_MAX];        /* latest read of ADC's
 extern   PROBE_TYPE     probe_type[2*COMPART_MAX];      /* sensor type */
 extern   unsigned int   result_ptr[COMPART_MAX];        /* latest read of ADC's */
 extern   unsigned int   old_probe_volt[COMPART_MAX];    /* previous read of ADC's in mv */
+extern   unsigned int   probe_q_lost;       /* T3 scans dropped, probe queue full */
+extern   unsigned char  probe_q_peak;       /* Most scans waiting for probe_drain() */
 extern   int            adc_convert_flag;               /* Indicate that the analog conversion */
                                                         /*  has finished */
 extern   char           berr;                           /* buss error occurred */
@@ -348,6 +377,24 @@ extern   char           main_array[MAX_RELAY];          /* main relay oscillatio
 extern   char           bak_array[MAX_RELAY];           /* backup relay oscillation array */
 extern   char           bak_charge[MAX_RELAY];          /* backup charge driver array */
 
+/* Parallel probe classification window (see probe_class_check()) */
+extern   unsigned char  class_window;                   /* CLASS_IDLE, CLASS_OPEN or CLASS_DONE */
+extern   unsigned int   class_opt_hi;                   /* Optic threshold latch, 1 bit/channel */
+extern   unsigned int   class_thm_hi;                   /* Thermistor threshold latch, 1 bit/channel */
+extern   unsigned char  class_opt_edge[COMPART_MAX];    /* Optic threshold rising edges */
+extern   unsigned char  class_thm_edge[COMPART_MAX];    /* Thermistor threshold rising edges */
+extern   unsigned int   class_start_volt[COMPART_MAX];  /* Probe mv when window opened */
+extern   unsigned int   class_avg_volt[COMPART_MAX];    /* Filtered probe mv (ramp) */
+extern   unsigned char  class_conf[4];                  /* Confidence (%) by PROBE_TRY_STATE */
+extern   unsigned long  class_start;                    /* read_time() when window opened */
+extern   unsigned int   class_ms;                       /* ms from window open to decision */
+
+/* IDLE truck arrival watch (see arrive_watch()) */
+extern   unsigned char  arrive_state;                   /* ARRIVE_OFF, ARRIVE_ARMED or ARRIVE_SEEN */
+extern   unsigned char  arrive_chan;                    /* First channel (1-8) seen to drop */
+extern   unsigned int   arrive_limit[COMPART_MAX];      /* Below this mv a truck is suspected */
+extern   unsigned long  arrive_time;                    /* read_time() of the drop */
+
 /******************************* 12/30/2008 7:12AM ***************************
  * Area to store the contents of the TIM truck configuration.
  * Byte 0 is the number of truck compartments
@@ -371,10 +418,13 @@ extern   unsigned char  modbus_csize;     /* ModBus/Comm character size */
 extern   unsigned char  modbus_err;
 extern   unsigned char  modbus_state;
 extern   unsigned char  modbusVIPmode;
-extern   unsigned short modbus_eom_time;
+extern   unsigned short modbus_eom_time;  /* t3.5 in Timer 5 ticks */
+extern   unsigned short modbus_t15_time;  /* t1.5 + 1 char in Timer 5 ticks */
+extern   volatile unsigned char modbus_eom; /* t3.5 idle seen by Timer 5 */
 extern   unsigned short modbus_swx_time;  /* ModBus "turnaround" time */
 extern   unsigned short modbus_Recv_err;
 extern   unsigned short modbus_PrepMsg_err;
+extern   unsigned short modbus_tx_timeout; /* Stuck ModBus transmits */
 extern   unsigned short modbus_DecodeMsg_err;
 
 extern   unsigned char  modbus_rx_len;
@@ -32,6 +32,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include "hardass.h"
+#include "hal.h"
 #include "stdsym.h"
 #include "enum.h"
 #include "stsbits.h"
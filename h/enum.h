@@ -19,6 +19,8 @@
  *              04/22/08  KLL  Started porting old Intellitrol enumerated list from the 
  *                                         MC68HC16Y1 cpu on the original Intellitrol
  * 1.5.31  08/10/14  DHP  Removed M_VAPORFLOW, VAPOR_FLOW, VAPOR_REF
+ * 1.6.38  10/19/26  AGT  BAUD_RATE: indexes 9 and 10 are now 57600 and 115200;
+ *                          8 and above are only reachable via SysParm.ModBusBaud
  *
  *********************************************************************************************/
 #ifndef ENUM_H
@@ -167,9 +169,9 @@ typedef enum
     B04800,     /* 05   4800 */
     B09600,     /* 06   9600 */
     B19200,     /* 07  19200 */
-    B38400,     /* 08  38400 */
-    BRESERVED4, /* 09  Reserved (7-bit character) */
-    BRESERVED5  /* 10  Reserved (8-bit character) */
+    B38400,     /* 08  38400 (jumper 8 is 7-bit character) */
+    B57600,     /* 09  57600 (jumper 9 is 8-bit character) */
+    B115200     /* 10 115200 */
 } BAUD_RATE;
 /****************************************************************************/
 
@@ -14,6 +14,20 @@
  *
  *   Revision History:
  *
+ *   1.6.38  10/19/26  AGT  Added packed Truck ID format (TPK_*) definitions.
+ *                          Version 2: block directory and update flag in
+ *                          the header blocks.
+ *                          Version 3: block map (TPK_MAPOFF), TPK_HDRBLKS 22.
+ *                          Capacity comment measured by timconv.
+ *                          Added the per-connection Session Record ring
+ *                          (E2SESREC, SES_*) in the old Error Log space.
+ *                         Added KEY_HASHSIZ, the RAM Bypass Key index size.
+ *                         Added the SysParm journal (EEP_SPJ, SPJ_*) in the
+ *                          free end of the System NonVolatile block.
+ *                         Record word and time fields are UINT16/UINT32 (same
+ *                          on the PIC) so records keep their layout in the
+ *                          host test build, see stdsym.h.
+ *
  *****************************************************************************/
 #ifndef ESQUARED_H
 #define ESQUARED_H
@@ -27,6 +41,11 @@
 
 #define E2KEYCNT    32
 
+/* Slots in the RAM index of authorized Bypass Keys (see nvKeyInit());
+   a power of 2, at least twice E2KEYCNT */
+
+#define KEY_HASHSIZ 64
+
 /* Minimum number of Truck ID Module entries to maintain in EEPROM. 5000
    fits nicely (well, tightly) into a 32KB (28C256) EEPROM. */
 
@@ -66,9 +85,13 @@
 *           +----------------+      System Non-Volatile storage
 *   0100/   | NonVolatile    |
 *           ~  System        ~
-*   03FF/   |   Info         |
-*           +----------------+      Customer/System Error log
-*   0400/   | Error Log      |
+*   027F/   |   Info         |
+*           +----------------+      SysParm journal (2 regions)
+*   0280/   | Snapshot and   |
+*           ~  changes       ~
+*   03FF/   |   2 x 192      |
+*           +----------------+      Session Record ring (was Error log)
+*   0400/   | Session Recs   |
 *           ~  32 x 32       ~
 *   07FF/   |                |
 *           +----------------+      Bypass Key Registry
@@ -100,6 +123,22 @@
 
 #define EEP_TIM         0x07
 #define EEP_FACT        0x08
+#define EEP_SPJ         0x09        /* SysParm journal, within EEP_SYSNV */
+
+/* SysParm journal (see nvsystem.c). Two regions, used in turn; each is a
+   header (magic, generation), a SysParmNV snapshot, then SPJ_RECS change
+   records of SPJ_RECSIZ bytes: offset (SPJ_COMMIT on the last of an
+   update), value, generation low byte, CRC-8 of the three. */
+
+#define SPJ_OFS         0x180       /* Offset within the System NV block */
+#define SPJ_REGSIZ      0xC0        /* Bytes per region */
+#define SPJ_SIZE        (2 * SPJ_REGSIZ)
+#define SPJ_MAGIC       0x534A      /* "SJ" */
+#define SPJ_HDRSIZ      4
+#define SPJ_JRNOFS      (SPJ_HDRSIZ + sizeof(SysParmNV))
+#define SPJ_RECSIZ      4
+#define SPJ_RECS        ((SPJ_REGSIZ - SPJ_JRNOFS) / SPJ_RECSIZ)
+#define SPJ_COMMIT      0x80
 
 /* EEPROM "Home" block format. This is the "root" of all access to the
    various "non-volatile partitions" used by the Intellitrol. */
@@ -108,26 +147,26 @@ typedef struct
 {
     unsigned char pat1;         /* Pattern: 0x17 */
     unsigned char pat2;         /* Pattern: 0xE8 */
-    unsigned    Version;        /* Version/format number */
+    UINT16      Version;        /* Version/format number */
     unsigned char Valid;          /* Home/EEPROM validity flags */
     char        Status;         /* Home/EEProm status */
     char        Serial[8];      /* Unit Serial number (Dallas clock) */
-    unixtime    Time;           /* Unit EEPROM Home init time (4 byte unsigned long) */
-    unsigned    EESize;         /* Size (in KB) of EEPROM */
-    unsigned    Bootlen;        /* Length of "boot" block */
-    unsigned    Bootptr;        /* Start of "boot" block */
-    unsigned    Crashlen;       /* Length of "Crash" block */
-    unsigned    Crashptr;       /* Start of "Crash" block */
-    unsigned    SysNVlen;       /* Length of "NonVolatile" system block */
-    unsigned    SysNVptr;       /* Start of "NonVolatile" system block */
-    unsigned    Loglen;         /* Length of system log block */
-    unsigned    Logptr;         /* Start of system log block */
-    unsigned    Keylen;         /* Length of Bypass Key block */
-    unsigned    Keyptr;         /* Start of Bypass Key block */
-    unsigned    TIMlen;         /* Length of Authorized-TIM block */
-    unsigned    TIMptr;         /* Start of Authorized-TIM block */
+    UINT32      Time;           /* Unit EEPROM Home init time (4 byte unsigned long) */
+    UINT16      EESize;         /* Size (in KB) of EEPROM */
+    UINT16      Bootlen;        /* Length of "boot" block */
+    UINT16      Bootptr;        /* Start of "boot" block */
+    UINT16      Crashlen;       /* Length of "Crash" block */
+    UINT16      Crashptr;       /* Start of "Crash" block */
+    UINT16      SysNVlen;       /* Length of "NonVolatile" system block */
+    UINT16      SysNVptr;       /* Start of "NonVolatile" system block */
+    UINT16      Loglen;         /* Length of system log block */
+    UINT16      Logptr;         /* Start of system log block */
+    UINT16      Keylen;         /* Length of Bypass Key block */
+    UINT16      Keyptr;         /* Start of Bypass Key block */
+    UINT16      TIMlen;         /* Length of Authorized-TIM block */
+    UINT16      TIMptr;         /* Start of Authorized-TIM block */
     char        free[18];       /* Free/Available Home block storage */
-    unsigned        CRC;            /* Home block CRC */
+    UINT16          CRC;            /* Home block CRC */
     } E2HOMEBLK;
 
 /* Home block magic pattern bytes (used to id/verify it's a home block) */
@@ -154,7 +193,7 @@ typedef struct
 typedef struct
 {
     char        free[62];       /* Whatever we decide upon */
-    unsigned        CRC;            /* Boot block CRC */
+    UINT16          CRC;            /* Boot block CRC */
     } E2BOOTBLK;
 
 
@@ -164,7 +203,7 @@ typedef struct
 typedef struct
 {
     char        free[126];      /* Whatever we decide upon */
-    unsigned        CRC;            /* Crash block CRC */
+    UINT16          CRC;            /* Crash block CRC */
     } E2CRASHBLK;
 
 
@@ -210,10 +249,10 @@ typedef struct
 {
     char        Type;           /* Log entry type */
     char        Subtype;        /* Type-specific additional info (byte *1*) */
-    unsigned    RepMask;        /* Repeat mask (must be bytes *2* and *3*) */
-    unixtime    Time;           /* Date/Time (UCT) of original entry */
+    UINT16      RepMask;        /* Repeat mask (must be bytes *2* and *3*) */
+    UINT32      Time;           /* Date/Time (UCT) of original entry */
     char        Info[22];       /* Type- & Subtype-specific log entry data */
-    unsigned    CRC;            /* Log entry CRC */
+    UINT16      CRC;            /* Log entry CRC */
     } E2LOGREC;
 
 
@@ -231,7 +270,7 @@ typedef struct
 typedef struct
 {
     unsigned char   Key[BYTESERIAL]; /* Bypass/Dallas key serial number */
-    unsigned        CRC;            /* Bypass key CRC */
+    UINT16          CRC;            /* Bypass key CRC */
     } E2KEYREC;
 
 
@@ -304,6 +343,73 @@ Size of E2TIMSIZ  : 0x7530 30000
 #define TIM_BASE    (KEY_BASE + E2KEYSIZ)
 #define E2TIMSIZ    (E2TIMCNT * sizeof(E2TIMREC))
 
+/* Optional packed ("sorted") Truck ID format within the same E2TIMSIZ
+   range (see nvtruck.c). TPK_HDRBLKS header blocks (signature, update in
+   progress flag, a directory of per-block counts and the map of blocks in
+   sorted order, 16-bit little-endian entries) are followed by TPK_BLOCKS
+   blocks, each holding a count, the first serial number (low 5
+   bytes), variable length deltas to the following serial numbers and a
+   CRC-16. Blocks are half an EEPROM page so never straddle a page
+   boundary. A block holds 1 + 56/d Truck IDs for d-byte deltas. A list
+   loaded in order fills its blocks; Truck IDs added in any order first
+   move into a neighbouring block with room and only then split one. So
+   capacity depends on how clustered the serial numbers are and on the
+   order they came in (test/timconv -b, in order / random order):
+   25400 / 21200 consecutive, 24000 / 18800 in fleets of 60, and 6700 /
+   5200 with serial numbers spread over the whole range (mostly 4-byte
+   deltas), against the 5000 E2TIMREC slots. A list that would not fit
+   is refused by timconv, the conversion tool. */
+
+#define TPK_BLKSIZ  64                  /* Bytes per packed block */
+#define TPK_HDRBLKS 22                  /* Header, directory and map blocks */
+#define TPK_BLOCKS  ((E2TIMSIZ / TPK_BLKSIZ) - TPK_HDRBLKS)
+#define TPK_HDRSIZ  (1 + (BYTESERIAL-1)) /* Count plus first serial */
+#define TPK_BLKMAX  (1 + (TPK_BLKSIZ - TPK_HDRSIZ - 2)) /* All 1-byte deltas */
+#define TPK_MAGIC0  'T'                 /* Header block signature */
+#define TPK_MAGIC1  'P'
+#define TPK_MAGIC2  'K'
+#define TPK_VERSION 3
+#define TPK_DIRTY   4                   /* Header byte: update in progress */
+#define TPK_DIROFF  8                   /* Directory: count byte per block */
+#define TPK_MAPOFF  (TPK_DIROFF + TPK_BLOCKS) /* Map: block number per position */
+
+/* Per-connection "Session" record ring. One E2SESREC is written for each
+   truck connection when it is closed in truck_gone() (see trukstat.c).
+   The ring lives in the 0x400 - 0x7FF range the Event Log used before it
+   moved to LOG_BASE; records are 32 bytes so one write never crosses a
+   128 byte EEPROM page. All times are milliseconds from entering ACQUIRE
+   (0xFFFF = "65 seconds or more", 0 = never happened). */
+
+typedef struct
+{
+    UINT16      Seq;            /* Session sequence number (0xFFFF = empty) */
+    UINT32      Time;           /* Date/Time (UCT) ACQUIRE entered */
+    char        Serial[BYTESERIAL]; /* Truck TIM serial number (0 if none) */
+    unsigned char Probe;        /* acquire_state that was determined */
+    unsigned char Flags;        /* SES_xxx flags below */
+    UINT16      ArriveMs;       /* Arrival watch drop to ACQUIRE */
+    UINT16      ProbeMs;        /* Probe type determined (which_probe_type) */
+    UINT16      ValidMs;        /* Truck authorized (truck_validate) */
+    UINT16      PermitMs;       /* First permit */
+    UINT16      Flaps;          /* Dry -> Wet transitions */
+    UINT16      Secs;           /* Seconds connected */
+    UINT16      LoopMax;        /* Longest main loop pass (ms) */
+    unsigned char Bypass;       /* Times bypassed */
+    unsigned char LoopAvg;      /* Average main loop pass (ms) */
+    UINT16      CRC;            /* Session record CRC */
+    } E2SESREC;
+
+#define SES_BASE    0x0400
+#define E2SESCNT    32
+#define E2SESSIZ    (E2SESCNT * sizeof(E2SESREC))
+
+#define SES_ARRIVE  0x01        /* Woken by the T3 arrival watch */
+#define SES_TALK    0x02        /* TIM serial number read */
+#define SES_VALID   0x04        /* Truck authorized */
+#define SES_PERMIT  0x08        /* Permit given */
+#define SES_BYPASS  0x10        /* Bypassed */
+#define SES_PROBE   0x20        /* Probe type determined */
+
 
 extern  E2HOMEBLK *eeHomePtr(void); /* Return Home block pointer */
 
@@ -13,6 +13,9 @@
  *   Description:    Event Log "Record" entry layouts
  *
  *   Revision History:
+ *   Rev      Date      Who   Description of Change Made
+ *  --------  --------- ---  --------------------------------------------
+ *  1.6.38    10/19/26  AGT  Added EVJUMPERS
  *
  *****************************************************************************/
 #ifndef EVLOG_H
@@ -262,5 +265,22 @@ typedef struct                      /* Must be 22 bytes */
     unsigned char probe;            /* What kind of probe was wet */
     char          future;           /* Reserved for future */
 } EEOVF2_INFO;                      /* OVF OverFill */
+
+/***********************************************************************
+   Jumper change. A jumper read while running is not what it was (see
+   read_jumpers()). The subcode is currently ignored.
+
+   Jumper events can be "repeated".
+***********************************************************************/
+
+#define EVJUMPERS       0x0B
+
+typedef struct
+{
+    unsigned        Was;            /* jumper_now before the change */
+    unsigned        Now;            /* jumper_now after it */
+    unsigned        Latched;        /* enable_jumpers as read at reset */
+    char            future[16];     /* Reserved for future */
+} EVI_JUMPERS;
 /*********************  End of EVLOG.H  ***********************************/
 #endif      /* end of EVLOG_H */
@@ -0,0 +1,48 @@
+/*********************************************************************************************
+ *
+ *       File:       hal.h
+ *
+ *       Description:
+ *           Hardware access used by the truck/probe logic modules (trukstat,
+ *           com_two, optic5, modcmd). Those modules reach the PIC24 special
+ *           function registers only through these macros or through the
+ *           driver routines (ops_ADC(), read_ADC(), set_porte(), read_time(),
+ *           time_ms64(), eeBlockRead()/eeBlockWrite(), the UART/ModBus and
+ *           Dallas drivers), so a different target only has to supply this
+ *           file and the drivers.  The driver modules themselves (adc.c,
+ *           modbus.c, eeprom.c, i2c, init_*.c, sim.c, ...) still talk to the
+ *           registers directly.
+ *
+ * Revision History:
+ *   Rev      Date   Who  Description of Change Made
+ * -------- -------- ---  --------------------------------------------
+ * 1.6.38  10/19/26  AGT  Initial version.
+ *                        HAL_CHAN_DRIVE_SET() calls probe_q_resync().
+ *********************************************************************************************/
+#ifndef HAL_H
+#define HAL_H
+
+/* Probe channel drive latch (PORTE; a PORT write lands in the latch).
+   A drive change restarts the queued probe scans (probe_q_resync()). */
+
+#define HAL_CHAN_DRIVE_GET()        (LATE)
+#define HAL_CHAN_DRIVE_SET(chans)   do { probe_q_resync(); LATE = (chans); } while (0)
+
+/* Timer 3 paces the 1ms ADC scan (see ops_ADC()) */
+
+#define HAL_ADC_SCAN_RUNNING()      (T3CONbits.TON)
+
+/* Timer 4 times the 1500us optic pulse; Timers 6/7 are the 32-bit
+   free running count read by read_32bit_realtime() */
+
+#define HAL_OPTIC_TIMER_RUNNING()   (T4CONbits.TON)
+#define HAL_OPTIC_TIMER_STOP()      do { IFS1bits.T4IF = 0; T4CONbits.TON = 0; } while (0)
+#define HAL_REALTIME_CLEAR()        do { TMR7HLD = 0; TMR6 = 0; } while (0)
+
+/* Hold off the heartbeat and DMA interrupts (IEC0) around timing
+   critical 1-Wire work, then put them back */
+
+#define HAL_IEC0_HOLD(save)         do { (save) = IEC0; IEC0 = 0; } while (0)
+#define HAL_IEC0_RESTORE(save)      (IEC0 = (save))
+
+#endif        /* end of HAL_H */
@@ -59,6 +59,49 @@
 #define READ_NUM_PROBES             0x5B
 #define USE_UPDATED_ADC_TABLE       0x5C
 #define GET_CURRENT_ADC_TABLE       0x5D
+#define READ_TRACE_BUFFER           0x5E
+#define PROBE_CAPTURE               0x5F
+#define UPDATE_IMAGE                0x60
+#define READ_SESSIONS               0x61
+#define BENCHMARK                   0x62
+#define READ_STATUS_BURST           0x63
+#define READ_JOURNAL_SEQ            0x64
+#define READ_JOURNAL                0x65
+#define READ_LOG_QUERY              0x66
+#define READ_SORTED_VEHICLES        0x67
+
+/* READ_STATUS_BURST snapshot (see mbrStatusBurst()) */
+
+#define STS_BURST_VER               3     /* Bump if the layout changes */
+#define STS_BURST_SIZE              49    /* Bytes in version 3 */
+
+/* Change journal (see mbrJournalScan()) */
+
+#define JRN_SIZE                    32    /* Records held; a power of 2 */
+#define JRN_MB_SIZE                 11    /* Bytes per record in a reply */
+#define JRN_READ_MAX                6     /* 5 + 6 * 11 fits MODBUS_MAX_DATA */
+#define JRN_OVERFLOW                0x01  /* Records since N were lost */
+#define JRN_MORE                    0x02  /* More records than returned */
+
+#define JRN_STATUSA                 0x01  /* Journal record tags */
+#define JRN_STATUSB                 0x02
+#define JRN_STATUSO                 0x03
+#define JRN_STATUSP                 0x04
+#define JRN_NONPERMIT               0x05
+#define JRN_MAIN                    0x06  /* main_state */
+#define JRN_TRUCK                   0x07  /* truck_state */
+#define JRN_BYPASS                  0x08  /* bystatus << 8 | bylevel */
+#define JRN_GROUND                  0x09  /* badgndflag */
+#define JRN_DEADMAN                 0x0A  /* baddeadman */
+#define JRN_FAULT                   0x0B  /* iambroke */
+#define JRN_JUMPERS                 0x0C  /* jumper_now */
+#define JRN_SERIAL                  0x0D  /* + 0 - 2, truck_SN as reg 10A-10C */
+#define JRN_PROBE                   0x10  /* + probe 0 - 15, as reg 10D-114 */
+#define JRN_COMPART                 0x20  /* Compartments as reg 120 */
+#define JRN_CLOCKHI                 0x21  /* Calendar seconds at tick 0 */
+#define JRN_CLOCKLO                 0x22
+#define JRN_VIP                     0x23  /* badvipflag as reg 06E */
+#define JRN_TAGS                    0x24
 
 
 /*
@@ -173,6 +216,12 @@ MODBSTS modbus_decode (unsigned char  recv_len,
                        unsigned char *xmit_rsp);
 MODBSTS mbrRdReg (unsigned int, unsigned int *);
 MODBSTS mbrWrReg (unsigned int, unsigned int *);
+unsigned char mbrStatusBurst (unsigned char *);
+void mbrJournalInit (void);
+void mbrJournalScan (void);
+unsigned int mbrJournalSeq (void);
+unsigned char mbrJournalEpoch (void);
+unsigned char mbrJournalRead (unsigned int, unsigned char *);
 MODBSTS mbxForce (unsigned int, unsigned int);
 
 #endif    /* end of MODBUS_H */
@@ -36,9 +36,17 @@ char read_ADC(void);
 void setup_probes(void);
 int wait_for_probes(void);
 char read_muxADC(unsigned int mux, SET_MUX muxchan, unsigned int *retval);
-void convert_to_binary(void);
+void convert_to_binary(const unsigned int *scan);
 void read_probes(void);
+void probe_drain(void);
+void probe_q_resync(void);
 void ops_ADC(char int_on);
+void arrive_watch(void);
+void capture_arm(unsigned char mask);
+void capture_trigger(unsigned char cause);
+unsigned char capture_status(unsigned char *buf);
+unsigned char capture_read(unsigned char chan, unsigned char start,
+                           unsigned char *buf, unsigned char max, unsigned char *count);
 
 /**************************** com_two Prototypes *****************************/
 void HighI_Off(unsigned int probe);
@@ -50,8 +58,13 @@ unsigned int check_all_oscillating(void);
 void check_shorts_opens(void);
 int check_active_shorts(unsigned int channel);
 unsigned int check_truck_gone(void);
+char depart_busy(void);
 char short_6to4_5to3(void);
+void depart_poll(void);
+void depart_reset(void);
 unsigned char check_2wire(void);
+void probe_class_open(void);
+PROBE_TRY_STATE probe_class_check(void);
 
 /**************************** dallas Prototypes *****************************/
 int reset_iButton(unsigned char port);
@@ -76,6 +89,9 @@ char Read_Clock (void);
 char Touch_Copied (char port);
 char Write_Clock (void);
 void UNIX_to_Greg (void);
+void time_tick (void);
+char rtc_read_seconds (unsigned long *secs);
+unsigned long long time_ms64 (void);
 unixtime Greg_to_UNIX(unsigned year, unsigned month, unsigned day, unsigned hour,
     unsigned minute);
 void Print_Crnt_Time (void);
@@ -109,8 +125,8 @@ void  probe_leds_off(void);
 /****************************** eeprom Prototypes *****************************/
 unsigned int EEPROM_write(unsigned char device_addr, unsigned long reg_addr,
                            const unsigned char *data_ptr, unsigned char length);
-unsigned int EEPROM_read(unsigned char device_addr,
- unsigned long reg_addr, unsigned char *data_ptr, unsigned char length);
+unsigned int EEPROM_read(UINT8 device_addr,
+ UINT32 reg_addr, UINT8 *data_ptr, UINT8 length);
 char eeBlockWrite(unsigned long loc, const unsigned char *datum, unsigned int count);
 char eeBlockFill(unsigned long loc, unsigned char datum, unsigned int count);
 UINT16 EEPROM_fill(UINT8 device_addr, UINT32 reg_addr,
@@ -168,6 +184,9 @@ void Init_ADC(void);
 
 /**************************** init_DMA Prototypes *****************************/
 void Init_DMA0(void);
+void Init_DMA1(void);
+void Init_DMA2(void);
+void Init_DMA3(void);
 
 /************************** init_ports Prototypes **************************/
 void init_ports(void);
@@ -177,8 +196,10 @@ void Init_Timer2(void);
 void Init_Timer1(void);
 void Init_Timer3(void);
 void Init_Timer4(void);
+void Init_Timer5(void);
 void Init_32bit_Timer(void);
 unsigned long read_32bit_realtime(void);
+unsigned long read_32bit_cycles(void);
 unsigned short DeltaMsTimer(unsigned short oldtime);      /* Old ("previous") value of mstimer */
 unsigned long read_time(void);
 UINT16 DeltaTCNT(unsigned short oldtime);  /* Old ("previous") value of timer count */
@@ -191,6 +212,8 @@ unsigned char fetch_jumpers(void);
 int init_I_O_Expander(void);
 char test_jumpers(void);
 void read_jumpers(char flag);
+void latch_line_jumpers(void);
+char line_jumper_mv(unsigned char tap, unsigned int *retval);
 unsigned char volts_jumper(unsigned volts);
 char  deadman_ops(char past_deadman);
 
@@ -200,6 +223,7 @@ void  memory_test(void);
 /**************************** modbus Prototypes *****************************/
 unsigned char  get_modbus_addr(void);
 unsigned char  get_modbus_baud(void);
+void modbus_baud_override(void);
 unsigned char  get_modbus_parity(void);
 unsigned char  get_modbus_csize(void);
 void  modbus_init(void);
@@ -219,6 +243,7 @@ MODBSTS mbfSetEnaFeatures(unsigned char bits);      /* Enable-flags to clear */
 
 
 /**************************** nvtruck Prototypes *****************************/
+void nvKeyInit (void);
 char nvKeyEmpty(word *index);
 char nvKeyFind(unsigned char *key, word *index);
 char nvKeyGet(unsigned char *key, word index);
@@ -236,6 +261,9 @@ char nvTrkPut(unsigned char *trk, word index);
 char nvTrkPutMany(unsigned char *trk, word index, unsigned char count);
 char nvTrkDelete(word index);
 char nvTrkErase (void);
+void nvTrkInit (void);
+unsigned char nvTrkPacked (void);
+char nvTrkRank(const unsigned char *trk, word *index);
 
 /**************************** nvsystem Prototypes *****************************/
 char nvSysParmUpdate(void);
@@ -246,8 +274,13 @@ char nvSysVoltUpdate (void);
 char nvSysDSUpdate(DateStampNV *dsptr);
 char nvSysSet1Update (void);
 char nvLogGet(unsigned char *eptr, unsigned int index);
+unsigned char nvLogType (unsigned int index);
+unsigned int nvLogAtTime (unixtime when);
 char nvSysWrBlock(char etype, unsigned char bcnt, char *buf);
 char nvLogInit (void);
+void nvSesInit (void);
+char nvSesPut (E2SESREC *sptr);
+char nvSesGet (unsigned int back, E2SESREC *sptr);
 char nvLogErase(void);
 void nvSysInit (void);
 void nvLogPut(char etyp, char esub, const char *eptr);
@@ -270,6 +303,13 @@ char check_echo(void);
 char check_diag(void);
 char check_5wire_fault(char do_two_wire);
 unsigned int calc_tank(void);
+void tank_cal_start(void);
+unsigned char tank_cal_step(void);
+void tank_cal_poll(void);
+void tank_cal_reset(void);
+char tank_cal_busy(void);
+char tank_cal_driving(void);
+unsigned int tank_cal_result(void);
 char scully_probe(void);
 
 /**************************** permit Prototypes *****************************/
@@ -308,6 +348,8 @@ char mem_test(void);
 /**************************** printout Prototypes *****************************/
 void ee83sts(unsigned int eests);
 void xprintf(unsigned int message_number, unsigned int parameter1);
+void trace_put(unsigned char id, unsigned int arg1, unsigned int arg2);
+unsigned char trace_get(unsigned char *buf, unsigned char max, unsigned int *lost);
 
 /************************** rino main Prototypes *****************************/
 void loginit(char partid);                 /* EEV_* partition mask */
@@ -358,6 +400,12 @@ int SPI_EEPROMReadStatus(unsigned char cmd, _SPI_EEPROMStatus_ *status);
 int spi_erase(void);
 unsigned long SPI_EEPROMReadDeviceID(void);
 int spi_erase_sector(unsigned long Address);
+int SPI_EEPROMWaitReady(void);
+int SPI_EEPROMStreamCRC(unsigned long Address, unsigned long len, unsigned short *crc);
+int spi_stage_status(unsigned long *next);
+int spi_stage_restart(void);
+int spi_stage_write(unsigned long offset, const unsigned char *data, unsigned cnt);
+int spi_stage_finish(unsigned long count, const unsigned char *hdr, unsigned short *crc);
 
 /**************************** spi_mpol Prototypes ******************************/
 void SPIMPolInit(void);
@@ -376,6 +424,10 @@ int copy_scratchpad(unsigned int address, unsigned char E_S);
 int tim_block_write(unsigned char *memory_ptr, unsigned int address, unsigned int count);
 int dallas_fill(unsigned int scratchpad_size, unsigned int count, unsigned int address, const unsigned char *buffer);
 int tim_block_read(unsigned char *memory_ptr, unsigned int address, unsigned int count);
+int tim_journal_write(const unsigned char *memory_ptr, unsigned int address, unsigned int count);
+int tim_journal_read(unsigned char *memory_ptr, unsigned int address, unsigned int count);
+int tim_journal_flush(void);
+void tim_journal_reset(void);
 unsigned char fetch_serial_number(unsigned char tim_type, unsigned char *tim_number);
 void TIM_log_fault(unsigned int fault_val);
 void log_date_and_time(unsigned int log_address);
@@ -401,6 +453,8 @@ int CPU_RegisterTest(void);
 void UART2Init(void);
 void clear_tx2en(void);
 void set_tx2_en(void);
+void modbus_tx_start(void);
+void modbus_tx_release(void);
 void UART2PutChar(char Ch);
 void flush_uart2(void);
 void UART1Init(void);
@@ -10,6 +10,7 @@
  *           CONSTANTS, CODES AND ADDRESSES FOR ALL HARDWARE REGISTERS
  *
  *       Revision History:
+ *  1.6.38  10/19/26  AGT  Added SPI_EEPROM_SECTOR_SIZE
  *
 ****************************************************************************/
 #ifndef SPI_EEPROM_H
@@ -20,6 +21,7 @@
  *****************************************************************************/
 #define SPI_EEPROM_PAGE_SIZE        (unsigned)256
 #define SPI_EEPROM_PAGE_MASK        (unsigned)0x00FF
+#define SPI_EEPROM_SECTOR_SIZE      0x1000L             /* Sector erase size */
 #define SPI_EEPROM_CMD_READ         (unsigned)0x03      /* Read Data */
 #define SPI_EEPROM_CMD_WRITE        (unsigned)0x02      /* Page Program (Write bytes) */
 #define SPI_EEPROM_CMD_WRDI         (unsigned)0x04      /* Write Disabled */
@@ -20,6 +20,23 @@
  *  1.6.34  08/05/16  DHP  Corrected variable type for free in SysParmNV to allow for correct
  *                          CRC checking in nvSysInit()
  *  1.6.35  02/07/17  DHP  Added SysParmNV entries for Active deadman
+ *  1.6.38  10/19/26  AGT  Added CLASS_ states for the parallel probe classifier
+ *                         Added ARRIVE_ states for the IDLE arrival watch
+ *                         Added CAP_ states/triggers for the probe waveform capture
+ *                         Added SysParmNV ModBusBaud (baud override) from free[]
+ *                         Added SPI_STAGE_ update image staging return codes
+ *                         Added TIME_SYNC_SECS
+ *                         Added DEP_ departure detector states/weights and
+ *                          SysParmNV DepartThresh from free[]
+ *                         Added TC_ tank calibration states and limits
+ *                         Added SLOT_ 5-wire pulse slot timing, O5_ codes
+ *                         Added PROBE_Q_SIZE
+ *                         Added SysParmNV UpdSector from free[]
+ *                         Added SysParmNV BootCount (journal boot epoch) from free[]
+ *                         Block CRC fields, and the word fields of the SysNV
+ *                          blocks, are UINT16 (same on the PIC) so the layout
+ *                          and "sizeof - 2" CRC span also hold in the host
+ *                          test build; UINT32 is 32 bits there too
  *********************************************************************************************/
 #ifndef STDSYM_H
 #define STDSYM_H
@@ -63,9 +80,15 @@ typedef int bool;
 typedef char byte;
 typedef unsigned int word;
 typedef unsigned short UINT16;
+#ifdef __LP64__                         /* Host test build (test/), long is 64 bits */
+typedef unsigned int UINT32;
+#else
 typedef unsigned long UINT32;
+#endif
 typedef unsigned char UINT8;
 typedef unsigned long unixtime;         /* seconds since 1 Jan 1970 */
+
+#define TIME_SYNC_SECS  600             /* time_tick() re-reads the RTC this often */
 typedef unsigned long adctime;          /* A/D time. One tick = 3 msec */
 
 typedef unsigned short volatile USV;
@@ -147,6 +170,77 @@ enum    err
 #define TMR1_OPT        55000       /* optimal TCNT value for 5 wire */
 #define TMR1_MAX        0xFFFF      /* max TCNT value */
 
+/* Parallel probe classifier window states (class_window) */
+#define CLASS_IDLE      0           /* Not yet opened this acquire */
+#define CLASS_OPEN      1           /* ADC interrupt feeding the classifiers */
+#define CLASS_DONE      2           /* Decision made (or abandoned) */
+
+/* IDLE truck arrival watch states (arrive_state) */
+#define ARRIVE_OFF      0           /* T3 scan off or serving ACQUIRE/ACTIVE */
+#define ARRIVE_ARMED    1           /* Slow T3 scan comparing against arrive_limit[] */
+#define ARRIVE_SEEN     2           /* A channel dropped; truck_idle() to confirm */
+#define ARRIVE_POLL     MSec100     /* IDLE re-poll (TIM, ground) while armed */
+
+/* Departure detector (check_truck_gone()/depart_poll()) states and the
+   confidence each piece of "truck gone" evidence adds to a round */
+#define DEP_OFF         0           /* Not asked */
+#define DEP_START       1           /* Drive channels, settle */
+#define DEP_OPEN        2           /* Channels back at open_c_volt? */
+#define DEP_GROUND      3           /* Ground and TIM presence */
+#define DEP_RAIL        4           /* check_channels() rail test */
+#define DEP_SHORT       5           /* Smart probe short test (one call) */
+#define DEP_DONE        6           /* Verdict waiting for check_truck_gone() */
+#define DEP_UNKNOWN     2           /* check_truck_gone(): no fresh verdict yet */
+#define DEP_W_OPEN      40          /* Channels at open circuit level */
+#define DEP_W_GROUND    15          /* No ground bolt */
+#define DEP_W_TIM       15          /* No TIM answering */
+#define DEP_W_RAIL      10          /* Rail level with Jump-Start */
+#define DEP_W_SHORT     20          /* No smart probe short pattern */
+#define DEPART_THRESH   100         /* Default confidence to declare GONE */
+#define DEPART_HOLD     SEC1        /* Drop a verdict not taken this long */
+
+/* 5-wire tank calibration (calc_tank()/tank_cal_poll()) states; one
+   diagnostic line reading is taken per main loop pass */
+#define TC_IDLE         0           /* Nothing running, no result */
+#define TC_SETTLE       1           /* Sensor recovery before the pulse */
+#define TC_SAMPLE       2           /* Diag line driven, averaging readings */
+#define TC_DONE         3           /* Result ready for tank_cal_result() */
+#define TC_SETTLE_TIME  (3*MSec10)  /* Minimum period before the pulse */
+#define TC_TRIALS       10          /* Most readings averaged */
+#define TC_MIN_TRIALS   4           /* Fewest before an early finish */
+#define TC_CI_MV        10          /* Finish once 2 sigma of the mean is under */
+#define TC_FAILED       18          /* Result when the ADC can't be read */
+#define TC_MAX_AGE      SEC1        /* A result older than this is measured again */
+
+/* 5-wire pulse slots (active_5wire()) when another unit pulses the truck;
+   a frame is one pulse period, slot 0 is the other unit's pulse */
+#define SLOT_FRAME      95          /* Own pulse period, ms (power spec minimum) */
+#define SLOT_FRAME_MAX  120         /* Longest foreign period locked to */
+#define SLOT_WIDTH      20          /* Pulse plus echo, ms */
+#define SLOT_COUNT      4           /* Slots per frame */
+#define SLOT_TRACK      64          /* Most frames between sightings to time */
+#define SLOT_LATE       10          /* Main loop lateness allowed, ms */
+#define O5_CLEAR        0           /* optic_5_clear(): line free */
+#define O5_FOREIGN      1           /* Another unit's pulse present */
+#define O5_NOADC        2           /* ADC could not be read */
+
+/* Probe waveform capture (raw ADC, all channels, one scan per T3 tick) */
+#define CAP_DEPTH       64          /* Scans held; must be a power of 2 */
+#define CAP_POST        16          /* Scans recorded after the trigger */
+#define CAP_OFF         0           /* Not recording */
+#define CAP_RUN         1           /* Recording, waiting for a trigger */
+#define CAP_POSTTRIG    2           /* Triggered, recording CAP_POST more */
+#define CAP_HELD        3           /* Frozen, ready for readout */
+#define CAP_TRIG_WET    0x01        /* A DRY probe went WET */
+#define CAP_TRIG_ECHO   0x02        /* 5-wire echo missed */
+#define CAP_TRIG_SHORT  0x04        /* Short detected on a channel */
+#define CAP_TRIG_MANUAL 0x80        /* ModBus request (always allowed) */
+
+/* T3 scans queued by read_probes() for probe_drain(); covers a main
+   loop pass of up to 31ms at one scan per ms, longer passes overflow
+   and probe_drain() starts over (probe_q_lost) */
+#define PROBE_Q_SIZE    32          /* Scans held; must be a power of 2 */
+
 
 #define  SHELL_START    0x00000
 
@@ -235,17 +329,17 @@ enum    err
 
 typedef struct
 {
-  unsigned int    ModBusRespWait;      /* 0x020100 Milliseconds turnaround delay for ModBus */
-  unsigned int    TASWait;             /* 0x020102 Seconds to wait for TAS/VIP control */
-  unsigned int    BypassTimeOut;       /* 0x020104 Seconds active before Bypass Timeout */
-  unsigned int    Terminal;            /* 0x020106 Terminal ID number (999 = wildcard) */
+  UINT16          ModBusRespWait;      /* 0x020100 Milliseconds turnaround delay for ModBus */
+  UINT16          TASWait;             /* 0x020102 Seconds to wait for TAS/VIP control */
+  UINT16          BypassTimeOut;       /* 0x020104 Seconds active before Bypass Timeout */
+  UINT16          Terminal;            /* 0x020106 Terminal ID number (999 = wildcard) */
   unsigned char   ConfigB;             /* 0x020108 Future "ConfigB" bits */
   unsigned char   EnaFeatures;         /* 0x020109 Enabled software Features */
   unsigned char   EnaPassword;         /* 0x02010A Enabled-Features "password" */
   unsigned char   VIPMode;             /* 0x02010B Remember the VIP Mode JGS Rev 1.8 */
-  unsigned int    ADCTmaxNV;           /* 0x02010C Thermal 3.8 volt max swing */
-  unsigned int    ADCTHstNV;           /* 0x02010E Hysteresis value */
-  unsigned int    ADCOmaxNV;           /* 0x020110 Optical 4.5 volt min(of max) swing */
+  UINT16          ADCTmaxNV;           /* 0x02010C Thermal 3.8 volt max swing */
+  UINT16          ADCTHstNV;           /* 0x02010E Hysteresis value */
+  UINT16          ADCOmaxNV;           /* 0x020110 Optical 4.5 volt min(of max) swing */
   unsigned char   Ena_INTL_ShortNV;    /* 0x020112 Enable Shorts Test Flag */
   unsigned char   Ena_Debug_Func_1;    /* 0x020113 */
   unsigned char   Ena_Debug_Func_2;    /* 0x020114 */
@@ -260,20 +354,24 @@ typedef struct
   unsigned char   Ena_TIM_Read;        /* 0x02011D WPW: Enable TIM read internally */
   unsigned char   Ena_GND_Display;     /* 0x02011E Display GND OK during truck_acquire */
   unsigned char   Modbus_Ena_Features; /* 0x02011F Remember features enable/disable by modbus commands */
-  unsigned int    Ground_Reference;    /* 0x020220 Level for resistive ground checking, with jumpstart (ECR 2857) */
-  unsigned int    EU_GND_REF;          /* 0x020222 Level for resistive ground checking without jumpstart*/
-  unsigned int    Five_Wire_Display;   /* 0x020224 Display time for 5-wire compartment count */
-  unsigned int    DM_Active;           /* 0x020226 Active Deadman Enabled */
-  unsigned int    DM_Max_Open;         /* 0x020228 Active Deadman Max open time */
-  unsigned int    DM_Max_Close;        /* 0x02022A Active Deadman Max close time */ 
-  unsigned int    DM_Warn_Start;       /* 0x02022C Active Deadman Warning time */
+  UINT16          Ground_Reference;    /* 0x020220 Level for resistive ground checking, with jumpstart (ECR 2857) */
+  UINT16          EU_GND_REF;          /* 0x020222 Level for resistive ground checking without jumpstart*/
+  UINT16          Five_Wire_Display;   /* 0x020224 Display time for 5-wire compartment count */
+  UINT16          DM_Active;           /* 0x020226 Active Deadman Enabled */
+  UINT16          DM_Max_Open;         /* 0x020228 Active Deadman Max open time */
+  UINT16          DM_Max_Close;        /* 0x02022A Active Deadman Max close time */ 
+  UINT16          DM_Warn_Start;       /* 0x02022C Active Deadman Warning time */
   unsigned char   Cert_Expiration_Mask; /* 0x02022E supertim cert expiration mask */
-  unsigned int    Unload_Max_Time_min;  /* 0x02022F Allowable time for unload since load */
+  UINT16          Unload_Max_Time_min;  /* 0x02022F Allowable time for unload since load */
   unsigned char   EnaSftFeatures2;
   unsigned char   fuel_type_check_mask;
   unsigned char   default_fuel_type[3];
-  unsigned char   free[10];             /* Fogbugz 131 0x020231 Round up to 64 bytes total  (23E - current) */
-  unsigned int    CRC;                  /* 0x02023E G.P. Parameter block CRC */
+  unsigned char   ModBusBaud;           /* BAUD_RATE override of the jumper; 0 = use jumper */
+  unsigned char   DepartThresh;         /* Departure confidence to declare GONE; 0 = DEPART_THRESH */
+  unsigned char   UpdSector;            /* Update image sectors fully staged (spi_stage_) */
+  unsigned char   BootCount;            /* Power ups with no clock; journal epoch */
+  unsigned char   free[6];              /* Fogbugz 131 0x020231 Round up to 64 bytes total  (23E - current) */
+  UINT16          CRC;                  /* 0x02023E G.P. Parameter block CRC */
 } SysParmNV;
 
 #define DM_OPEN     (1*4)       /* Active Deadman Max open time */
@@ -295,7 +393,7 @@ typedef struct
     char            name[DS_NAMMAX];/* DateStamp "company name" */
     char            psw[DS_PSWMAX]; /* DateStamp "password" */
     char            free[22 - DS_NAMMAX - DS_PSWMAX]; /* 24 bytes total */
-    unsigned        CRC;            /* DateStamp block CRC */
+    UINT16          CRC;            /* DateStamp block CRC */
 } DateStampNV;
 
 
@@ -306,12 +404,12 @@ typedef struct
 
 typedef struct
 {
-    unsigned        Reference;          /* "6.759" volt reference level */
-    unsigned        PNOffset;           /* Transistor PN-junction bias/offset */
-    unsigned        WetVolts[16];       /* 16-probe "wet" level */
-    unsigned int    updatedADCTable;    /* Switch to use updated ADC table for probe counting in calc_tank, 1 = new table, 0 = old table */
+    UINT16          Reference;          /* "6.759" volt reference level */
+    UINT16          PNOffset;           /* Transistor PN-junction bias/offset */
+    UINT16          WetVolts[16];       /* 16-probe "wet" level */
+    UINT16          updatedADCTable;    /* Switch to use updated ADC table for probe counting in calc_tank, 1 = new table, 0 = old table */
                                         /* DateStamp + SysDia5 = 64 bytes total! */
-    unsigned        CRC;                /* SysDia5 block CRC */
+    UINT16          CRC;                /* SysDia5 block CRC */
 } SysDia5NV;
 
 
@@ -321,32 +419,32 @@ typedef struct
 
 typedef struct
 {
-    unsigned        Raw13Lo;        /* Minimum "Raw 13 Volt" level */
-    unsigned        Raw13Hi;        /* Maximum "Raw 13 Volt" level */
-    unsigned        RefVoltLo;      /* Minimum "1 Volt Reference" level */
-    unsigned        RefVoltHi;      /* Maximum "1 Volt Reference" level */
-    unsigned        Chan10Lo;       /* Minimum "10 Volt" channel drive level */
-    unsigned        Chan10Hi;       /* Maximum "10 Volt" channel drive level */
-    unsigned        ChanNoiseP;     /* Maximum "Channel Noise Plus" (positive) */
-    unsigned        ChanNoiseM;     /* Maximum "Channel Noise Minus" (negative) */
-    unsigned        Jump20Lo;       /* Minimum "20 Volt Jump Start" level */
-    unsigned        Jump20Hi;       /* Maximum "20 Volt Jump Start" level */
-    unsigned        Euro20Lo;       /* Minimum "Euro-Jumper" clamping level */
-    unsigned        Euro20Hi;       /* Maximum "Euro-Jumper" clamping level */
-    unsigned        Bias35Lo;       /* Minimum "3.5 Volt Bias" level */
-    unsigned        Bias35Hi;       /* Maximum "3.5 Volt Bias" level */
-    unsigned        Bias38Lo;       /* Minimum "3.8 Volt Bias" level */
-    unsigned        Bias38Hi;       /* Maximum "3.8 Volt Bias" level */
-    unsigned        BiasNoiseP;     /* Maximum "Bias Noise Plus" (positive) */
-    unsigned        BiasNoiseM;     /* Maximum "Bias Noise Minus" (negative) */
-    unsigned        OpticOutLo;     /* Minimum "5-Wire Optic" drive level */
-    unsigned        OpticOutHi;     /* Maximum "5-Wire Optic" drive level */
-    unsigned        OpticInLo;      /* Minimum "5-Wire Optic" response level */
-    unsigned        OpticInHi;      /* Maximum "5-Wire Optic" response level */
-    unsigned        ProbeSensJSV;   /* Probe detection threshold (millivolts) */
-    unsigned        ProbeSensEuroV; /* Ditto, "European" voltages jumper */
-    unsigned        free[14];       /* Round up to 64 bytes total */
-    unsigned        CRC;            /* CRC-16 validity check */
+    UINT16          Raw13Lo;        /* Minimum "Raw 13 Volt" level */
+    UINT16          Raw13Hi;        /* Maximum "Raw 13 Volt" level */
+    UINT16          RefVoltLo;      /* Minimum "1 Volt Reference" level */
+    UINT16          RefVoltHi;      /* Maximum "1 Volt Reference" level */
+    UINT16          Chan10Lo;       /* Minimum "10 Volt" channel drive level */
+    UINT16          Chan10Hi;       /* Maximum "10 Volt" channel drive level */
+    UINT16          ChanNoiseP;     /* Maximum "Channel Noise Plus" (positive) */
+    UINT16          ChanNoiseM;     /* Maximum "Channel Noise Minus" (negative) */
+    UINT16          Jump20Lo;       /* Minimum "20 Volt Jump Start" level */
+    UINT16          Jump20Hi;       /* Maximum "20 Volt Jump Start" level */
+    UINT16          Euro20Lo;       /* Minimum "Euro-Jumper" clamping level */
+    UINT16          Euro20Hi;       /* Maximum "Euro-Jumper" clamping level */
+    UINT16          Bias35Lo;       /* Minimum "3.5 Volt Bias" level */
+    UINT16          Bias35Hi;       /* Maximum "3.5 Volt Bias" level */
+    UINT16          Bias38Lo;       /* Minimum "3.8 Volt Bias" level */
+    UINT16          Bias38Hi;       /* Maximum "3.8 Volt Bias" level */
+    UINT16          BiasNoiseP;     /* Maximum "Bias Noise Plus" (positive) */
+    UINT16          BiasNoiseM;     /* Maximum "Bias Noise Minus" (negative) */
+    UINT16          OpticOutLo;     /* Minimum "5-Wire Optic" drive level */
+    UINT16          OpticOutHi;     /* Maximum "5-Wire Optic" drive level */
+    UINT16          OpticInLo;      /* Minimum "5-Wire Optic" response level */
+    UINT16          OpticInHi;      /* Maximum "5-Wire Optic" response level */
+    UINT16          ProbeSensJSV;   /* Probe detection threshold (millivolts) */
+    UINT16          ProbeSensEuroV; /* Ditto, "European" voltages jumper */
+    UINT16          free[14];       /* Round up to 64 bytes total */
+    UINT16          CRC;            /* CRC-16 validity check */
 } SysVoltNV;
 
 /* System "Settings" block ("Static", manufacturing, not customer/end-user
@@ -356,8 +454,8 @@ typedef struct
 
 typedef struct
 {
-    unsigned        free[62];       /* Round up to 64 byes total */
-    unsigned        CRC;            /* CRC-16 validity check */
+    UINT16          free[62];       /* Round up to 64 byes total */
+    UINT16          CRC;            /* CRC-16 validity check */
 } SysSet1NV;
 
 #define GND_REF_DEFAULT 0x3A0   // Fogbugz 134 Near 2.2k ohms 
@@ -387,6 +485,14 @@ typedef union EEPROMStatus
   char    Char;
 } _SPI_EEPROMStatus_;
 
+/* spi_stage_*() update image staging return codes */
+
+#define SPI_STAGE_OK        0
+#define SPI_STAGE_IOERR     1           /* SPI read/program/erase failed */
+#define SPI_STAGE_OFFSET    2           /* Not the expected image offset */
+#define SPI_STAGE_RANGE     3           /* Runs into the loader header */
+#define SPI_STAGE_NODEV     4           /* No (or wrong) update module */
+
 typedef union tuReg32
 {
   unsigned long Val32;
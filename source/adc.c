@@ -36,10 +36,86 @@
  *                           turn off of ADC to ops_ADC(OFF) to ensure related
  *                           background activities were also off and added 
  *                           conditional restore of ops ADC.
+ *  1.6.38  10/19/26  AGT  In convert_to_binary() feed the parallel probe
+ *                          classifier (class_sample()) while its window is open.
+ *                         Added arrive_watch() and arrive_check(): in IDLE the
+ *                          T3 scan runs at 1:8 (8ms) and flags a channel drop
+ *                          below its open_c_volt reference from the interrupt.
+ *                          ops_ADC() always restores the 1ms rate and
+ *                          read_ADC() ends the watch for a polled reading.
+ *                         Added the probe waveform capture: read_probes()
+ *                          stores each raw scan in a pre/post-trigger ring
+ *                          that capture_read() delta-encodes for ModBus.
+ *                         convert_to_binary() now works from per-channel
+ *                          threshold tables (thresh_build()) rebuilt only when
+ *                          probe_try_state, probe_type[] or the SysParm
+ *                          thresholds change, and forms the level/transition
+ *                          masks for all channels with bitwise ops; only
+ *                          rising dry channels go through the high_3[]/high_8[]
+ *                          classification.
+ *                         read_probes() (T3 interrupt) no longer converts to
+ *                          binary: it queues each millivolt scan and
+ *                          probe_drain() runs convert_to_binary() on them
+ *                          from the main loop.  probe_q_lost counts scans
+ *                          dropped on a full queue; probe_q_peak the most
+ *                          waiting (1ms each).
+ *                         A full queue, ops_ADC() and a change of the
+ *                          channel drive (probe_q_resync()) now discard the
+ *                          queued scans, and the next scan becomes
+ *                          old_probe_volt[] without making transitions.
+ *                          ops_ADC(ON) with the 1ms scan already running
+ *                          does not: two_wire_start() makes that call every
+ *                          pass, and the serial OPTIC2/THERMIS checks then
+ *                          never saw a transition.
+ *                         wait_for_probes() waits in DelayUS(1) steps, 2ms
+ *                          at most, as read_ADC() does; the bare spin's
+ *                          length was whatever the compiler made of it.
 *********************************************************************************************/
 #include "common.h"
 #include "volts.h"
 static void ADC_timedrive(void);
+static void class_sample(unsigned int index, unsigned int imsk, unsigned int volt);
+static void arrive_check(void);
+static void capture_sample(void);
+static void thresh_build(void);
+static void thresh_channel(unsigned int index);
+
+/* Per-channel convert_to_binary() thresholds and the values they were
+   built from; see thresh_build(). */
+static unsigned int  thr_hi[MAX_CHAN];    /* test_volt */
+static unsigned int  thr_lo[MAX_CHAN];    /* test_volt less hysteresis */
+static PROBE_TRY_STATE thr_try;           /* probe_try_state used */
+static unsigned int  thr_tmax;            /* SysParm.ADCTmaxNV used */
+static unsigned int  thr_omax;            /* SysParm.ADCOmaxNV used */
+static unsigned int  thr_hyst;            /* SysParm.ADCTHstNV used */
+
+/* Probe waveform capture ring; written by the T3 interrupt only while
+   cap_state is CAP_RUN or CAP_POSTTRIG, read only once CAP_HELD. */
+static unsigned int  cap_ring[CAP_DEPTH][MAX_CHAN];
+static unsigned char cap_head = 0;        /* Next scan slot */
+static unsigned char cap_fill = 0;        /* Valid scans in the ring */
+static unsigned char cap_post = 0;        /* Scans left after trigger */
+static unsigned char cap_state = CAP_RUN;  /* Recording from power-up */
+static unsigned char cap_mask = CAP_TRIG_WET | CAP_TRIG_ECHO | CAP_TRIG_SHORT;
+static unsigned char cap_cause = 0;       /* Cause that froze the ring */
+static unsigned short cap_stamp = 0;      /* mstimer at the trigger */
+
+/* Scans waiting for convert_to_binary(); read_probes() (T3 interrupt)
+   only moves probe_q_head and probe_drain() (main loop) only moves
+   probe_q_tail, so neither needs the other held off.  probe_q_cut asks
+   probe_drain() to drop the scans before that slot and start over from
+   the next one (PROBE_Q_NONE when not). */
+#define PROBE_Q_NONE    0xFF
+typedef struct
+{
+  unsigned int   volt[MAX_CHAN];          /* millivolts */
+} PROBE_SCAN;
+
+static PROBE_SCAN probe_q[PROBE_Q_SIZE];
+static volatile unsigned char probe_q_head = 0;   /* Next slot to fill */
+static volatile unsigned char probe_q_tail = 0;   /* Next scan to convert */
+static volatile unsigned char probe_q_cut = PROBE_Q_NONE; /* Start over here */
+static unsigned char probe_q_sync = FALSE;        /* Next scan is the baseline */
 
 /*************************************************************************
  *  subroutine:      read_probes()
@@ -49,8 +125,12 @@ static void ADC_timedrive(void);
  *
  *         1.  Read the probe voltages and convert to millivolts
  *         2.  This uses the T3 interrupt @1ms rate
- *         3.  The resultant value is converted to binary
- *             based on threshold values and hysteresis
+ *         3.  The scan is queued for probe_drain() to convert to binary
+ *             based on threshold values and hysteresis; that work (and
+ *             the high_3[]/high_8[] bookkeeping) is kept out of the
+ *             interrupt.  A full queue drops the scan (probe_q_lost)
+ *             and has probe_drain() start over after it, since the scans
+ *             either side of the gap are not 1ms apart.
  *  input:  none
  *  output: none
  *
@@ -61,6 +141,8 @@ void read_probes(void)
 {
 int             probe;
 unsigned long temp_word;
+unsigned char next;
+PROBE_SCAN    *scan;
 
 //  // last_routine = 0x110;
   if (dma_result_flag)             /* if ADC data ready */
@@ -72,12 +154,279 @@ unsigned long temp_word;
      temp_word /= (unsigned long)100;
      probe_volt[probe] = (unsigned int) (temp_word);
     }
-    convert_to_binary();          /* Only convert if successful reading */
+    if ((cap_state == CAP_RUN) || (cap_state == CAP_POSTTRIG))
+    {
+      capture_sample();           /* Raw scan into the capture ring */
+    }
+    if (arrive_state == ARRIVE_OFF) /* Queue for convert to binary */
+    {
+      next = (unsigned char)((probe_q_head + 1) & (PROBE_Q_SIZE - 1));
+      if (next == probe_q_tail)
+      {
+        probe_q_lost++;           /* probe_drain() is behind */
+        probe_q_cut = probe_q_head;
+      }
+      else
+      {
+        scan = &probe_q[probe_q_head];
+        for (probe = 0; probe < MAX_CHAN; probe++)
+        {
+          scan->volt[probe] = probe_volt[probe];
+        }
+        probe_q_head = next;      /* Scan complete, publish it */
+      }
+    }
+    else
+    {
+      arrive_check();             /* IDLE: just watch for a truck */
+    }
     probe_result_flag = 1;
     ADC_timedrive();     /* Start the next 8 channel A/D scan */
   }
 } /* end of read_probes */
 
+/*************************************************************************
+ *  subroutine:      probe_drain()
+ *
+ *  function:
+ *         Called from the main loop; converts every scan read_probes()
+ *         has queued, oldest first.  While a main loop pass takes less
+ *         than the PROBE_Q_SIZE scans the queue holds, probe_array[] and
+ *         probe_pulse see the same 1ms sequence as before, just later in
+ *         the pass.  After a longer pass (or a drive change, or ops_ADC())
+ *         the queued scans are dropped and the first scan after the gap
+ *         only sets old_probe_volt[]: nothing is compared across it.
+ *  input:  none
+ *  output: none
+ *
+ *************************************************************************/
+void probe_drain(void)
+{
+unsigned char tail;
+unsigned char held;
+unsigned char cut;
+unsigned int  save_ipl;
+unsigned int  index;
+
+  save_ipl = SRbits.IPL;
+  SRbits.IPL = 7;
+  cut = probe_q_cut;
+  probe_q_cut = PROBE_Q_NONE;
+  SRbits.IPL = save_ipl;
+  if (cut != PROBE_Q_NONE)
+  {
+    probe_q_tail = cut;             /* Drop everything before the gap */
+    probe_q_sync = TRUE;
+  }
+  tail = probe_q_tail;
+  held = (unsigned char)((probe_q_head - tail) & (PROBE_Q_SIZE - 1));
+  if (held > probe_q_peak)
+  {
+    probe_q_peak = held;
+  }
+  while (tail != probe_q_head)
+  {
+    if (probe_q_sync)
+    {
+      for (index = 0; index < MAX_CHAN; index++)
+      {
+        old_probe_volt[index] = probe_q[tail].volt[index];
+      }
+      probe_q_sync = FALSE;
+    }
+    convert_to_binary(probe_q[tail].volt);
+    tail = (unsigned char)((tail + 1) & (PROBE_Q_SIZE - 1));
+    probe_q_tail = tail;            /* Slot free for the interrupt */
+  }
+} /* end of probe_drain */
+
+/*************************************************************************
+ *  subroutine:      probe_q_resync()
+ *
+ *  function:
+ *         The scans queued so far no longer compare with the ones to
+ *         come (T3 stopped or restarted, or the channel drive changed);
+ *         have probe_drain() drop them and start over.
+ *  input:  none
+ *  output: none
+ *
+ *************************************************************************/
+void probe_q_resync(void)
+{
+  probe_q_cut = probe_q_head;
+} /* end of probe_q_resync */
+
+/*************************************************************************
+ *  subroutine:      capture_sample()
+ *
+ *  function:
+ *         Called from read_probes() (T3 interrupt) while the capture is
+ *         recording.  Copies the raw 12-bit scan of all channels into the
+ *         ring; a fixed 8 stores per tick.  Once triggered, counts down
+ *         CAP_POST scans and then freezes the ring for readout.
+ *  input:  none
+ *  output: none
+ *************************************************************************/
+
+static void capture_sample(void)
+{
+unsigned int *slot;
+unsigned int probe;
+
+  slot = cap_ring[cap_head];
+  for (probe = 0; probe < MAX_CHAN; probe++)
+  {
+    slot[probe] = result_ptr[probe] & 0x0FFF;
+  }
+  cap_head = (unsigned char)((cap_head + 1) & (CAP_DEPTH - 1));
+  if (cap_fill < CAP_DEPTH)
+  {
+    cap_fill++;
+  }
+  if (cap_state == CAP_POSTTRIG)
+  {
+    if (--cap_post == 0)
+    {
+      cap_state = CAP_HELD;
+    }
+  }
+} /* end of capture_sample */
+
+/*************************************************************************
+ *  subroutine:      capture_arm()
+ *
+ *  function:
+ *         (Re)start recording with the given CAP_TRIG_ mask; a zero mask
+ *         turns the capture off.  Any held capture is discarded.
+ *  input:  trigger mask
+ *  output: none
+ *************************************************************************/
+
+void capture_arm(unsigned char mask)
+{
+unsigned int save_ipl;
+
+  save_ipl = SRbits.IPL;
+  SRbits.IPL = 7;
+  cap_head = 0;
+  cap_fill = 0;
+  cap_post = 0;
+  cap_cause = 0;
+  cap_mask = mask;
+  cap_state = (mask != 0) ? CAP_RUN : CAP_OFF;
+  SRbits.IPL = save_ipl;
+} /* end of capture_arm */
+
+/*************************************************************************
+ *  subroutine:      capture_trigger()
+ *
+ *  function:
+ *         Mark the trigger point if recording and the cause is enabled;
+ *         the ring keeps CAP_DEPTH - CAP_POST scans from before it.
+ *         Cheap enough to leave in the probe state code.
+ *  input:  CAP_TRIG_ cause
+ *  output: none
+ *************************************************************************/
+
+void capture_trigger(unsigned char cause)
+{
+unsigned int save_ipl;
+
+  if ((cap_state != CAP_RUN) ||
+      (((cap_mask | CAP_TRIG_MANUAL) & cause) == 0))
+  {
+    return;
+  }
+  save_ipl = SRbits.IPL;
+  SRbits.IPL = 7;
+  if (cap_state == CAP_RUN)
+  {
+    cap_cause = cause;
+    cap_stamp = mstimer;
+    cap_post = CAP_POST;
+    cap_state = CAP_POSTTRIG;
+  }
+  SRbits.IPL = save_ipl;
+} /* end of capture_trigger */
+
+/*************************************************************************
+ *  subroutine:      capture_status()
+ *
+ *  function:
+ *         Fill in the capture status block: state, trigger mask, cause,
+ *         scans held, post-trigger scans and the 16-bit trigger stamp.
+ *  input:  buffer (7 bytes)
+ *  output: bytes used
+ *************************************************************************/
+
+unsigned char capture_status(unsigned char *buf)
+{
+  buf[0] = cap_state;
+  buf[1] = cap_mask;
+  buf[2] = cap_cause;
+  buf[3] = cap_fill;
+  buf[4] = CAP_POST;
+  buf[5] = (unsigned char)(cap_stamp >> 8);
+  buf[6] = (unsigned char)cap_stamp;
+  return 7;
+} /* end of capture_status */
+
+/*************************************************************************
+ *  subroutine:      capture_read()
+ *
+ *  function:
+ *         Delta-encode one channel of a held capture, oldest scan first,
+ *         beginning at scan "start".  A byte with the top bit clear is the
+ *         high byte of an absolute 12-bit sample (low byte follows); a
+ *         byte with the top bit set is a 7-bit signed change from the
+ *         previous sample.  The first sample is always absolute.
+ *  input:  channel, first scan, buffer and its size
+ *  output: bytes used (0 if nothing held); *count gets the scans encoded
+ *************************************************************************/
+
+unsigned char capture_read(unsigned char chan, unsigned char start,
+                           unsigned char *buf, unsigned char max, unsigned char *count)
+{
+unsigned char len = 0;
+unsigned char oldest;
+unsigned char scan;
+unsigned int  volt;
+unsigned int  last = 0;
+int           delta;
+
+  *count = 0;
+  if ((cap_state != CAP_HELD) || (chan >= MAX_CHAN))
+  {
+    return 0;
+  }
+  oldest = (unsigned char)((cap_head - cap_fill) & (CAP_DEPTH - 1));
+  for (scan = start; scan < cap_fill; scan++)
+  {
+    volt = cap_ring[(oldest + scan) & (CAP_DEPTH - 1)][chan];
+    delta = (int)volt - (int)last;
+    if ((scan != start) && (delta >= -64) && (delta <= 63))
+    {
+      if (len >= max)
+      {
+        break;
+      }
+      buf[len++] = (unsigned char)(0x80 | (delta & 0x7F));
+    }
+    else
+    {
+      if ((len + 2) > max)
+      {
+        break;
+      }
+      buf[len++] = (unsigned char)(volt >> 8);
+      buf[len++] = (unsigned char)volt;
+    }
+    last = volt;
+    (*count)++;
+  }
+  return len;
+} /* end of capture_read */
+
 /*******************************6/26/2008 1:40PM******************************
  * 1.  This routine sets up and reads the 8 channels of the ADC
  *     in a timed cyclic scan sequence of all 8 channels.
@@ -110,10 +459,11 @@ void setup_probes()
  *************************************************************************/
 int wait_for_probes()
 {
-unsigned int timeout = 0x5000;
+unsigned int timeout = 2000;
   // last_routine = 0x65;
   while ((probe_result_flag == 0) && (--timeout > 0))
   {
+    DelayUS(1);
   }
   if ( timeout == 0)
   {
@@ -126,6 +476,52 @@ unsigned int timeout = 0x5000;
   return PASSED;
 }
 
+/*************************************************************************
+ *  subroutine:      thresh_build() / thresh_channel()
+ *
+ *  function:
+ *         Build the convert_to_binary() threshold tables.  A channel uses
+ *         the thermistor threshold (ADCTmaxNV) while trying THERMIS and its
+ *         probe_type[] is still untyped or thermistor, otherwise the optic
+ *         one (ADCOmaxNV); thr_lo[] is that less the ADCTHstNV hysteresis.
+ *         thresh_build() redoes every channel and notes the inputs used;
+ *         thresh_channel() redoes one after its probe_type[] changed.
+ *  input:  channel index (thresh_channel())
+ *  output: none
+ *
+ *************************************************************************/
+static void thresh_channel(unsigned int index)
+{
+unsigned int test_volt;
+
+  if((thr_try == THERMIS) && ((probe_type[index] ==P_NO_TYPE) ||
+                                     (probe_type[index] ==P_THERMIS)))
+  {
+    test_volt = thr_tmax;               /* It's Thermistor type */
+  }
+  else
+  {
+    test_volt = thr_omax;               /* Or it's 2 wire optic value */
+  }
+  thr_hi[index] = test_volt;
+  thr_lo[index] = (unsigned int)(test_volt - thr_hyst);
+}
+
+static void thresh_build(void)
+{
+unsigned int index;
+
+  thresh_stale = FALSE;
+  thr_try  = probe_try_state;
+  thr_tmax = SysParm.ADCTmaxNV;
+  thr_omax = SysParm.ADCOmaxNV;
+  thr_hyst = SysParm.ADCTHstNV;
+  for (index = 0; index < MAX_CHAN; index++)
+  {
+    thresh_channel(index);
+  }
+} /* end of thresh_build */
+
 /*************************************************************************
  *  subroutine:      convert_to_binary()
  *
@@ -142,94 +538,150 @@ unsigned int timeout = 0x5000;
  *           optic.  Rev E PIC CPU hardware incorporates the supporting hardware
  *           for this; I/O has no effect with older revisions.
  *           Added high_3[] and high_8[]arrays to handle wet-dry-wet transitions. 
- *  input:  none
+ *  The per-channel test_volt comes from thr_hi[]/thr_lo[], rebuilt when
+ *  probe_try_state or the SysParm thresholds differ from those used, or
+ *  thresh_stale says probe_type[] was changed outside this routine.  Each
+ *  comparison yields an all-ones or zero word, so the level (probe_pulse)
+ *  and transition (probe_array[]) masks are built without branching; the
+ *  high_3[]/high_8[] classification only runs for rising dry channels.
+ *  Runs from probe_drain() (main loop) on each queued T3 scan.
+ *  input:  the scan, millivolts per channel
  *  output: none
  *
  *************************************************************************/
-void convert_to_binary( void )
+void convert_to_binary( const unsigned int *scan )
 {
-unsigned int probe_level;
+unsigned int above = 0;         /* Above test_volt */
+unsigned int rise = 0;          /* Was at/below the low threshold */
+unsigned int fall = 0;          /* Below the low threshold, was at/above test_volt */
+unsigned int chans;             /* Channels converted */
 unsigned int probe_therm = 0;
 unsigned int index;
-unsigned int test_volt;
-unsigned int imsk = 0x00;
+unsigned int volt, old;
+unsigned int imsk;
 
-  probe_level = 0x00;
+  if (thresh_stale || (probe_try_state != thr_try)
+      || (SysParm.ADCTmaxNV != thr_tmax) || (SysParm.ADCOmaxNV != thr_omax)
+      || (SysParm.ADCTHstNV != thr_hyst))
+  {
+    thresh_build();
+  }
   for ( index=start_point; index<MAX_CHAN; index++ )
   {
-    if((probe_try_state == THERMIS) && ((probe_type[index] ==P_NO_TYPE) ||
-                                               (probe_type[index] ==P_THERMIS)))
-    {
-       test_volt = SysParm.ADCTmaxNV;   /* It's Thermistor type, use thermistor threshold */
-    }
-    else
-    {
-      test_volt = SysParm.ADCOmaxNV;   /* Or it's 2 wire optic value */
-    }
+    volt = scan[index];
+    old = old_probe_volt[index];
     imsk = ((unsigned int)1 << index);   /* Walk 1 across a byte */
-    if (probe_volt[index] > test_volt)   /* Test for high */
+    above |= imsk & (unsigned int)-(volt > thr_hi[index]);
+    rise  |= imsk & (unsigned int)-(old <= thr_lo[index]);
+    fall  |= imsk & (unsigned int)-((volt < thr_lo[index]) & (old >= thr_hi[index]));
+    old_probe_volt[index] = volt;       /* Store for next binary check */
+    if (class_window == CLASS_OPEN)      /* Acquire classifiers listening? */
     {
-      probe_pulse |= imsk;
+      class_sample(index, imsk, volt);
     }
-    else                                 /* Low */
+  }  /* End of for ( index=point; index<MAX_CHAN; index++ ) */
+  chans = (((unsigned int)1 << MAX_CHAN) - 1) & ~(((unsigned int)1 << start_point) - 1);
+  probe_pulse = (probe_pulse & ~chans) | above;  /* 1 means high */
+  rise &= above;                        /* Going UP and change > Hysteresis */
+  fall &= ~above;                       /* Going DOWN and change > Hysteresis */
+
+  /* Classify the probes that just went up while dry */
+  for ( index=start_point; rise >> index; index++ )
+  {
+    imsk = ((unsigned int)1 << index);
+    if (!(rise & imsk) || (probes_state[index] != P_DRY))
     {
-      probe_pulse &= ~imsk;
+      continue;
     }
-    if ((probe_volt[index] > test_volt)    /* Above the High */
-        && (old_probe_volt[index] <= (unsigned int)(test_volt - SysParm.ADCTHstNV)))
-                                          /* Going UP and change > Hysteresis */
+    if (scan[index] > ADC6V)
     {
-      probe_level |= imsk;              /* 1 means Transition */
-    /* This probe active and OK? */
-      if (probes_state[index] == P_DRY) 
+      if (high_8[index]++ >= 3)  //This means 3 transitions from low to high
       {
-        if (probe_volt[index] > ADC6V)
+        probe_therm |= imsk;     /* Mark mask as optic  */
+        probe_type[index]=P_OPTIC2;
+        thresh_channel(index);
+        high_3[index] = 0;
+        high_8[index] = 3;  /* avoid roll over */
+        if(dry_once == FALSE)
         {
-         if (high_8[index]++ >= 3)  //This means 3 transitions from low to high
-          {
-            probe_therm |= imsk;     /* Mark mask as optic  */
-            probe_type[index]=P_OPTIC2;
-            high_3[index] = 0;
-            high_8[index] = 3;  /* avoid roll over */
-            if(dry_once == FALSE)
-            {
-              HighI_Off(index);
-            }  
-          }
-        }
-         else
-         {
-          if ( (probe_type[index] == P_NO_TYPE) || (probe_type[index] == P_THERMIS))
-          {
-            if(high_3[index]++ >= 4)  //This means 4 transitions from low to high
-            {
-              probe_type[index]=P_THERMIS;  //DHP ??? 
-              high_3[index] = 4;  /* avoid roll over */
-            } 
-          }
-         }
+          HighI_Off(index);
+        }  
       }
-       // High voltage and Not dry
     }
     else
-    { // no transition to high
-      if ((probe_volt[index] < (unsigned int)(test_volt - SysParm.ADCTHstNV))
-           && (old_probe_volt[index] >= test_volt))
-                                        /* Going DOWN and change > Hysteresis */
+    {
+      if ( (probe_type[index] == P_NO_TYPE) || (probe_type[index] == P_THERMIS))
       {
-        probe_level |= imsk;               /* 1 means Transition */
+        if(high_3[index]++ >= 4)  //This means 4 transitions from low to high
+        {
+          probe_type[index]=P_THERMIS;  //DHP ??? 
+          thresh_channel(index);
+          high_3[index] = 4;  /* avoid roll over */
+        } 
       }
     }
-    old_probe_volt[index] = probe_volt[index]; /* Store for next binary check */
-  }  /* End of for ( index=point; index<MAX_CHAN; index++ ) */
+  }
   act_therm_mask |= probe_therm;      /* Accumulate thermal probes */
-  probe_array[probe_index++] = probe_level;    /* Set to accumulative mask */
+  probe_array[probe_index++] = rise | fall;    /* Set to accumulative mask */
   if (probe_index>=MAX_ARRAY)   /* Index the binary array */
   {
     probe_index = 0;           /* and wrap around */
   }
 } /*  end of convert_to_binary */
 
+/*************************************************************************
+ *  subroutine:      class_sample()
+ *
+ *  function:
+ *         Called from convert_to_binary() (probe_drain()) for each channel
+ *         while the acquire classification window is open.  The same 1ms
+ *         scan feeds all of the 2-wire classifiers at once:
+ *         1. Rising edges through the optic threshold (ADCOmaxNV)
+ *         2. Rising edges through the thermistor threshold (ADCTmaxNV)
+ *         3. A filtered voltage for the thermistor warm-up ramp
+ *         Each threshold is latched with the ADCTHstNV hysteresis so a
+ *         slow thermistor swing is counted as well as a sharp optic one.
+ *  input:  channel index, its bit mask and its scan voltage
+ *  output: none
+ *
+ *************************************************************************/
+static void class_sample(unsigned int index, unsigned int imsk, unsigned int volt)
+{
+  if (volt > SysParm.ADCOmaxNV)
+  {
+    if (!(class_opt_hi & imsk))
+    {
+      class_opt_hi |= imsk;
+      if (class_opt_edge[index] < 0xFF)
+      {
+        class_opt_edge[index]++;
+      }
+    }
+  }
+  else if (volt < (unsigned int)(SysParm.ADCOmaxNV - SysParm.ADCTHstNV))
+  {
+    class_opt_hi &= ~imsk;
+  }
+  if (volt > SysParm.ADCTmaxNV)
+  {
+    if (!(class_thm_hi & imsk))
+    {
+      class_thm_hi |= imsk;
+      if (class_thm_edge[index] < 0xFF)
+      {
+        class_thm_edge[index]++;
+      }
+    }
+  }
+  else if (volt < (unsigned int)(SysParm.ADCTmaxNV - SysParm.ADCTHstNV))
+  {
+    class_thm_hi &= ~imsk;
+  }
+  /* 1/16 per sample low pass; oscillation averages out, warm-up does not */
+  class_avg_volt[index] = (unsigned int)((signed int)class_avg_volt[index] +
+                    (((signed int)volt - (signed int)class_avg_volt[index]) >> 4));
+} /* end of class_sample */
+
 /*************************************************************************
  *  subroutine:      ADC_timedrive()
  *
@@ -266,8 +718,15 @@ static void ADC_timedrive()
 void ops_ADC( char int_on)
 {
   // last_routine = 0x66;
+  if (!int_on || !T3CONbits.TON || (arrive_state != ARRIVE_OFF)
+      || (T3CONbits.TCKPS != NO_PRESCALE))
+  {
+    probe_q_resync();          /* Queued scans are from before */
+  }                            /* (not for ON with the 1ms scan running) */
+  arrive_state = ARRIVE_OFF;   /* Any owner of the scan ends the IDLE watch */
   if ( int_on )
   {
+    T3CONbits.TCKPS = NO_PRESCALE;  /* Back to the 1ms scan */
     if (!T3CONbits.TON)      /* Only turn on the probes if needed */
     {
       Init_ADC();
@@ -284,6 +743,86 @@ void ops_ADC( char int_on)
    } 
 } /* end of ops_ADC */
 
+/*************************************************************************
+ *  subroutine:      arrive_watch()
+ *
+ *  function:
+ *         Called by truck_idle() after a polled pass found no truck, with
+ *         the channels driven for PULSE_TEST.
+ *         1.  Set arrive_limit[] for each channel from its open_c_volt
+ *             reference using the same drop truck_idle() looks for
+ *             (1V with the EURO8VOLT jumper, else 4V)
+ *         2.  Start the T3 scan at 1:8 prescale (8ms) and arm the watch;
+ *             read_probes() then calls arrive_check() instead of
+ *             convert_to_binary() until ops_ADC() is next called
+ *
+ *  input:  none
+ *  output: none
+ *
+ *************************************************************************/
+void arrive_watch(void)
+{
+unsigned int index;
+unsigned int drop;
+
+  if (ConfigA & CFGA_EURO8VOLT)
+  {
+    drop = ADC1V;
+  }
+  else
+  {
+    drop = ADC4V;
+  }
+  for (index=0; index<MAX_CHAN; index++)
+  {
+    if (open_c_volt[1][index] > drop)
+    {
+      arrive_limit[index] = open_c_volt[1][index] - drop;
+    }
+    else
+    {
+      arrive_limit[index] = 0;          /* No reference, don't watch it */
+    }
+  }
+  ops_ADC( ON );                        /* Clears arrive_state */
+  arrive_chan = 0;
+  T3CONbits.TCKPS = PRESCALE_8;         /* 8ms is plenty to see a connect */
+  arrive_state = ARRIVE_ARMED;
+} /* end of arrive_watch */
+
+/*************************************************************************
+ *  subroutine:      arrive_check()
+ *
+ *  function:
+ *         Called from read_probes() (T3 interrupt) while the IDLE watch
+ *         is armed.  A channel that is not grounded but has dropped below
+ *         its arrive_limit[] moves the watch to ARRIVE_SEEN so the next
+ *         truck_idle() pass runs the full checks straight away.
+ *
+ *  input:  none
+ *  output: none
+ *
+ *************************************************************************/
+static void arrive_check(void)
+{
+unsigned int index;
+
+  if (arrive_state != ARRIVE_ARMED)
+  {
+    return;
+  }
+  for (index=start_point; index<MAX_CHAN; index++)
+  {
+    if ((probe_volt[index] > ADC1V) && (probe_volt[index] < arrive_limit[index]))
+    {
+      arrive_chan  = (unsigned char)(index + 1);
+      arrive_time  = freetimer;
+      arrive_state = ARRIVE_SEEN;
+      break;
+    }
+  }
+} /* end of arrive_check */
+
 /*************************************************************************
  *  subroutine:      read_ADC()
  *
@@ -309,6 +848,10 @@ int retry;
   /***************************** 9/29/2008 9:38AM **************************
    * Only need to do this if timer 3 and DMA is not doing the probe_volt capture
    *************************************************************************/
+  if (arrive_state != ARRIVE_OFF)  /* IDLE watch has T3 at 8ms, */
+  {
+    ops_ADC( OFF );                /* take a polled reading instead */
+  }
   /* Is Timer 3 off */
   if (T3CONbits.TON == 0)  
   {
@@ -64,6 +64,30 @@
  *                        FogBugz 127 Added check_highI_shorts() and call from 
  *                            active_two_wire() to detect a wet sensor shorted
  *                            to a dry.
+ * 1.6.38  10/19/26  AGT  Added probe_class_open() and probe_class_check(): one
+ *                          acquire window where the ADC scans feed the 2-wire
+ *                          optic, thermistor oscillation and thermistor ramp
+ *                          classifiers at once, each reporting a confidence.
+ *                         Trigger the probe waveform capture when a DRY probe
+ *                          goes WET and when check_active_shorts() finds a short.
+ *                         Channel drive and T3 state go through the hal.h macros.
+ *                         check_truck_gone() no longer blocks: it keeps the new
+ *                          depart_poll() detector going and reports its verdict.
+ *                          depart_poll() gathers the same evidence a step per
+ *                          main loop pass into a confidence score, with the
+ *                          settle times as timers. short_6to4_5to3() pattern
+ *                          counting split into short_count_358()/_467().
+ *                         The short test is one step again (it holds the drive,
+ *                          JUMP_START and T3 scan only inside the call), a TIM
+ *                          still answering vetoes GONE again, and each verdict
+ *                          is handed out once: check_truck_gone() returns
+ *                          DEP_UNKNOWN until a fresh round finishes.  Nothing
+ *                          is driven between rounds.  Added depart_busy().
+ *                         depart_poll() waits while a 5-wire tank calibration
+ *                          reading has the diag line driven.
+ *                         probe_class_check() counts no warm-up ramp in the
+ *                          first CLASS_RAMP_WAIT: a dry optic probe that was
+ *                          high when the window opened looked like one.
  * NOTE: check_active_shorts() is called only for thermistors.  Dry 2-wire optics
  *       appear to drop about 2 volts from their high state after pvolt is
  *       removed but this takes about 10 ms. A lot of testing would be needed to
@@ -310,7 +334,7 @@ static unsigned char short_fail_count;
                                   /* End two-wire short test */
       case SHORTFAIL_2W:
         tank_state = T_SHORT;       /* De-Permit */
-        if (check_truck_gone())     /* Truck/whatever still attached? */
+        if (check_truck_gone() == TRUE) /* Truck/whatever still attached? */
         {
           xprintf( 47, 1 );          /* Force the next message to print */
           truck_state = GONE_TWO;      /* No, outta here! */
@@ -440,7 +464,8 @@ static unsigned char short_fail_count;
               }
             }
           }
-          if (check_truck_gone() !=FALSE)   /* determine if truck Gone */
+          status = check_truck_gone();      /* determine if truck Gone */
+          if (status == TRUE)
           {                                  /* Give connection a second or two */
             if (gon_pass_count++ > 67)
             {                             /* Truck is truly gone */
@@ -450,7 +475,7 @@ static unsigned char short_fail_count;
                                           /* in main_activity() */
             }
           }
-          else
+          else if (status == FALSE)          /* Not DEP_UNKNOWN: a fresh verdict */
           {
             if (wet_pass_count > N_CYCLES_10)
             {
@@ -611,6 +636,149 @@ unsigned int volt_transition;
     return(status);
 } /* end of check_all_pulses */
 
+/*************************************************************************
+ *  subroutine:      probe_class_open()
+ *
+ *  function:
+ *         Open the parallel classification window for a newly attached
+ *         2-wire truck.  From here on every 1ms ADC scan (convert_to_binary)
+ *         is handed to all the 2-wire classifiers through class_sample().
+ *         Call after two_wire_start() so the starting voltages are taken
+ *         with the 2-wire drive in place.
+ *
+ *  input:  none
+ *  output: none
+ *
+ *************************************************************************/
+void probe_class_open(void)
+{
+unsigned int index;
+
+  class_window = CLASS_IDLE;          /* Keep the interrupt out while we setup */
+  if (read_ADC() == FAILED)           /* Start from a 2-wire drive scan */
+  {
+    return;                           /* Window stays idle, retry next pass */
+  }
+  class_opt_hi = 0;
+  class_thm_hi = 0;
+  for (index=0; index<COMPART_MAX; index++)
+  {
+    if (probe_volt[index] > SysParm.ADCOmaxNV) /* Already high is not an edge */
+    {
+      class_opt_hi |= ((unsigned int)1 << index);
+    }
+    if (probe_volt[index] > SysParm.ADCTmaxNV)
+    {
+      class_thm_hi |= ((unsigned int)1 << index);
+    }
+    class_opt_edge[index]   = 0;
+    class_thm_edge[index]   = 0;
+    class_start_volt[index] = probe_volt[index];
+    class_avg_volt[index]   = probe_volt[index];
+  }
+  class_conf[OPTIC2]  = 0;
+  class_conf[THERMIS] = 0;
+  class_ms            = 0;
+  class_start         = read_time();
+  class_window        = CLASS_OPEN;
+} /* end of probe_class_open */
+
+/*************************************************************************
+ *  subroutine:      probe_class_check()
+ *
+ *  function:
+ *         Evaluate the classifiers fed by the open window and set
+ *         class_conf[] (0-100%) for each:
+ *         1. OPTIC2  - most optic threshold edges seen on any channel, full
+ *                      confidence at more than OPTIC_COUNT (as check_all_pulses)
+ *         2. THERMIS - larger of
+ *                      a) thermistor threshold edges on a channel that never
+ *                         crossed the optic threshold, full at > THERMIS_COUNT
+ *                      b) warm-up ramp, channels whose filtered voltage has
+ *                         fallen CLASS_RAMP from the window start; two
+ *                         channels needed (as thermistor_present).  Not
+ *                         before CLASS_RAMP_WAIT, by when any optic probe
+ *                         has crossed its threshold: one caught high at
+ *                         the start filters down by more than CLASS_RAMP.
+ *         The first classifier to reach 100% is the decision and the window
+ *         is closed.  Optic wins a tie, the same order as the serial tests.
+ *
+ *  input:  none
+ *  output: OPTIC2 or THERMIS when conclusive, NO_TYPE when not (yet)
+ *
+ *************************************************************************/
+
+#define CLASS_RAMP      ADC1V       /* Thermistor warm-up drop for a channel */
+#define CLASS_RAMP_WAIT MSec500     /* Optic edges (10Hz or more) come first */
+
+PROBE_TRY_STATE probe_class_check(void)
+{
+unsigned int   index, compart;
+unsigned int   conf, opt_conf, thm_conf, ramp_count;
+char           ramp_ok;
+PROBE_TRY_STATE decision;
+
+  decision = NO_TYPE;
+  if (class_window != CLASS_OPEN)
+  {
+    return decision;
+  }
+  if (ConfigA & CFGA_8COMPARTMENT)    /* 6 or 8 compartment mode? */
+  {
+    compart = 0;
+  }
+  else
+  {
+    compart = 2;
+  }
+  opt_conf   = 0;
+  thm_conf   = 0;
+  ramp_count = 0;
+  ramp_ok    = (char)((read_time() - class_start) > CLASS_RAMP_WAIT);
+  for (index=compart; index<MAX_CHAN; index++)
+  {
+    conf = ((unsigned int)class_opt_edge[index] * 100) / (OPTIC_COUNT+1);
+    if (conf > opt_conf)
+    {
+      opt_conf = conf;
+    }
+    if (class_opt_edge[index] == 0)    /* Only a non-optic channel counts */
+    {
+      conf = ((unsigned int)class_thm_edge[index] * 100) / (THERMIS_COUNT+1);
+      if (conf > thm_conf)
+      {
+        thm_conf = conf;
+      }
+      if (ramp_ok && ((class_avg_volt[index] + CLASS_RAMP) <= class_start_volt[index]))
+      {
+        ramp_count++;
+      }
+    }
+  }
+  if ((ramp_count * 50) > thm_conf)
+  {
+    thm_conf = ramp_count * 50;
+  }
+  class_conf[OPTIC2]  = (unsigned char)((opt_conf > 100) ? 100 : opt_conf);
+  class_conf[THERMIS] = (unsigned char)((thm_conf > 100) ? 100 : thm_conf);
+
+  if (class_conf[OPTIC2] == 100)
+  {
+    decision = OPTIC2;
+  }
+  else if (class_conf[THERMIS] == 100)
+  {
+    decision = THERMIS;
+  }
+  if (decision != NO_TYPE)
+  {
+    class_window = CLASS_DONE;
+    class_ms     = (unsigned int)(read_time() - class_start);
+    xprintf( 29, (unsigned int)decision );
+  }
+  return decision;
+} /* end of probe_class_check */
+
 /*************************************************************************
  *  subroutine:      check_all_oscillating()
  *
@@ -693,6 +861,7 @@ unsigned char bit_state;
           /* High current maybe will cause a probe shorted to this one to show as bad */
           if (probes_state[ch_index] == P_DRY)
           { 
+              capture_trigger(CAP_TRIG_WET);
               for (index = start_point; index<MAX_CHAN; index++)
               {
                 HighI_On(index);
@@ -902,8 +1071,8 @@ unsigned int  chan_mask;            /* Current PORTE/channel bit */
  *****************************************************************************/
     threshold = ADC1_25V;                /* Thermistors go right to ground */
     ops_ADC (OFF);
-    porte_save = LATE;                  /* Save current active channels */
-    LATE &= (char)~channel;             /* Shut off selected channel(s) */
+    porte_save = HAL_CHAN_DRIVE_GET();  /* Save current active channels */
+    HAL_CHAN_DRIVE_SET(porte_save & (char)~channel); /* Shut off selected channel(s) */
 
     /* Now loop, timing out the supposedly-disabled channel... */
     msdelay = mstimer;                   /* Current millisecond counter */
@@ -921,7 +1090,7 @@ unsigned int  chan_mask;            /* Current PORTE/channel bit */
           break;                         /* All (selected) channels OK... */
        }
     } /* End timeout on channel powering down */
-    LATE = porte_save;                 /* Restore active channels */
+    HAL_CHAN_DRIVE_SET(porte_save);    /* Restore active channels */
    /* By now the selected channel (s) should have quieted down. The ADC
       is actively running/being polled by T3, so probe_volt[] will have
       the last "sampled" values (within 1 MS...), which should be "0" for
@@ -935,6 +1104,7 @@ unsigned int  chan_mask;            /* Current PORTE/channel bit */
           {                              /* Something is feeding this channel */
              status = 1;            /* Indicate an error was uncovered */
              probes_state[i] = P_SHORT;  /* Latch the bad news (12) */
+             capture_trigger(CAP_TRIG_SHORT);
              two_wire_state = SHORTFAIL_2W;   /* Shut things down */
           }
        }
@@ -943,6 +1113,107 @@ unsigned int  chan_mask;            /* Current PORTE/channel bit */
     return status;
 } /* End check_active_shorts() */
 
+/*************************************************************************
+ *  Departure detector
+ *
+ *  check_truck_gone() used to gather all of its "truck gone" evidence in
+ *  one blocking call (10ms settle, open voltages, the ~10ms smart probe
+ *  short test, ground, TIM presence and the Jump-Start rail check).  The
+ *  evidence is now gathered a step at a time by depart_poll() from the main
+ *  loop, with the 10ms settle as a timer; the short test is still one call
+ *  so that the drive, JUMP_START and T3 scan it takes over are never left
+ *  changed between passes.  Each step that agrees the truck has gone adds
+ *  its DEP_W_ weight to the round's confidence; pulsing probes, loaded
+ *  channels, a ground bolt, a TIM still answering, a failed rail check or
+ *  the smart probe short pattern end the round as "still here".  GONE is
+ *  declared when a round reaches the threshold (SysParm.DepartThresh,
+ *  default DEPART_THRESH: every piece of evidence, as before); a lower
+ *  threshold lets the short test be skipped.
+ *
+ *  Each verdict is handed out once: check_truck_gone() returns DEP_UNKNOWN
+ *  until a round started for it has finished, and taking a verdict starts
+ *  the next round.  A round puts the drive back when it ends, so nothing
+ *  is driven once the caller stops asking, and a verdict nobody collects
+ *  within DEPART_HOLD is dropped.
+ *
+ *************************************************************************/
+
+static unsigned char dep_state = DEP_OFF;
+static unsigned char dep_gone;          /* Verdict of the last round */
+static unsigned char dep_score;         /* Confidence this round */
+static unsigned long dep_time;          /* read_time() the next step may run */
+static unsigned long dep_hold;          /* read_time() the verdict lapses */
+static unsigned long dep_first;         /* read_time() of the first request */
+static unsigned int  dep_drive;         /* Channel drive the step relies on */
+
+static unsigned char depart_thresh(void)
+{
+  if ((SysParm.DepartThresh == 0) || (SysParm.DepartThresh > DEPART_THRESH))
+  {
+    return (DEPART_THRESH);
+  }
+  return (SysParm.DepartThresh);
+}
+
+/* Did somebody else change the channel drive since the step set it? */
+
+static char depart_disturbed(void)
+{
+  return ((HAL_CHAN_DRIVE_GET() & 0xFF) != (dep_drive & 0xFF));
+}
+
+/* End a round with its verdict, held for check_truck_gone() */
+
+static void depart_round(char gone)
+{
+unsigned long ms;
+
+  if (gone && !dep_gone)
+  {
+    ms = read_time() - dep_first;
+    depart_latency = (ms > 0xFFFFL) ? 0xFFFF : (unsigned int)ms;
+  }
+  dep_gone = gone;
+  dep_state = DEP_DONE;
+  dep_hold = read_time() + DEPART_HOLD;
+  if(probe_try_state == OPTIC5)
+  {
+    set_porte(OPTIC_DRIVE);
+  }
+}
+
+/*************************************************************************
+ *  subroutine:      depart_reset()
+ *
+ *  function:   Stop the departure detector and forget any verdict
+ *              (truck_gone(), pulsing probes, or no longer asked).
+ *  input:  none
+ *  output: none
+ *************************************************************************/
+void depart_reset(void)
+{
+  if ((dep_state != DEP_OFF) && (dep_state != DEP_DONE)
+      && (probe_try_state == OPTIC5))
+  {
+    set_porte(OPTIC_DRIVE);
+  }
+  dep_state = DEP_OFF;
+  dep_gone = FALSE;
+}
+
+/*************************************************************************
+ *  subroutine:      depart_busy()
+ *
+ *  function:   TRUE while a round is driving the channels (other code
+ *              using the same lines should wait).
+ *  input:  none
+ *  output: TRUE/FALSE
+ *************************************************************************/
+char depart_busy(void)
+{
+  return ((dep_state != DEP_OFF) && (dep_state != DEP_DONE));
+}
+
 /*************************************************************************
  *  subroutine:      check_truck_gone()
  *
@@ -953,80 +1224,174 @@ unsigned int  chan_mask;            /* Current PORTE/channel bit */
  *             or approximately there
  *         2.  Check for ground gone
  *         3.  Check for TIM gone
+ *         The checks are run by depart_poll(); this hands out the verdict
+ *         of a finished round (once) and starts the next one.
  *
  *  input:  none
- *  output: TRUE/FALSE  (TRUE means GONE)
+ *  output: TRUE (GONE), FALSE (still here) or DEP_UNKNOWN (round not
+ *          finished yet; ask again)
  *
  *************************************************************************/
 unsigned int check_truck_gone(void)
 {
-unsigned int status;
+unsigned int verdict;
+
+  if (truck_pulsing)
+  {
+     depart_reset();
+     return FALSE;                         /* truck still here */
+  }
+  switch (dep_state)
+  {
+    case DEP_OFF:
+      dep_first = read_time();
+      verdict = DEP_UNKNOWN;
+      break;
+
+    case DEP_DONE:
+      verdict = dep_gone ? TRUE : FALSE;
+      break;
+
+    default:
+      return (DEP_UNKNOWN);             /* Round under way */
+  }
+  dep_state = DEP_START;                /* Next round */
+  dep_time = read_time();
+  return (verdict);
+} /* end of check_truck_gone */
+
+/*************************************************************************
+ *  subroutine:      depart_poll()
+ *
+ *  function:   Called every main loop pass; runs the next step of the
+ *              departure detector when one is due.
+ *  input:  none
+ *  output: none
+ *************************************************************************/
+void depart_poll(void)
+{
 unsigned int start, i;
 #define PROBE_GONE_BIAS   (ADC1V/2)
 
+  if (dep_state == DEP_OFF)
+  {
+    return;
+  }
   if (truck_pulsing)
   {
-     return FALSE;                         /* truck still here */
+    depart_reset();                   /* Pulsing: still here */
+    return;
   }
-  status = TRUE;                            /* truck gone */
-  PORTE = PULSE_TEST;
-  PULSE5VOLT = CLR;               /* Chan 4 normal (10V) drive */
-  JUMP_START = CLR;               /* Jump-Start always off! */
-  DelayMS(10);                              /* Allow voltages to stabilize */
-/* >>> Fogbugz 108 check_channels() does the same check as in truck_idle();
-    the difference between codes would sometimes call a truck gone that wasn't.
-    Test with non-permitting 5-wire IntelliCheck */ 
+  if (dep_state == DEP_DONE)
   {
-    if (read_ADC() == FAILED) return TRUE; /* Read 8 voltages in manually */
-    if (ConfigA & CFGA_8COMPARTMENT)
-    {
-       start = 0;
-    } else
+    if (read_time() > dep_hold)
     {
-      start = 2;
+      dep_state = DEP_OFF;            /* Nobody came for the verdict */
     }
-    for ( i=start; i<8; i++)
-    {
-      if ( probe_volt[i] < (open_c_volt[0][i] - PROBE_GONE_BIAS) ) /* same as open */
+    return;
+  }
+  if ((read_time() < dep_time) || tank_cal_driving())
+  {
+    return;                           /* Not due, or channels in use */
+  }
+  switch (dep_state)
+  {
+    case DEP_START:
+      dep_score = 0;
+      HAL_CHAN_DRIVE_SET(PULSE_TEST);
+      PULSE5VOLT = CLR;               /* Chan 4 normal (10V) drive */
+      JUMP_START = CLR;               /* Jump-Start always off! */
+      dep_drive = HAL_CHAN_DRIVE_GET();
+      dep_time = read_time() + MSec10; /* Allow voltages to stabilize */
+      dep_state = DEP_OPEN;
+      break;
+
+/* >>> Fogbugz 108 check_channels() does the same check as in truck_idle();
+    the difference between codes would sometimes call a truck gone that wasn't.
+    Test with non-permitting 5-wire IntelliCheck */ 
+    case DEP_OPEN:
+      if (depart_disturbed())
       {
-         status = FALSE;                                        /* truck NOT gone */
+        dep_state = DEP_START;        /* Drive changed under us, again */
+        break;
       }
-    }
-  }
-  if (status)                         /* No pulsing probes - anything else going on? */
-  {  
-     if (short_6to4_5to3() )   /*  3,5,8 & 4,6,7 */
-     {
-        status = FALSE;              /* not gone */
-     }
-     else
-     {
+      if (read_ADC() == FAILED)       /* Read 8 voltages in manually */
+      {
+        depart_round(TRUE);
+        break;
+      }
+      if (ConfigA & CFGA_8COMPARTMENT)
+      {
+         start = 0;
+      } else
+      {
+        start = 2;
+      }
+      for ( i=start; i<8; i++)
+      {
+        if ( probe_volt[i] < (open_c_volt[0][i] - PROBE_GONE_BIAS) ) /* same as open */
+        {
+           break;
+        }
+      }
+      if (i < 8)
+      {
+        depart_round(FALSE);          /* truck NOT gone */
+        break;
+      }
+      dep_score += DEP_W_OPEN;
+      dep_state = DEP_GROUND;
+      break;
+
+    case DEP_GROUND:
       if (( (groundiodestate & PRESENT_IDLE) != PRESENT_IDLE)  && ( badgndflag == GND_OK ))
       {
-          status = FALSE;              /* not gone, handles special cases */
-      }else
+        depart_round(FALSE);          /* not gone, handles special cases */
+        break;
+      }
+      dep_score += DEP_W_GROUND;
+      if (TIM_state)                  /* Did we have a TIM? */
+      {                               /* Yes */
+        if (Read_Truck_Presence() != FALSE) /* Do we still have TIM? */
+        {
+          depart_round(FALSE);        /* Yes, still connected or unable to check */
+          break;                      /* If the TIM "changes" this will NOT catch it */
+        }
+      }
+      dep_score += DEP_W_TIM;
+      dep_state = DEP_RAIL;
+      break;
+
+    case DEP_RAIL:
+      if (!check_channels ())
       {
-        if (TIM_state)                     /* Did we have a TIM? */
-        {                                  /* Yes */
-            if (Read_Truck_Presence() != FALSE) /* Do we still have TIM? */
-            {
-              status = FALSE;          /* Yes, still connected or unable to check */
-              /* If the TIM "changes" this will NOT catch it */
-            }
-         }
-       } 
-     }
-  }
-  if (status)
-  {
-    status = check_channels ();
-  }
-  if(probe_try_state == OPTIC5)
-  {
-    set_porte(OPTIC_DRIVE);
+        depart_round(FALSE);
+        break;
+      }
+      dep_score += DEP_W_RAIL;
+      if (dep_score >= depart_thresh())
+      {
+        depart_round(TRUE);           /* Enough without the short test */
+        break;
+      }
+      dep_state = DEP_SHORT;
+      break;
+
+    case DEP_SHORT:                   /* One call: it restores what it takes */
+      if (short_6to4_5to3())          /*  3,5,8 & 4,6,7 */
+      {
+        depart_round(FALSE);          /* not gone */
+        break;
+      }
+      dep_score += DEP_W_SHORT;
+      depart_round(dep_score >= depart_thresh());
+      break;
+
+    default:
+      depart_reset();
+      break;
   }
-  return(status);
-} /* end of check_truck_gone */
+} /* end of depart_poll */
 
 /*************************************************************************
  *  subroutine:      short_6to4_5to3()
@@ -1045,40 +1410,20 @@ unsigned int start, i;
  *
  *          Note: This routine is called from truck_idle() only once every 7+ seconds,  so 
  *                  a SHORT_COUNT of 2 seems appropriate.
+ *          The readings are judged by short_count_358() (probe 8 driven) and
+ *          short_count_467() (probe 6 driven).
  *  input:  none
  *  output: TRUE/FALSE  (TRUE means Smart probe two wire)
  *
  *************************************************************************/
 #define  SHORT_COUNT 2
 
-char short_6to4_5to3(void)
-{
-char           status;
-unsigned long  temp_jump;
-unsigned int temp_volt[8], i, temp_ops;
-unsigned long  time_counter;
 static char       short_all = 0, short_5to3 = 0, short_6to4 = 0;
-//  last_routine = 0x95;
-  service_charge();                    /* Appease watchdog */
-  status = FALSE;                     /* default to NO smart probes */
-  temp_jump = jump_time;
-  jump_time = 0;                       /* shut off JUMP_START */
-  temp_ops = T3CONbits.TON;
-  ops_ADC(OFF);                   /* shut off T3 and DMA */
-  for (i=0; i<8; i++)
-  {
-    temp_volt[i] = probe_volt[i];
-  }
-  time_counter = read_time()+MSec2;
-  set_porte( OFF );                   /* Output to no probes */
-  while (time_counter > read_time())  /* Wait here for time out */
-    {;}
-  time_counter = read_time()+MSec2;
-  set_porte( PIN8 );            /* power up probe 8 */
-  while (time_counter > read_time())  /* Wait here for time out */
-    {;}
-  if (read_ADC() == FAILED) return FALSE;
-  // last_routine = 0x95;
+
+/* Probe 8 driven: count the 3/5/8 and all-channel short patterns */
+
+static char short_count_358(void)
+{
   if ((probe_volt[2] > ADC8V) && (probe_volt[4] > ADC8V) && (probe_volt[7] > ADC8V))    /* read probes 3, 5, 8 */
   {
     short_5to3++;               /* 3, 5 and 8 seem to be shorted together */
@@ -1103,16 +1448,15 @@ static char       short_all = 0, short_5to3 = 0, short_6to4 = 0;
       short_all++;            /* 6 compartments shorted! */
     }
   }
-  time_counter = read_time()+MSec2;
-  set_porte( OFF );                   /* Output to probes OFF */
-  while (time_counter > read_time())  /* Wait */
-  {;}
-  time_counter = read_time()+MSec2;
-  set_porte( PIN6 );                 /* Output to probe 6 */
-  while (time_counter > read_time())
-  {;}
-  if (read_ADC() == FAILED) return FALSE;
-  // last_routine = 0x95;
+  return (short_5to3);
+}
+
+/* Probe 6 driven: count the 4/6/7 pattern and give the verdict */
+
+static char short_count_467(void)
+{
+char           status = FALSE;
+
   if ((probe_volt[3] > ADC8V) && (probe_volt[5] > ADC8V) && (probe_volt[6] > ADC8V))  /* read probe 3, 5, 7 */
   {
     short_6to4++;
@@ -1136,6 +1480,47 @@ static char       short_all = 0, short_5to3 = 0, short_6to4 = 0;
      status = TRUE;                               /* This could be "DRUM" - whatever that is */
     }
   }
+  return (status);
+}
+
+char short_6to4_5to3(void)
+{
+char           status;
+unsigned long  temp_jump;
+unsigned int temp_volt[8], i, temp_ops;
+unsigned long  time_counter;
+//  last_routine = 0x95;
+  service_charge();                    /* Appease watchdog */
+  temp_jump = jump_time;
+  jump_time = 0;                       /* shut off JUMP_START */
+  temp_ops = HAL_ADC_SCAN_RUNNING();
+  ops_ADC(OFF);                   /* shut off T3 and DMA */
+  for (i=0; i<8; i++)
+  {
+    temp_volt[i] = probe_volt[i];
+  }
+  time_counter = read_time()+MSec2;
+  set_porte( OFF );                   /* Output to no probes */
+  while (time_counter > read_time())  /* Wait here for time out */
+    {;}
+  time_counter = read_time()+MSec2;
+  set_porte( PIN8 );            /* power up probe 8 */
+  while (time_counter > read_time())  /* Wait here for time out */
+    {;}
+  if (read_ADC() == FAILED) return FALSE;
+  // last_routine = 0x95;
+  (void)short_count_358();
+  time_counter = read_time()+MSec2;
+  set_porte( OFF );                   /* Output to probes OFF */
+  while (time_counter > read_time())  /* Wait */
+  {;}
+  time_counter = read_time()+MSec2;
+  set_porte( PIN6 );                 /* Output to probe 6 */
+  while (time_counter > read_time())
+  {;}
+  if (read_ADC() == FAILED) return FALSE;
+  // last_routine = 0x95;
+  status = short_count_467();
   set_porte( PULSE_TEST );    /* return to normal two wire pulse */
   if (temp_ops != 0)
   {
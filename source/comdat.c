@@ -29,6 +29,17 @@
  *                                       and vapor_timeout
  * 1.6.31  01/05/15  DHP  Removed unused "touch chip" variables
  * 1.6.34  07/08/16  DHP  QCCC 53: Added probe_type[]
+ * 1.6.38  10/19/26  AGT  Added parallel probe classifier variables class_*
+ *                         Added IDLE arrival watch variables arrive_*
+ *                         Added modbus_t15_time and modbus_eom for the Timer 5
+ *                          ModBus inter-frame timing
+ *                         modbus_tx_buff moved to DMA RAM for DMA1 transmit
+ *                         Added monotimer
+ *                         Added thresh_stale
+ *                         Added depart_latency
+ *                         Added jumper_now and jumper_seq
+ *                         Added modbus_tx_timeout
+ *                         Added probe_q_lost and probe_q_peak
  *********************************************************************************************/
 
 #include "common.h"
@@ -54,6 +65,8 @@ unsigned char dry_once;               /* FogBugz 108 */
 unsigned long cycle_timeout;         /* FogBugz 108 */
 unsigned int high_3[8];                  /* QCCC 53 */
 unsigned int high_8[8];                  /* QCCC 53 */
+volatile unsigned char thresh_stale = TRUE; /* probe_type[] changed; rebuild convert_to_binary() thresholds */
+unsigned int depart_latency;          /* ms from first check_truck_gone() to GONE */
 unsigned int unit_type;
 unsigned int Ground_Reference;
 unsigned int gnd_retry;
@@ -130,6 +143,8 @@ unsigned char     ConfigC;                   /* System Software configuration */
 
 unsigned char     enable_jumpers;            /* Hardware jumpers/enable byte, 1=TRUE */
                                     /* see comdat.h for defines */
+unsigned int      jumper_now;                /* J5 jumpers as last read + JMP_DEBUG */
+unsigned int      jumper_seq;                /* Snapshot version, bumped on change */
 
 char     enable_soft;               /* Software feature/enable byte, 1=TRUE */
                                     /* see comdat.h for defines */
@@ -178,6 +193,7 @@ int probe_result_flag;                 /* ADC interrupt flag */
 int dma_result_flag;                   /* ADC interrupt flag */
 unsigned short mstimer;                /* Like TCNT, but milliseconds */
 unsigned long  freetimer;              /* timer 1 ms count */
+volatile unsigned long long monotimer; /* 1 ms count since reset, see time_ms64() */
 unsigned short service_time;         /* service charge counter */
 unsigned long  dry_timer;              /* timer of dry probe attachment */
 unsigned long  drive_time;             /* a force timer to prevent charge runaway */
@@ -208,6 +224,8 @@ PROBE_TYPE     probe_type[2*COMPART_MAX];    /* Sensor type */
 // <<< QCCC 53
 unsigned int   result_ptr[COMPART_MAX];     /* latest read of ADC's in mv */
 unsigned int   old_probe_volt[COMPART_MAX]; /* last read of ADC's in mv */
+unsigned int   probe_q_lost;                /* T3 scans dropped, queue full */
+unsigned char  probe_q_peak;                /* Most scans waiting to convert */
 int            adc_convert_flag;       /* Indicate that the analog conversion */
                                        /*  has finished */
 char           berr;                   /* buss error occurred */
@@ -221,6 +239,30 @@ char           main_array[MAX_RELAY];  /* main relay oscillation array */
 char           bak_array[MAX_RELAY];   /* backup relay oscillation array */
 char           bak_charge[MAX_RELAY];  /* backup charge driver array */
 
+/*
+ * Parallel probe classification window; filled by convert_to_binary() and
+ * evaluated by probe_class_check() during ACQUIRE
+ */
+unsigned char  class_window;           /* CLASS_IDLE, CLASS_OPEN or CLASS_DONE */
+unsigned int   class_opt_hi;           /* Optic threshold latch, 1 bit/channel */
+unsigned int   class_thm_hi;           /* Thermistor threshold latch, 1 bit/channel */
+unsigned char  class_opt_edge[COMPART_MAX];  /* Optic threshold rising edges */
+unsigned char  class_thm_edge[COMPART_MAX];  /* Thermistor threshold rising edges */
+unsigned int   class_start_volt[COMPART_MAX]; /* Probe mv when window opened */
+unsigned int   class_avg_volt[COMPART_MAX];   /* Filtered probe mv (ramp) */
+unsigned char  class_conf[4];          /* Confidence (%) by PROBE_TRY_STATE */
+unsigned long  class_start;            /* read_time() when window opened */
+unsigned int   class_ms;               /* ms from window open to decision */
+
+/*
+ * IDLE truck arrival watch; armed by arrive_watch(), checked in the T3
+ * interrupt by read_probes()
+ */
+unsigned char  arrive_state;           /* ARRIVE_OFF, ARRIVE_ARMED or ARRIVE_SEEN */
+unsigned char  arrive_chan;            /* First channel (1-8) seen to drop */
+unsigned int   arrive_limit[COMPART_MAX]; /* Below this mv a truck is suspected */
+unsigned long  arrive_time;            /* read_time() of the drop */
+
 /******************************* 12/30/2008 7:12AM ***************************
  * Area to store the contents of the TIM truck configuration.
  * Byte 0 is the number of truck compartments
@@ -244,9 +286,12 @@ unsigned char  modbus_csize;        /* ModBus/Comm character size */
 unsigned char  modbus_err;
 unsigned char  modbus_state;
 unsigned char  modbusVIPmode;
-unsigned short modbus_eom_time;
+unsigned short modbus_eom_time;     /* t3.5 in Timer 5 ticks (PR5) */
+unsigned short modbus_t15_time;     /* t1.5 + 1 char in Timer 5 ticks */
+volatile unsigned char modbus_eom;  /* Set by Timer 5: t3.5 idle since last char */
 unsigned short modbus_Recv_err;
 unsigned short modbus_PrepMsg_err;
+unsigned short modbus_tx_timeout;   /* Responses DMA1/UART2 never finished */
 unsigned short modbus_DecodeMsg_err;
 unsigned char  modbus_rx_len;
 unsigned char  *modbus_rx_ptr;
@@ -257,7 +302,7 @@ unsigned char  *modbus_tx_ptr;
 unsigned short modbus_tx_time;
 
 unsigned char  modbus_rx_buff[MODBUS_MAX_LEN+1];
-unsigned char  modbus_tx_buff[MODBUS_MAX_LEN+1];
+unsigned char  modbus_tx_buff[MODBUS_MAX_LEN+1] __attribute__((space(dma)));  /* DMA1 source */
 unsigned char  save_last_recv[MODBUS_MAX_LEN+1];
 unsigned char  save_last_recv_len;
 unsigned char  save_last_xmit[MODBUS_MAX_LEN+1];
@@ -29,6 +29,29 @@
  * 1.5.31  01/14/15  DHP  Removed setting of READ_COMM_ID_BIT
  * 1.6.34  08/08/16  DHP  Cleanup: commented unneeded (duplicated) printf
  *                        FogBugz 143: Added interrupt protection in Dallas_Byte()
+ * 1.6.38  10/19/26  AGT  UNIX_to_Greg() now converts only when present_time
+ *                          has changed other than by time_tick(), which
+ *                          advances the calendar in place once a second and
+ *                          re-reads the RTC every TIME_SYNC_SECS. Added
+ *                          time_ms64() and rtc_read_seconds().
+ *                         read_bypass() only checks for a presence pulse
+ *                          while the key it last read is still held, doing
+ *                          the full Read_Bypass_SN() on a new presence and
+ *                          every BYPASS_REREAD polls.  Presence is watched
+ *                          every BYPASS_EDGE between polls so a swapped key
+ *                          is seen as a new presence.
+ *                         BYPASS_EDGE is half a poll rather than 50ms: each
+ *                          watch is a 1ms reset, so at 50ms a held key took
+ *                          more 1-Wire time than reading it in full every
+ *                          poll.  A swap quicker than that is still caught
+ *                          by the BYPASS_REREAD read.
+ *                         Read_Bypass_SN() no longer refuses a key whose
+ *                          CRC8 is 0xFF; an open line reading all ones
+ *                          already fails the CRC check.
+ *                         Dallas_Byte() leaves the DMA1 (ModBus response
+ *                          sent) interrupt on, as the UART2 ones already
+ *                          are; held off for the byte, the line stayed
+ *                          driven up to 0.6ms past the response.
  *
  *********************************************************************************************/
 
@@ -40,6 +63,12 @@
 #define  JAN_01_1970    0x00000000        /* UNIX time constants */
 #define  JAN_01_1994    0x2D24BD00
 
+#define  BYPASS_REREAD  8                 /* Polls a held key is trusted */
+#define  BYPASS_EDGE    (MSec500/2)       /* Presence watch between polls */
+#define  IEC0_DMA1IE    0x4000            /* ModBus response DMA, left on */
+
+static char bypass_held = FALSE;          /* Key read, present ever since */
+
 /******************************** Constants *********************************/
 
 static const unsigned char month_days[] = {31, 28, 31, 30, 31, 30,
@@ -47,6 +76,11 @@ static const unsigned char month_days[] = {31, 28, 31, 30, 31, 30,
 
 static unsigned char save_bypass_key[10];
 
+/* month/day/year/hour/minute/second hold the conversion of greg_time */
+
+static unixtime greg_time;
+static unsigned char greg_valid;
+
 /******************************* Subroutines ********************************/
 
 /******************************* 12/29/2008 3:22PM ***************************
@@ -78,6 +112,12 @@ int timeout = 3;
  *
  *       1.  If in time window (1/2 second elapsed) Read_Bypass_SN()
  *           Return status if called with FALSE parameter
+ *           While the key read last time keeps answering the reset
+ *           pulse it is taken to be the same key; the ROM is read (and
+ *           CRC checked) again on a new presence, and every BYPASS_REREAD
+ *           polls.  Between polls presence is watched every BYPASS_EDGE,
+ *           and any check that finds no key clears bypass_held, so a key
+ *           lifted off and another put on is always read.
  *       2.  Validate key if found, then set the bypass flag and bypass level
  *
  *  Input:        Action - TRUE/FALSE (Read bypass chip)
@@ -89,6 +129,9 @@ char read_bypass (char action)
   static unsigned long bypass_delay = 0; /* Bypass timer */
   static unsigned long bypass_wait;      /* Bypass timer wait */
   static char          bypass_toggle = 0;/* Bypass True/False toggle */
+  static unsigned long bypass_edge;      /* Next presence watch */
+  static unsigned char bypass_polls;     /* Polls since ROM read */
+  static unsigned char bypass_key[BYTESERIAL]; /* Serial number read */
   unsigned int         index;            /* Key index in NV authorization */
   char                 bypass_found;     /* TRUE if bypass key present */
   unsigned int         level;            /* Level of bypass detected */
@@ -99,9 +142,38 @@ char read_bypass (char action)
     bypass_wait = read_time();
   }
   bypass_found = FALSE;
+  if (bypass_held && (bypass_delay >= read_time()) && (bypass_edge < read_time()))
+  {                                  /* Between polls: a key lifted off and */
+    bypass_edge = read_time() + BYPASS_EDGE; /* put back must be read again */
+    if (Dallas_Reset (READ_BYPASS) == 0)
+    {
+      bypass_held = FALSE;
+    }
+  }
   if (bypass_delay < read_time())
   {                                  /* We have waited long enough */
-    if ((bypass_found = Read_Bypass_SN()) != 0)   /* Valid Dallas key detected? */
+    if (bypass_held && (bypass_polls < BYPASS_REREAD))
+    {                                /* Same key, if it still answers */
+      bypass_polls++;
+      if (Dallas_Reset (READ_BYPASS) != 0)
+      {
+        (void)memcpy (bypass_SN, bypass_key, BYTESERIAL);
+        bypass_found = TRUE;
+      }
+      bypass_edge = read_time() + BYPASS_EDGE;
+    }
+    else
+    {
+      bypass_found = Read_Bypass_SN();
+      if (bypass_found)
+      {
+        (void)memcpy (bypass_key, bypass_SN, BYTESERIAL);
+      }
+      bypass_polls = 0;
+      bypass_edge = read_time() + BYPASS_EDGE;
+    }
+    bypass_held = bypass_found;
+    if (bypass_found != 0)           /* Valid Dallas key detected? */
     {                                /* Yes - CRC-validated bypass key */
       if ( action == FALSE)          /* We are idle and there is a bypass key */
       {
@@ -474,7 +546,7 @@ unsigned int save_iec0;
   }
 
   save_iec0 = IEC0;
-  IEC0 = 0;                   /* Disable heart beat and DMA interrupt */
+  IEC0 = save_iec0 & IEC0_DMA1IE; /* Disable heart beat and ADC DMA interrupt */
   for (loop = 0; loop < 8; loop++)
   {
     // shift the result to get it ready for the next bit
@@ -779,6 +851,7 @@ char status;
   // last_routine = 0x79;
   if (Dallas_Reset (READ_BYPASS) == 0)       /* Issue reset pulse */
   {
+    bypass_held = FALSE;                     /* Gone: read_bypass() re-reads */
     return (FALSE);
   }
   for ( i=0; i<5; i++)
@@ -790,12 +863,13 @@ char status;
    {
      if (Dallas_Reset (READ_BYPASS) == 0)       /* Issue reset pulse */
      {
+       bypass_held = FALSE;
        return (FALSE);
      }
    }
   }
 
-  if ((save_bypass_key[0] == 0xFF) || (save_bypass_key[7] == 0xFF))
+  if (save_bypass_key[0] == 0xFF)        /* Family code: line open */
   {
     return (FALSE);
   }
@@ -1115,12 +1189,7 @@ unsigned long second_time;
     }
   }
 
-  for (i = 4; i > 0; i--)
-  {
-     second_time <<= 8;
-     (void)I2C1_read(DS1371_DEVICE, (unsigned char)(i-1), &data, 1);  /* Fetch the time count */
-     second_time |= data;
-  }
+  (void)rtc_read_seconds(&second_time);           /* Fetch the time count */
 
   present_time = second_time;                     /* Return time */
 
@@ -1223,6 +1292,9 @@ void UNIX_to_Greg (void)
    unsigned char not_leap_year, days_in_month;
 
    // last_routine = 0x7F;
+   if (greg_valid && (greg_time == present_time))
+      return;                             /* Already converted */
+
    seconds = present_time;                         /* Get the current time */
 
    second = seconds % 60;                 /* Save seconds */
@@ -1271,8 +1343,134 @@ void UNIX_to_Greg (void)
 
    day = (unsigned char)seconds;                   /* Calculate day */
 
+   greg_time = present_time;
+   greg_valid = TRUE;
+
 }  /* end of UNIX_to_Greg() */
 
+/****************************************************************************
+ *
+ *  Subroutine:   time_tick()
+ *
+ *  Function:     Advance the system Time-Of-Day by one second.
+ *
+ *       1.  Called once a second from doSeconds(). present_time is
+ *           incremented and, if the Gregorian globals matched the old
+ *           value, they are stepped forward (second, minute, ... year)
+ *           instead of being converted again, so UNIX_to_Greg() callers
+ *           (VIP time registers, TIM log stamps) just read memory.
+ *       2.  Every TIME_SYNC_SECS the Dallas RTC seconds counter is read
+ *           back and, if readable and sane, replaces present_time; the
+ *           doSeconds() tick is only "on average" once a second.
+ *
+ *  Input:        None
+ *  Output:       None
+ *
+ ****************************************************************************/
+
+void time_tick (void)
+{
+   static unsigned int sync_count = 0;
+   unsigned long rtc;
+   unsigned char days_in_month;
+
+   present_time++;                        /* Advance system Time-Of-Day */
+
+   if (++sync_count >= TIME_SYNC_SECS)
+   {
+      sync_count = 0;
+      if ((rtc_read_seconds(&rtc) == 0) && (rtc >= JAN_01_1994))
+         present_time = rtc;              /* Calendar reconverts if moved */
+   }
+
+   if (!greg_valid || (present_time != (greg_time + 1)))
+      return;                             /* Convert on next use */
+
+   greg_time = present_time;
+   if (++second < 60)
+      return;
+   second = 0;
+   if (++minute < 60)
+      return;
+   minute = 0;
+   if (++hour < 24)
+      return;
+   hour = 0;
+   days_in_month = month_days[month - 1];
+   if ((month == 2) && !(year % 4))       /* Same leap rule as above */
+      ++days_in_month;
+   if (++day <= days_in_month)
+      return;
+   day = 1;
+   if (++month <= 12)
+      return;
+   month = 1;
+   ++year;
+
+}  /* end of time_tick() */
+
+/****************************************************************************
+ *
+ *  Subroutine:   rtc_read_seconds()
+ *
+ *  Function:     Read the DS1371 32-bit seconds counter.
+ *
+ *  Input:        Pointer to returned UNIX time
+ *  Output:       0 if read OK, non-zero on I2C error
+ *
+ ****************************************************************************/
+
+char rtc_read_seconds (unsigned long *secs)
+{
+   unsigned long second_time;
+   unsigned char i;
+   UINT8 data;
+   char sts;
+
+   sts = 0;
+   second_time = 0;
+   for (i = 4; i > 0; i--)
+   {
+      second_time <<= 8;
+      data = 0;
+      if (I2C1_read(DS1371_DEVICE, (unsigned char)(i-1), &data, 1))
+         sts = 1;
+      second_time |= data;
+   }
+   *secs = second_time;
+   return (sts);
+
+}  /* end of rtc_read_seconds() */
+
+/****************************************************************************
+ *
+ *  Subroutine:   time_ms64()
+ *
+ *  Function:     Return the monotonic millisecond count since reset.
+ *
+ *       1.  monotimer is bumped by timer_heartbeat() alongside freetimer,
+ *           but unlike freetimer (restarted at every truck connect) it is
+ *           never reset and never wraps. It is read until two reads agree,
+ *           so a tick landing between the word reads is not torn.
+ *
+ *  Input:        None
+ *  Output:       Milliseconds since reset
+ *
+ ****************************************************************************/
+
+unsigned long long time_ms64 (void)
+{
+   unsigned long long ms;
+
+   do
+   {
+      ms = monotimer;
+   } while (ms != monotimer);
+
+   return (ms);
+
+}  /* end of time_ms64() */
+
 /****************************************************************************
  *
  *  Subroutine:   Greg_to_UNIX()
@@ -39,6 +39,10 @@
  *                        Changed report_tank_state() to use switch rather than 
  *                          long sequence of if else statements and incorporated 
  *                          use of new probe_type array in decisions.
+ * 1.6.38  10/19/26  AGT  dry_5W_probes() and unknown_probes() set thresh_stale
+ *                          after rewriting probe_type[].
+ *                        init_variables() latches the ModBus line jumpers
+ *                          (latch_line_jumpers()) ahead of get_modbus_addr() etc.
   *****************************************************************************/
 #include "common.h"
 /*************************************************************************
@@ -96,6 +100,7 @@ void   init_variables(void)
 
    /* ModBus/Communications line control/parameters */
 
+   latch_line_jumpers();                /* Read the line jumpers, once */
    modbus_addr = get_modbus_addr();     /* Read Address for printf/ModBus */
   // last_routine = 0x83;
    modbus_baud = get_modbus_baud();     /* Read baud rate for printf/ModBus */
@@ -107,6 +112,7 @@ void   init_variables(void)
    modbus_Recv_err = 0;
    modbusVIPmode = 0;
    modbus_PrepMsg_err = 0;
+   modbus_tx_timeout = 0;
    modbus_DecodeMsg_err = 0;
    for (index = 0;index < MAX_CHAN;++index)        /* Preset for positive edge */
    {
@@ -552,6 +558,7 @@ void      dry_5W_probes(void)
      probes_state[index] = P_UNKNOWN;
      probe_type[index] = P_NONE;
   }
+  thresh_stale = TRUE;                /* New probe_type[] thresholds */
   return;
 } /* end of dry_5W_probes */
 // <<< QCCC 53, 58, FogBugz 137  
@@ -593,6 +600,7 @@ void    unknown_probes(void)
 // <<< QCCC 53
       probes_state[index]  = P_UNKNOWN;
    }
+   thresh_stale = TRUE;                 /* New probe_type[] thresholds */
 } /* end of unknown_probes */
 
 /*************************************************************************
@@ -22,6 +22,14 @@
  *                          factory options. These should not change!
  *                         Added to eeUpdateSys() the new parameters for 
  *                           the Active Deadman
+ *  1.6.38  10/19/26  AGT  Added nvTrkInit() call to eeInit()
+ *                         Added nvKeyInit() call to eeInit()
+ *                         Added EEP_SPJ (SysParm journal) to eeMapPartition()
+ *                         Added nvSesInit() call to eeInit(); eeFormatHome()
+ *                          erases the Session Record ring.
+ *                         eeMapPartition() re-checks the Home block patterns
+ *                          after reading it: a blank part mapped every
+ *                          partition at 0xFFFF bytes.
  *
  *********************************************************************************************/
 #include "common.h"
@@ -85,6 +93,13 @@ char eeMapPartition
         *base = 0;                      /* Not valid */
         return (EE_DATAERROR);          /* Return error status */
       }
+      if ((home_block.pat1 != EEHOMEPAT1)
+         || (home_block.pat2 != EEHOMEPAT2))
+      {                                 /* Blank/unformatted EEPROM: all 0xFF */
+        *size = 0;                      /*  lengths would map the whole part */
+        *base = 0;
+        return (EE_DATAERROR);
+      }
     }
 
     /* Identify and extract partition info from the Home block */
@@ -127,6 +142,16 @@ char eeMapPartition
         ofs = home_block.Keyptr;             /* Key Block base offset */
         break;
 
+      case EEP_SPJ:                     /* SysParm journal, end of SysNV */
+        sts = (char)(home_block.Valid & EEV_SYSBLK); /* Extract validity bit */
+        if (home_block.SysNVlen < (SPJ_OFS + SPJ_SIZE))
+        {
+          sts = 0;                      /* Old/short SysNV partition */
+        }
+        len = SPJ_SIZE;
+        ofs = home_block.SysNVptr + SPJ_OFS;
+        break;
+
       case EEP_TIM:                     /* TIM Block or Partition */
         sts = (char)(home_block.Valid & EEV_TIMBLK); /* Extract validity bit */
         len = home_block.TIMlen;             /* TIM Block length */
@@ -380,7 +405,13 @@ unsigned crc;                         /* Temporary storage for Checksum */
 
   nvSysInit ();
 
+  nvTrkInit ();                         /* Truck ID store format */
+
+  nvKeyInit ();                         /* RAM copy of Bypass Keys */
+
   (void)nvLogInit();
+
+  nvSesInit ();                         /* Session Record ring */
 } /* End of eeInit() */
 
 /****************************************************************************
@@ -712,6 +743,10 @@ static char eeFormatHome (void)
     else
         xprintf( 88, EEP_TIM);
 
+    /* Session Record ring (no partition of its own, CRCs each record) */
+
+    status |= eeBlockFill (SES_BASE, 0xFF, E2SESSIZ); /* Just "erase" it */
+
     home_block.Valid = valid;                 /* Mark EEPROM validity in home block */
     home_block.Status = status;               /* Accumulated status */
     EE_status |= status;                /* Mark it in system status too */
@@ -17,6 +17,9 @@
  *   Rev      Date       Who   Description of Change Made
  * -------   --------- -----      --------------------------------------------
  * 1.6.03  03/10/15  DHP   In Init_DMA0() added set_mux(M_PROBES)
+ * 1.6.38  10/19/26  AGT   Added Init_DMA1() for ModBus (UART2) transmit
+ *                         Added Init_DMA2()/Init_DMA3() for SPI2 (update module)
+ *                         DMAxPAD addresses cast through size_t
  *
  *****************************************************************************/
 #include "common.h"
@@ -40,9 +43,71 @@ void Init_DMA0(void)
   IPC1bits.DMA0IP = 6;
   DMA0CONbits.AMODE = 0;      /* Configure DMA for Register Indirect with Post Increment mode */
   DMA0CONbits.MODE = 1;       /* Configure DMA for One-Shot, Ping-Pong mode disabled */
-  DMA0PAD = (unsigned int) &ADC1BUF0;           /* Point DMA to ADC1BUF0 */
+  DMA0PAD = (unsigned int)(size_t)&ADC1BUF0;    /* Point DMA to ADC1BUF0 */
   DMA0CNT = 7;                /* 8 DMA request (8 buffers, each with 1 word) */
   DMA0REQ = 13;               /* Select ADC1 as DMA Request source */
   DMA0STA = (unsigned int)__builtin_dmaoffset(&BufferA[0]);
   IEC0bits.DMA0IE = 1;        /*Set the DMA interrupt enable bit  */
-  set_mux(M_PROBES);           /* Point to probe voltage */}
+  set_mux(M_PROBES);           /* Point to probe voltage */
+}
+
+/*****************************************************************************
+ * DMA1 configuration
+ * Direction: Read from DMA RAM (modbus_tx_buff) and write to U2TXREG
+ * AMODE: Register Indirect with Post Increment, byte transfers
+ * MODE: One-Shot, Ping-Pong Mode disabled; DMA1CNT is set per frame
+ * IRQ: UART2 Transmitter (UTXISEL = 00: one byte per byte shifted out)
+ *****************************************************************************/
+void Init_DMA1(void)
+{
+  DMA1CONbits.CHEN = 0;       /* Disable DMA */
+  IFS0bits.DMA1IF = 0;        /* Clear the DMA interrupt flag bit */
+  IPC3bits.DMA1IP = 5;        /* Same level as the UART2 interrupts */
+  DMA1CONbits.SIZE = 1;       /* Byte transfers */
+  DMA1CONbits.DIR = 1;        /* DMA RAM to peripheral */
+  DMA1CONbits.AMODE = 0;      /* Register Indirect with Post Increment mode */
+  DMA1CONbits.MODE = 1;       /* One-Shot, Ping-Pong mode disabled */
+  DMA1PAD = (unsigned int)(size_t)&U2TXREG;
+  DMA1REQ = 31;               /* Select UART2 TX as DMA Request source */
+  DMA1STA = (unsigned int)__builtin_dmaoffset(modbus_tx_buff);
+  IEC0bits.DMA1IE = 1;        /* Set the DMA interrupt enable bit */
+}
+
+/*****************************************************************************
+ * DMA2 configuration
+ * Direction: Read from DMA RAM and write to SPI2BUF
+ * AMODE: Set per transfer (post increment, or a fixed zero byte)
+ * MODE: One-Shot, Ping-Pong Mode disabled; DMA2STA/DMA2CNT set per transfer
+ * IRQ: SPI2 transfer done; polled, interrupt not enabled
+ *****************************************************************************/
+void Init_DMA2(void)
+{
+  DMA2CONbits.CHEN = 0;       /* Disable DMA */
+  IEC1bits.DMA2IE = 0;        /* Polled by spi_eeprom.c */
+  IFS1bits.DMA2IF = 0;
+  DMA2CONbits.SIZE = 1;       /* Byte transfers */
+  DMA2CONbits.DIR = 1;        /* DMA RAM to peripheral */
+  DMA2CONbits.MODE = 1;       /* One-Shot, Ping-Pong mode disabled */
+  DMA2PAD = (unsigned int)(size_t)&SPI2BUF;
+  DMA2REQ = 33;               /* Select SPI2 as DMA Request source */
+}
+
+/*****************************************************************************
+ * DMA3 configuration
+ * Direction: Read from SPI2BUF and write to DMA RAM
+ * AMODE: Set per transfer (post increment, or a discard byte)
+ * MODE: One-Shot, Ping-Pong Mode disabled; spi_eeprom.c alternates the
+ *       buffers itself so that it can CRC one while the other fills
+ * IRQ: SPI2 transfer done; polled, interrupt not enabled
+ *****************************************************************************/
+void Init_DMA3(void)
+{
+  DMA3CONbits.CHEN = 0;       /* Disable DMA */
+  IEC2bits.DMA3IE = 0;        /* Polled by spi_eeprom.c */
+  IFS2bits.DMA3IF = 0;
+  DMA3CONbits.SIZE = 1;       /* Byte transfers */
+  DMA3CONbits.DIR = 0;        /* Peripheral to DMA RAM */
+  DMA3CONbits.MODE = 1;       /* One-Shot, Ping-Pong mode disabled */
+  DMA3PAD = (unsigned int)(size_t)&SPI2BUF;
+  DMA3REQ = 33;               /* Select SPI2 as DMA Request source */
+}
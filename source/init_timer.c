@@ -14,6 +14,8 @@
  *                   microprocessor PIC24HJ256GP210
  *
  *   Revision History:
+ *   1.6.38  10/19/26  AGT  Added Init_Timer5() for the ModBus t1.5/t3.5 timing
+ *                          Added read_32bit_cycles()
  *
  *****************************************************************************/
 
@@ -134,6 +136,23 @@ void Init_Timer4( void )
 
 
 
+/*****************************************************************************
+ * Init Timer 5 as the ModBus inter-character timer: FCY/64 (3.2 us) ticks,
+ * left off until modbus_init() loads the t3.5 period for the baud rate.
+ * Same priority as U2RX so neither interrupts the other.
+ *****************************************************************************/
+void Init_Timer5( void )
+{
+  T5CON = 0;
+  IFS1bits.T5IF = 0;
+  TMR5 = 0x00;
+  PR5 = 0xFFFF;
+  T5CONbits.TCKPS = PRESCALE_64;
+  T5CONbits.TCS = 0;
+  IPC7bits.T5IP = 5;
+  IEC1bits.T5IE = 1;
+}
+
 /******************************* 10/31/2008 6:20AM ***************************
  * Init 32bit timer pair 6 and 7
  *****************************************************************************/
@@ -295,4 +314,22 @@ union
     return  (ul.lword/(unsigned long)20 );    /* In Us */
 } /* end of read_32bit_realtime */
 
+/* Same free running Timer 6/7 count in raw instruction cycles (50ns) */
+
+unsigned long read_32bit_cycles(void)
+{
+union
+{
+  struct {
+    unsigned int low;
+    unsigned int high;
+  } temp;
+  unsigned long lword;
+} ul;
+
+    ul.temp.low = TMR6;
+    ul.temp.high = TMR7HLD;
+    return  (ul.lword);
+} /* end of read_32bit_cycles */
+
 
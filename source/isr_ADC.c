@@ -14,6 +14,9 @@
  *                   microprocessor PIC24HJ256GP210
  *
  *   Revision History:
+ *  1.6.38  10/19/26  AGT  _ADC1Interrupt() reads ADC1BUF0-7 through the
+ *                          buffer's address, not its contents (the ADC
+ *                          interrupt is not enabled; adc.c uses DMA0)
  *
  *****************************************************************************/
 
@@ -31,10 +34,10 @@ void __attribute__((__interrupt__, auto_psv)) _ADC1Interrupt( void )
 int index;
 unsigned int *adc_ptr;
 
-  adc_ptr = (unsigned int *)ADC1BUF0;
+  adc_ptr = (unsigned int *)&ADC1BUF0;  /* ADC1BUF0-7 are consecutive */
   for ( index = 0; index<8; index++)
   {
-    probe_volt[index] = *adc_ptr;
+    probe_volt[index] = adc_ptr[index];
   }
 
 	/* reset ADC interrupt flag */
@@ -14,6 +14,8 @@
  *                   microprocessor PIC24HJ256GP210
  *
  *   Revision History:
+ *   1.6.38  10/19/26  AGT  Added _DMA1Interrupt() for the ModBus DMA transmit
+ *                          (releases the line itself if TRMT is already set)
  *
  *****************************************************************************/
 
@@ -47,3 +49,26 @@ void __attribute__((__interrupt__, auto_psv)) _DMA0Interrupt( void )
   IFS0bits.DMA0IF = 0;      /* Clear the DMA0 Interrupt Flag */
 }
 
+/*****************************************************************************
+ * Function Name: _DMA1Interrupt
+ * Description:   The last ModBus response byte is in the UART2 TX FIFO.
+ *                Switch UART2 to interrupt when the shift register has
+ *                emptied; _U2TXInterrupt() then releases the line.
+ *                That interrupt is an edge: if the last byte is already
+ *                out (TRMT) it will not come, so release here.
+ * Inputs:        None
+ * Returns:       None
+ *****************************************************************************/
+void __attribute__((__interrupt__, auto_psv)) _DMA1Interrupt( void )
+{
+  IFS0bits.DMA1IF = 0;      /* Clear the DMA1 Interrupt Flag */
+  DMA1CONbits.CHEN = 0;     /* One-shot is done */
+  U2STAbits.UTXISEL1 = 0;   /* Interrupt when all transmit operations */
+  U2STAbits.UTXISEL0 = 1;   /*  are complete */
+  IFS1bits.U2TXIF = 0;
+  IEC1bits.U2TXIE = 1;
+  if (U2STAbits.TRMT && (modbus_state == (unsigned char)XMITMSG))
+  {
+    modbus_tx_release();
+  }
+}
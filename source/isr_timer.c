@@ -14,6 +14,9 @@
  *                   microprocessor PIC24HJ256GP210
  *
  *   Revision History:
+ *   1.6.38  10/19/26  AGT  _T5Interrupt() now ends the ModBus t3.5 wait
+ *                          read_probes() from _T3Interrupt() only queues the
+ *                           scan; conversion is done by probe_drain()
  *
  *****************************************************************************/
 
@@ -42,7 +45,7 @@ void __attribute__((__interrupt__, auto_psv)) _T3Interrupt( void )
 {
   /* reset Timer 3 interrupt flag */
   IFS0bits.T3IF = 0;
-  read_probes();                     /* read A/D convert into probe_volt */
+  read_probes();                     /* read A/D convert into probe_volt, queue it */
 }
 
 /*******************************6/17/2008 6:06AM******************************
@@ -68,7 +71,7 @@ void __attribute__((__interrupt__, auto_psv)) _T4Interrupt( void )
 
 /*******************************6/17/2008 6:06AM******************************
  * Function Name: _T5Interrupt
- * Description:   Timer5 Interrupt Handler. Interrupt every 500us
+ * Description:   Timer5 Interrupt Handler. ModBus t3.5 inter-frame timeout
  * Inputs:        None
  * Returns:       None
  *****************************************************************************/
@@ -76,5 +79,7 @@ void __attribute__((__interrupt__, auto_psv)) _T5Interrupt( void )
 {
   /* reset Timer 5 interrupt flag */
   IFS1bits.T5IF = 0;
+  T5CONbits.TON = 0;      /* One shot, restarted by each ModBus character */
+  modbus_eom = TRUE;      /* t3.5 of idle line: end of message */
 }
 
@@ -26,6 +26,13 @@
  *         04/01/14  DHP  Removed lines of commented out code.
  * 1.6.34  10/10/16  DHP  Renamed communicate_flag to receive_bk_status.
  * 1.6.35  02/07/17  DHP  Added parameter & overflow checks in U1RXInterrupt
+ * 1.6.38  10/19/26  AGT  U2RX: start of message is the Timer 5 t3.5 flag and
+ *                          each character restarts Timer 5; a gap over t1.5
+ *                          inside a frame discards the frame.  The check
+ *                          allows for the character's own time.
+ *                        U2TX: the response is now sent by DMA1; the one
+ *                          transmit interrupt left is end of frame, which
+ *                          calls modbus_tx_release().
  ****************************************************************************/
 #include "common.h"
 
@@ -48,8 +55,14 @@ unsigned char data;
 
   do
   {
+    if (!modbus_eom && T5CONbits.TON && (TMR5 > modbus_t15_time)
+        && (modbus_state == (unsigned char)RECV) && (modbus_rx_len != 0))
+    { // Over t1.5 (but under t3.5) idle before this character: broken frame
+      modbus_state = (unsigned char)RESETMSG;
+      modbus_Recv_err++;
+    }
    /* The following was added to help get rid of lost messages */
-    if (DeltaMsTimer(modbus_rx_time) > modbus_eom_time)
+    if (modbus_eom)
     { // Should get here on first character of every message
       if (modbus_err)
       {
@@ -104,6 +117,10 @@ unsigned char data;
       *modbus_rx_ptr++ = data;
     }
     modbus_rx_time  = mstimer;        /* Mark the time */
+    TMR5 = 0;                         /* Restart the t1.5/t3.5 timing */
+    IFS1bits.T5IF = 0;
+    modbus_eom = FALSE;
+    T5CONbits.TON = 1;
   }
   while(U2STAbits.URXDA == 1);
   IFS1bits.U2RXIF = 0;
@@ -112,34 +129,14 @@ unsigned char data;
 void __attribute__((__interrupt__, auto_psv)) _U2TXInterrupt( void )
 {
 
+  IFS1bits.U2TXIF = 0;
   if (modbus_state == (unsigned char)XMITMSG)
+  { /* Enabled by _DMA1Interrupt() with UTXISEL = 01: last stop bit is out */
+    modbus_tx_release();
+  }
+  else
   {
-    IFS1bits.U2TXIF = 0;
-    if (modbus_tx_len > 0)
-    {
-      send_char++;
-      modbus_tx_len--;
-
-      U2TXREG = *(modbus_tx_ptr++);
-      ledstate[TASCOMM] = PULSE;   /* Note TAS/VIPER comm activity */
-    }
-    else
-    {
-      while(U2STAbits.TRMT == 0) {} /* Wait for transmit shift register to empty */
-      IEC1bits.U2TXIE = 0;
-      modbus_state = (unsigned char)RESETMSG;
-      /* DHP  The following Block added to prevent host collisions */
-      {
-        U2STAbits.UTXEN = 0;            /* To force Int when set in set_tx2_en() */
-        IEC1bits.U2TXIE = 0;
-        IFS1bits.U2TXIF = 0;
-        TXEN = 0;                       /* Disable transmit at board level */
-        flush_uart2();                  /* Remove any received characters */
-        IFS1bits.U2RXIF = 0;
-        IEC1bits.U2RXIE = 1;            /* Now ready for receive */
-      }
-      /* End of added code */
-    }
+    IEC1bits.U2TXIE = 0;
   }
 }
 
@@ -33,9 +33,18 @@
  *                                        when jumper is out
  *                                      Removed k_poke_dog(), ClrWdt() is used in its place
  *  1.6.35  02/01/17  DHP  Moved deadman_ops() function to deadman.c
+ *  1.6.38  10/19/26  AGT  read_jumpers() keeps the reading in jumper_now and
+ *                                      bumps jumper_seq when it changes; the main
+ *                                      loop now calls it once a second from
+ *                                      doSeconds() instead of every pass.
+ *                                      A change is logged as an EVJUMPERS event.
+ *                                      Added latch_line_jumpers()/line_jumper_mv(): the
+ *                                      ModBus line jumpers are read through the mux
+ *                                      once, at power up.
 *********************************************************************************************/
 
 #include "common.h"
+#include "evlog.h"
 /****************************************************************************/
 static const EXP_DEF Expander_init_buf[] =
 {
@@ -258,6 +267,11 @@ unsigned char new_jumpers = 0;
  *
  *  function:   read the jumpers and place the result in the
  *              global variable enable_jumpers
+ *              The reading (plus JMP_DEBUG) is also kept in jumper_now,
+ *              jumper_seq counting the changes, for readers that want to
+ *              see one without another I2C read.  Verifying is done once a
+ *              second (doSeconds()); the jumpers change about never, and
+ *              a change is logged (EVJUMPERS).
  *
  *  input:  flag    if 0, initial/reset, just read and set
  *                  if 1, verify against previous
@@ -267,6 +281,7 @@ unsigned char new_jumpers = 0;
 void read_jumpers(char flag)
 {
 unsigned char  new_jumpers;
+unsigned int   snap;
 
   /* Read the DEBUG jumper. This jumper is read dynamically and allowed to
      change on the fly; in theory any other jumper that changes value while
@@ -280,6 +295,26 @@ unsigned char  new_jumpers;
   }
   new_jumpers = fetch_jumpers(); 
  // last_routine = 0x5E;
+  snap = (unsigned int)new_jumpers;
+  if (DEBUG_IN == 0)
+  {
+    snap |= JMP_DEBUG;
+  }
+  if ((flag == 0) || (snap != jumper_now))
+  {
+    if (flag)                       /* Changed while running? */
+    {                               /* Yes, log it */
+      EVI_JUMPERS info;
+
+      memset (&info, 0, sizeof(info));
+      info.Was = jumper_now;
+      info.Now = snap;
+      info.Latched = enable_jumpers;
+      nvLogRepeat (EVJUMPERS, 0, (const char *)&info, (unsigned long)60);
+    }
+    jumper_now = snap;
+    jumper_seq++;                   /* New snapshot */
+  }
   if (DEBUG_IN == 1) /* DEBUG jumper in place (0 = jumper)? */
   {                                 /* No */
     StatusA &= ~STSA_DEBUG;         /* Note DEBUG jumper "OFF" */
@@ -362,6 +397,74 @@ unsigned char  new_jumpers;
     /* 8-Compartment, 8.2-Volt, and 100-Ohm Ground are intuited elsewhere... */
 } /* End of read_jumpers() */
 
+/*************************************************************************
+ *  subroutine:      latch_line_jumpers()
+ *
+ *  function:   Read the ModBus line jumpers (address, baud, parity and
+ *              character size), resistor networks behind the analog mux,
+ *              and keep the millivolts for line_jumper_mv().  Called once
+ *              at power up, before the probe scan runs: read_muxADC()
+ *              stops T3/DMA for each reading.
+ *
+ *  input:  none
+ *  output: none
+ *
+ *************************************************************************/
+
+static const struct
+{
+  unsigned char chan;                   /* Analog input */
+  SET_MUX       mux;                    /* MUX channel */
+} line_tap[LJ_TAPS] =
+{
+  { 1, M_ADDR },                        /* LJ_ADDR10 */
+  { 0, M_ADDR },                        /* LJ_ADDR1 */
+  { 1, M_PARITY },                      /* LJ_BAUD */
+  { 0, M_PARITY },                      /* LJ_PARITY */
+  { 1, M_GND_7_8 }                      /* LJ_CSIZE */
+};
+
+static unsigned int  line_mv[LJ_TAPS];  /* As latched */
+static unsigned char line_ok;           /* Bit per tap read */
+
+void latch_line_jumpers(void)
+{
+unsigned char i;
+
+  line_ok = 0;
+  for (i = 0; i < LJ_TAPS; i++)
+  {
+    if (read_muxADC (line_tap[i].chan, line_tap[i].mux, &line_mv[i]))
+    {
+      line_ok |= (unsigned char)(1 << i);
+    }
+  }
+} /* End latch_line_jumpers() */
+
+/*************************************************************************
+ *  subroutine:      line_jumper_mv()
+ *
+ *  function:   Return a ModBus line jumper reading as latched at power
+ *              up (latch_line_jumpers()), from RAM
+ *
+ *  input:  tap (LJ_xxx), pointer to result storage
+ *  output: status TRUE if the tap was read, FALSE if not
+ *
+ *************************************************************************/
+char line_jumper_mv
+    (
+    unsigned char tap,                  /* LJ_xxx */
+    unsigned int *retval                /* Millivolts */
+    )
+{
+  if ((tap >= LJ_TAPS) || !(line_ok & (1 << tap)))
+  {
+    return FALSE;
+  }
+  *retval = line_mv[tap];
+  return TRUE;
+} /* End line_jumper_mv() */
+
 /*************************************************************************
  *  subroutine: volts_jumper
  *
@@ -59,6 +59,17 @@
  *                        Restored the SysParm.ADCTmaxNV value to original.
  * 1.6.35  01/07/17  DHP  Increased the wait time in check_bk() due to a missed
  *                         message when a 5-wire vehicle was connected.
+ * 1.6.38  10/19/26  AGT  Added Init_Timer5() and the SysParm ModBus baud
+ *                         override ahead of starting ModBus service.
+ *                        doSeconds() advances the time through time_tick().
+ *                        Main loop ends each pass with mbrJournalScan().
+ *                        Power up takes the journal epoch (mbrJournalInit()).
+ *                        Jumpers are verified once a second from doSeconds()
+ *                         rather than by an I2C read every main loop pass.
+ *                        Main loop converts the queued T3 probe scans
+ *                         (probe_drain()) ahead of main_activity().
+ *                        clrinfo() clears the size of the block it is given;
+ *                         the EVI_* blocks are all 22 bytes only on the chip.
  ******************************************************************************/
 #include "common.h"
 #include "evlog.h"
@@ -113,7 +124,7 @@ static void log_err_reset(void);
 static const BK_ERROR *bk_error;
 static int send_bk_status;
 static int bk_retry;
-static void clrinfo(char *info);
+static void clrinfo(char *info, unsigned int size);
 static void doEighths(void);
 static void doSeconds(void);
 static char lastEighths;        /* Local 125-millisecond trigger */
@@ -454,6 +465,7 @@ int __attribute__((__section__(".user_start"))) main (void)
   Init_32bit_Timer();     /* Init 32 bit timer */
   Init_Timer3();
   Init_Timer4();
+  Init_Timer5();            /* ModBus t1.5/t3.5 timer */
 
   service_charge();       /* Appease watchdog */
 
@@ -590,6 +602,7 @@ int __attribute__((__section__(".user_start"))) main (void)
                                       /* Reference, open voltages and 6/8 compartment */
                                       /* jumpers, raw, bias, noise voltages, 10/20 voltage */
                                       /* Ground R/Diode, LED Panel, Enable Jumpers */
+  mbrJournalInit();             /* Change journal epoch, from the clock */
   
   show_revision();
   
@@ -644,6 +657,7 @@ int __attribute__((__section__(".user_start"))) main (void)
 
   if (modbus_addr != 0)
   {
+     modbus_baud_override();          /* SysParm baud in place of jumper */
      modbus_init();                   /* Initialize ModBus service */
      clear_tx2en();
   }
@@ -717,7 +731,6 @@ int __attribute__((__section__(".user_start"))) main (void)
     main_charge();                  /* Drive (toggle) the charge pump */
                                     /*  for the main permit relay */
     permit_relay();                 /* Drive main permit relay as needed */
-    read_jumpers(1);                /* Read and verify enable jumpers */
     service_charge();               /* Appease watchdog */
 
     modbus_execloop_process();      /* Serial (RS-485) Input */
@@ -730,6 +743,7 @@ int __attribute__((__section__(".user_start"))) main (void)
      /* Main dispatch to either truck-servicing operations, or instead to
         drive any "Special" operations in effect. */
     service_charge();               /* Appease watchdog */
+    probe_drain();                  /* Convert the queued T3 probe scans */
     if (StatusB & STSB_SPECIAL)     /* "Normal" or "Special" mode? */
     {
       SpecialOps();                 /* Special -- check special operations */
@@ -739,6 +753,7 @@ int __attribute__((__section__(".user_start"))) main (void)
       service_charge();             /* Appease watchdog */
       main_activity();              /* Normal --  service trucks */
     }
+    mbrJournalScan();               /* Note what changed this pass */
     
   } /* End main Loop Level while/loop forever */
       /* check if time to update LCD with TOD data */
@@ -1053,7 +1068,8 @@ int loop = 1;
     /**** Once-per-Second processing *****/
     /*************************************/
 
-    present_time++;                              /* Advance system Time-Of-Day */
+    time_tick();                                 /* Advance system Time-Of-Day */
+    read_jumpers(1);                             /* Read and verify enable jumpers */
 
     /* If we are in a fault state for more than 53 (or so) seconds, then
        force a RESET condition and hope that will clear it up. This should
@@ -1110,10 +1126,11 @@ int loop = 1;
 * clrinfo() -- helper to initialize (clear) the various "info" blocks
 **************************************************************************/
 
-static void clrinfo(char * info)  /* Pointer to 22-byte E2LOGREC.Info block */
+static void clrinfo(char * info,   /* Pointer to an E2LOGREC.Info block */
+                    unsigned int size)  /* Its sizeof */
 {
   // last_routine = 0x6;
-  memset (info, 0x00, sizeof(EVI_RESET)); /* All EVI_* same size */
+  memset (info, 0x00, size);
 }
 
 /**************************************************************************
@@ -1134,7 +1151,7 @@ void logcrcerr ()
   // last_routine = 0x7;
 
   printf("\n\r    Logging CRC error: Shell Good: 0x%X  Bad: 0x%X\n\r", Good_Shell_CRC_val, ShellCRCval);
-  clrinfo ((char *)&info);            /* Clear out info block */
+  clrinfo ((char *)&info, sizeof(info)); /* Clear out info block */
 
   info.KernelGood = Good_KernelCRCval;  /* Good Kernel CRC-16 value */
   info.KernelReal = KernelCRCval;       /* Actual Kernel CRC-16 value */
@@ -1157,7 +1174,7 @@ void logEEPROM ()
   EVI_HDW_EEPROM info;
 
   printf("\n\r    Logging EEPROM error: EE_status: 0x%X\n\r", EE_status);
-  clrinfo ((char *)&info);            /* Clear out info block */
+  clrinfo ((char *)&info, sizeof(info)); /* Clear out info block */
 
   info.EE_status = EE_status;
   info.StatusA = StatusA;
@@ -1210,7 +1227,7 @@ EVI_INIT   info;            /* Event log data buffer */
 unsigned int *info_ptr;
 
     printf("\n\r    Logging EEPROM erase and Init\n\r");
-    clrinfo ((char *)&info);            /* Clear out info block */
+    clrinfo ((char *)&info, sizeof(info)); /* Clear out info block */
   // last_routine = 0x9;
 
     /* Fill in the Info buffer with our configuration information */
@@ -1246,7 +1263,7 @@ void logrelayerr ()
     EVI_HDW_RELAY info;
 
     printf("\n\r    Logging Relay Error: Backup: 0x%X    Main: 0x%X\n\r", BackRelaySt, MainRelaySt);
-    clrinfo ((char *)&info);            /* Clear out info block */
+    clrinfo ((char *)&info, sizeof(info)); /* Clear out info block */
 
   // last_routine = 0xA;
     info.BackupSt = BackRelaySt;        /* Log backup relay state */
@@ -1272,7 +1289,7 @@ EVI_RESET   info;           /* Event log data buffer */
 unsigned char rsr = 0;
 unsigned int *info_ptr;
 
-    clrinfo ((char *)&info);            /* Clear out info block */
+    clrinfo ((char *)&info, sizeof(info)); /* Clear out info block */
 
     printf("\n\r    Logging Reset\n\r");
   // last_routine = 0xB;
@@ -20,6 +20,7 @@
  *  --------   --------    ---   --------------------------------------------
  *  1.5.23     04/18/12    KLL   Changed the test memory area due to more memory is
  *                                 used by the C compiler.
+ *  1.6.38     10/19/26    AGT   error_address casts test_ptr through size_t.
  *
  *****************************************************************************/
 
@@ -78,7 +79,7 @@ register unsigned int i, test_data;
       {
         error_good_data = test_data;
         error_bad_data = *test_ptr;
-        error_address = (unsigned int)test_ptr;
+        error_address = (unsigned int)(size_t)test_ptr;
         return FAILED;
       }
       *test_ptr = ~test_data;  /* Write complement data */
@@ -93,7 +94,7 @@ register unsigned int i, test_data;
       {
         error_good_data = ~test_data;
         error_bad_data = *test_ptr;
-        error_address = (unsigned int)test_ptr;
+        error_address = (unsigned int)(size_t)test_ptr;
         return FAILED;
       }
       *test_ptr = test_data;  /* Put back original data */
@@ -23,6 +23,20 @@
  *
  * 1.5.27   03/25/14  DHP  Deleted commented out code, corrected comments
  * 1.5.31  01/14/15  DHP  Added increment of bufptr in program_memory_CRC()
+ * 1.6.38  10/19/26  AGT  End-of-message is now timed by Timer 5 from the last
+ *                          received character (exact t3.5, 1.75 ms above 19200)
+ *                          instead of the 1 ms mstimer; a gap over t1.5 inside
+ *                          a frame discards it.  Added 38400/57600/115200 and
+ *                          modbus_baud_override() for SysParm.ModBusBaud.
+ *                        Responses are sent by DMA1 (modbus_tx_start()) rather
+ *                          than a main loop byte loop that spun on TRMT.
+ *                        get_modbus_baud() defaults jumper positions that are
+ *                          not baud rates (0-2, 8, 9) to 9600.
+ *                        A transmit stuck over 1 second counts in
+ *                          modbus_tx_timeout, not modbus_Recv_err.
+ *                        get_modbus_addr/baud/parity/csize() take the jumpers
+ *                          from line_jumper_mv(), latched at power up, rather
+ *                          than each doing a read_muxADC().
  *
  *********************************************************************************************/
 #include "common.h"
@@ -52,11 +66,11 @@ char sts;
        just use address "0" (ASCII debug output) as that would "jam" any
        working ModBus network to which we might be connected!) */
 
-    sts = read_muxADC (1, M_ADDR, &volts); /* Read "Tens" address jumper */
+    sts = line_jumper_mv (LJ_ADDR10, &volts); /* Read "Tens" address jumper */
     if (sts)
         {
         addr = 10 * volts_jumper (volts); /* "Convert to decimal" */
-        sts = read_muxADC (0, M_ADDR, &volts); /* Read "Ones" address */
+        sts = line_jumper_mv (LJ_ADDR1, &volts); /* Read "Ones" address */
         if (sts)
             {
             addr += volts_jumper(volts); /* "Convert to decimal" */
@@ -94,13 +108,17 @@ unsigned char    get_modbus_baud(void)
     unsigned baud;
     char sts;
 
-    sts = read_muxADC (1, M_PARITY, &volts); /* Read "Baud Rate" jumper */
+    sts = line_jumper_mv (LJ_BAUD, &volts); /* Read "Baud Rate" jumper */
     if (!sts)
         {
         return(6);        /* Default 9600 */
         }
 
     baud = (unsigned int)volts_jumper (volts);        /* Convert to integer/raw-index */
+    if ((baud < B01200) || (baud > B19200))
+        {
+        return(6);        /* Not a baud position, default 9600 */
+        }
 
     /* The ModBus/Comm parity/baud/size jumpers share a single 0-9 jumper
        block:
@@ -109,7 +127,8 @@ unsigned char    get_modbus_baud(void)
            3/4/5/6/7    1200/2400/4800/9600/19200 baud rate
            8/9          7/8 data bits
 
-       For baud rate, just return the raw index into 10-word table */
+       For baud rate, just return the raw index into the BAUD_RATE tables.
+       The faster rates are only set through SysParm.ModBusBaud. */
 
     return ((unsigned char)baud);                      /* Return resultant baud index */
 
@@ -134,7 +153,7 @@ unsigned char get_modbus_parity(void)
     unsigned parity;
     char sts;
 
-    sts = read_muxADC (0, M_PARITY, &volts); /* Read "Parity" jumper */
+    sts = line_jumper_mv (LJ_PARITY, &volts); /* Read "Parity" jumper */
     if (!sts)
         {
         return 0;         /* No parity */
@@ -178,7 +197,7 @@ unsigned char get_modbus_csize(void)
     unsigned csize;
     char sts;
 
-    sts = read_muxADC (1, M_GND_7_8, &volts); /* Read "7/8" jumper */
+    sts = line_jumper_mv (LJ_CSIZE, &volts); /* Read "7/8" jumper */
     if (!sts)
         {
         volts = 0;
@@ -208,21 +227,70 @@ unsigned char get_modbus_csize(void)
             M O D B U S _ I N I T ( )
 **************************************************************************/
 
-static const char eomtimtbl[10] =
+/* Timer 5 runs at FCY/64 (3.2 us).  A character is 11 bits, so t3.5 is
+   38.5 and t1.5 16.5 bit times; above 19200 baud the spec fixes them at
+   1750 and 750 us.  Timer 5 restarts as each character is received, so
+   the next character's receive interrupt comes one character time
+   (CHAR_US) after the end of the gap: the t1.5 check adds that in. */
+
+#define T5_TICKS(us)    (unsigned short)(((unsigned long)(us) * (FCY / 1000000UL)) / 64UL)
+#define T35_US(baud)    (38500000UL / (baud))
+#define T15_US(baud)    (16500000UL / (baud))
+#define CHAR_US(baud)   (11000000UL / (baud))
+
+static const unsigned short eomtimtbl[B115200 + 1] =
 {
-     0,                         /* 00  Reserved (no parity) */
-     0,                         /* 01  Reserved (odd parity) */
-     0,                         /* 02  Reserved (even parity) */
-    29,                         /* 03   1200 baud */
-    15,                         /* 04   2400 baud */
-     7,                         /* 05   4800 baud */
-     4,                         /* 06   9600 baud */
-     3,                         /* 07  19200 baud */
-//   2,                         /* 08  38400 baud */
-     0,                         /* 08  Reserved (7-bit char) */
-     0                          /* 09  Reserved (8-bit char) */
+    0,                          /* 00  Reserved (no parity) */
+    0,                          /* 01  Reserved (odd parity) */
+    0,                          /* 02  Reserved (even parity) */
+    T5_TICKS(T35_US(1200)),     /* 03   1200 baud */
+    T5_TICKS(T35_US(2400)),     /* 04   2400 baud */
+    T5_TICKS(T35_US(4800)),     /* 05   4800 baud */
+    T5_TICKS(T35_US(9600)),     /* 06   9600 baud */
+    T5_TICKS(T35_US(19200)),    /* 07  19200 baud */
+    T5_TICKS(1750),             /* 08  38400 baud */
+    T5_TICKS(1750),             /* 09  57600 baud */
+    T5_TICKS(1750)              /* 10 115200 baud */
     };
 
+static const unsigned short t15timtbl[B115200 + 1] =
+{
+    0,                          /* 00  Reserved (no parity) */
+    0,                          /* 01  Reserved (odd parity) */
+    0,                          /* 02  Reserved (even parity) */
+    T5_TICKS(T15_US(1200) + CHAR_US(1200)),     /* 03   1200 baud */
+    T5_TICKS(T15_US(2400) + CHAR_US(2400)),     /* 04   2400 baud */
+    T5_TICKS(T15_US(4800) + CHAR_US(4800)),     /* 05   4800 baud */
+    T5_TICKS(T15_US(9600) + CHAR_US(9600)),     /* 06   9600 baud */
+    T5_TICKS(T15_US(19200) + CHAR_US(19200)),   /* 07  19200 baud */
+    T5_TICKS(750 + CHAR_US(38400)),             /* 08  38400 baud */
+    T5_TICKS(750 + CHAR_US(57600)),             /* 09  57600 baud */
+    T5_TICKS(750 + CHAR_US(115200))             /* 10 115200 baud */
+    };
+
+/*************************************************************************
+ *  subroutine:      modbus_baud_override()
+ *
+ *  function:
+ *         If SysParm.ModBusBaud holds a valid BAUD_RATE, use it in place
+ *         of the jumper setting and restart UART2 at that rate.  Called
+ *         once the System parameters are loaded, before ModBus service
+ *         starts; a register write takes effect at the next reset.
+ *
+ *  input:  none
+ *  output: none
+ *************************************************************************/
+
+void modbus_baud_override(void)
+{
+   if ((SysParm.ModBusBaud >= B01200) && (SysParm.ModBusBaud <= B115200)
+       && (SysParm.ModBusBaud != modbus_baud))
+   {
+      modbus_baud = SysParm.ModBusBaud;
+      UART2Init();
+   }
+}    /* End of modbus_baud_override */
+
 void modbus_init(void)
 {
    unsigned char * ptr;
@@ -238,7 +306,17 @@ void modbus_init(void)
    modbus_tx_len  = 0;
    modbus_tx_ptr  = modbus_tx_buff;
 
-   modbus_eom_time = (unsigned short)((unsigned char)eomtimtbl[modbus_baud]);
+   modbus_eom_time = eomtimtbl[modbus_baud];
+   modbus_t15_time = t15timtbl[modbus_baud];
+
+   /* Restart the t3.5 timer: the line must be idle that long before the
+      next character can start a message */
+   T5CONbits.TON = 0;
+   PR5 = modbus_eom_time;
+   TMR5 = 0;
+   modbus_eom = FALSE;
+   IFS1bits.T5IF = 0;
+   T5CONbits.TON = 1;
 
    for (ptr = modbus_tx_buff; ptr < (modbus_tx_buff + MODBUS_MAX_LEN); ptr++)
       *ptr = 0;
@@ -268,10 +346,7 @@ unsigned int i;
            byte we see is potentially the start of the next message, that
            might be addressed to us. */
 
-        delta_time = DeltaMsTimer (modbus_rx_time);
-  // last_routine = 0x61;
-
-        if (delta_time > modbus_eom_time)
+        if (modbus_eom)                 /* Timer 5 saw t3.5 of idle line */
         {
             modbus_state = (unsigned char)RECV;
         }
@@ -303,14 +378,10 @@ unsigned int i;
         send_char |= 0xA000;
 
         /* Actively receiving characters. If 3.5 character times have elapsed
-           since last character, then we have EOM and need to process the
-           just-received message */
+           since last character (Timer 5 expired), then we have EOM and need
+           to process the just-received message */
 
-
-        delta_time = DeltaMsTimer (modbus_rx_time);
-  // last_routine = 0x61;
-
-        if (delta_time > modbus_eom_time)
+        if (modbus_eom)
         {                           /* End-Of-Message! */
           send_char |= 0x0A00;
           if ((modbus_rx_buff[0] == modbus_addr)  /* Address to us? */
@@ -374,8 +445,7 @@ unsigned int i;
   // last_routine = 0x61;
                 if (delta_time > SysParm.ModBusRespWait)
                 {       /* OK to start response */
-                  modbus_state = (unsigned char)XMITMSG;
-                  set_tx2_en ();    /* Trigger xmit ISR */
+                  modbus_tx_start ();   /* DMA1 sends the response */
                 }
                 else
                 {       /* Must wait for line turnaround */
@@ -418,33 +488,19 @@ unsigned int i;
         if (delta_time > SysParm.ModBusRespWait)
         {
           send_char |= 0x50;
-          modbus_state = (unsigned char)XMITMSG;
-          set_tx2_en();
+          modbus_tx_start();
         }
       }
         break;
 
       case XMITMSG:
-      {
-        int index;
-        for ( index=0; index<modbus_tx_len; index++)
-        {
-          while (U2STAbits.UTXBF == 1) ;    /* Wait for room for at least one character */
-          U2TXREG = *(modbus_tx_ptr++);
-        }
-        while(U2STAbits.TRMT == 0) {} /* Wait for transmit shift register to empty */
-        modbus_state = (unsigned char)RESETMSG;
-        /* DHP  The following Block added to prevent host collisions */
+        /* DMA1 and the UART2 TX interrupt send the response and return us
+           to RESETMSG; only step in if the transmit never completes. */
+        if (DeltaMsTimer (modbus_tx_time) > SEC1)
         {
-          U2STAbits.UTXEN = 0;            /* To force Int when set in set_tx2_en() */
-          IEC1bits.U2TXIE = 0;
-          IFS1bits.U2TXIF = 0;
-          TXEN = 0;                       /* Disable transmit at board level */
-          flush_uart2();                  /* Remove any received characters */
-          IFS1bits.U2RXIF = 0;
-          IEC1bits.U2RXIE = 1;            /* Now ready for receive */
+          modbus_tx_timeout++;
+          modbus_tx_release();
         }
-      }
         break;
 
       case RESETMSG:
@@ -23,6 +23,25 @@
  * 1.5.27   03/25/14 DHP  Deleted commented out code, corrected comments.
  *                                       Added code in mbcRdTruckIDs() to reject zero a count
  *                                        command and read current truck with count other than 1.
+ * 1.6.38   10/19/26 AGT   Added function 0x5E to read out the binary trace ring.
+ *                         Added function 0x5F to arm/trigger/read the probe waveform capture.
+ *                         Added function 0x60 to stage an update image in the SPI module.
+ *                         Added function 0x61 to read the per-connection Session Records.
+ *                         TIM area functions hold IEC0 through the hal.h macros.
+ *                         Added function 0x62 to time the hot routines on the unit.
+ *                         Added function 0x63 to read the live unit state as one
+ *                           versioned snapshot.
+ *                         Added functions 0x64 and 0x65 to read the change journal;
+ *                           both replies carry the boot epoch.
+ *                         Added function 0x66, filtered multi-record Event Log query.
+ *                         The slot (index) Truck ID functions 0x41/0x42/0x46/0x47/
+ *                           0x4A are refused in the packed Truck ID format; added
+ *                           function 0x67 to read it by sorted position.
+ *                         Function 0x62 times a full nvTrkFind() each call, not
+ *                           the answer remembered from the first.
+ *                         0x41/0x42/0x46/0x47/0x4A work in the packed format
+ *                           again, the index being the sorted position; 0x67
+ *                           is kept as another name for 0x47.
  *
  ****************************************************************************/
 
@@ -958,6 +977,8 @@ static MODBSTS mbcInsertTruckID (void)
   {                               /* Yes */
     return (MB_EXC_MEM_PAR_ERR);    /* Needs fleshing out */                                      /* E.g., index out of range, etc. */
   }
+  if (nvTrkPacked ())                 /* Return where it sorted to */
+    (void)nvTrkRank (ptr, (word *)&index);
 
   val_state = 0;                      /* Re-Authorize active truck as needed */
 
@@ -1301,14 +1322,20 @@ static MODBSTS mbcWrTruckIDs (void)
 
 /*************************************************************************
 * mbcRdTruckIDs  --  Function 0x47: Read Truck IDs from EEPROM
+* mbcRdSortedIDs --  Function 0x67: Read Truck IDs by sorted position
 *
 * Call is:
 *
 *      mbcRdTruckIDs ()
+*      mbcRdSortedIDs ()
 *
 * mbcRdTruckIDs() reads one or more Truck Identification code or Serial
 * Numbers from the Intellitrol/VIP Authorization List (in EEPROM).
 *
+* mbcRdSortedIDs() is the same message under the name it was given for
+* the packed Truck ID format, where the index (in both) is the position
+* in sorted order rather than a slot, see nvtruck.c.
+*
 * Return value is the ModBus Exception code ("Success" meaning that the
 * olen/orsp buffer is filled in and ready to be transmitted to the ModBus
 * master).
@@ -1388,6 +1415,11 @@ static MODBSTS mbcRdTruckIDs (void)
 
 } /* End of mbcRdTruckIDs() */
 
+static MODBSTS mbcRdSortedIDs (void)
+{
+    return (mbcRdTruckIDs ());
+}
+
 /*************************************************************************
 * mbcVrTruckIDs  --  Function 0x4A: Verify (CRC) Truck IDs from EEPROM
 *
@@ -1535,6 +1567,789 @@ static MODBSTS mbcRdTrlLog (void)
 
 } /* End of mbcRdTrlLog() */
 
+/*************************************************************************
+* mbcLogQuery  --  Function 0x66: Read Event Log records matching a filter
+*
+* Call is:
+*
+*      mbcLogQuery ()
+*
+* The request is:
+*
+*      mode    byte    0 = start at an entry index, 1 = start at a time
+*      start   long    entry index, or UCT time (oldest entry at or after)
+*      mask    int     Event Types wanted, bit n = Type n (0xFFFF = all)
+*      max     byte    records wanted (1 - LOGQ_MAX)
+*
+* Entries are searched from "start" towards the newest, using the RAM Type
+* index so that only the matching records are read from EEPROM.  The
+* response is the count of records, then the cursor (the index to give as
+* "start", mode 0, to continue; 0xFFFF once the newest entry has been
+* searched), then for each record its index (int) and the 32-byte E2LOGREC
+* as function 0x49 returns it.  At most LOGQ_SCAN entries are searched per
+* request, so a reply can hold no records yet not be done.
+*
+* Return value is the ModBus Exception code.
+*
+*************************************************************************/
+
+#define LOGQ_MAX        2               /* 3 + 2 * 34 fits MODBUS_MAX_DATA */
+#define LOGQ_SCAN       256             /* Entries searched per request */
+
+static MODBSTS mbcLogQuery (void)
+{
+    unsigned char buf[LOGQ_MAX * (2 + sizeof(E2LOGREC))];
+    unsigned char *ptr;
+    unsigned char mode;         /* Start at index or time */
+    unsigned int hi, lo;        /* "start" halves */
+    unsigned int mask;          /* Event Types wanted */
+    unsigned char max;          /* Records wanted */
+    unsigned char count;        /* Records returned */
+    unsigned char type;
+    unsigned int index;         /* Entry being searched */
+    unsigned int left;          /* Entries up to the newest */
+    unsigned int scan;          /* Entries searched this request */
+    MODBSTS sts;                /* Local status */
+
+    sts = mbcGetByte (&mode);
+    if (sts == MB_OK)
+    {
+        sts = mbcGetInt (&hi);
+    }
+    if (sts == MB_OK)
+    {
+        sts = mbcGetInt (&lo);
+    }
+    if (sts == MB_OK)
+    {
+        sts = mbcGetInt (&mask);
+    }
+    if (sts == MB_OK)
+    {
+        sts = mbcGetByte (&max);
+    }
+    if (sts)
+    {
+        return (sts);
+    }
+    /* Message should now be empty */
+    if (getcnt)
+    {
+        return (MB_EXC_ILL_FUNC);       /* Malformed message */
+    }
+    if ((mode > 1) || (max == 0) || (max > LOGQ_MAX))
+    {
+        return (MB_EXC_ILL_DATA);
+    }
+    if (evMax == 0)
+    {
+        return (MB_EXC_MEM_PAR_ERR);    /* No Event Log */
+    }
+    if (mode == 0)
+    {
+        if ((hi != 0) || (lo >= evMax))
+        {
+            return (MB_EXC_ILL_ADDR);   /* Event Number out of range */
+        }
+        index = lo;
+    }
+    else
+    {
+        index = nvLogAtTime (((unsigned long)hi << 16) | lo);
+    }
+
+    /* Entries from "index" up to and including the newest (evIndex - 1) */
+
+    if (index == 0xFFFF)
+    {
+        left = 0;                       /* Nothing that recent */
+    }
+    else if (index == evIndex)
+    {
+        left = evMax;                   /* From the oldest, wrapped log */
+    }
+    else
+    {
+        left = (unsigned int)(((unsigned long)evIndex + evMax - index) % evMax);
+    }
+    ptr = buf;
+    count = 0;
+    for (scan = 0; left && (count < max) && (scan < LOGQ_SCAN); scan++)
+    {
+        type = nvLogType (index);
+        if ((type != 0xFF)
+            && ((mask == 0xFFFF) || ((type < 16) && (mask & (1 << type)))))
+        {
+            *ptr++ = (unsigned char)(index >> 8);
+            *ptr++ = (unsigned char)index;
+            if (nvLogGet (ptr, index))
+            {
+                return (MB_EXC_MEM_PAR_ERR);
+            }
+            ptr += sizeof(E2LOGREC);
+            evLastRead = index;         /* Remember "read"/expired entries */
+            count++;
+        }
+        left--;
+        if (++index >= evMax)
+        {
+            index = 0;
+        }
+        service_charge ();              /* Keep Service LED off */
+    }
+    sts = mbcPutByte (count);
+    if (sts == MB_OK)
+    {
+        sts = mbcPutInt (left ? index : 0xFFFF);
+    }
+    if (sts)
+    {
+        return (sts);
+    }
+    return (mbcPutNString ((char)(ptr - buf), buf));
+
+} /* End of mbcLogQuery() */
+
+/*************************************************************************
+* mbcRdTrace  --  Function 0x5E: Read Binary Trace Records
+*
+* Call is:
+*
+*      mbcRdTrace ()
+*
+* mbcRdTrace() returns (and releases) up to the requested number of the
+* oldest unread trace records logged by xprintf()/trace_put().  The
+* request is one byte: the maximum record count (1 - 8).  The response is
+* the record count actually returned, the number of records lost to
+* overwrite since the last read (16 bits), then 8 bytes per record:
+* message number, context (interrupt priority, 0 = main loop), 16-bit ms
+* stamp, parameter 1 and parameter 2.  The message numbers are those of
+* the printout.c debug texts.
+*
+* Return value is the ModBus Exception code.
+*
+*************************************************************************/
+
+#define TRACE_READ_MAX  8               /* 3 + 8 * 8 fits MODBUS_MAX_DATA */
+
+static MODBSTS mbcRdTrace (void)
+{
+    unsigned char buf[TRACE_READ_MAX * 8];
+    unsigned char max;          /* Records requested */
+    unsigned char count;        /* Records returned */
+    unsigned int lost;          /* Records overwritten unread */
+    MODBSTS sts;                /* Local status */
+
+    sts = mbcGetByte (&max);            /* Extract record count wanted */
+    if (sts)
+    {
+        return (sts);
+    }
+    /* Message should now be empty */
+    if (getcnt)
+    {
+        return (MB_EXC_ILL_FUNC);       /* Malformed message */
+    }
+    if ((max == 0) || (max > TRACE_READ_MAX))
+    {
+        return (MB_EXC_ILL_DATA);
+    }
+    count = trace_get (buf, max, &lost);
+    sts = mbcPutByte (count);
+    if (sts)
+    {
+        return (sts);
+    }
+    sts = mbcPutInt (lost);
+    if (sts)
+    {
+        return (sts);
+    }
+    return (mbcPutNString ((char)(count * 8), buf));
+
+} /* End of mbcRdTrace() */
+
+/*************************************************************************
+* mbcCapture  --  Function 0x5F: Probe Waveform Capture
+*
+* Call is:
+*
+*      mbcCapture ()
+*
+* The first request byte selects the operation:
+*
+*      0   Status only
+*      1   Arm: next byte is the CAP_TRIG_ mask (0 turns the capture off)
+*      2   Manual trigger
+*      3   Read: next bytes are channel (0 - 7) and first scan (0 - 63)
+*
+* Every response starts with the 7 byte status block (state, trigger mask,
+* cause, scans held, post-trigger scans, 16-bit trigger ms stamp).  A read
+* adds channel, first scan, scans returned and byte count followed by the
+* delta-encoded samples (see capture_read() in adc.c); the master repeats
+* the read from (first + returned) until all held scans are fetched.
+*
+* Return value is the ModBus Exception code.
+*
+*************************************************************************/
+
+#define CAP_READ_MAX    60              /* 2 + 7 + 4 + 60 fits MODBUS_MAX_DATA */
+
+static MODBSTS mbcCapture (void)
+{
+    unsigned char buf[CAP_READ_MAX];
+    unsigned char op;           /* Requested operation */
+    unsigned char chan = 0;     /* Channel to read */
+    unsigned char start = 0;    /* First scan to read */
+    unsigned char count;        /* Scans encoded */
+    unsigned char len;          /* Encoded byte count */
+    MODBSTS sts;                /* Local status */
+
+    sts = mbcGetByte (&op);
+    if (sts)
+    {
+        return (sts);
+    }
+    if (op == 1)
+    {
+        sts = mbcGetByte (&chan);       /* Trigger mask */
+    }
+    else if (op == 3)
+    {
+        sts = mbcGetByte (&chan);
+        if (sts == MB_OK)
+        {
+            sts = mbcGetByte (&start);
+        }
+    }
+    else if (op > 3)
+    {
+        return (MB_EXC_ILL_DATA);
+    }
+    if (sts)
+    {
+        return (sts);
+    }
+    /* Message should now be empty */
+    if (getcnt)
+    {
+        return (MB_EXC_ILL_FUNC);       /* Malformed message */
+    }
+    if ((op == 3) && ((chan >= MAX_CHAN) || (start >= CAP_DEPTH)))
+    {
+        return (MB_EXC_ILL_ADDR);
+    }
+    if (op == 1)
+    {
+        capture_arm (chan);
+    }
+    else if (op == 2)
+    {
+        capture_trigger (CAP_TRIG_MANUAL);
+    }
+    len = capture_status (buf);
+    sts = mbcPutNString ((char)len, buf);
+    if (sts || (op != 3))
+    {
+        return (sts);
+    }
+    len = capture_read (chan, start, buf, CAP_READ_MAX, &count);
+    sts = mbcPutByte (chan);
+    if (sts == MB_OK)
+    {
+        sts = mbcPutByte (start);
+    }
+    if (sts == MB_OK)
+    {
+        sts = mbcPutByte (count);
+    }
+    if (sts == MB_OK)
+    {
+        sts = mbcPutByte (len);
+    }
+    if (sts == MB_OK)
+    {
+        sts = mbcPutNString ((char)len, buf);
+    }
+    return (sts);
+
+} /* End of mbcCapture() */
+
+/*************************************************************************
+* mbcUpdImage  --  Function 0x60: Stage an update image in the SPI module
+*
+* Call is:
+*
+*      mbcUpdImage ()
+*
+* The first request byte selects the operation:
+*
+*      0   Status: where to resume
+*      1   Restart: begin a new image at offset 0
+*      2   Write: 32-bit offset (two ints, high first) then 1 - UPD_WINDOW_MAX
+*          image bytes; the offset must be the one last reported
+*      3   Finish: 32-bit image byte count, then the 8 byte loader header
+*          (byte count and checksum, as the loader expects them)
+*
+* Every response is the operation byte followed by the 32-bit offset the
+* next write must use; Finish adds the CRC-16 of the staged image as read
+* back from the module. See spi_stage_write() in spi_eeprom.c.
+*
+* Since page programming and sector erases (while mostly overlapped with
+* ModBus traffic) hold up the main loop, this is allowed only while idle.
+*
+* Return value is the ModBus Exception code.
+*
+*************************************************************************/
+
+#define UPD_WINDOW_MAX  64              /* 1 + 4 + 64 fits MODBUS_MAX_DATA */
+
+static MODBSTS mbcUpdImage (void)
+{
+    unsigned char hdr[8];       /* Finish: loader header */
+    unsigned char op;           /* Requested operation */
+    unsigned int hi;            /* Offset/count, high half */
+    unsigned int lo;            /* Offset/count, low half */
+    unsigned long next;         /* Resume offset */
+    unsigned short crc = 0;     /* Finish: image CRC-16 */
+    unsigned char i;
+    int ssts;                   /* spi_stage_*() status */
+    MODBSTS sts;                /* Local status */
+
+    if (main_state != IDLE)             /* Sittin' idle? */
+    {
+        return (MB_EXC_BUSY);           /* No, tell 'im to try later */
+    }
+    sts = mbcGetByte (&op);
+    if (sts)
+    {
+        return (sts);
+    }
+    if (op > 3)
+    {
+        return (MB_EXC_ILL_DATA);
+    }
+    if (op >= 2)                        /* Offset or byte count */
+    {
+        sts = mbcGetInt (&hi);
+        if (sts == MB_OK)
+        {
+            sts = mbcGetInt (&lo);
+        }
+        if (sts)
+        {
+            return (sts);
+        }
+    }
+    if ((op < 2) && getcnt)
+    {
+        return (MB_EXC_ILL_FUNC);       /* Malformed message */
+    }
+    if (op == 0)
+    {
+        ssts = spi_stage_status (&next);
+    }
+    else if (op == 1)
+    {
+        ssts = spi_stage_restart ();
+    }
+    else if (op == 2)
+    {
+        if ((getcnt == 0) || (getcnt > UPD_WINDOW_MAX))
+        {
+            return (MB_EXC_ILL_FUNC);   /* Malformed message */
+        }
+        ssts = spi_stage_write (((unsigned long)hi << 16) | lo,
+                                getptr, getcnt);
+        getcnt = 0;                     /* Consumed */
+    }
+    else
+    {
+        if (getcnt != sizeof(hdr))
+        {
+            return (MB_EXC_ILL_FUNC);   /* Malformed message */
+        }
+        for (i = 0; i < sizeof(hdr); i++)
+        {
+            (void)mbcGetByte (&hdr[i]);
+        }
+        ssts = spi_stage_finish (((unsigned long)hi << 16) | lo, hdr, &crc);
+    }
+    switch (ssts)
+    {
+        case SPI_STAGE_OK:
+            break;
+        case SPI_STAGE_OFFSET:
+            return (MB_EXC_ILL_ADDR);   /* Ask for status and resume */
+        case SPI_STAGE_RANGE:
+            return (MB_EXC_ILL_DATA);
+        case SPI_STAGE_NODEV:
+            return (MB_SPI_FAMILY_ERR);
+        default:
+            return (MB_SPI_WRITE_ERR);
+    }
+    if (op != 0)
+    {
+        (void)spi_stage_status (&next);
+    }
+    sts = mbcPutByte (op);
+    if (sts == MB_OK)
+    {
+        sts = mbcPutInt ((unsigned int)(next >> 16));
+    }
+    if (sts == MB_OK)
+    {
+        sts = mbcPutInt ((unsigned int)next);
+    }
+    if ((sts == MB_OK) && (op == 3))
+    {
+        sts = mbcPutInt (crc);
+    }
+    return (sts);
+
+} /* End of mbcUpdImage() */
+
+/*************************************************************************
+* mbcRdSessions  --  Function 0x61: Read per-connection Session Records
+*
+* Call is:
+*
+*      mbcRdSessions ()
+*
+* The request is two bytes: how many sessions back to start (0 = the most
+* recent truck) and how many records are wanted (1 - SES_READ_MAX), older
+* records following.  The response is the count of records returned, then
+* for each the E2SESREC fields in order, less the CRC, as big-endian
+* ModBus words/bytes (30 bytes per record).  Fewer records are returned
+* once the ring runs out.
+*
+* Return value is the ModBus Exception code.
+*
+*************************************************************************/
+
+#define SES_READ_MAX    2               /* 1 + 2 * 30 fits MODBUS_MAX_DATA */
+#define SES_MB_SIZE     30              /* E2SESREC less the CRC */
+
+/* Store "val" as "len" (2 or 4) big-endian bytes, return next position */
+
+static unsigned char *mbcSesPut (unsigned char *ptr, unsigned long val,
+                                 unsigned char len)
+{
+    while (len--)
+    {
+        *ptr++ = (unsigned char)(val >> (len * 8));
+    }
+    return (ptr);
+}
+
+static MODBSTS mbcRdSessions (void)
+{
+    unsigned char buf[SES_READ_MAX * SES_MB_SIZE];
+    unsigned char *ptr;
+    E2SESREC rec;
+    unsigned char back;         /* Sessions back from newest */
+    unsigned char max;          /* Records requested */
+    unsigned char count;        /* Records returned */
+    MODBSTS sts;                /* Local status */
+
+    sts = mbcGetByte (&back);
+    if (sts == MB_OK)
+    {
+        sts = mbcGetByte (&max);
+    }
+    if (sts)
+    {
+        return (sts);
+    }
+    /* Message should now be empty */
+    if (getcnt)
+    {
+        return (MB_EXC_ILL_FUNC);       /* Malformed message */
+    }
+    if ((max == 0) || (max > SES_READ_MAX))
+    {
+        return (MB_EXC_ILL_DATA);
+    }
+    ptr = buf;
+    for (count = 0; count < max; count++)
+    {
+        if (nvSesGet ((unsigned int)back + count, &rec))
+        {
+            break;
+        }
+        ptr = mbcSesPut (ptr, rec.Seq, 2);
+        ptr = mbcSesPut (ptr, rec.Time, 4);
+        memcpy (ptr, rec.Serial, BYTESERIAL);
+        ptr += BYTESERIAL;
+        *ptr++ = rec.Probe;
+        *ptr++ = rec.Flags;
+        ptr = mbcSesPut (ptr, rec.ArriveMs, 2);
+        ptr = mbcSesPut (ptr, rec.ProbeMs, 2);
+        ptr = mbcSesPut (ptr, rec.ValidMs, 2);
+        ptr = mbcSesPut (ptr, rec.PermitMs, 2);
+        ptr = mbcSesPut (ptr, rec.Flaps, 2);
+        ptr = mbcSesPut (ptr, rec.Secs, 2);
+        ptr = mbcSesPut (ptr, rec.LoopMax, 2);
+        *ptr++ = rec.Bypass;
+        *ptr++ = rec.LoopAvg;
+    }
+    sts = mbcPutByte (count);
+    if (sts)
+    {
+        return (sts);
+    }
+    return (mbcPutNString ((char)(count * SES_MB_SIZE), buf));
+
+} /* End of mbcRdSessions() */
+
+/*************************************************************************
+* mbcBench  --  Function 0x62: Time one of the hot routines on the unit
+*
+* Call is:
+*
+*      mbcBench ()
+*
+* The request is the routine to time and the number of calls (1 -
+* BENCH_ITER_MAX):
+*
+*      0   modbus_CRC() over 64 bytes
+*      1   Dallas_CRC8() over 8 bytes
+*      2   UNIX_to_Greg() of a new date each call
+*      3   nvTrkFind() of an unlisted serial number (EEPROM bound, so at
+*          most BENCH_TRK_MAX calls)
+*      4   time_ms64()
+*
+* Each call is timed with the Timer 6/7 instruction cycle count (50ns),
+* including the two counter reads.  The response is the routine and call
+* count followed by the fastest call and the total, both as 32-bit cycle
+* counts (two ints, high first); the fastest call is the figure to track
+* from release to release since interrupts stay enabled and land on some
+* calls.  Only allowed while idle.
+*
+* Return value is the ModBus Exception code.
+*
+*************************************************************************/
+
+#define BENCH_COUNT     5               /* Routines that can be timed */
+#define BENCH_TRKFIND   3
+#define BENCH_ITER_MAX  200
+#define BENCH_TRK_MAX   16
+
+static MODBSTS mbcBench (void)
+{
+    unsigned char buf[64];
+    unsigned char id;           /* Routine to time */
+    unsigned char iter;         /* Calls to make */
+    unsigned char i;
+    unsigned long start, cycles;
+    unsigned long least;        /* Fastest call */
+    unsigned long total;        /* All calls */
+    unixtime save_time;
+    unsigned int save_bvf;
+    word index;
+    volatile unsigned int sink = 0; /* Keep the results "used" */
+    MODBSTS sts;                /* Local status */
+
+    if (main_state != IDLE)             /* Sittin' idle? */
+    {
+        return (MB_EXC_BUSY);           /* No, tell 'im to try later */
+    }
+    sts = mbcGetByte (&id);
+    if (sts == MB_OK)
+    {
+        sts = mbcGetByte (&iter);
+    }
+    if (sts)
+    {
+        return (sts);
+    }
+    /* Message should now be empty */
+    if (getcnt)
+    {
+        return (MB_EXC_ILL_FUNC);       /* Malformed message */
+    }
+    if ((id >= BENCH_COUNT) || (iter == 0) || (iter > BENCH_ITER_MAX)
+        || ((id == BENCH_TRKFIND) && (iter > BENCH_TRK_MAX)))
+    {
+        return (MB_EXC_ILL_DATA);
+    }
+    for (i = 0; i < sizeof(buf); i++)
+    {
+        buf[i] = (unsigned char)((i * 37) + 11);
+    }
+    save_time = present_time;
+    save_bvf = badvipflag;
+    least = 0xFFFFFFFFL;
+    total = 0;
+    for (i = 0; i < iter; i++)
+    {
+        start = read_32bit_cycles ();
+        switch (id)
+        {
+          case 0:
+            sink += modbus_CRC (buf, sizeof(buf), INIT_CRC_SEED);
+            break;
+          case 1:
+            sink += Dallas_CRC8 (buf, 8);
+            break;
+          case 2:
+            present_time = save_time + ((unsigned long)i * 86399L) + 1;
+            UNIX_to_Greg ();
+            break;
+          case BENCH_TRKFIND:
+            buf[BYTESERIAL-1] = i;
+            badvipflag &= ~(BVF_DONE | BVF_UNAUTH); /* Look, don't remember */
+            sink += (unsigned int)nvTrkFind (buf, &index);
+            break;
+          default:
+            sink += (unsigned int)time_ms64 ();
+            break;
+        }
+        cycles = read_32bit_cycles () - start;
+        total += cycles;
+        if (cycles < least)
+        {
+            least = cycles;
+        }
+        service_charge ();              /* Keep Service LED off */
+    }
+    badvipflag = save_bvf;
+    if (id == 2)
+    {
+        present_time = save_time;       /* Put the real date back */
+        UNIX_to_Greg ();
+    }
+    sts = mbcPutByte (id);
+    if (sts == MB_OK)
+    {
+        sts = mbcPutByte (iter);
+    }
+    if (sts == MB_OK)
+    {
+        sts = mbcPutInt ((unsigned int)(least >> 16));
+    }
+    if (sts == MB_OK)
+    {
+        sts = mbcPutInt ((unsigned int)least);
+    }
+    if (sts == MB_OK)
+    {
+        sts = mbcPutInt ((unsigned int)(total >> 16));
+    }
+    if (sts == MB_OK)
+    {
+        sts = mbcPutInt ((unsigned int)total);
+    }
+    return (sts);
+
+} /* End of mbcBench() */
+
+/*************************************************************************
+* mbcRdStatus  --  Function 0x63: Read the live unit state in one reply
+*
+* Call is:
+*
+*      mbcRdStatus ()
+*
+* The request has no data.  The response is the STS_BURST_SIZE byte
+* snapshot built by mbrStatusBurst() (status flags, non-permissive
+* reasons, states, truck serial number, probes, bypass, ground, deadman,
+* and Truck ID status, then the change journal sequence and epoch), the
+* first byte being the layout version STS_BURST_VER.  One of these
+* replaces reading registers 100-10F, 110-11A, 06D-06E and 120 as
+* separate ranges.
+*
+* Return value is the ModBus Exception code.
+*
+*************************************************************************/
+
+static MODBSTS mbcRdStatus (void)
+{
+    unsigned char buf[STS_BURST_SIZE];
+    unsigned char len;
+
+    /* Message should be empty */
+    if (getcnt)
+    {
+        return (MB_EXC_ILL_FUNC);       /* Malformed message */
+    }
+    len = mbrStatusBurst (buf);
+    return (mbcPutNString ((char)len, buf));
+
+} /* End of mbcRdStatus() */
+
+/*************************************************************************
+* mbcRdJrnSeq  --  Function 0x64: Read the change journal sequence number
+*
+* Call is:
+*
+*      mbcRdJrnSeq ()
+*
+* The request has no data.  The response is the sequence number (int) of
+* the newest change journal record and the boot epoch (byte); nothing has
+* changed while both stay the same.
+*
+* Return value is the ModBus Exception code.
+*
+*************************************************************************/
+
+static MODBSTS mbcRdJrnSeq (void)
+{
+    MODBSTS sts;                /* Local status */
+
+    /* Message should be empty */
+    if (getcnt)
+    {
+        return (MB_EXC_ILL_FUNC);       /* Malformed message */
+    }
+    sts = mbcPutInt (mbrJournalSeq ());
+    if (sts)
+    {
+        return (sts);
+    }
+    return (mbcPutByte (mbrJournalEpoch ()));
+
+} /* End of mbcRdJrnSeq() */
+
+/*************************************************************************
+* mbcRdJournal  --  Function 0x65: Read the changes since a sequence number
+*
+* Call is:
+*
+*      mbcRdJournal ()
+*
+* The request is the last sequence number (int) the master has applied.
+* The response is built by mbrJournalRead(): the current sequence, the
+* boot epoch (changed: read function 0x63 again), flags (JRN_OVERFLOW:
+* read function 0x63 again; JRN_MORE: ask again), a count and up to
+* JRN_READ_MAX change records, oldest first.
+*
+* Return value is the ModBus Exception code.
+*
+*************************************************************************/
+
+static MODBSTS mbcRdJournal (void)
+{
+    unsigned char buf[5 + (JRN_READ_MAX * JRN_MB_SIZE)];
+    unsigned int since;
+    unsigned char len;
+    MODBSTS sts;                /* Local status */
+
+    sts = mbcGetInt (&since);
+    if (sts)
+    {
+        return (sts);
+    }
+    /* Message should now be empty */
+    if (getcnt)
+    {
+        return (MB_EXC_ILL_FUNC);       /* Malformed message */
+    }
+    len = mbrJournalRead (since, buf);
+    return (mbcPutNString ((char)len, buf));
+
+} /* End of mbcRdJournal() */
+
 /*************************************************************************
 * mbcWrKeys  --  Function 0x4B: Write one or more Bypass Keys to EEPROM
 *
@@ -3572,8 +4387,7 @@ unsigned char data;                  /* Local data byte */
            /****************************** 9/11/2008 10:33AM **************************
             * Disable interrupts
             ***************************************************************************/
-            save_iec0 = IEC0;
-            IEC0 = 0;                   /* Disable heart beat and DMA interrupt */
+            HAL_IEC0_HOLD(save_iec0);   /* Disable heart beat and DMA interrupt */
             if (!Read_Dallas_SN(COMM_ID))         /* Fetch the serial number */
             {
                sts = MB_READ_SERIAL_ERROR;
@@ -3585,7 +4399,7 @@ unsigned char data;                  /* Local data byte */
                * restore interrupts
                ***************************************************************************/
             }
-            IEC0 = save_iec0;           /* Re-enable Heart Beat and DMA interrupts */
+            HAL_IEC0_RESTORE(save_iec0); /* Re-enable Heart Beat and DMA interrupts */
           }
             break;
 
@@ -3597,8 +4411,7 @@ unsigned char data;                  /* Local data byte */
             /****************************** 9/11/2008 10:33AM **************************
              * Disable interrupts
              ***************************************************************************/
-            save_iec0 = IEC0;
-            IEC0 = 0;                   /* Disable heart beat and DMA interrupt */
+            HAL_IEC0_HOLD(save_iec0);   /* Disable heart beat and DMA interrupt */
             if (!Read_Dallas_SN(COMM_ID))         /* Fetch the serial number */
             {
                sts = MB_READ_SERIAL_ERROR;
@@ -3609,7 +4422,7 @@ unsigned char data;                  /* Local data byte */
            /****************************** 9/11/2008 10:35AM **************************
             * restore interrupts
             ***************************************************************************/
-           IEC0 = save_iec0;           /* Re-enable Heart Beat and DMA interrupts */
+           HAL_IEC0_RESTORE(save_iec0); /* Re-enable Heart Beat and DMA interrupts */
           }
            break;
 
@@ -3621,13 +4434,12 @@ unsigned char data;                  /* Local data byte */
             /****************************** 9/11/2008 10:33AM **************************
              * Disable interrupts
              ***************************************************************************/
-            save_iec0 = IEC0;
-            IEC0 = 0;                   /* Disable heart beat and DMA interrupt */
+            HAL_IEC0_HOLD(save_iec0);   /* Disable heart beat and DMA interrupt */
             sts = mbcRdTrBuilderInfo();
             /****************************** 9/11/2008 10:35AM **************************
              * restore interrupts
              ***************************************************************************/
-            IEC0 = save_iec0;           /* Re-enable Heart Beat and DMA interrupts */
+            HAL_IEC0_RESTORE(save_iec0); /* Re-enable Heart Beat and DMA interrupts */
             end_time = mstimer;
             break;
 
@@ -3638,13 +4450,12 @@ unsigned char data;                  /* Local data byte */
            /****************************** 9/11/2008 10:33AM **************************
             * Disable interrupts
             ***************************************************************************/
-            save_iec0 = IEC0;
-            IEC0 = 0;                   /* Disable heart beat and DMA interrupt */
+            HAL_IEC0_HOLD(save_iec0);   /* Disable heart beat and DMA interrupt */
             sts = mbcWrBuilderInfo();
             /****************************** 9/11/2008 10:35AM **************************
              * restore interrupts
              ***************************************************************************/
-            IEC0 = save_iec0;           /* Re-enable Heart Beat and DMA interrupts */
+            HAL_IEC0_RESTORE(save_iec0); /* Re-enable Heart Beat and DMA interrupts */
             break;
 
           /************************** 6/22/2009 8:16AM ***********************
@@ -3654,13 +4465,12 @@ unsigned char data;                  /* Local data byte */
           /****************************** 9/11/2008 10:33AM **************************
            * Disable interrupts
            ***************************************************************************/
-            save_iec0 = IEC0;
-            IEC0 = 0;                   /* Disable heart beat and DMA interrupt */
+            HAL_IEC0_HOLD(save_iec0);   /* Disable heart beat and DMA interrupt */
             sts = readTIMarea(0x080, 0x0FF);
             /****************************** 9/11/2008 10:35AM **************************
              * restore interrupts
              ***************************************************************************/
-            IEC0 = save_iec0;           /* Re-enable Heart Beat and DMA interrupts */
+            HAL_IEC0_RESTORE(save_iec0); /* Re-enable Heart Beat and DMA interrupts */
             break;
 
           /************************** 6/22/2009 8:17AM ***********************
@@ -3670,13 +4480,12 @@ unsigned char data;                  /* Local data byte */
           /****************************** 9/11/2008 10:33AM **************************
            * Disable interrupts
            ***************************************************************************/
-            save_iec0 = IEC0;
-            IEC0 = 0;                   /* Disable heart beat and DMA interrupt */
+            HAL_IEC0_HOLD(save_iec0);   /* Disable heart beat and DMA interrupt */
             sts = writeTIMarea(0x080, 0x0FF);
             /****************************** 9/11/2008 10:35AM **************************
              * restore interrupts
              ***************************************************************************/
-            IEC0 = save_iec0;           /* Re-enable Heart Beat and DMA interrupts */
+            HAL_IEC0_RESTORE(save_iec0); /* Re-enable Heart Beat and DMA interrupts */
             break;
 
           /************************** 6/22/2009 8:16AM ***********************
@@ -3686,13 +4495,12 @@ unsigned char data;                  /* Local data byte */
             /****************************** 9/11/2008 10:33AM **************************
              * Disable interrupts
              ***************************************************************************/
-            save_iec0 = IEC0;
-            IEC0 = 0;                   /* Disable heart beat and DMA interrupt */
+            HAL_IEC0_HOLD(save_iec0);   /* Disable heart beat and DMA interrupt */
            sts = readTIMarea(0x400, 0xBFF);
           /****************************** 9/11/2008 10:35AM **************************
            * restore interrupts
            ***************************************************************************/
-            IEC0 = save_iec0;           /* Re-enable Heart Beat and DMA interrupts */
+            HAL_IEC0_RESTORE(save_iec0); /* Re-enable Heart Beat and DMA interrupts */
             break;
 
           /************************** 6/22/2009 8:17AM ***********************
@@ -3702,13 +4510,12 @@ unsigned char data;                  /* Local data byte */
           /****************************** 9/11/2008 10:33AM **************************
             * Disable interrupts
             ***************************************************************************/
-            save_iec0 = IEC0;
-            IEC0 = 0;                   /* Disable heart beat and DMA interrupt */
+            HAL_IEC0_HOLD(save_iec0);   /* Disable heart beat and DMA interrupt */
             sts = writeTIMarea(0x400, 0xBFF);
             /****************************** 9/11/2008 10:35AM **************************
              * restore interrupts
              ***************************************************************************/
-            IEC0 = save_iec0;           /* Re-enable Heart Beat and DMA interrupts */
+            HAL_IEC0_RESTORE(save_iec0); /* Re-enable Heart Beat and DMA interrupts */
             break;
 
           case INSERT_VEHICLE:     /* 0x59 -- Insert Single Vehicle ID */ 
@@ -3745,6 +4552,46 @@ unsigned char data;                  /* Local data byte */
                   sts = mbcPutByte (0x00);  // Return 00
               }
             break;
+
+          case READ_TRACE_BUFFER:           /* 0x5E -- Read binary trace records */
+            sts = mbcRdTrace ();
+            break;
+
+          case PROBE_CAPTURE:               /* 0x5F -- Probe waveform capture */
+            sts = mbcCapture ();
+            break;
+
+          case UPDATE_IMAGE:                /* 0x60 -- Stage SPI update image */
+            sts = mbcUpdImage ();
+            break;
+
+          case READ_SESSIONS:               /* 0x61 -- Read Session Records */
+            sts = mbcRdSessions ();
+            break;
+
+          case BENCHMARK:                   /* 0x62 -- Time a hot routine */
+            sts = mbcBench ();
+            break;
+
+          case READ_STATUS_BURST:           /* 0x63 -- Live state snapshot */
+            sts = mbcRdStatus ();
+            break;
+
+          case READ_JOURNAL_SEQ:            /* 0x64 -- Newest change number */
+            sts = mbcRdJrnSeq ();
+            break;
+
+          case READ_JOURNAL:                /* 0x65 -- Changes since N */
+            sts = mbcRdJournal ();
+            break;
+
+          case READ_LOG_QUERY:              /* 0x66 -- Filtered Event Log */
+            sts = mbcLogQuery ();
+            break;
+
+          case READ_SORTED_VEHICLES:        /* 0x67 -- Packed Truck ID list */
+            sts = mbcRdSortedIDs ();
+            break;
             
           default:                      /* Unknown, Illegal, etc. */
             sts = MB_EXC_ILL_FUNC;
@@ -27,6 +27,30 @@
  *  1.6.35  02/03/17  DHP  Added code for new Active deadman registers 80-83
  *                         Replaced REG_RES_VAL with an appropriate error code;
  *                           changes a good return to the appropriate error code.
+ *  1.6.38  10/19/26  AGT  Added register 8C, ModBus baud override (BAUD_RATE
+ *                           index, 0 = jumper); takes effect at next reset.
+ *                         Added register 8D, Truck ID storage format.
+ *                         Added register 8E, last departure detection time
+ *                           (ms), and 8F, departure confidence threshold.
+ *                         Added mbrStatusBurst(), the live state registers
+ *                           in one snapshot for function READ_STATUS_BURST.
+ *                         Added the change journal: mbrJournalScan() records
+ *                           each change of the live state with a sequence
+ *                           number for READ_JOURNAL_SEQ/READ_JOURNAL; the
+ *                           status burst (version 2) ends with the sequence.
+ *                         Journal tag JRN_JUMPERS records jumper changes.
+ *                         Journal probes use the register 10D-114 numbering;
+ *                           added truck serial, compartment count and clock
+ *                           step tags, and the boot epoch to the replies.
+ *                         Added registers 090/091, probe scan queue lost and
+ *                           peak counts.
+ *                         VIP time registers 001-004 also bring the cached
+ *                           calendar up to date (a compare, see time_tick()).
+ *                         Register 0A1 casts the Home block pointer through
+ *                           size_t.
+ *                         Journal boot epoch is kept in RAM, taken at power
+ *                           up from the calendar clock (mbrJournalInit());
+ *                           added tag JRN_VIP for badvipflag.
 *******************************************************************************/
 
 #include "common.h"
@@ -125,6 +149,354 @@ static unsigned mbrNonPermitReg (void)
 
     } /* End mbrNonPermitReg() */
 
+/*************************************************************************
+* Change journal
+*
+* A RAM ring of the last JRN_SIZE changes to the live unit state, so that
+* a ModBus master can poll for what changed rather than re-reading it all.
+* Each record is a sequence number (1, 2, ... wrapping at 16 bits), a
+* JRN_ tag, the old and new values, and the time_ms64() tick (low 32
+* bits).  A master reads the status burst, which ends with the current
+* sequence number and boot epoch, then asks for the changes since that
+* number; if the journal no longer holds them all the reply says so and
+* the master reads the burst again.  The sequence begins again at 0 when
+* the unit restarts, so a master also compares the epoch and reads the
+* burst again when it changes.  The epoch is the low byte of the calendar
+* seconds at power up, so two power ups less than 256 seconds apart never
+* share one (a master that has not heard from the unit for longer reads
+* the burst again anyway) and nothing is written to tell them apart.  Only
+* with no running clock is SysParm BootCount bumped, and added in.
+*
+* Every field of the burst is journaled but the time itself: JRN_CLOCKHI/
+* JRN_CLOCKLO record the calendar seconds at tick 0 when the clock is set,
+* so the calendar time of any record is that plus tick / 1000.
+**************************************************************************/
+
+typedef struct
+{
+    unsigned int    seq;
+    unsigned char   tag;
+    unsigned int    old;
+    unsigned int    now;
+    unsigned long   tick;
+} JRNREC;
+
+static JRNREC jrn_ring[JRN_SIZE];
+static unsigned int jrn_seq;            /* Sequence of newest record */
+static unsigned char jrn_held;          /* Records in the ring */
+static unsigned int jrn_last[JRN_TAGS]; /* Value at the last scan */
+static unsigned char jrn_primed;        /* jrn_last[] has been filled */
+static unsigned long jrn_time;          /* present_time at the last base */
+static unsigned long jrn_base;          /* Calendar seconds at tick 0 */
+static unsigned char jrn_epoch;         /* Boot epoch, see mbrJournalInit() */
+
+/* Probe "probe" (0 - 15) as registers 10D-114 report it: a USA/6-
+   compartment truck not in 5-wire optic mode shifts probes_state[] up by
+   two (channels 0 and 1 are not compartments), the rest read P_UNKNOWN */
+
+static unsigned char mbrProbeState (unsigned char probe)
+{
+    if ((ConfigA & CFGA_8COMPARTMENT)   /* US/6-compartment truck? */
+        || (truck_state == OPTIC_FIVE)) /* 5wire-Optic overrides */
+        return ((unsigned char)probes_state[probe]);
+    if (probe < 6)
+        return ((unsigned char)probes_state[probe + 2]);
+    return ((unsigned char)P_UNKNOWN);
+}
+
+/* Compartment count as register 120, 0xFF if not configured */
+
+static unsigned char mbrCompartments (void)
+{
+    if ((number_of_Compartments < 1) || (number_of_Compartments > 16))
+        return (0xFF);
+    return ((unsigned char)number_of_Compartments);
+}
+
+/* Current value of the state behind journal tag "tag" */
+
+static unsigned int jrn_value (unsigned char tag)
+{
+    switch (tag)
+    {
+      case JRN_STATUSA:   return (StatusA);
+      case JRN_STATUSB:   return (StatusB);
+      case JRN_STATUSO:   return (StatusO);
+      case JRN_STATUSP:   return (StatusP);
+      case JRN_NONPERMIT: return (mbrNonPermitReg ());
+      case JRN_MAIN:      return ((unsigned)main_state);
+      case JRN_TRUCK:     return ((unsigned)truck_state);
+      case JRN_BYPASS:    return ((unsigned)(((unsigned)(unsigned char)bystatus << 8)
+                                  | (unsigned)bylevel));
+      case JRN_GROUND:    return ((unsigned)badgndflag);
+      case JRN_DEADMAN:   return ((unsigned)(unsigned char)baddeadman);
+      case JRN_FAULT:     return (iambroke);
+      case JRN_JUMPERS:   return (jumper_now);
+      case JRN_SERIAL:
+      case JRN_SERIAL + 1:
+      case JRN_SERIAL + 2:
+        tag = (unsigned char)((tag - JRN_SERIAL) * 2);
+        return ((unsigned)(((unsigned)truck_SN[tag] << 8)
+                           | (unsigned)truck_SN[tag + 1]));
+      case JRN_COMPART:   return ((unsigned)mbrCompartments ());
+      case JRN_VIP:       return (badvipflag);
+      default:
+        if ((tag >= JRN_PROBE) && (tag < JRN_PROBE + 16))
+            return ((unsigned)mbrProbeState ((unsigned char)(tag - JRN_PROBE)));
+        return (0);
+    }
+}
+
+/* Add one record to the ring */
+
+static void jrn_add (unsigned char tag, unsigned int old, unsigned int now)
+{
+    JRNREC *rec;
+
+    jrn_seq++;
+    rec = &jrn_ring[jrn_seq & (JRN_SIZE - 1)];
+    rec->seq = jrn_seq;
+    rec->tag = tag;
+    rec->old = old;
+    rec->now = now;
+    rec->tick = (unsigned long)time_ms64 ();
+    if (jrn_held < JRN_SIZE)
+        jrn_held++;
+}
+
+/* Calendar seconds at tick 0; only worked out once present_time moves, as
+   it costs a 64 bit divide.  The two clocks roll over at different times,
+   so only a step of more than a second is a clock set. */
+
+static void jrn_clock (void)
+{
+    unsigned long base;
+
+    if (jrn_primed && (present_time == jrn_time))
+        return;
+    jrn_time = present_time;
+    base = present_time - (unsigned long)(time_ms64 () / 1000);
+    if (!jrn_primed)
+    {
+        jrn_base = base;
+        return;
+    }
+    if (((base - jrn_base) > 1) && ((jrn_base - base) > 1))
+    {
+        jrn_add (JRN_CLOCKHI, (unsigned)(jrn_base >> 16), (unsigned)(base >> 16));
+        jrn_add (JRN_CLOCKLO, (unsigned)jrn_base, (unsigned)base);
+        jrn_base = base;
+    }
+}
+
+/*************************************************************************
+* mbrJournalScan -- Record any change of the live state
+*
+* Call is:
+*
+*       mbrJournalScan ()
+*
+* Called once per main loop pass, after main_activity()/SpecialOps(); the
+* permit, probe, truck, fault and bypass state all settle there, so one
+* compare per tag catches every change made anywhere during the pass.
+**************************************************************************/
+
+void mbrJournalScan (void)
+{
+    unsigned int val;
+    unsigned char tag;
+
+    for (tag = JRN_STATUSA; tag < JRN_TAGS; tag++)
+    {
+        if ((tag == JRN_CLOCKHI) || (tag == JRN_CLOCKLO))
+            continue;                   /* See jrn_clock() */
+        val = jrn_value (tag);
+        if (jrn_primed && (val != jrn_last[tag]))
+            jrn_add (tag, jrn_last[tag], val);
+        jrn_last[tag] = val;
+    }
+    jrn_clock ();
+    jrn_primed = TRUE;
+
+    } /* End mbrJournalScan() */
+
+/*************************************************************************
+* mbrJournalInit -- Take the boot epoch
+*
+* Call is:
+*
+*       mbrJournalInit ()
+*
+* Called once at power up, after diagnostics() has read the clock.
+**************************************************************************/
+
+void mbrJournalInit (void)
+{
+    if (clock_status != CLOCK_OK)       /* Nothing to tell boots apart by */
+    {
+        SysParm.BootCount++;
+        (void)nvSysParmUpdate();
+    }
+    jrn_epoch = (unsigned char)(present_time + SysParm.BootCount);
+
+    } /* End mbrJournalInit() */
+
+/*************************************************************************
+* mbrJournalSeq -- Sequence number of the newest journal record
+**************************************************************************/
+
+unsigned int mbrJournalSeq (void)
+{
+    return (jrn_seq);
+
+    } /* End mbrJournalSeq() */
+
+/*************************************************************************
+* mbrJournalEpoch -- Boot epoch the journal sequence belongs to
+**************************************************************************/
+
+unsigned char mbrJournalEpoch (void)
+{
+    return (jrn_epoch);
+
+    } /* End mbrJournalEpoch() */
+
+/*************************************************************************
+* mbrJournalRead -- Journal records since a sequence number
+*
+* Call is:
+*
+*       mbrJournalRead (since, buf)
+*
+* Fills "buf" with the current sequence (2 bytes), the boot epoch, JRN_
+* flags, a count and then up to JRN_READ_MAX records after "since", oldest
+* first, each as its
+* sequence, tag, old value, new value (big-endian) and 4 byte tick.
+* JRN_OVERFLOW means records after "since" have been lost (the records
+* returned are the oldest still held); JRN_MORE means ask again.  Returns
+* the count of bytes.
+**************************************************************************/
+
+unsigned char mbrJournalRead (unsigned int since, unsigned char *buf)
+{
+    JRNREC *rec;
+    unsigned char *ptr;
+    unsigned int pending;               /* Records after "since" */
+    unsigned char flags, count, i;
+
+    flags = 0;
+    pending = jrn_seq - since;
+    if (pending > jrn_held)             /* Lost, or not from this run */
+    {
+        flags |= JRN_OVERFLOW;
+        pending = jrn_held;
+    }
+    count = (pending > JRN_READ_MAX) ? JRN_READ_MAX : (unsigned char)pending;
+    if (pending > count)
+        flags |= JRN_MORE;
+
+    ptr = buf;
+    *ptr++ = (unsigned char)(jrn_seq >> 8);
+    *ptr++ = (unsigned char)jrn_seq;
+    *ptr++ = jrn_epoch;
+    *ptr++ = flags;
+    *ptr++ = count;
+    for (i = 0; i < count; i++)
+    {
+        rec = &jrn_ring[(jrn_seq - pending + 1 + i) & (JRN_SIZE - 1)];
+        *ptr++ = (unsigned char)(rec->seq >> 8);
+        *ptr++ = (unsigned char)rec->seq;
+        *ptr++ = rec->tag;
+        *ptr++ = (unsigned char)(rec->old >> 8);
+        *ptr++ = (unsigned char)rec->old;
+        *ptr++ = (unsigned char)(rec->now >> 8);
+        *ptr++ = (unsigned char)rec->now;
+        *ptr++ = (unsigned char)(rec->tick >> 24);
+        *ptr++ = (unsigned char)(rec->tick >> 16);
+        *ptr++ = (unsigned char)(rec->tick >> 8);
+        *ptr++ = (unsigned char)rec->tick;
+    }
+    return ((unsigned char)(ptr - buf));
+
+    } /* End mbrJournalRead() */
+
+/*************************************************************************
+* mbrStatusBurst -- Snapshot of the live unit state in one buffer
+*
+* Call is:
+*
+*       mbrStatusBurst (buf)
+*
+* Fills "buf" (at least STS_BURST_SIZE bytes) with what a TAS otherwise
+* polls as several register ranges, big-endian as the registers are, and
+* returns the count of bytes.  Version STS_BURST_VER layout:
+*
+*       0   STS_BURST_VER               1
+*       1   Date/Time (reg 100-101)     4
+*       5   StatusA/B/O/P (reg 104-107) 8
+*      13   Non-permissive (reg 11A)    2
+*      15   main_state, truck_state     1 + 1
+*      17   Truck serial (reg 10A-10C)  6
+*      23   Probes 1 - 16 (reg 10D-114) 16, one byte each
+*      39   bystatus, bylevel (reg 115) 1 + 1
+*      41   badgndflag, baddeadman      1 + 1
+*      43   badvipflag (reg 06E)        2
+*      45   Compartments (reg 120)      1, 0xFF if not configured
+*      46   Journal sequence            2, see mbrJournalScan()
+*      48   Boot epoch                  1
+*
+* It is called from the ModBus decode in the main loop, so every field is
+* from the same pass between main_activity() calls.
+**************************************************************************/
+
+unsigned char mbrStatusBurst (unsigned char *buf)
+{
+    unsigned char *ptr;
+    unsigned hval;
+    unsigned char i;
+
+    ptr = buf;
+    *ptr++ = STS_BURST_VER;
+    *ptr++ = (unsigned char)(present_time >> 24);
+    *ptr++ = (unsigned char)(present_time >> 16);
+    *ptr++ = (unsigned char)(present_time >> 8);
+    *ptr++ = (unsigned char)present_time;
+    hval = StatusA;
+    if (hval == 0)                      /* As register 104 */
+        hval = STSA_IDLE;
+    *ptr++ = (unsigned char)(hval >> 8);
+    *ptr++ = (unsigned char)hval;
+    *ptr++ = (unsigned char)(StatusB >> 8);
+    *ptr++ = (unsigned char)StatusB;
+    *ptr++ = (unsigned char)(StatusO >> 8);
+    *ptr++ = (unsigned char)StatusO;
+    *ptr++ = (unsigned char)(StatusP >> 8);
+    *ptr++ = (unsigned char)StatusP;
+    hval = mbrNonPermitReg ();
+    *ptr++ = (unsigned char)(hval >> 8);
+    *ptr++ = (unsigned char)hval;
+    *ptr++ = (unsigned char)main_state;
+    *ptr++ = (unsigned char)truck_state;
+    memcpy (ptr, truck_SN, BYTESERIAL);
+    ptr += BYTESERIAL;
+
+    for (i = 0; i < 16; i++)            /* As registers 10D-114 */
+        *ptr++ = mbrProbeState (i);
+    *ptr++ = (unsigned char)bystatus;
+    *ptr++ = bylevel;
+    *ptr++ = badgndflag;
+    *ptr++ = (unsigned char)baddeadman;
+    *ptr++ = (unsigned char)(badvipflag >> 8);
+    *ptr++ = (unsigned char)badvipflag;
+    *ptr++ = mbrCompartments ();
+    *ptr++ = (unsigned char)(jrn_seq >> 8);
+    *ptr++ = (unsigned char)jrn_seq;
+    *ptr++ = jrn_epoch;
+
+    return ((unsigned char)(ptr - buf));
+
+    } /* End mbrStatusBurst() */
+
 /*************************************************************************
 * mbrVIPModeWr -- Set "VIP Mode Control" register
 *
@@ -291,24 +663,30 @@ MODBSTS mbrRdReg
               {
             case 0x0:                 /* 000 -- VIP Year */
               UNIX_to_Greg ();        /* Update year/month/day/hour/min */
-                                      /* Ergo "time" only accurate if read
-                                         as a block starting with "year" */
+                                      /* Cached; only present_time changes
+                                         other than time_tick() convert. The
+                                         time can't move during one request,
+                                         so a block read is consistent. */
               hval = year;            /* Return Year */
               break;
 
             case 0x1:                 /* 001 -- VIP Month */
+              UNIX_to_Greg ();
               hval = month;           /* Return Month; see "Year" above. */
               break;
 
             case 0x2:                 /* 002 -- VIP Day */
+              UNIX_to_Greg ();
               hval = day;             /* Return Day; see "Year" above. */
               break;
 
             case 0x3:                 /* 003 -- VIP Hour */
+              UNIX_to_Greg ();
               hval = hour;            /* Return Hour; see "Year" above. */
               break;
 
             case 0x4:                 /* 004 -- VIP Minute */
+              UNIX_to_Greg ();
               hval = minute;          /* Return Minute; see "Year" above. */
                                       /* For "Second" resolution, use
                                          Registers 100 & 101 */
@@ -851,6 +1229,26 @@ MODBSTS mbrRdReg
               wtmp |= (unsigned int)(SysParm.default_fuel_type[2] << 8);
               hval = wtmp;
             break;
+
+            case 0x0C:                /* 8C -- ModBus baud override */
+              hval = SysParm.ModBusBaud;
+            break;
+
+            case 0x0D:                /* 8D -- Truck ID format, hi = in use */
+              hval = (unsigned int)nvTrkPacked() << 8; /*   lo = on erase */
+              if(SysParm.EnaSftFeatures2 & ENA_TIM_PACKED)
+              {
+                  hval |= 1;
+              }
+            break;
+
+            case 0x0E:                /* 8E -- ms to declare last truck GONE */
+              hval = depart_latency;
+            break;
+
+            case 0x0F:                /* 8F -- Departure confidence threshold */
+              hval = SysParm.DepartThresh;  /* 0 = DEPART_THRESH */
+            break;
           
           default:                  /* Others are an error */
               return(MB_EXC_ILL_ADDR);
@@ -858,6 +1256,23 @@ MODBSTS mbrRdReg
           } /* End switch on gbreg for group 000 block 80 */
           break;
 
+        case 0x90:                    /* 090-09F -- Diagnostic counters */
+          switch (gbreg)
+          {
+            case 0x0:                 /* 090 -- T3 probe scans lost (queue full) */
+              hval = probe_q_lost;
+              break;
+
+            case 0x1:                 /* 091 -- Most probe scans queued */
+              hval = (unsigned)probe_q_peak;
+              break;
+
+            default:                  /* Others are an error */
+              return(MB_EXC_ILL_ADDR);
+              break;
+          } /* End switch on gbreg for group 000 block 90 */
+          break;
+
         case 0xA0:                    /* 0A0-0BF -- EEPROM/NV partition info */
           switch (gbreg)
           {
@@ -867,7 +1282,7 @@ MODBSTS mbrRdReg
 
             case 0x1:                 /* 0A1 -- EEPROM base address, lo */
               ptr = (char *)eeHomePtr(); /* Base address of Home block */
-              hval = (unsigned int)ptr; /* Low-order 16 bits */
+              hval = (unsigned int)(size_t)ptr; /* Low-order 16 bits */
               break;
 
             case 0x2:                 /* 0A2 -- Home block size */
@@ -1893,6 +2308,45 @@ MODBSTS mbrWrReg
         SysParm.default_fuel_type[2] = tmp_byte;
         (void)nvSysParmUpdate();
       break;
+
+      case 0x8C:                /* 8C -- ModBus baud override, 0 = jumper */
+        if ((*value == 0) || ((*value >= B01200) && (*value <= B115200)))
+        {
+          SysParm.ModBusBaud = (unsigned char)(*value);
+          (void)nvSysParmUpdate();     /* Used at next reset */
+        }
+        else
+        {
+          return (MB_EXC_ILL_DATA); /* reject bad values */
+        }
+      break;
+
+      case 0x8D:                /* 8D -- Truck ID format used by next erase */
+        if (*value == 0)                 /* Standard slots */
+        {
+           SysParm.EnaSftFeatures2 =
+                   (unsigned char) (SysParm.EnaSftFeatures2 & ~ENA_TIM_PACKED);
+        }
+        else if (*value == 1)            /* Packed (sorted) */
+        {
+           SysParm.EnaSftFeatures2 =
+                   (unsigned char) (SysParm.EnaSftFeatures2 | ENA_TIM_PACKED);
+        }
+        else
+        {
+          return (MB_EXC_ILL_DATA); /* reject bad values */
+        }
+        modNVflag++;                    /* Request EEPROM update */
+      break;
+
+      case 0x8F:                /* 8F -- Departure confidence, 0 = default */
+        if (*value > DEPART_THRESH)
+        {
+          return (MB_EXC_ILL_DATA); /* reject bad values */
+        }
+        SysParm.DepartThresh = (unsigned char)(*value);
+        modNVflag++;                    /* Request EEPROM update */
+      break;
           
       case 0x100:                       /* 100 -- High-order system Time-Of-Day */
         /* Wait for second half to do the actual write as an atomic operation.
@@ -35,11 +35,28 @@
  *                          ensure Active Deadman parameters were in place and
  *                          add them if not so that the max open time on standard 
  *                          deadman was not zero.
+ * 1.6.38  10/19/26  AGT  Added the ev_recent[] RAM copy of the newest Event Log
+ *                          records, loaded by nvLogInit() and kept by nvLogPut(),
+ *                          nvLogMerge() and nvLogRepeat() so merge and repeat
+ *                          decisions no longer re-read EEPROM.
+ *                         Added the Session Record ring services nvSesInit(),
+ *                          nvSesPut() and nvSesGet().
+ *                         Added the ev_type[] RAM index of Event Log record
+ *                          types, built by nvLogInit() and kept by nvLogPut(),
+ *                          with nvLogType() and nvLogAtTime() for the filtered
+ *                          Event Log query.
+ *                         nvSysParmUpdate() appends only the changed bytes to
+ *                          the SysParm journal (EEP_SPJ), compacting into the
+ *                          other region when full; nvSysInit() replays it.
+ *                         nvSysFormat() starts the SysParm journal over.
  ******************************************************************************/
 
 #include "common.h"
 #include "volts.h"      /* SysVolts stuff */
 
+static char nvSpjCompact (void);
+static char nvSpjLoad (void);
+static void nvSpjStop (void);
 
 /****************************************************************************
 *
@@ -121,6 +138,8 @@ char sts;
   // last_routine = 0x1F;
   nvSysParmDefaults();
   // last_routine = 0x1F;
+  nvSpjStop();                        /* Not onto the old journal (ModBus */
+                                      /*  format at run time) */
   sts = nvSysParmUpdate();            /* Write SysParm to EEPROM */
                                       /* When FIRST power Up */
                                       /* with UNFormatted EEPROM - will */
@@ -129,6 +148,7 @@ char sts;
   {
     return sts;
   }
+  (void)nvSpjCompact();               /* New journal from the defaults */
   // last_routine = 0x1F;
   sts = nvSysDia5Update(1);
   if ( sts)
@@ -201,6 +221,7 @@ unsigned char *temp_ptr;
 unsigned int i;
 unsigned int eeprom_addr;
 unsigned long temp_word;
+char journal;                   /* SysParm came from the SysParm journal */
 
   /* Locate and "map" the EEPROM's "System NonVolatile" parameters partition */
   // last_routine = 0x20;
@@ -241,11 +262,16 @@ unsigned long temp_word;
                          sizeof(SysParmNV) - 2,
                          INIT_CRC_SEED);
   }
+  journal = (char)(Pptr && nvSpjLoad ());  /* Newer than the block */
 //>>> FogBugz 131  if (Pptr && (crc == Pptr->CRC))     /* EE's SysParm block look good? */
-  if ((Pptr && (crc == Pptr->CRC)) || 
+  if (journal || (Pptr && (crc == Pptr->CRC)) || 
      (Pptr && (home_block.Version & EE_MINVERMASK) == 0x15)) //<<< FogBugz 131
   {  /* copy it to RAM */
-    memcpy (&SysParm, (char *)Pptr, sizeof(SysParmNV));
+    if (!journal)
+    {
+      memcpy (&SysParm, (char *)Pptr, sizeof(SysParmNV));
+      (void)nvSpjCompact ();          /* Start the journal from it */
+    }
     if(SysParm.DM_Max_Open == 0)  /* ensure new active deadman variable are included */
     {  // put in defaults if not already there
       SysParm.DM_Max_Open = DM_OPEN;
@@ -443,6 +469,212 @@ char sts;
   return (sts);                       /* Propagate success/failure */
 } /* End nvSysVoltUpdate() */
 
+/****************************************************************************
+*
+* SysParm journal
+*
+* Every parameter change used to rewrite the whole SysParm block, the same
+* 64 bytes of EEPROM each time. The SysParm journal (EEP_SPJ) is two
+* regions used in turn. The current region holds a snapshot of SysParm
+* followed by change records, one per changed byte, so an update writes
+* only what changed (the last record of an update carries SPJ_COMMIT, and
+* an update missing its commit record is ignored). When the records run
+* out the whole of SysParm goes into the other region as its snapshot,
+* with the next generation number; the header is written last, so until
+* it is the previous region is still the one used. Boot (nvSysInit())
+* takes the valid region with the newest generation and replays its
+* committed records. The old SysParm block is written at each compaction,
+* so that it is never more than SPJ_RECS changes behind.
+*
+* Records are 4 byte aligned and so never straddle an EEPROM page, but the
+* records of one update can: eeBlockWrite() then makes two page writes
+* (region 0's records cross 0x300). A power cut between them loses the
+* commit record, so the update is ignored as a whole.
+*
+****************************************************************************/
+
+static SysParmNV spj_image;             /* SysParm as the journal has it */
+static unsigned char spj_ready;         /* Journal in use */
+static unsigned char spj_region;        /* Current region, 0 or 1 */
+static unsigned int spj_gen;            /* Its generation */
+static unsigned int spj_used;           /* Change records written */
+
+/* Record check byte: CRC-8 of offset, value and generation */
+
+static unsigned char spj_check (const unsigned char *rec)
+{
+  return (Dallas_CRC8 ((UINT8 *)rec, 3));
+}
+
+/* Stop using the journal: invalidate both headers so that nvSysInit()
+   goes back to the SysParm block */
+
+static void spj_drop (unsigned int base)
+{
+  (void)eeBlockFill ((unsigned long)base, 0xFF, SPJ_HDRSIZ);
+  (void)eeBlockFill ((unsigned long)base + SPJ_REGSIZ, 0xFF, SPJ_HDRSIZ);
+  spj_ready = FALSE;
+}
+
+/* Stop using the journal, for a format: nvSysParmUpdate() then writes the
+   SysParm block until nvSpjCompact() starts a new journal from it */
+
+static void nvSpjStop (void)
+{
+  unsigned int base, size;
+
+  if (eeMapPartition (EEP_SPJ, &size, &base) == 0)
+  {
+    spj_drop (base);
+  }
+  spj_ready = FALSE;
+}
+
+/****************************************************************************
+* nvSpjCompact -- Start a new SysParm journal region from SysParm
+*
+* Writes all of SysParm as the snapshot of the other region, then its
+* header. Also brings the SysParm block up to date.
+****************************************************************************/
+static char nvSpjCompact (void)
+{
+  unsigned char hdr[SPJ_HDRSIZ];
+  unsigned int base, size, crc, gen;
+  unsigned long addr;
+  unsigned char region;
+  char sts;
+
+  sts = eeMapPartition (EEP_SPJ, &size, &base);
+  if (sts)
+  {
+    spj_ready = FALSE;
+    return (sts);
+  }
+  crc = modbus_CRC ((unsigned char *)&SysParm, sizeof(SysParmNV) - 2, INIT_CRC_SEED);
+  SysParm.CRC = crc;
+  region = (unsigned char)(spj_ready ? (spj_region ^ 1) : 0);
+  gen = spj_gen + 1;
+  addr = (unsigned long)base + ((unsigned long)region * SPJ_REGSIZ);
+  sts = eeBlockFill (addr + SPJ_JRNOFS, 0xFF, SPJ_RECS * SPJ_RECSIZ);
+  if (sts == 0)
+  {
+    sts = eeBlockWrite (addr + SPJ_HDRSIZ, (unsigned char *)&SysParm, sizeof(SysParmNV));
+  }
+  if (sts == 0)
+  {
+    hdr[0] = (unsigned char)(SPJ_MAGIC >> 8);
+    hdr[1] = (unsigned char)SPJ_MAGIC;
+    hdr[2] = (unsigned char)(gen >> 8);
+    hdr[3] = (unsigned char)gen;
+    sts = eeBlockWrite (addr, hdr, SPJ_HDRSIZ);
+  }
+  if (sts)
+  {
+    spj_drop (base);
+    return (sts);
+  }
+  spj_ready = TRUE;
+  spj_region = region;
+  spj_gen = gen;
+  spj_used = 0;
+  memcpy (&spj_image, &SysParm, sizeof(SysParmNV));
+
+  if (eeMapPartition (EEP_SYSNV, &size, &base) == 0)
+  {
+    (void)eeBlockWrite ((unsigned long)base, (unsigned char *)&SysParm, sizeof(SysParmNV));
+  }
+  return (0);
+} /* End nvSpjCompact() */
+
+/****************************************************************************
+* nvSpjLoad -- Load SysParm from the SysParm journal
+*
+* Returns TRUE, with SysParm filled in, if the journal holds a valid region;
+* FALSE (SysParm untouched, journal not in use) if not.
+****************************************************************************/
+static char nvSpjLoad (void)
+{
+  SysParmNV snap;
+  unsigned char hdr[SPJ_HDRSIZ];
+  unsigned char jrn[SPJ_RECS * SPJ_RECSIZ];
+  unsigned char *rec;
+  unsigned int base, size, gen, crc, i;
+  unsigned long addr;
+  unsigned char region, found;
+
+  spj_ready = FALSE;
+  spj_gen = 0;
+  if (eeMapPartition (EEP_SPJ, &size, &base) != 0)
+  {
+    return (FALSE);
+  }
+  found = FALSE;
+  for (region = 0; region < 2; region++)
+  {
+    addr = (unsigned long)base + ((unsigned long)region * SPJ_REGSIZ);
+    if ((eeReadBlock ((unsigned int)addr, hdr, SPJ_HDRSIZ) != 0)
+        || (hdr[0] != (unsigned char)(SPJ_MAGIC >> 8))
+        || (hdr[1] != (unsigned char)SPJ_MAGIC))
+    {
+      continue;
+    }
+    gen = ((unsigned int)hdr[2] << 8) | hdr[3];
+    if (found && ((int)(gen - spj_gen) <= 0))
+    {
+      continue;                         /* Not newer than the other */
+    }
+    if (eeReadBlock ((unsigned int)addr + SPJ_HDRSIZ, (unsigned char *)&snap,
+                     sizeof(SysParmNV)) != 0)
+    {
+      continue;
+    }
+    crc = modbus_CRC ((unsigned char *)&snap, sizeof(SysParmNV) - 2, INIT_CRC_SEED);
+    if (crc != snap.CRC)
+    {
+      continue;
+    }
+    memcpy (&spj_image, &snap, sizeof(SysParmNV));
+    spj_region = region;
+    spj_gen = gen;
+    found = TRUE;
+  }
+  if (!found)
+  {
+    return (FALSE);
+  }
+
+  /* Replay the committed changes: "snap" collects an update until its
+     commit record, spj_image has everything committed */
+
+  addr = (unsigned long)base + ((unsigned long)spj_region * SPJ_REGSIZ);
+  if (eeReadBlock ((unsigned int)addr + SPJ_JRNOFS, jrn, sizeof(jrn)) != 0)
+  {
+    return (FALSE);
+  }
+  memcpy (&snap, &spj_image, sizeof(SysParmNV));
+  spj_used = 0;
+  for (i = 0; i < SPJ_RECS; i++)
+  {
+    rec = &jrn[i * SPJ_RECSIZ];
+    if ((rec[2] != (unsigned char)spj_gen) || (spj_check (rec) != rec[3])
+        || ((rec[0] & ~SPJ_COMMIT) >= (sizeof(SysParmNV) - 2)))
+    {
+      break;                            /* Erased, torn or stale */
+    }
+    ((unsigned char *)&snap)[rec[0] & ~SPJ_COMMIT] = rec[1];
+    if (rec[0] & SPJ_COMMIT)
+    {
+      memcpy (&spj_image, &snap, sizeof(SysParmNV));
+      spj_used = i + 1;                 /* Next record goes after this */
+    }
+  }
+  spj_image.CRC = modbus_CRC ((unsigned char *)&spj_image, sizeof(SysParmNV) - 2,
+                              INIT_CRC_SEED);
+  memcpy (&SysParm, &spj_image, sizeof(SysParmNV));
+  spj_ready = TRUE;
+  return (TRUE);
+} /* End nvSpjLoad() */
+
 /****************************************************************************
 * nvSysParmUpdate -- Update "SysParm" block in EEPROM
 *
@@ -452,14 +684,67 @@ char sts;
 *
 * On successful return, the "SysParm" block in the "System" partition has
 * been updated. On failure, who knows what has happened...
+*
+* With the SysParm journal in use, only the bytes of SysParm that differ
+* from what the journal holds are written, as change records; a full
+* journal is compacted into the other region instead.
 ****************************************************************************/
 char nvSysParmUpdate (void)
 {
+  unsigned char rec[SPJ_RECS * SPJ_RECSIZ];
+  unsigned char *now, *was, *ptr;
   unsigned int base;                  /* Base offset of System-NV partition */
   unsigned int size;                  /* Size (bytes) of System-NV partition */
-  unsigned int crc;
+  unsigned int crc, i, count;
   char sts;
 
+  if (spj_ready)
+  {
+    now = (unsigned char *)&SysParm;
+    was = (unsigned char *)&spj_image;
+    ptr = rec;
+    count = 0;
+    for (i = 0; i < (sizeof(SysParmNV) - 2); i++)
+    {
+      if (now[i] != was[i])
+      {
+        if ((spj_used + count) >= SPJ_RECS)
+        {
+          return (nvSpjCompact ());     /* Journal full */
+        }
+        *ptr++ = (unsigned char)i;
+        *ptr++ = now[i];
+        *ptr++ = (unsigned char)spj_gen;
+        ptr++;
+        count++;
+      }
+    }
+    SysParm.CRC = modbus_CRC ((unsigned char *)&SysParm, sizeof(SysParmNV) - 2, INIT_CRC_SEED);
+    if (count == 0)
+    {
+      return (0);                       /* Nothing changed */
+    }
+    rec[(count - 1) * SPJ_RECSIZ] |= SPJ_COMMIT;
+    for (i = 0; i < count; i++)
+    {
+      rec[(i * SPJ_RECSIZ) + 3] = spj_check (&rec[i * SPJ_RECSIZ]);
+    }
+    sts = eeMapPartition (EEP_SPJ, &size, &base);
+    if (sts == 0)
+    {
+      sts = eeBlockWrite ((unsigned long)base + ((unsigned long)spj_region * SPJ_REGSIZ)
+                          + SPJ_JRNOFS + (spj_used * SPJ_RECSIZ),
+                          rec, count * SPJ_RECSIZ);
+    }
+    if (sts)
+    {
+      return (nvSpjCompact ());         /* Don't trust that region now */
+    }
+    spj_used += count;
+    memcpy (&spj_image, &SysParm, sizeof(SysParmNV));
+    return (0);
+  }
+
   sts = eeMapPartition (EEP_SYSNV, &size, &base);
   if (sts)
   {
@@ -648,6 +933,68 @@ char nvSysWrBlock
 *
 ****************************************************************************/
 
+/* RAM copy of the newest EVRECENT Event Log records, exactly as they are in
+   EEPROM (bytes and all), indexed by log entry index modulo EVRECENT. An
+   ev_recent_idx[] of EVRECENT_NONE means that copy is not known good and the
+   record must be read from EEPROM. EVRECENT covers nvLogRepeat()'s search. */
+
+#define EVRECENT        8
+#define EVRECENT_NONE   0xFFFF
+
+static E2LOGREC ev_recent[EVRECENT];
+static unsigned int ev_recent_idx[EVRECENT];
+
+/* RAM index of the Type of every Event Log record, so that a filtered
+   query only reads the records it returns. EVTYPE_NONE is an empty slot;
+   EVTYPE_READ means the slot is not known (failed write) and the Type
+   must be read from EEPROM. Not used (ev_typed FALSE) if the log is
+   bigger than E2LOGCNT or could not all be read. The times are not
+   indexed: the log is in time order, so nvLogAtTime() binary searches
+   the EEPROM instead of holding 4 bytes per record in RAM. */
+
+#define EVTYPE_NONE     0xFF
+#define EVTYPE_READ     0xFE
+
+static unsigned char ev_type[E2LOGCNT];
+static unsigned char ev_typed;
+
+/****************************************************************************
+* nvLogRecent -- Fetch a recent Event Log record, from RAM if possible
+*
+* Call is:
+*
+*   nvLogRecent (index, eptr)
+*
+* Returns a pointer to the record for Event Log entry "index". If the
+* ev_recent[] copy is good that is returned and EEPROM is not touched;
+* otherwise the record is read from EEPROM into "eptr" (and, if the read
+* succeeds, remembered in ev_recent[]).
+****************************************************************************/
+static E2LOGREC *nvLogRecent
+    (
+    unsigned int index,         /* Event Log entry index */
+    E2LOGREC *eptr              /* Buffer for an EEPROM read */
+    )
+{
+unsigned int slot;
+
+  slot = index % EVRECENT;
+  if (ev_recent_idx[slot] == index)
+  {
+    return (&ev_recent[slot]);
+  }
+  if (eeReadBlock(LOG_BASE + (index * sizeof(E2LOGREC)), (unsigned char *)eptr,
+                  sizeof(E2LOGREC)) != 0)
+  {
+    EE_status |= EE_FORMAT;         /* EEPROM needs formatting */
+    StatusB |= STSB_ERR_EEPROM;     /* Note errors reading EEPROM */
+    return (eptr);
+  }
+  memcpy (&ev_recent[slot], eptr, sizeof(E2LOGREC));
+  ev_recent_idx[slot] = index;
+  return (&ev_recent[slot]);
+} /* End nvLogRecent() */
+
 /****************************************************************************
 * nvLogInit -- Initialize Event Logging
 *
@@ -676,6 +1023,7 @@ char sts;
    *************************************************************************/
   evMax = 0;                      /* Not allowed to index */
   evIndex = 0;                    /* Starting index if we could write */
+  ev_typed = FALSE;
   sts = eeMapPartition (EEP_LOG, &evMax, &base);
   /* Map "address" of EEPROM-resident Event Log block */
   if (sts == 0)               /* If OK so far...*/
@@ -694,6 +1042,11 @@ char sts;
         break;
       }
       byte_swap = long_swap(log_store.Time);  /* Current UCT date/time  */
+      if (i < E2LOGCNT)
+      {
+        ev_type[i] = (byte_swap == 0xFFFFFFFF) ? EVTYPE_NONE
+                                               : (unsigned char)log_store.Type;
+      }
 
       if ((byte_swap != 0xFFFFFFFF)  /* Ignore empty slots */
            && (byte_swap > hitime))  /* Check date/time */
@@ -709,6 +1062,7 @@ char sts;
       }
       logptr+=sizeof(E2LOGREC);   /* Advance to next Event Log entry */
     }
+    ev_typed = (unsigned char)((i == evMax) && (evMax <= E2LOGCNT));
     /* Setup volatile parameters based on Non-Volatile EEPROM */
     hindex++;                       /* Point to "next" free slot */
     if (hindex >= evMax)      /* Off end of Event Log block? */
@@ -720,6 +1074,29 @@ char sts;
        automatically set the system clock forward? */
   }
   evLastRead = evIndex;             /* Assume TAS/VIPER up to date */
+  /* Load the RAM copy of the newest records for merge/repeat */
+  for (i = 0; i < EVRECENT; i++)
+  {
+    ev_recent_idx[i] = EVRECENT_NONE;
+  }
+  if ((sts == 0) && (evMax != 0))
+  {
+    hindex = evIndex;
+    for (i = 0; (i < EVRECENT) && (i < evMax); i++)
+    {
+      if (hindex == 0)
+      {
+        hindex = evMax;
+      }
+      hindex--;
+      logptr = LOG_BASE + ((unsigned long)hindex * sizeof(E2LOGREC));
+      if (eeReadBlock((unsigned int)logptr, (unsigned char *)&ev_recent[hindex % EVRECENT],
+                      sizeof(E2LOGREC)) == 0)
+      {
+        ev_recent_idx[hindex % EVRECENT] = hindex;
+      }
+    }
+  }
   return (sts);                     /* Return likely success/fail status */
 } /* End nvLogInit() */
 
@@ -806,6 +1183,82 @@ char nvLogGet
   return sts;                         /* Success return */
 } /* End nvLogGet() */
 
+/****************************************************************************
+* nvLogType -- Type of an Event Log entry
+*
+* Call is:
+*
+*   nvLogType (index)
+*
+* Returns the Type of Event Log entry "index", or 0xFF if the slot is empty
+* (or unreadable). Answered from the ev_type[] index when possible; else
+* the Type byte is read from EEPROM.
+****************************************************************************/
+unsigned char nvLogType (unsigned int index)
+{
+unsigned char type;
+
+  if (ev_typed && (ev_type[index] != EVTYPE_READ))
+  {
+    return (ev_type[index]);
+  }
+  if (eeReadBlock(LOG_BASE + (index * sizeof(E2LOGREC)), &type, 1) != 0)
+  {
+    return (EVTYPE_NONE);
+  }
+  return (type);
+} /* End nvLogType() */
+
+/****************************************************************************
+* nvLogAtTime -- Find the oldest Event Log entry at or after a time
+*
+* Call is:
+*
+*   nvLogAtTime (when)
+*
+* Returns the index of the oldest entry logged at or after "when" (UCT), or
+* 0xFFFF if there is none. The log is written in time order from the oldest
+* entry (evIndex once it has wrapped) so this is a binary search, reading
+* only the Time of about a dozen entries. Empty slots count as older than
+* any time.
+****************************************************************************/
+unsigned int nvLogAtTime (unixtime when)
+{
+unsigned long stamp;
+unsigned int lo, hi, mid, index;
+
+  if (evMax == 0)                     /* Event Logging disabled? */
+  {
+    return (0xFFFF);
+  }
+  lo = 0;                             /* Positions, 0 = oldest */
+  hi = evMax;
+  while (lo < hi)
+  {
+    mid = lo + ((hi - lo) / 2);
+    index = (unsigned int)(((unsigned long)evIndex + mid) % evMax);
+    if (eeReadBlock(LOG_BASE + (index * sizeof(E2LOGREC)) + 4,
+                    (unsigned char *)&stamp, sizeof(stamp)) != 0)
+    {
+      return (0xFFFF);
+    }
+    stamp = long_swap(stamp);
+    if ((stamp == 0xFFFFFFFF) || (stamp < when))
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+  if (lo >= evMax)
+  {
+    return (0xFFFF);                  /* Everything is older */
+  }
+  return ((unsigned int)(((unsigned long)evIndex + lo) % evMax));
+} /* End nvLogAtTime() */
+
 /****************************************************************************
 * nvLogPut -- Write an Event Log entry to EEPROM
 *
@@ -880,8 +1333,19 @@ unsigned long byte_swap;
                       sizeof(E2LOGREC));
   if (sts)                            /* Problems writing EEPROM? */
   {
+      ev_recent_idx[evIndex % EVRECENT] = EVRECENT_NONE; /* Unknown now */
+      if (ev_typed)
+      {
+        ev_type[evIndex] = EVTYPE_READ;
+      }
       return;                         /* Yes, punt */
   }
+  if (ev_typed)
+  {
+    ev_type[evIndex] = (unsigned char)etyp;
+  }
+  memcpy (&ev_recent[evIndex % EVRECENT], &event, sizeof(E2LOGREC));
+  ev_recent_idx[evIndex % EVRECENT] = evIndex;
   evIndex++;                          /* Advance Event Log "first free" */
   if (evIndex == evMax)               /* Hit "end" of circular buffer? */
   {
@@ -938,7 +1402,6 @@ E2LOGREC *logptr;               /* Pointer to EEPROM Event Log entry */
 unsigned base;                  /* Base offset of Event Log partition */
 unsigned size;                  /* Size (bytes) of Event Log partition */
 unsigned int lasti, orbits, sts;
-unsigned int eeprom_addr;
 unsigned long current_time;
 
   // last_routine = 0x2A;
@@ -957,13 +1420,7 @@ unsigned long current_time;
     lasti = evMax;                  /* Wrap back */
   }
   lasti--;                            /* Last entry written */
-  eeprom_addr = LOG_BASE + (lasti * sizeof(E2LOGREC));
-  if (eeReadBlock(eeprom_addr, (unsigned char *)&last_log, sizeof(E2LOGREC)) != 0)
-  {
-    EE_status |= EE_FORMAT;         /* EEPROM needs formatting */
-    StatusB |= STSB_ERR_EEPROM;        /* Note errors reading EEPROM */
-  }
-  logptr = (E2LOGREC *)&last_log;     /* Point to stored last record */
+  logptr = nvLogRecent (lasti, &last_log); /* Point to last record */
   current_time = long_swap(logptr->Time);  /* Current UCT date/time  */
   if ((lasti != evLastRead)           /* If TAS/VIPER hasn't read this yet, */
       && (logptr->Type == etyp)       /*   the types match, */
@@ -973,8 +1430,15 @@ unsigned long current_time;
     && (current_time  + deltat > present_time)) /* AND it was fairly recently */
   {                               /* Merge this entry */
     orbits = (char)(logptr->Subtype | esub); /* "Merge" Subtype fields */
-    (void)eeWriteByte (base + (lasti * sizeof(E2LOGREC)) + 1,
-                       (unsigned char)orbits);
+    if (eeWriteByte (base + (lasti * sizeof(E2LOGREC)) + 1,
+                       (unsigned char)orbits) == 0)
+    {
+      logptr->Subtype = (char)orbits;  /* Keep the RAM copy matching */
+    }
+    else
+    {
+      ev_recent_idx[lasti % EVRECENT] = EVRECENT_NONE;
+    }
   }
   else
   {                               /* Must write new entry */
@@ -1038,7 +1502,6 @@ E2LOGREC log_store;             /* Pointer to EEPROM Event Log entry */
 unsigned base;                  /* Base offset of Event Log partition */
 unsigned size;                  /* Size (bytes) of Event Log partition */
 unsigned int i, lasti, orbits;
-unsigned int eeprom_addr;
 unsigned long current_time;
 union
 {
@@ -1067,13 +1530,7 @@ union
       i = 0;                      /* Terminate the search, and write */
       break;                      /*  this entry as a new one */
     }
-    eeprom_addr = LOG_BASE + (lasti * sizeof(E2LOGREC));
-    if (eeReadBlock(eeprom_addr, (unsigned char *)&log_store, sizeof(E2LOGREC)) != 0)
-    {
-      EE_status |= EE_FORMAT;     /* EEPROM needs formatting */
-      StatusB |= STSB_ERR_EEPROM; /* Note errors reading EEPROM */
-    }
-    logptr = (E2LOGREC *)&log_store;     /* Point to stored last record */
+    logptr = nvLogRecent (lasti, &log_store); /* Point to this record */
     current_time = long_swap(logptr->Time);  /* Current UCT date/time  */
     if ((logptr->Type == etyp)      /* If the types match, */
         && (logptr->Subtype == esub) /*  and the subtypes match */
@@ -1095,8 +1552,10 @@ union
       if (eeWriteByte (base + (lasti * sizeof(E2LOGREC)) + 2,
                              (unsigned char)orbits))
       {
+        ev_recent_idx[lasti % EVRECENT] = EVRECENT_NONE;
         return; /* Rewrite repeat mask low byte */
       }
+      ((unsigned char *)&logptr->RepMask)[0] = (unsigned char)orbits;
       orbits = (unsigned char)(byte_swap.data[1]);
       asm volatile("nop");    /* place for the breakpoint to stop */
       asm volatile("nop");    /* place for the breakpoint to stop */
@@ -1104,8 +1563,10 @@ union
       if (eeWriteByte (base + (lasti * sizeof(E2LOGREC)) + 3,
                              (unsigned char)orbits))
       {
+        ev_recent_idx[lasti % EVRECENT] = EVRECENT_NONE;
         return; /* Rewrite repeat mask low byte */
       }
+      ((unsigned char *)&logptr->RepMask)[1] = (unsigned char)orbits;
       break;                      /* Done searching, entry repeated */
     } /* End if one record repeatable */
   } /* End 'for' loop on finding repeatable entry */
@@ -1117,4 +1578,148 @@ union
   }
 } /* End nvLogRepeat() */
 
+/****************************************************************************
+*
+* Non-Volatile Session Record ring services
+*
+* Sessions are written in order around E2SESCNT slots, each one tagged with
+* the next sequence number (0xFFFF is never used, it marks an erased slot).
+* The newest record is the valid one whose successor slot does not carry
+* the following sequence number.
+*
+****************************************************************************/
+
+static unsigned int sesIndex;       /* Next slot to write */
+static unsigned int sesSeq;         /* Next sequence number to use */
+static unsigned int sesCount;       /* Valid records held */
+
+static unsigned int nvSesNextSeq (unsigned int seq)
+{
+  seq++;
+  if (seq == 0xFFFF)                /* Reserved for erased slots */
+  {
+    seq = 0;
+  }
+  return (seq);
+} /* End nvSesNextSeq() */
+
+/* Read slot "slot" into "sptr"; returns TRUE if it holds a good record */
+static char nvSesRead (unsigned int slot, E2SESREC *sptr)
+{
+  if (eeReadBlock(SES_BASE + (slot * sizeof(E2SESREC)), (unsigned char *)sptr,
+                  sizeof(E2SESREC)) != 0)
+  {
+    return (FALSE);
+  }
+  if (sptr->Seq == 0xFFFF)
+  {
+    return (FALSE);
+  }
+  return (sptr->CRC == modbus_CRC ((unsigned char *)sptr,
+                                   sizeof(E2SESREC) - 2, INIT_CRC_SEED));
+} /* End nvSesRead() */
+
+/****************************************************************************
+* nvSesInit -- Find the newest Session Record
+*
+* Call is:
+*
+*   nvSesInit ()
+*
+* Scans the Session Record ring and sets up the next slot and sequence
+* number to write. An unreadable or erased ring simply starts at slot zero.
+****************************************************************************/
+void nvSesInit (void)
+{
+E2SESREC rec;
+unsigned int seq[E2SESCNT];
+unsigned char good[E2SESCNT];
+unsigned int i, next;
+
+  sesIndex = 0;
+  sesSeq = 0;
+  sesCount = 0;
+  for (i = 0; i < E2SESCNT; i++)
+  {
+    good[i] = (unsigned char)nvSesRead (i, &rec);
+    seq[i] = rec.Seq;
+    if (good[i])
+    {
+      sesCount++;
+    }
+  }
+  for (i = 0; i < E2SESCNT; i++)
+  {
+    if (!good[i])
+    {
+      continue;
+    }
+    next = (i + 1) % E2SESCNT;
+    if (!good[next] || (seq[next] != nvSesNextSeq (seq[i])))
+    {
+      sesIndex = next;              /* Slot "i" is the newest */
+      sesSeq = nvSesNextSeq (seq[i]);
+      break;
+    }
+  }
+} /* End nvSesInit() */
+
+/****************************************************************************
+* nvSesPut -- Write a Session Record
+*
+* Call is:
+*
+*   nvSesPut (sptr)
+*
+* The sequence number and CRC are filled in and the record is written to
+* the next slot with a single (page-contained) EEPROM write. Returns the
+* eeBlockWrite() status.
+****************************************************************************/
+char nvSesPut (E2SESREC *sptr)
+{
+char sts;
+
+  sptr->Seq = sesSeq;
+  sptr->CRC = modbus_CRC ((unsigned char *)sptr, sizeof(E2SESREC) - 2,
+                          INIT_CRC_SEED);
+  sts = eeBlockWrite ((unsigned long)(SES_BASE + (sesIndex * sizeof(E2SESREC))),
+                      (unsigned char *)sptr, sizeof(E2SESREC));
+  if (sts == 0)
+  {
+    sesSeq = nvSesNextSeq (sesSeq);
+    if (++sesIndex >= E2SESCNT)
+    {
+      sesIndex = 0;
+    }
+    if (sesCount < E2SESCNT)
+    {
+      sesCount++;
+    }
+  }
+  return (sts);
+} /* End nvSesPut() */
+
+/****************************************************************************
+* nvSesGet -- Read a Session Record
+*
+* Call is:
+*
+*   nvSesGet (back, sptr)
+*
+* Reads the record "back" sessions before the newest (0 = newest) into
+* "sptr". Returns zero on success, non-zero if there is no such record or
+* it is unreadable.
+****************************************************************************/
+char nvSesGet (unsigned int back, E2SESREC *sptr)
+{
+unsigned int slot;
+
+  if (back >= sesCount)
+  {
+    return (1);
+  }
+  slot = (sesIndex + E2SESCNT - 1 - back) % E2SESCNT;
+  return ((char)(nvSesRead (slot, sptr) ? 0 : 1));
+} /* End nvSesGet() */
+
 /*********************** end of NVSYSTEM.C **********************************/
@@ -30,6 +30,31 @@
  * Original
  * 1.6.32  04/12/15  DHP  In nvTrkErase() changed return code on error to MB_EXC_FAULT;
  *                                           from what on invalid partition decoded as MB_EXC_ILL_FUNC 
+ * 1.6.38  10/19/26  AGT  Added optional packed Truck ID format: sorted,
+ *                          delta-encoded serial numbers in CRC-16 checked
+ *                          blocks with binary search by block. nvTrkInit()
+ *                          selects the format; the nvTrk*() index functions
+ *                          translate logical indices when it is active.
+ *                         Packed format version 2: a block directory read
+ *                          in one pass at boot, an update-in-progress flag
+ *                          and tpk_repair(); a split writes the new upper
+ *                          block first. Added nvTrkRank().
+ *                         Added a RAM copy of the Bypass Key store with a
+ *                          hashed index (nvKeyInit()): nvKeyFind() and
+ *                          nvKeyEmpty() no longer read the EEPROM, and the
+ *                          nvKey write functions keep the copy current.
+ *                        Dropped nvTrkEmpty()'s unused tidarray/tim_store.
+                         Packed format version 3: a map of the blocks in
+                          sorted order, so a split takes the nearest free
+                          block instead of moving every later one up.
+                         nvTrkPut()/nvTrkPutMany() replace the Truck IDs at
+                          the given sorted positions in the packed format
+                          (tpk_replace()) instead of ignoring the index.
+                         A packed list loaded in order fills its blocks: a
+                          Truck ID past the end starts a new block rather
+                          than splitting the last one. A full block hands
+                          a Truck ID to a neighbour with room (tpk_push())
+                          before it splits.
 ****************************************************************************/
 
 #include "common.h"
@@ -57,6 +82,145 @@ static const char erased[] = { "\377\377\377\377\377\377\377\377" };
 *
 ****************************************************************************/
 
+/****************************************************************************
+*
+* RAM copy of the Bypass Key store
+*
+* read_bypass() validates a presented key every half second, and walking
+* the Key partition for it is 32 I2C reads. The serial numbers are kept
+* in RAM instead, along with which slots hold a good (CRC checked) key and
+* which are erased, and an open addressed (linear probe) hash of the good
+* keys gives nvKeyFind() its slot directly. The copy is loaded at boot by
+* nvKeyInit() and updated by every function here that writes the Key
+* partition; a failed write reloads it from the EEPROM. If the partition
+* is larger than E2KEYCNT keys, or cannot be read, the copy is not used
+* and the EEPROM is searched as before.
+*
+****************************************************************************/
+
+static unsigned char key_ram[E2KEYCNT][BYTESERIAL]; /* Serial numbers */
+static unsigned long key_good;          /* Slot holds a CRC checked key */
+static unsigned long key_free;          /* Slot erased (all 0xFF) */
+static unsigned char key_hash[KEY_HASHSIZ]; /* Slot + 1, 0 = unused */
+static word key_slots;                  /* Slots in the partition */
+static unsigned char key_valid;         /* RAM copy may be used */
+
+/****************************************************************************
+* key_hash_of -- First hash index to try for "key"
+****************************************************************************/
+
+static unsigned key_hash_of (const unsigned char *key)
+{
+    unsigned h;
+
+    h = (unsigned)key[0] ^ ((unsigned)key[1] << 1) ^ ((unsigned)key[2] << 2)
+        ^ (unsigned)key[3] ^ ((unsigned)key[4] << 3) ^ ((unsigned)key[5] << 4);
+    return ((h ^ (h >> 6)) & (KEY_HASHSIZ - 1));
+}
+
+/****************************************************************************
+* key_hash_build -- Rebuild the hash from key_ram[]/key_good
+*
+* Keys go in lowest slot first and a duplicate is not entered again, so
+* (as with the EEPROM search) nvKeyFind() returns the lowest matching slot.
+****************************************************************************/
+
+static void key_hash_build (void)
+{
+    unsigned h;
+    word i;
+
+    memset (key_hash, 0, sizeof(key_hash));
+    for (i = 0; i < key_slots; i++)
+        {
+        if (!(key_good & (1UL << i)))
+            continue;
+        h = key_hash_of (key_ram[i]);
+        while (key_hash[h] != 0)
+            {
+            if (memcmp (key_ram[key_hash[h] - 1], key_ram[i], BYTESERIAL) == 0)
+                break;                  /* Already have this key */
+            h = (h + 1) & (KEY_HASHSIZ - 1);
+            }
+        if (key_hash[h] == 0)
+            key_hash[h] = (unsigned char)(i + 1);
+        }
+}
+
+/****************************************************************************
+* key_ram_set -- Record what was written to Key slot "index"
+*
+* "key" is the serial number written, or NULL if the slot was erased.
+* "sts" is the status of the write; on failure the copy is reloaded.
+****************************************************************************/
+
+static void key_ram_set (const unsigned char *key, word index, char sts)
+{
+    if (!key_valid)
+        return;
+    if ((sts != 0) || (index >= key_slots))
+        {
+        nvKeyInit ();                   /* Don't know, look again */
+        return;
+        }
+    if (key)
+        {
+        memcpy (key_ram[index], key, BYTESERIAL);
+        key_good |= (1UL << index);
+        key_free &= ~(1UL << index);
+        }
+    else
+        {
+        memset (key_ram[index], 0xFF, BYTESERIAL);
+        key_good &= ~(1UL << index);
+        key_free |= (1UL << index);
+        }
+}
+
+/****************************************************************************
+* nvKeyInit -- Load the RAM copy of the Bypass Key store
+*
+* Call is:
+*
+*   nvKeyInit ()
+*
+* Called from eeInit(); reads the whole Key partition once.
+****************************************************************************/
+
+void nvKeyInit (void)
+{
+    E2KEYREC key_store;         /* Temp storage of current key eeprom entry */
+    word base;                  /* Base offset of Key partition */
+    word size;                  /* Size (bytes) of Key partition */
+    word i;
+
+    key_valid = FALSE;
+    key_good = 0;
+    key_free = 0;
+    if (eeMapPartition (EEP_KEY, &size, &base) != 0)
+        return;
+    key_slots = size/sizeof(E2KEYREC);
+    if (key_slots > E2KEYCNT)           /* More than the copy can hold */
+        return;
+
+    for (i = 0; i < key_slots; i++)
+        {
+        if (eeReadBlock(KEY_BASE + (word)(i * sizeof(E2KEYREC)),
+                        (unsigned char *)&key_store, sizeof(E2KEYREC)) != 0)
+            return;
+        memcpy (key_ram[i], key_store.Key, BYTESERIAL);
+        if ((memcmp (key_store.Key, erased, BYTESERIAL) == 0)
+            && (key_store.CRC == 0xFFFF))
+            key_free |= (1UL << i);     /* *ALL* bytes erased */
+        else if (modbus_CRC (key_store.Key, BYTESERIAL, INIT_CRC_SEED)
+                 == key_store.CRC)
+            key_good |= (1UL << i);     /* Else just ignore "bad" entry */
+        }
+    key_valid = TRUE;
+    key_hash_build ();
+
+} /* End nvKeyInit() */
+
 /****************************************************************************
 * nvKeyEmpty -- Find empty bypass key slot in NonVolatile store
 *
@@ -91,6 +255,19 @@ char nvKeyEmpty
     char sts;
 
   // last_routine = 0x4D;
+    if (key_valid)                      /* Lowest erased slot in RAM copy */
+        {
+        for (i = 0; i < key_slots; i++)
+            {
+            if (key_free & (1UL << i))
+                {
+                *index = i;
+                return (0);
+                }
+            }
+        return (-1);
+        }
+
     sts = eeMapPartition (EEP_KEY, &size, &keybase);
     if (sts)
         return (sts);
@@ -165,6 +342,22 @@ word size;                  /* Size of NV Key store */
   char sts;
 
   // last_routine = 0x4E;
+  if (key_valid)                        /* Hashed lookup in RAM copy */
+  {
+    i = key_hash_of (key);
+    while (key_hash[i] != 0)
+    {
+      if (memcmp (key_ram[key_hash[i] - 1], key, BYTESERIAL) == 0)
+      {
+        *index = (word)(key_hash[i] - 1);  /* Return matching index */
+        return (0);
+      }
+      i = (i + 1) & (KEY_HASHSIZ - 1);
+    }
+    printf("\n\r*** Bypass Key not found in EEPROM ***\n\r");
+    return (-1);
+  }
+
   sts = eeMapPartition (EEP_KEY, &size, &keybase);
   if (sts)
       return (sts);
@@ -452,6 +645,8 @@ char nvKeyPut
     sts = eeBlockWrite ((unsigned long)((unsigned long)base + ((unsigned long)index * (unsigned long)sizeof(E2KEYREC))),
                         (unsigned char *)&keycrc,
                         sizeof(E2KEYREC));
+    key_ram_set (key, index, sts);
+    key_hash_build ();
   // last_routine = 0x51;
     printf("\n\r*** Bypass Key ");
     Report_SN(key);
@@ -530,6 +725,11 @@ char nvKeyPutMany
       sts = eeBlockWrite ((unsigned long)((unsigned long)base + ((unsigned long)index * (unsigned long)sizeof(E2KEYREC))),
                         (unsigned char *)&keycrc[0],
                         (unsigned)((unsigned int)cnt * sizeof(E2KEYREC)));
+      for (i = 0; i < cnt; i++)
+        {
+        key_ram_set (keycrc[i].Key, (word)(index + i), sts);
+        }
+      key_hash_build ();
     }
 
 //    sts = eeBlockWrite (base + (index * sizeof(E2KEYREC)),
@@ -578,6 +778,8 @@ char nvKeyDelete
     sts = eeBlockFill ((unsigned long)base + ((unsigned long)index * (unsigned long)sizeof(E2KEYREC)),
                         0xFF,
                         sizeof(E2KEYREC) );
+    key_ram_set (NULL, index, sts);
+    key_hash_build ();
   // last_routine = 0x53;
 
     return (sts);                       /* Propagate success/failure */
@@ -616,6 +818,7 @@ char nvKeyErase (void)
     /* Block-fill Bypass Key NonVolatile store with 0xFF ("erase it"). */
 
     sts = eeBlockFill ((unsigned long)base, 0xff, size);   /* Erase the home block */
+    nvKeyInit ();                       /* Reload the (erased) RAM copy */
 
   // last_routine = 0x54;
     return (sts);                       /* Propagate success/failure */
@@ -629,6 +832,1016 @@ char nvKeyErase (void)
 ****************************************************************************/
 
 
+/****************************************************************************
+*
+* Packed ("sorted") Truck ID format
+*
+* The standard TIM format is a flat array of E2TIMREC slots, filled in
+* whatever order the ModBus master chooses, so that finding a Truck ID
+* means reading every slot. The packed format (selected with SysParm
+* ENA_TIM_PACKED when the TIM list is erased) instead keeps the serial
+* numbers sorted in fixed-size TPK_BLKSIZ blocks. Each block holds a
+* count, the first (low 5 bytes) serial number in full, then the delta
+* to each following serial number as a 7-bits-per-byte variable-length
+* number, and a block CRC-16. nvTrkFind() binary searches the blocks'
+* first serial numbers (a dozen short reads) and then decodes one block.
+* The per-block counts and the block map are kept in RAM, loaded at boot
+* from the header blocks, so that a position in sorted order can be
+* translated to a block/entry. There are no slots: the nvTrk*() functions
+* take an index as the position in sorted order, so the ModBus slot
+* functions (0x41/0x42/0x46/0x47/0x4A) work on the sorted list, writing
+* "slot" n replacing the n'th Truck ID (see tpk_replace()).
+*
+* Partition layout (TIM_BASE relative):
+*
+*   0                   "TPK" magic plus version
+*   TPK_DIRTY           Non-zero while an update is in progress
+*   TPK_DIROFF + p      Count of physical block p (the directory)
+*   TPK_MAPOFF + 2*n    Physical block holding the n'th run of Truck IDs
+*                       in sorted order (the map, n = 0 .. blocks in use-1)
+*   TPK_BLKSIZ * (p+TPK_HDRBLKS)  block p, p = 0 .. TPK_BLOCKS-1
+*
+* Physical blocks are used in any order; the map lists them in sorted
+* order, so that a split takes any free block (the nearest one) and only
+* the map entries above it move, not the blocks themselves. An unused
+* block has a count of 0 (or 0xFF when freshly erased). The block's own
+* count is the real one; the directory and map are written at the end of
+* each update.
+*
+* A full block first hands its largest (smallest) Truck ID on to the next
+* (previous) block if that has room, and is only split when neither does;
+* a list loaded in order just starts a new block at the end.
+*
+* Every update is ordered so that a reset part way through leaves each
+* Truck ID in at least one block: a split writes the upper half to the
+* new block before the lower half replaces the old one, and a Truck ID
+* handed to a neighbour is written there first. The TPK_DIRTY
+* flag is set for the update, and if nvTrkInit() finds it set (or the map
+* doesn't agree with the directory) it rebuilds both from the blocks and
+* trims the duplicates (tpk_repair()).
+*
+****************************************************************************/
+
+static unsigned char tpk_active;        /* Packed format in use */
+static word tpk_used;                   /* Blocks in use (0 .. TPK_BLOCKS) */
+static word tpk_total;                  /* Truck IDs stored */
+static unsigned char tpk_cnt[TPK_BLOCKS]; /* Per-block Truck ID counts */
+static UINT16 tpk_map[TPK_BLOCKS];      /* Sorted order -> physical block */
+
+static unsigned long long tpk_vals[TPK_BLKMAX + 1]; /* Decoded block */
+static unsigned char tpk_n;             /* Entries in tpk_vals[] */
+static word tpk_cur;                    /* Block in tpk_vals[], or 0xFFFF */
+
+static unsigned char tpk_dirty;         /* TPK_DIRTY flag written */
+static word tpk_dlo;                    /* Directory entries to write */
+static word tpk_dhi;
+static word tpk_mlo;                    /* Map entries to write */
+static word tpk_mhi;
+
+/****************************************************************************
+* tpk_addr -- EEPROM address of physical packed block "blk"
+****************************************************************************/
+
+static unsigned long tpk_addr (word blk)
+{
+    return ((unsigned long)TIM_BASE
+            + ((unsigned long)(blk + TPK_HDRBLKS) * (unsigned long)TPK_BLKSIZ));
+}
+
+/****************************************************************************
+* tpk_mark -- Note that the directory entry for block "blk" has changed
+****************************************************************************/
+
+static void tpk_mark (word blk)
+{
+    if (blk < tpk_dlo)
+        tpk_dlo = blk;
+    if ((blk + 1) > tpk_dhi)
+        tpk_dhi = (word)(blk + 1);
+}
+
+/****************************************************************************
+* tpk_mmark -- Note that map entries "lo" up to (not including) "hi" changed
+****************************************************************************/
+
+static void tpk_mmark (word lo, word hi)
+{
+    if (lo < tpk_mlo)
+        tpk_mlo = lo;
+    if (hi > tpk_mhi)
+        tpk_mhi = hi;
+}
+
+/****************************************************************************
+* tpk_begin -- Flag an update in progress (once, until tpk_end())
+****************************************************************************/
+
+static char tpk_begin (void)
+{
+    unsigned char flag;
+
+    tpk_dlo = TPK_BLOCKS;
+    tpk_dhi = 0;
+    tpk_mlo = TPK_BLOCKS;
+    tpk_mhi = 0;
+    if (tpk_dirty)
+        return (0);
+    flag = 1;
+    tpk_dirty = TRUE;
+    return (eeBlockWrite ((unsigned long)TIM_BASE + TPK_DIRTY, &flag, 1));
+}
+
+/****************************************************************************
+* tpk_end -- Write the changed directory and map entries, clear the flag
+*
+* "sts" is the status of the update; if it failed the flag is left set so
+* that the next nvTrkInit() repairs the partition.
+****************************************************************************/
+
+static char tpk_end (char sts)
+{
+    unsigned char flag;
+
+    if ((sts == 0) && (tpk_dlo < tpk_dhi))
+        sts = eeBlockWrite ((unsigned long)TIM_BASE + TPK_DIROFF + tpk_dlo,
+                            &tpk_cnt[tpk_dlo], (unsigned)(tpk_dhi - tpk_dlo));
+    if ((sts == 0) && (tpk_mlo < tpk_mhi))
+        sts = eeBlockWrite ((unsigned long)TIM_BASE + TPK_MAPOFF
+                            + 2 * (unsigned long)tpk_mlo,
+                            (unsigned char *)&tpk_map[tpk_mlo],
+                            2 * (unsigned)(tpk_mhi - tpk_mlo));
+    if (sts == 0)
+    {
+        flag = 0;
+        if ((sts = eeBlockWrite ((unsigned long)TIM_BASE + TPK_DIRTY, &flag, 1)) == 0)
+            tpk_dirty = FALSE;
+    }
+    return (sts);
+}
+
+/****************************************************************************
+* tpk_value -- 40-bit value of the low 5 bytes of a Dallas serial number
+****************************************************************************/
+
+static unsigned long long tpk_value (const unsigned char *ser)
+{
+    unsigned long long val;
+    unsigned char i;
+
+    val = 0;
+    for (i = 0; i < (BYTESERIAL-1); i++)
+        val = (val << 8) | ser[i];
+    return (val);
+}
+
+/****************************************************************************
+* tpk_serial -- Expand 40-bit value back into a 6-byte Truck ID (MSB zero)
+****************************************************************************/
+
+static void tpk_serial (unsigned long long val, unsigned char *trk)
+{
+    unsigned char i;
+
+    for (i = BYTESERIAL-1; i > 0; i--)
+    {
+        trk[i] = (unsigned char)val;
+        val >>= 8;
+    }
+    trk[0] = 0;
+}
+
+/****************************************************************************
+* tpk_load -- Read, verify and decode packed block "blk" into tpk_vals[]
+*
+* The last block decoded is remembered, so that GetMany/VrMany walking
+* through one block only read it once.
+****************************************************************************/
+
+static char tpk_load (word blk)
+{
+    unsigned char buf[TPK_BLKSIZ];
+    unsigned long long val;
+    unsigned long long dlt;
+    unsigned char cnt;
+    unsigned char i;
+    unsigned char shf;
+    char sts;
+
+    if (blk == tpk_cur)
+        return (0);                     /* Already have it */
+
+    tpk_cur = 0xFFFF;
+    if ((sts = eeBlockRead (tpk_addr (blk), buf, TPK_BLKSIZ)) != 0)
+        return (sts);
+
+    if (modbus_CRC (buf, TPK_BLKSIZ-2, INIT_CRC_SEED)
+        != (((word)buf[TPK_BLKSIZ-1] << 8) | buf[TPK_BLKSIZ-2]))
+        return (EE_CRC);
+
+    cnt = buf[0];
+    if ((cnt == 0) || (cnt > TPK_BLKMAX))
+        return (EE_DATAERROR);
+
+    val = tpk_value (&buf[1]);
+    tpk_vals[0] = val;
+    i = TPK_HDRSIZ;
+    for (tpk_n = 1; tpk_n < cnt; tpk_n++)
+    {
+        dlt = 0;
+        shf = 0;
+        do
+        {
+            if ((i >= (TPK_BLKSIZ-2)) || (shf > 35))
+                return (EE_DATAERROR);  /* Runs off the end of the block */
+            dlt |= (unsigned long long)(buf[i] & 0x7F) << shf;
+            shf += 7;
+        } while (buf[i++] & 0x80);
+        val += dlt;
+        tpk_vals[tpk_n] = val;
+    }
+
+    tpk_cur = blk;
+    return (0);
+
+} /* End tpk_load() */
+
+/****************************************************************************
+* tpk_varint -- 7-bits-per-byte encoding of delta "dlt", returns its length
+****************************************************************************/
+
+static unsigned char tpk_varint (unsigned long long dlt, unsigned char *tmp)
+{
+    unsigned char j;
+
+    j = 0;
+    do
+    {
+        tmp[j] = (unsigned char)(dlt & 0x7F);
+        dlt >>= 7;
+        if (dlt)
+            tmp[j] |= 0x80;
+        j++;
+    } while (dlt);
+    return (j);
+}
+
+/****************************************************************************
+* tpk_encode -- Encode "cnt" values starting at "vals" into block image
+*
+* Returns the number of values that fit in the block; only if all "cnt"
+* fit is "buf" complete (count and CRC-16 filled in).
+****************************************************************************/
+
+static unsigned char tpk_encode
+    (
+    unsigned char *buf,
+    const unsigned long long *vals,
+    unsigned char cnt
+    )
+{
+    unsigned char n;
+    unsigned char i;
+    unsigned char j;
+    unsigned char tmp[6];
+    word crc;
+
+    memset (buf, 0, TPK_BLKSIZ);
+    tpk_serial (vals[0], tmp);
+    memcpy (&buf[1], &tmp[1], BYTESERIAL-1);
+
+    i = TPK_HDRSIZ;
+    for (n = 1; (n < cnt) && (n < TPK_BLKMAX); n++)
+    {
+        j = tpk_varint (vals[n] - vals[n-1], tmp);
+        if ((i + j) > (TPK_BLKSIZ-2))
+            break;                      /* Block full */
+        memcpy (&buf[i], tmp, j);
+        i += j;
+    }
+    if (n < cnt)
+        return (n);                     /* Won't fit */
+    buf[0] = n;
+
+    crc = modbus_CRC (buf, TPK_BLKSIZ-2, INIT_CRC_SEED);
+    buf[TPK_BLKSIZ-2] = (unsigned char)crc;
+    buf[TPK_BLKSIZ-1] = (unsigned char)(crc >> 8);
+    return (n);
+
+} /* End tpk_encode() */
+
+/****************************************************************************
+* tpk_write -- Write a complete block image to block "blk"
+****************************************************************************/
+
+static char tpk_write (word blk, const unsigned char *buf)
+{
+    char sts;
+
+    tpk_cur = 0xFFFF;                   /* tpk_vals[] may be stale now */
+    sts = eeBlockWrite (tpk_addr (blk), (unsigned char *)buf, TPK_BLKSIZ);
+    if (sts == 0)
+    {
+        tpk_cnt[blk] = buf[0];
+        tpk_mark (blk);
+    }
+    return (sts);
+}
+
+/****************************************************************************
+* tpk_store -- Encode and write "cnt" values starting at "vals" to block
+*
+* Returns the number of values that fit in the block. The block is only
+* written (with "*sts" receiving the EEPROM status) if all "cnt" fit;
+* otherwise nothing is written and the caller must split the block.
+****************************************************************************/
+
+static unsigned char tpk_store
+    (
+    word blk,
+    const unsigned long long *vals,
+    unsigned char cnt,
+    char *sts
+    )
+{
+    unsigned char buf[TPK_BLKSIZ];
+    unsigned char n;
+
+    *sts = 0;
+    if ((n = tpk_encode (buf, vals, cnt)) == cnt)
+        *sts = tpk_write (blk, buf);
+    return (n);
+
+} /* End tpk_store() */
+
+/****************************************************************************
+* tpk_push -- Add value "val" at the front (or end) of packed block "blk"
+*
+* For moving a Truck ID into a neighbouring block without decoding it into
+* tpk_vals[] (which holds the block being updated): "val" must sort before
+* (or after) everything in the block. The block's own bytes are edited:
+* the new delta goes in after the first serial number (or after the last
+* delta). Returns TRUE if "val" was added, FALSE if there is no room (or
+* the block can't be read), with "*sts" the status of the write.
+****************************************************************************/
+
+static unsigned char tpk_push
+    (
+    word blk,
+    unsigned long long val,
+    unsigned char front,
+    char *sts
+    )
+{
+    unsigned char buf[TPK_BLKSIZ];
+    unsigned char tmp[6];
+    unsigned long long last;
+    unsigned long long first;
+    unsigned char i;
+    unsigned char j;
+    unsigned char k;
+    unsigned char shf;
+    word crc;
+
+    *sts = 0;
+    if ((tpk_cnt[blk] == 0) || (tpk_cnt[blk] >= TPK_BLKMAX)
+        || (eeBlockRead (tpk_addr (blk), buf, TPK_BLKSIZ) != 0)
+        || (modbus_CRC (buf, TPK_BLKSIZ-2, INIT_CRC_SEED)
+            != (((word)buf[TPK_BLKSIZ-1] << 8) | buf[TPK_BLKSIZ-2]))
+        || (buf[0] != tpk_cnt[blk]))
+        return (FALSE);
+
+    first = tpk_value (&buf[1]);        /* Walk to the end of the deltas */
+    last = first;
+    i = TPK_HDRSIZ;
+    for (k = 1; k < buf[0]; k++)
+    {
+        shf = 0;
+        do
+        {
+            if ((i >= (TPK_BLKSIZ-2)) || (shf > 35))
+                return (FALSE);
+            last += (unsigned long long)(buf[i] & 0x7F) << shf;
+            shf += 7;
+        } while (buf[i++] & 0x80);
+    }
+
+    if (front ? (val >= first) : (val <= last))
+        return (FALSE);                 /* Doesn't belong there */
+    j = tpk_varint (front ? (first - val) : (val - last), tmp);
+    if ((i + j) > (TPK_BLKSIZ-2))
+        return (FALSE);                 /* No room */
+    if (front)
+    {
+        memmove (&buf[TPK_HDRSIZ + j], &buf[TPK_HDRSIZ], i - TPK_HDRSIZ);
+        memcpy (&buf[TPK_HDRSIZ], tmp, j);
+        tpk_serial (val, tmp);
+        memcpy (&buf[1], &tmp[1], BYTESERIAL-1);
+    }
+    else
+        memcpy (&buf[i], tmp, j);
+    buf[0]++;
+
+    crc = modbus_CRC (buf, TPK_BLKSIZ-2, INIT_CRC_SEED);
+    buf[TPK_BLKSIZ-2] = (unsigned char)crc;
+    buf[TPK_BLKSIZ-1] = (unsigned char)(crc >> 8);
+    *sts = tpk_write (blk, buf);
+    return (*sts == 0);
+
+} /* End tpk_push() */
+
+/****************************************************************************
+* tpk_clear -- Mark packed block "blk" unused
+****************************************************************************/
+
+static char tpk_clear (word blk)
+{
+    unsigned char zero[TPK_HDRSIZ];
+
+    memset (zero, 0, TPK_HDRSIZ);
+    tpk_cnt[blk] = 0;
+    tpk_mark (blk);
+    tpk_cur = 0xFFFF;
+    return (eeBlockWrite (tpk_addr (blk), zero, TPK_HDRSIZ));
+}
+
+/****************************************************************************
+* tpk_alloc -- Find the free physical block nearest block "near"
+*
+* Keeping the blocks of a split together keeps the directory range that
+* tpk_end() writes short. Returns TPK_BLOCKS if every block is in use.
+****************************************************************************/
+
+static word tpk_alloc (word near)
+{
+    word d;
+
+    for (d = 0; d < TPK_BLOCKS; d++)
+    {
+        if (((near + d) < TPK_BLOCKS) && (tpk_cnt[near + d] == 0))
+            return ((word)(near + d));
+        if ((d <= near) && (tpk_cnt[near - d] == 0))
+            return ((word)(near - d));
+    }
+    return (TPK_BLOCKS);
+}
+
+/****************************************************************************
+* tpk_mapins -- Enter physical block "blk" at sorted position "pos"
+****************************************************************************/
+
+static void tpk_mapins (word pos, word blk)
+{
+    word n;
+
+    for (n = tpk_used; n > pos; n--)
+        tpk_map[n] = tpk_map[n-1];
+    tpk_map[pos] = (UINT16)blk;
+    tpk_used++;
+    tpk_mmark (pos, tpk_used);
+}
+
+/****************************************************************************
+* tpk_unmap -- Free the block at sorted position "pos" and close the gap
+****************************************************************************/
+
+static char tpk_unmap (word pos)
+{
+    word n;
+    char sts;
+
+    if ((sts = tpk_clear (tpk_map[pos])) != 0)
+        return (sts);
+    tpk_used--;
+    for (n = pos; n < tpk_used; n++)
+        tpk_map[n] = tpk_map[n+1];
+    tpk_mmark (pos, tpk_used);
+    return (0);
+}
+
+/****************************************************************************
+* tpk_locate -- Binary search the block map for serial value "val"
+*
+* Returns (in *pos) the last sorted position whose block's first serial
+* number is not greater than "val" (0 if "val" sorts before everything).
+****************************************************************************/
+
+static char tpk_locate (unsigned long long val, word *pos)
+{
+    unsigned char first[BYTESERIAL-1];
+    word lo, hi, mid;
+    char sts;
+
+    lo = 0;
+    hi = (tpk_used != 0) ? (tpk_used - 1) : 0;
+    while (lo < hi)
+    {
+        mid = (word)((lo + hi + 1) / 2);
+        if ((sts = eeBlockRead (tpk_addr (tpk_map[mid]) + 1, first,
+                                BYTESERIAL-1)) != 0)
+            return (sts);
+        if (tpk_value (first) <= val)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    *pos = lo;
+    return (0);
+
+} /* End tpk_locate() */
+
+/****************************************************************************
+* tpk_index -- Translate logical TIM index to sorted block position/entry
+*
+* Returns non-zero if "index" is beyond the last stored Truck ID.
+****************************************************************************/
+
+static char tpk_index (word index, word *blk, unsigned char *pos)
+{
+    word b;
+
+    if (index >= tpk_total)
+        return (-1);
+    for (b = 0; index >= tpk_cnt[tpk_map[b]]; b++)
+        index -= tpk_cnt[tpk_map[b]];
+    *blk = b;
+    *pos = (unsigned char)index;
+    return (0);
+}
+
+/****************************************************************************
+* tpk_get -- Retrieve Truck ID at logical index (all zeroes if none)
+****************************************************************************/
+
+static char tpk_get (unsigned char *trk, word index)
+{
+    word blk;
+    unsigned char pos;
+    char sts;
+
+    if (tpk_index (index, &blk, &pos) != 0)
+    {
+        memset (trk, 0, BYTESERIAL);    /* "Empty" slot */
+        return (0);
+    }
+    if ((sts = tpk_load (tpk_map[blk])) != 0)
+    {
+        memset (trk, 0, BYTESERIAL);    /* As nvTrkGet() for a bad CRC-8 */
+        return (0);
+    }
+    tpk_serial (tpk_vals[pos], trk);
+    return (0);
+}
+
+/****************************************************************************
+* tpk_insert -- Insert Truck ID in sorted position (no-op if present)
+****************************************************************************/
+
+static char tpk_insert (const unsigned char *trk)
+{
+    unsigned long long val;
+    word lb;
+    word blk;
+    word nb;
+    unsigned char buf[TPK_BLKSIZ];
+    unsigned char pos;
+    unsigned char n;
+    unsigned char m;
+    unsigned char half;
+    char sts;
+
+    if (trk[0] != 0)
+        return (EE_DATAERROR);          /* Can't be a Dallas Truck ID */
+    val = tpk_value (&trk[1]);
+    if (val == 0)
+        return (0);                     /* "Empty" entry, nothing to add */
+
+    if (tpk_used == 0)                  /* First Truck ID */
+    {
+        blk = tpk_alloc (0);
+        tpk_vals[0] = val;
+        (void)tpk_store (blk, tpk_vals, 1, &sts);
+        if (sts == 0)
+        {
+            tpk_mapins (0, blk);
+            tpk_total = 1;
+        }
+        return (sts);
+    }
+
+    if ((sts = tpk_locate (val, &lb)) != 0)
+        return (sts);
+    blk = tpk_map[lb];
+    if ((sts = tpk_load (blk)) != 0)
+        return (sts);
+
+    for (pos = 0; (pos < tpk_n) && (tpk_vals[pos] < val); pos++)
+        ;
+    if ((pos < tpk_n) && (tpk_vals[pos] == val))
+        return (0);                     /* Already authorized */
+
+    for (n = tpk_n; n > pos; n--)       /* Open a hole for it */
+        tpk_vals[n] = tpk_vals[n-1];
+    tpk_vals[pos] = val;
+    n = (unsigned char)(tpk_n + 1);
+
+    if ((n <= TPK_BLKMAX)
+        && (tpk_store (blk, tpk_vals, n, &sts) == n))
+    {
+        if (sts == 0)
+            tpk_total++;
+        return (sts);
+    }
+    if (sts)
+        return (sts);
+
+    /* Doesn't fit. Past the end of the whole list (a list loaded in
+       order) the full block is left full and the new Truck ID starts the
+       next one. */
+
+    if (((lb + 1) == tpk_used) && (pos == tpk_n) && (tpk_used < TPK_BLOCKS))
+    {
+        nb = tpk_alloc (blk);
+        (void)tpk_store (nb, &tpk_vals[pos], 1, &sts);
+        if (sts == 0)
+        {
+            tpk_mapins (tpk_used, nb);
+            tpk_total++;
+        }
+        return (sts);
+    }
+
+    /* Else hand the largest Truck ID on to the next block, or the
+       smallest back to the previous one, if that block has room and the
+       rest fit in this one: blocks stay fuller than splitting alone leaves
+       them. The neighbour is written first; until this block is rewritten
+       the moved Truck ID is in both (tpk_repair() trims the overlap). If
+       the one moved is the new one, this block stays as it was. */
+
+    m = (unsigned char)(n - 1);
+    if (((lb + 1) < tpk_used) && (tpk_encode (buf, tpk_vals, m) == m))
+    {
+        if (tpk_push (tpk_map[lb + 1], tpk_vals[m], TRUE, &sts))
+        {
+            if (pos != m)
+                sts = tpk_write (blk, buf);
+            if (sts == 0)
+                tpk_total++;
+            return (sts);
+        }
+        if (sts)
+            return (sts);
+    }
+    if ((lb > 0) && (tpk_encode (buf, &tpk_vals[1], m) == m))
+    {
+        if (tpk_push (tpk_map[lb - 1], tpk_vals[0], FALSE, &sts))
+        {
+            if (pos != 0)
+                sts = tpk_write (blk, buf);
+            if (sts == 0)
+                tpk_total++;
+            return (sts);
+        }
+        if (sts)
+            return (sts);
+    }
+
+    /* Else split the block in two. Either half of a full block plus one
+       new delta always fits in a block of its own. The upper half goes
+       out first, to a free block entered in the map after this one: until
+       the lower half is written, block "blk" still holds every old Truck
+       ID (tpk_repair() trims the overlap). */
+
+    if (tpk_used >= TPK_BLOCKS)
+        return (EE_DATAERROR);          /* Partition full */
+    nb = tpk_alloc (blk);
+
+    half = (unsigned char)(n / 2);
+    if (tpk_store (nb, &tpk_vals[half], (unsigned char)(n - half),
+                   &sts) != (unsigned char)(n - half))
+        return (EE_DATAERROR);
+    if (sts)
+        return (sts);
+    tpk_mapins ((word)(lb + 1), nb);
+    if (tpk_store (blk, tpk_vals, half, &sts) != half)
+        return (EE_DATAERROR);
+    if (sts == 0)
+        tpk_total++;
+    return (sts);
+
+} /* End tpk_insert() */
+
+/****************************************************************************
+* tpk_remove -- Delete the Truck ID at logical index
+****************************************************************************/
+
+static char tpk_remove (word index)
+{
+    word lb;
+    unsigned char pos;
+    unsigned char n;
+    char sts;
+
+    if (tpk_index (index, &lb, &pos) != 0)
+        return (0);                     /* Already "empty" */
+    if ((sts = tpk_load (tpk_map[lb])) != 0)
+        return (sts);
+
+    if (tpk_n == 1)                     /* Last one in the block */
+    {
+        if ((sts = tpk_unmap (lb)) == 0)
+            tpk_total--;
+        return (sts);
+    }
+
+    for (n = pos; (n + 1) < tpk_n; n++)
+        tpk_vals[n] = tpk_vals[n+1];
+    n = (unsigned char)(tpk_n - 1);
+
+    /* Two deltas merged into one never take more room than they did */
+
+    (void)tpk_store (tpk_map[lb], tpk_vals, n, &sts);
+    if (sts == 0)
+        tpk_total--;
+    return (sts);
+
+} /* End tpk_remove() */
+
+/****************************************************************************
+* tpk_rank -- Sorted position of serial value "val"
+*
+* Returns non-zero if the value is not listed.
+****************************************************************************/
+
+static char tpk_rank (unsigned long long val, word *index)
+{
+    word lb;
+    word i;
+    unsigned char k;
+
+    if ((tpk_used == 0)
+        || (tpk_locate (val, &lb) != 0) || (tpk_load (tpk_map[lb]) != 0))
+        return (-1);
+    for (k = 0; k < tpk_n; k++)
+    {
+        if (tpk_vals[k] == val)
+        {
+            *index = (word)k;
+            for (i = 0; i < lb; i++)
+                *index += tpk_cnt[tpk_map[i]];  /* Logical index */
+            return (0);
+        }
+    }
+    return (-1);
+
+} /* End tpk_rank() */
+
+/****************************************************************************
+* tpk_replace -- Replace the Truck ID at logical index (slot "overwrite")
+*
+* The packed format's answer to writing a slot: the Truck ID at sorted
+* position "index" is replaced by "trk", which then sorts to wherever it
+* belongs. An index at or past the end adds "trk"; an all zero or erased
+* (all 0xFF) "trk" just deletes the Truck ID at "index". The new Truck ID
+* is entered before the old one is removed, so a reset in between leaves
+* both listed rather than neither.
+****************************************************************************/
+
+static char tpk_replace (const unsigned char *trk, word index)
+{
+    unsigned long long old;
+    word lb;
+    unsigned char pos;
+    char sts;
+
+    if ((memcmp (trk, erased, BYTESERIAL) == 0)
+        || ((trk[0] == 0) && (tpk_value (&trk[1]) == 0)))
+        return (tpk_remove (index));    /* "Erase" the slot */
+    if (tpk_index (index, &lb, &pos) != 0)
+        return (tpk_insert (trk));      /* Past the end, just add it */
+    if ((sts = tpk_load (tpk_map[lb])) != 0)
+        return (sts);
+    old = tpk_vals[pos];
+    if ((trk[0] == 0) && (tpk_value (&trk[1]) == old))
+        return (0);                     /* Same Truck ID, nothing to do */
+
+    if ((sts = tpk_insert (trk)) != 0)
+        return (sts);
+    if (tpk_rank (old, &index) != 0)
+        return (EE_DATAERROR);          /* Can't have gone */
+    return (tpk_remove (index));
+
+} /* End tpk_replace() */
+
+/****************************************************************************
+* tpk_count -- Work out tpk_used and tpk_total from tpk_cnt[]
+****************************************************************************/
+
+static void tpk_count (void)
+{
+    word blk;
+
+    tpk_used = 0;
+    tpk_total = 0;
+    for (blk = 0; blk < TPK_BLOCKS; blk++)
+    {
+        if ((tpk_cnt[blk] == 0) || (tpk_cnt[blk] > TPK_BLKMAX))
+            tpk_cnt[blk] = 0;           /* Unused (or erased, 0xFF) */
+        else
+        {
+            tpk_used++;
+            tpk_total += tpk_cnt[blk];
+        }
+    }
+}
+
+/****************************************************************************
+* tpk_mapload -- Read the block map, check it against the directory
+*
+* Returns non-zero unless the map lists each in-use block exactly once.
+* The 0x80 bit of tpk_cnt[] (counts never exceed TPK_BLKMAX) marks the
+* blocks seen.
+****************************************************************************/
+
+static char tpk_mapload (void)
+{
+    word n;
+    char sts;
+
+    if ((sts = eeBlockRead ((unsigned long)TIM_BASE + TPK_MAPOFF,
+                            (unsigned char *)tpk_map, 2 * tpk_used)) != 0)
+        return (sts);
+    sts = 0;
+    for (n = 0; n < tpk_used; n++)
+    {
+        if ((tpk_map[n] >= TPK_BLOCKS) || (tpk_cnt[tpk_map[n]] == 0)
+            || (tpk_cnt[tpk_map[n]] & 0x80))
+        {
+            sts = EE_DATAERROR;
+            break;
+        }
+        tpk_cnt[tpk_map[n]] |= 0x80;
+    }
+    while (n--)
+        tpk_cnt[tpk_map[n]] &= 0x7F;
+    return (sts);
+
+} /* End tpk_mapload() */
+
+/****************************************************************************
+* tpk_repair -- Recover from a reset during a packed format update
+*
+* The directory and map are rebuilt from the blocks themselves: each block
+* that passes its CRC is entered in the map in order of its first serial
+* number. Then, walking the map, a block whose Truck IDs run into the next
+* block's first one is cut back to end below it: a block split when the
+* update stopped leaves one of those.
+****************************************************************************/
+
+static void tpk_repair (void)
+{
+    unsigned char first[BYTESERIAL-1];
+    unsigned long long nxt;
+    word blk;
+    word lo, hi, mid;
+    unsigned char n;
+    char sts;
+
+    if (tpk_begin () != 0)
+        return;
+    tpk_used = 0;
+    for (blk = 0; blk < TPK_BLOCKS; blk++)
+    {
+        tpk_cnt[blk] = 0;
+        if (tpk_load (blk) != 0)        /* Unused, torn or bad block */
+            continue;
+        tpk_cnt[blk] = tpk_n;
+        nxt = tpk_vals[0];
+        lo = 0;                         /* Sorted position to enter it */
+        hi = tpk_used;
+        while (lo < hi)
+        {
+            mid = (word)((lo + hi) / 2);
+            if (eeBlockRead (tpk_addr (tpk_map[mid]) + 1, first,
+                             BYTESERIAL-1) != 0)
+                return;
+            if (tpk_value (first) < nxt)
+                lo = (word)(mid + 1);
+            else
+                hi = mid;
+        }
+        tpk_mapins (lo, blk);
+    }
+
+    blk = 0;
+    while (blk < tpk_used)
+    {
+        if (tpk_load (tpk_map[blk]) != 0)
+            return;
+        if ((blk + 1) >= tpk_used)
+            break;
+        if (eeBlockRead (tpk_addr (tpk_map[blk + 1]) + 1, first,
+                         BYTESERIAL-1) != 0)
+            return;
+        nxt = tpk_value (first);
+        for (n = 0; (n < tpk_n) && (tpk_vals[n] < nxt); n++)
+            ;
+        if (n == 0)                     /* All in the next block too */
+        {
+            if (tpk_unmap (blk) != 0)
+                return;
+            continue;
+        }
+        if (n < tpk_n)                  /* Tail is in the next block */
+        {
+            (void)tpk_store (tpk_map[blk], tpk_vals, n, &sts);
+            if (sts)
+                return;
+        }
+        blk++;
+    }
+    tpk_count ();
+    tpk_dlo = 0;                        /* Whole directory and map */
+    tpk_dhi = TPK_BLOCKS;
+    tpk_mlo = 0;
+    tpk_mhi = tpk_used;
+    (void)tpk_end (0);                  /* Then clear the flag */
+
+} /* End tpk_repair() */
+
+/****************************************************************************
+* nvTrkInit -- Determine Truck ID store format and load block directory
+*
+* Call is:
+*
+*   nvTrkInit ()
+*
+* Called once from eeInit(). If the TIM partition carries the packed format
+* header, the per-block counts and the block map are read into RAM (or
+* rebuilt by tpk_repair() if an update was cut short); otherwise the
+* standard slot format is used.
+****************************************************************************/
+
+void nvTrkInit (void)
+{
+    unsigned char hdr[TPK_DIROFF];
+
+    tpk_active = FALSE;
+    tpk_used = 0;
+    tpk_total = 0;
+    tpk_cur = 0xFFFF;
+    tpk_dirty = FALSE;
+
+    if (eeBlockRead ((unsigned long)TIM_BASE, hdr, TPK_DIROFF) != 0)
+        return;
+    if ((hdr[0] != TPK_MAGIC0) || (hdr[1] != TPK_MAGIC1)
+        || (hdr[2] != TPK_MAGIC2) || (hdr[3] != TPK_VERSION))
+        return;                         /* Standard slot format */
+
+    if (eeBlockRead ((unsigned long)TIM_BASE + TPK_DIROFF, tpk_cnt,
+                     TPK_BLOCKS) != 0)
+        return;
+    tpk_active = TRUE;
+    tpk_count ();
+    if (hdr[TPK_DIRTY] != 0)
+        tpk_dirty = TRUE;
+    if (tpk_dirty || (tpk_mapload () != 0))
+        tpk_repair ();
+
+} /* End nvTrkInit() */
+
+/****************************************************************************
+* nvTrkRank -- Position of a Truck ID in the packed format's sorted order
+*
+* Call is:
+*
+*   nvTrkRank (trk, index)
+*
+* Returns zero with the position in "*index" if the Truck ID is listed;
+* non-zero if it is not, or the packed format is not in use. Unlike
+* nvTrkFind() the connected truck's BVF_ flags are left alone.
+****************************************************************************/
+
+char nvTrkRank
+    (
+    const unsigned char *trk,   /* Pointer to 6-digit Dallas ser no */
+    word *index                 /* Pointer to return sorted position */
+    )
+{
+    if (!tpk_active || (trk[0] != 0))
+        return (-1);
+    return (tpk_rank (tpk_value (&trk[1]), index));
+
+} /* End nvTrkRank() */
+
+/****************************************************************************
+* nvTrkPacked -- Return non-zero if the packed Truck ID format is in use
+****************************************************************************/
+
+unsigned char nvTrkPacked (void)
+{
+    return (tpk_active);
+}
+
 /****************************************************************************
 * nvTrkEmpty -- Find empty TIM slot in NonVolatile store
 *
@@ -651,8 +1864,6 @@ char nvTrkEmpty
     word *index                 /* Pointer to return matching index */
     )
 {
-    E2TIMREC *tidarray;         /* Base pointer to NV TIM store */
-    E2TIMREC tim_store;         /* Temp storage of current TIM eeprom entry */
     word tim_address;
     word tidbase;               /* TIM partition offset */
     word size;                  /* Size of NV TIM store */
@@ -662,13 +1873,20 @@ char nvTrkEmpty
     unsigned int tidmax, i;
      char sts;
 
+    if (tpk_active)                     /* Packed: next logical index */
+    {
+        if (tpk_used >= TPK_BLOCKS)
+            return (-1);                /* Full (or near enough) */
+        *index = tpk_total;
+        return (0);
+    }
+
   // last_routine = 0x54;
     sts = eeMapPartition (EEP_TIM, &size, &tidbase);
   // last_routine = 0x54;
     if (sts)
         return (sts);
 
-    tidarray = (E2TIMREC *)&tim_store;
     tim_address = TIM_BASE;
 
     /* Search the Truck ID array. This array is huge, so speed is of the
@@ -756,6 +1974,14 @@ char nvTrkFind
     trk[i] = trk_org[i];
   }
 
+  if (tpk_active)                     /* Packed: binary search by block */
+  {
+    if (nvTrkRank (trk, index) == 0)
+      return (0);
+    badvipflag |= BVF_UNAUTH;
+    return (-1);
+  }
+
   sts = eeMapPartition (EEP_TIM, &size, &tidbase);
   // last_routine = 0x55;
   if (sts)
@@ -856,6 +2082,9 @@ char nvTrkGet
 
     char sts;
 
+    if (tpk_active)
+        return (tpk_get (trk, index));
+
   // last_routine = 0x56;
     sts = eeMapPartition (EEP_TIM, &size, &base);
   // last_routine = 0x56;
@@ -958,6 +2187,13 @@ char nvTrkGetMany
     unsigned char i;
     char sts;
 
+    if (tpk_active)
+    {
+        for (i = 0; i < cnt; i++)
+            (void)tpk_get (&trk[i * BYTESERIAL], (word)(index + i));
+        return (0);
+    }
+
   // last_routine = 0x57;
     sts = eeMapPartition (EEP_TIM, &size, &base);
   // last_routine = 0x57;
@@ -1068,6 +2304,18 @@ char nvTrkVrMany
     unsigned char tim[BYTESERIAL];       /* Local holding copy */
     char sts;
 
+    if (tpk_active)                     /* Packed: CRC the sorted list */
+    {
+        crc = INIT_CRC_SEED;
+        for (i = 0; i < cnt; i++)
+        {
+            (void)tpk_get (tim, (word)(index + i));
+            crc = modbus_CRC (tim, BYTESERIAL, crc);
+        }
+        *vfc = crc;
+        return (0);
+    }
+
   // last_routine = 0x58;
     sts = eeMapPartition (EEP_TIM, &size, &base);
   // last_routine = 0x58;
@@ -1141,6 +2389,9 @@ char nvTrkVrMany
 * On successful match, nvTrkPut() returns zero, having overwritten the
 * NonVolatile TIM stored at the specified index. On error, an EE_status
 * error value is returned.
+*
+* In the packed format "index" is a position in sorted order: the Truck ID
+* there is replaced, and "trk" sorts to wherever it belongs.
 ****************************************************************************/
 
 char nvTrkPut
@@ -1156,6 +2407,13 @@ char nvTrkPut
 
     char sts;
 
+    if (tpk_active)                     /* Packed: replace sorted position */
+    {
+        if ((sts = tpk_begin ()) == 0)
+            sts = tpk_replace (trk, index);
+        return (tpk_end (sts));
+    }
+
   // last_routine = 0x59;
     sts = eeMapPartition (EEP_TIM, &size, &base);
   // last_routine = 0x59;
@@ -1208,6 +2466,9 @@ char nvTrkPut
 * NonVolatile TIM stored at the specified indices. On error, an EE_status
 * error value is returned.
 *
+* In the packed format the Truck IDs at sorted positions index .. index +
+* cnt - 1 are replaced by the new ones (erased entries just delete).
+*
 * Note: nvTrkPutMany *overwrites* the caller's buffer! It must calculate
 *       the CRC-8's "in place", and uses the caller's buffer for this
 *       purpose. The only caller should be ModBus code, and it expects this
@@ -1228,6 +2489,21 @@ char nvTrkPutMany
     unsigned char i;
     char sts;
 
+    if (tpk_active)                     /* Packed: replace sorted positions */
+    {
+        /* The old Truck IDs at index .. index+cnt-1 go first (each removal
+           brings the next one down to "index"), then the new ones are
+           entered wherever they sort to. */
+
+        sts = tpk_begin ();
+        for (i = 0; (i < cnt) && (sts == 0); i++)
+            sts = tpk_remove (index);
+        for (i = 0; (i < cnt) && (sts == 0); i++)
+            if (memcmp (&trk[i * BYTESERIAL], erased, BYTESERIAL) != 0)
+                sts = tpk_insert (&trk[i * BYTESERIAL]);
+        return (tpk_end (sts));
+    }
+
   // last_routine = 0x5A;
     sts = eeMapPartition (EEP_TIM, &size, &base);
   // last_routine = 0x5A;
@@ -1291,6 +2567,13 @@ char nvTrkDelete
 
     char sts;
 
+    if (tpk_active)
+    {
+        if ((sts = tpk_begin ()) == 0)
+            sts = tpk_remove (index);
+        return (tpk_end (sts));
+    }
+
   // last_routine = 0x5B;
     sts = eeMapPartition (EEP_TIM, &size, &base);
   // last_routine = 0x5B;
@@ -1345,6 +2628,21 @@ char nvTrkErase (void)
 
     sts = eeBlockFill ((unsigned long)base, 0xFF, size);
 
+    /* Lay down the packed format header if that format is selected */
+
+    if ((sts == 0) && (SysParm.EnaSftFeatures2 & ENA_TIM_PACKED))
+    {
+        unsigned char hdr[TPK_HDRSIZ];
+
+        memset (hdr, 0, TPK_HDRSIZ);
+        hdr[0] = TPK_MAGIC0;
+        hdr[1] = TPK_MAGIC1;
+        hdr[2] = TPK_MAGIC2;
+        hdr[3] = TPK_VERSION;           /* hdr[TPK_DIRTY] = 0 */
+        sts = eeBlockWrite ((unsigned long)base, hdr, TPK_HDRSIZ);
+    }
+    nvTrkInit ();                       /* Pick up (new) format */
+
   // last_routine = 0x5C;
     return (sts);                       /* Propagate success/failure */
 
@@ -67,6 +67,37 @@
  *                         Deleted now unused five_truck_gone().
  *                         Deleted reset_bypass() call from optic_5_setup(),
  *                           this is now called from tuck_idle at connect time.
+ *  1.6.38  10/19/26  AGT  In five_wire_optic() report the echo confidence in
+ *                          class_conf[OPTIC5] for the acquire classifiers.
+ *                         In active_5wire() trigger the probe waveform capture
+ *                          on the first missed echo.
+ *                         Timer 4/6/7 accesses in five_wire_optic() go through
+ *                          the hal.h macros.
+ *                         calc_tank() split into tank_cal_ steps taking one
+ *                          diag reading per main loop pass, finishing early
+ *                          once the mean is steady, and a binary search of
+ *                          voltList[].  check_diag() uses the result of the
+ *                          calibration run in the background since its last
+ *                          call; active_5wire() waits while one is running.
+ *                         optic_5_pulse() split into optic_5_clear() (is
+ *                          another unit's pulse on the line) and
+ *                          optic_5_fire().  active_5wire() no longer pulses
+ *                          into a foreign pulse (nor counts it a miss); it
+ *                          locks to that pulse train and moves to a slot
+ *                          chosen from the unit serial number (slot_).
+ *                         A calibration result older than TC_MAX_AGE is
+ *                          measured again.  The background calibration waits
+ *                          for a departure round to finish before it drives
+ *                          the diag line, and check_diag() leaves
+ *                          scully_probe() out while a round is running.
+ *                         Slot times are kept at least SLOT_FRAME after the
+ *                          last pulse actually fired (slot_last), and the
+ *                          calibration pulses through optic_5_pulse() wait
+ *                          for our slot as well.
+ *                         The slot follows the pulse actually fired, a late
+ *                          one no longer costing the next frame
+ *                          (slot_time()), and a miss while slotted moves to
+ *                          the next slot.
  *******************************************************************************/
 #include "common.h"
 #include "volts.h"
@@ -74,6 +105,17 @@
 /****************************************************************************/
 static   unsigned long  compute_time;
 //static int report_flag;           /* used to report a WET once per load */
+
+/* Pulse slot lock, active_5wire() sharing a truck with other units */
+static   char           slot_locked;        /* Foreign pulse train seen */
+static   unsigned long  slot_seen;          /* When it was last seen */
+static   unsigned long  slot_anchor;        /* One of our slot times */
+static   unsigned int   slot_period;        /* Locked frame period, ms */
+static   unsigned char  slot_tries;         /* Collisions this connection */
+static   unsigned long  slot_last;          /* When we last fired a pulse */
+
+static char optic_5_clear(void);
+static void optic_5_fire(void);
 /****************************************************************************/
 
 /*************************************************************************
@@ -179,6 +221,8 @@ char five_wire_optic( void )
     if (try_five_wire() != 0) /* setup five wire pulse */
     {
       dry_pass_count++;          /* see optical probe at least 3 times */
+      class_conf[OPTIC5] = (unsigned char)((dry_pass_count >= DRY_5WIRE) ? 100 :
+                                   ((unsigned int)dry_pass_count * 100) / DRY_5WIRE);
       if ( dry_pass_count >= DRY_5WIRE )
       {
         optic5_state = ECHOED;  /* we got 5 wire optics !!! */
@@ -188,6 +232,7 @@ char five_wire_optic( void )
     else
     {
       dry_pass_count = 0;           /* don't let it fool you */
+      class_conf[OPTIC5] = 0;
       if (check_5wire_fault(FALSE) != 0) /* see if a wet 5 wire */
       {
         wet_pass_count++;          /* see wet probe at least xx times */
@@ -207,6 +252,133 @@ char five_wire_optic( void )
   return(status);
 } /* end of five_wire_optic */
 
+/*************************************************************************
+ *  subroutine:      slot_reset()
+ *
+ *  function:   Forget any pulse train lock (new connection).
+ *  input:  none
+ *  output: none
+ *************************************************************************/
+static void slot_reset(void)
+{
+  slot_locked = FALSE;
+  slot_period = SLOT_FRAME;
+  slot_tries = 0;
+}
+
+/*************************************************************************
+ *  subroutine:      slot_advance()
+ *
+ *  function:   Move slot_anchor on by whole frames to "due" or later.
+ *              A slot that would have to wait more than SLOT_LATE into
+ *              itself to be SLOT_FRAME after the last pulse we fired
+ *              (however late that one was) is passed over too.
+ *  input:  earliest time wanted
+ *  output: none
+ *************************************************************************/
+static void slot_advance(unsigned long due)
+{
+  if (slot_anchor < due)
+  {
+    slot_anchor += ((due - slot_anchor + slot_period - 1) / slot_period) * slot_period;
+  }
+  if ((slot_anchor + SLOT_LATE) < (slot_last + SLOT_FRAME))
+  {
+    slot_anchor += slot_period;
+  }
+}
+
+/*************************************************************************
+ *  subroutine:      slot_time()
+ *
+ *  function:   When to pulse in the slot at slot_anchor: its start, or
+ *              SLOT_FRAME after the last pulse we fired if that is later.
+ *  input:  none
+ *  output: new probe_time
+ *************************************************************************/
+static unsigned long slot_time(void)
+{
+  if (slot_anchor < (slot_last + SLOT_FRAME))
+  {
+    return slot_last + SLOT_FRAME;
+  }
+  return slot_anchor;
+}
+
+/*************************************************************************
+ *  subroutine:      slot_foreign()
+ *
+ *  function:
+ *
+ *         Another unit's pulse is on the line, so ours would collide.
+ *         1.  If it was seen before, the time since is a whole number of
+ *             its frames; fold that into the locked period.
+ *         2.  Move our pulses to a slot SLOT_WIDTH multiples after it.
+ *             The slot comes from our serial number, a different pair of
+ *             its bits on each collision, so two units picking the same
+ *             slot part on a later try.  No talking between units.
+ *
+ *  input:  none
+ *  output: none (probe_time set to our slot in this frame)
+ *************************************************************************/
+static void slot_foreign(void)
+{
+unsigned long now;
+unsigned long gap;
+unsigned int  frames;
+unsigned char hash;
+unsigned char slot;
+
+  now = read_time();
+  if (slot_locked && (now > slot_seen))
+  {
+    gap = now - slot_seen;
+    frames = (unsigned int)((gap + (slot_period / 2)) / slot_period);
+    if ((frames > 0) && (frames <= SLOT_TRACK))
+    {
+      gap /= frames;
+      if ((gap >= SLOT_FRAME) && (gap <= SLOT_FRAME_MAX))
+      {
+        slot_period = (unsigned int)(((3 * (unsigned long)slot_period) + gap) / 4);
+      }
+    }
+  }
+  hash = Dallas_CRC8(Intellitrol_SN, BYTESERIAL);
+  slot = (unsigned char)(1 + ((hash >> ((slot_tries & 3) << 1)) % (SLOT_COUNT - 1)));
+  slot_tries++;
+  slot_seen = now;
+  slot_anchor = now + ((unsigned long)slot * SLOT_WIDTH);
+  slot_locked = TRUE;
+  slot_advance(slot_anchor);
+  probe_time = slot_time();
+}
+
+/*************************************************************************
+ *  subroutine:      slot_next()
+ *
+ *  function:   Time of the next pulse at least wait ms from now; when
+ *              locked to a foreign pulse train this is the next of our
+ *              slots (SLOT_LATE allows for main loop lateness in getting
+ *              to the current one).  Never sooner than SLOT_FRAME after
+ *              the last pulse fired (slot_time()); optic_5_fire() moves
+ *              it on again once the pulse this is called for has gone
+ *              out.
+ *  input:  minimum wait, ms
+ *  output: new probe_time
+ *************************************************************************/
+static unsigned long slot_next(unsigned int wait)
+{
+unsigned long due;
+
+  due = read_time() + wait;
+  if (!slot_locked)
+  {
+    return due;
+  }
+  slot_advance(due - SLOT_LATE);
+  return slot_time();
+}
+
 /*************************************************************************
  *  subroutine:      active_5wire()
  *
@@ -223,10 +395,16 @@ char five_wire_optic( void )
  *************************************************************************/
 void active_5wire( void )
 {
+char clear;
+
   // last_routine = 0x37;
+  if (tank_cal_busy())
+  {
+    return;                 /* Let the diag line reading finish first */
+  }
   if ( probe_time < read_time() )
   {
-     probe_time = (read_time() + 95);  /* set for appr  10.5 Hz repeat minimum */
+     probe_time = slot_next(SLOT_FRAME);  /* set for appr  10.5 Hz repeat minimum */
                                      /* to comply with power requirements per new */
                                      /* European Spec.*/
      switch (optic5_state)
@@ -236,7 +414,16 @@ void active_5wire( void )
       case ECHOED:
       /* When wet will toggle between first state and DIAG */
          optic5_state = PULSED;
-         optic_5_pulse();
+         clear = optic_5_clear();
+         if (clear == O5_FOREIGN)
+         {
+           slot_foreign();          /* Not a miss; pulse in our slot */
+           break;
+         }
+         if (clear == O5_CLEAR)
+         {
+           optic_5_fire();
+         }
   // last_routine = 0x37;
          if (check_echo() != 0)
          {
@@ -256,6 +443,10 @@ void active_5wire( void )
          {
            dry_timer = 0;          /* reset for wet probe operation */
            wet_pass_count++;
+           if (wet_pass_count == 1)
+           {
+             capture_trigger(CAP_TRIG_ECHO);   /* First miss after an echo */
+           }
            if (wet_pass_count > 2) /* allow for a few faults */
            {
              optic5_state = DIAG;
@@ -267,6 +458,13 @@ void active_5wire( void )
              tank_state = T_WET;  /* It's not pulsing, set it Wet */
            }
       /* WPW: reduce the cycle to handle multiple probe conflict */
+      /* (when slotted, the next slot on instead: shortening would walk */
+      /* back into the other unit's slot) */
+           else if (slot_locked)
+           {
+             slot_anchor += SLOT_WIDTH;
+             probe_time = slot_time();
+           }
            else if (wet_pass_count == 1)
            {
              probe_time -= 15;             //Joe was 10Msec changed to 15
@@ -284,7 +482,7 @@ void active_5wire( void )
            wet_pass_count++;
            if (wet_pass_count > 8)    /* Allow ~2 seconds... */
            {
-              if (check_truck_gone())   /* Test to see if truck has gone away */
+              if (check_truck_gone() == TRUE) /* Test to see if truck has gone away */
               {
                 xprintf( 47, 3 );       /* Force the next message to print */
                 truck_state = DEPARTED;
@@ -298,7 +496,7 @@ void active_5wire( void )
   // last_routine = 0x37;
          if (tank_state == T_WET)            /* this will allow Civicon probes to settle */
          {
-           probe_time = (read_time() + 500);  /* set for 500 ms repeat minimum */
+           probe_time = slot_next(500);  /* set for 500 ms repeat minimum */
          }
          break;
          default:
@@ -333,6 +531,7 @@ void optic_5_setup( void )
   jump_time = 0;                 /* JUMP_START off always */
   dry_timer = 0;                 /* dry probe operation only */
   badgndflag |= GND_INIT_TRIAL;
+  slot_reset();                  /* New truck, no pulse train lock */
   set_porte( OPTIC_DRIVE );     /* assure setup for 5 wire optic pulsing */
   set_mux( M_PROBES );           /* assure set mux to probes */
   ops_ADC( OFF );                /* shut off ADC timer interrupt (T3) */
@@ -387,33 +586,83 @@ void optic_5_setup( void )
 
 void optic_5_pulse( void )
 {
-unsigned long counter;
-char edge = FALSE;
+char clear;
+unsigned long now;
 
+  if (slot_locked)                            /* Sharing the truck: */
+  {
+    probe_time = slot_next(0);                /*  wait for our slot */
+    now = read_time();
+    if (probe_time > now)
+    {
+      DelayMS((unsigned int)(probe_time - now));
+    }
+  }
   // Check if pulse already Present, for the case where there are 2 Intellitrols
   // last_routine = 0x39;
+  clear = optic_5_clear();
+  if (clear == O5_NOADC)
+  {
+    return;
+  }
+  if (clear == O5_FOREIGN)
+  {
+     xprintf(28, DUMMY);  //"\n\r  Pulse Detected, Delaying          "
+     DelayMS (15);
+  }
+  optic_5_fire();
+} /* end of optic_5_pulse */
+
+/*************************************************************************
+ *  subroutine:      optic_5_clear()
+ *
+ *  function:  Read the probes and see whether another Intellitrol's
+ *             pulse or echo is on the 5 wire line right now.
+ *
+ *  input:  none
+ *  output: O5_CLEAR, O5_FOREIGN (pulse present) or O5_NOADC
+ *
+ *************************************************************************/
+static char optic_5_clear( void )
+{
   if (read_ADC() == FAILED)
   {
     Init_ADC();
     if (read_ADC() == FAILED)
     {
       printf("\n\r1: Trouble reading the Analog Port\n\r");
-      return;
+      return O5_NOADC;
     }
   }
   // last_routine = 0x39;
 
   if (probe_volt[5] > OPTIC5_CHECK_FOR_PULSE)      /* 3500 Mv */
   {
-     xprintf(28, DUMMY);  //"\n\r  Pulse Detected, Delaying          "
-     DelayMS (15);
+    return O5_FOREIGN;
   }
+  return O5_CLEAR;
+} /* end of optic_5_clear */
+
+/*************************************************************************
+ *  subroutine:      optic_5_fire()
+ *
+ *  function:  Output the 1500 usec pulse and catch the start of the echo
+ *             (see optic_5_pulse()); the line is assumed clear.
+ *
+ *  input:  none
+ *  output: none
+ *
+ *************************************************************************/
+static void optic_5_fire( void )
+{
+unsigned long counter;
+char edge = FALSE;
 
   compute_time = (read_time() + (MSec*3));
+  slot_last = read_time();
   opt_return.rise_edge = 0;  /* clean out the structure dynamics */
   opt_return.fall_edge = 0;
-  TMR7HLD = 0;
-  TMR6 = 0;
+  HAL_REALTIME_CLEAR();
   counter = read_32bit_realtime();
   // last_routine = 0x39;
   opt_return.base_count = counter;    /* get base count */
@@ -436,7 +685,7 @@ char edge = FALSE;
          opt_return.fall_edge = read_32bit_realtime();    /* Yes, mark time */
       break;
     }
-    if ( !T4CONbits.TON)          /* Did the 1500 uSec. timer interrupt happen ? */
+    if ( !HAL_OPTIC_TIMER_RUNNING()) /* Did the 1500 uSec. timer interrupt happen ? */
     {
         /* The Timer 4 interrupt routine will shut off optic pulse */
        break;                     /* Yes, quit the loop */
@@ -446,15 +695,20 @@ char edge = FALSE;
   /*******************************************************************
    * In case the loop finishes before the interrupt
    *******************************************************************/
-  IFS1bits.T4IF = 0;
-  T4CONbits.TON = 0;      /* Turn off Timer 4 */
+  HAL_OPTIC_TIMER_STOP();      /* Turn off Timer 4 */
   set_porte( OPTIC_DRIVE );  /* shut off optic pulse */
+  if (slot_locked)
+  {
+    slot_anchor = slot_last; /* Our slot is where this pulse went out, */
+    slot_advance(0);         /*  the next one a frame after it */
+    probe_time = slot_time();
+  }
   if (main_state != IDLE)
   {
      ledstate[OPTIC_OUT] = PULSE;      /* Tell Trucker we just PULSED */
      StatusO |= STSO_5WIRE_PULSE;      /* Tell TAS/VIPER we just PULSED */
   }
-} /* end of optic_5_pulse */
+} /* end of optic_5_fire */
 
 /*************************************************************************
  *  subroutine:      check_echo()
@@ -562,6 +816,12 @@ char           status;
  *         3. -If different compartment is wet, set previous to dry
  *         4. -Update flags and varibles for next check
  *         5. When not updating  probe_state[] check for truck gone via scully_probe()
+ *         6. The tank number comes from the calibration started on the last
+ *            call and run by tank_cal_poll() since; only the first look
+ *            (nothing started yet) waits for calc_tank().  While it is
+ *            still measuring the diag line is driven, so report still here.
+ *         7. scully_probe() drives the channels too; while a departure round
+ *            is running leave it out (still here) and let the round decide.
  *
  *  input:  none
  *  output: True/False        TRUE == truck departed
@@ -571,6 +831,7 @@ char check_diag( void )
 {
 //   static char       last_wet = 0;   /* force a second opinion always */
   char                 status;
+  char                 due = FALSE;
   unsigned int    wet_tank;
   unsigned int    index;
 
@@ -580,7 +841,20 @@ char check_diag( void )
       (tank_time > (read_time()+SEC5)) )        /* Over 5 Sec. since last time here */
   {
     tank_time = (read_time() + SEC1);            /* Set for 1 second timing */
-    if ((wet_tank = calc_tank()) < (2*MAX_CHAN))          /* 2 x 8 = 16 */
+    switch (tank_cal_step())
+    {
+      case TC_IDLE:                              /* First look, wait for it */
+        wet_tank = calc_tank();
+        break;
+      case TC_DONE:
+        wet_tank = tank_cal_result();
+        break;
+      default:                                   /* Still measuring */
+        tank_time = read_time();
+        return(FALSE);
+    }
+    due = TRUE;
+    if (wet_tank < (2*MAX_CHAN))          /* 2 x 8 = 16 */
     {
 // >>> FogBugz108 !!! handle probe_state 0
       if (wet_tank > 1)
@@ -611,9 +885,18 @@ char check_diag( void )
     tank_time = read_time();                 /* Recheck next cycle */ 
   }
 //   else
+  if (depart_busy())
+  {
+    status = FALSE;                              /* Its round gives the verdict */
+  }
+  else
   {
     status = scully_probe();                     /* Has truck left ??? */
   }
+  if (due && (status == FALSE))
+  {
+    tank_cal_start();                            /* Next look in the background */
+  }
   return(status);
 } /* end of check_diag */
 
@@ -742,61 +1025,205 @@ unsigned int open_3volt_good, open_7volt_good, powr_8volt_good;
  *             wire Diagnostic line when a probe is wet.  The open
  *             circuit value for the drive voltage (ReferenceVolt)
  *             is calabrated in the ADC code upon power up
+ *         6.  The work is done by the tank calibration steps below; this
+ *             runs them to the end for callers that need the answer now.
+ *             check_diag() lets tank_cal_poll() run them in the
+ *             background instead.
  *  
  *  input:  none 
  *  output: the tank number that's wet
  * 
  \***********************************************************************/
-#define TRIALS 10             /* number or repeats to do the averaging */
 
 unsigned long lowVolt = 9999;
 
+static const unsigned long voltList[17] = {6840, 6630, 6380, 6000, 5690, 5385, 5130, 4890, 4660, 4470, 4270, 4105, 3950, 3795, 3675, 3550, 3440};
+
+static unsigned char      tc_state = TC_IDLE;
+static unsigned long      tc_time;        /* End of the settle period */
+static unsigned int       tc_count;       /* Readings taken */
+static unsigned int       tc_first;       /* First reading, variance origin */
+static unsigned long      tc_sum;         /* Sum of the readings */
+static long               tc_dsum;        /* Sum of (reading - tc_first) */
+static unsigned long long tc_dsq;         /* Sum of (reading - tc_first)^2 */
+static unsigned int       tc_tank;        /* Result once TC_DONE */
+
 unsigned int calc_tank( void )
 {
-    unsigned long ch5_volt;
-    unsigned long ch5_volt_oldTable;
-    unsigned long index;
-    unsigned int  tank_number;
-    unsigned long voltList[17] = {6840, 6630, 6380, 6000, 5690, 5385, 5130, 4890, 4660, 4470, 4270, 4105, 3950, 3795, 3675, 3550, 3440};
-    char          error_found = 0;
-    
+    depart_reset();                       /* Drives the same channels */
+    tank_cal_start();
+    while (tank_cal_step() != TC_DONE)
+    {
+        ;
+    }
+    return(tank_cal_result());
+}
+
+/*************************************************************************
+ *  subroutine:      tank_cal_start()
+ *
+ *  function:   Begin a tank calibration; the first reading is taken
+ *              TC_SETTLE_TIME from now so the sensors can recover.
+ *  input:  none
+ *  output: none
+ *************************************************************************/
+void tank_cal_start(void)
+{
+    tank_cal_reset();
     StatusA &= ~CH5_HIGH_RESISTANCE;
-    
-    //printf("Using table number %d\n", pSysDia5->updatedADCTable);
-    
-    DelayMS(30);                              // ensure minimum period
-    optic_5_pulse();                          // Pulse optic probe to get reading
-    tank_number = 0;
-    ch5_volt = 0;
-    CH_TEST5 = 0;                             // Turn off Ch 5 (DIAG channel)
-    DIAGNOSTIC_EN = 0;                        // Turn on precision DIAG voltage 
-  
-    if (read_ADC() == FAILED)
+    tc_time = read_time() + TC_SETTLE_TIME;
+    tc_state = TC_SETTLE;
+}
+
+/*************************************************************************
+ *  subroutine:      tank_cal_reset()
+ *
+ *  function:   Abandon any calibration in progress (and its result) and
+ *              put the Ch 5 diagnostic drive back.
+ *  input:  none
+ *  output: none
+ *************************************************************************/
+void tank_cal_reset(void)
+{
+    if (tc_state == TC_SAMPLE)
     {
-        printf("\n\r3: Trouble reading the Analog Port\n\r");
-        Init_ADC();
-        return 18;                              // Since we can't read the voltage we call it a invalid probe
+        CH_TEST5 = 1;
+        DIAGNOSTIC_EN = 1;
     }
+    tc_state = TC_IDLE;
+}
 
-    for (index = 0; index < TRIALS; index++ )     // Average TRIALS
+/*************************************************************************
+ *  subroutine:      tank_cal_result()
+ *
+ *  function:   Hand over a finished calibration; the engine goes idle.
+ *  input:  none
+ *  output: the tank number that's wet (calc_tank() value), or 0 if no
+ *          calibration has finished
+ *************************************************************************/
+unsigned int tank_cal_result(void)
+{
+    if (tc_state != TC_DONE)
     {
-        if (read_ADC() == FAILED)
-        {
-            printf("\n\r4: Trouble reading the Analog Port\n\r");
-            Init_ADC();
-            return 18;                            // Since we can't read the voltage we call it a invalid probe
-        } 
-        else
-        {
-            ch5_volt += probe_volt[4];
-            optic5_table[index] = probe_volt[4];
-        }
+        return 0;
     }
-  
+    tc_state = TC_IDLE;
+    return tc_tank;
+}
+
+/*************************************************************************
+ *  subroutine:      tank_cal_poll()
+ *
+ *  function:   Called every main loop pass; advances a running
+ *              calibration by one step.  The departure detector drives
+ *              the same channels, so a calibration still settling waits
+ *              for its round to finish; once sampling, depart_poll()
+ *              waits instead (see tank_cal_driving()).
+ *  input:  none
+ *  output: none
+ *************************************************************************/
+void tank_cal_poll(void)
+{
+    if ((tc_state == TC_SETTLE) && depart_busy())
+    {
+        return;
+    }
+    if (tank_cal_busy())
+    {
+        (void)tank_cal_step();
+    }
+}
+
+/*************************************************************************
+ *  subroutine:      tank_cal_busy()
+ *
+ *  function:   Is a calibration using the probe drive right now?
+ *  input:  none
+ *  output: TRUE while settling or sampling
+ *************************************************************************/
+char tank_cal_busy(void)
+{
+    return ((tc_state == TC_SETTLE) || (tc_state == TC_SAMPLE));
+}
+
+/*************************************************************************
+ *  subroutine:      tank_cal_driving()
+ *
+ *  function:   Is the diag line driven for a calibration reading?
+ *  input:  none
+ *  output: TRUE while sampling
+ *************************************************************************/
+char tank_cal_driving(void)
+{
+    return (tc_state == TC_SAMPLE);
+}
+
+/*************************************************************************
+ *  subroutine:      tank_cal_fail()
+ *
+ *  function:   The ADC could not be read; finish with the invalid probe
+ *              result.
+ *  input:  which message to report
+ *  output: none
+ *************************************************************************/
+static void tank_cal_fail(unsigned int where)
+{
+    printf("\n\r%u: Trouble reading the Analog Port\n\r", where);
+    Init_ADC();
     CH_TEST5 = 1;
     DIAGNOSTIC_EN = 1;
-    ch5_volt /= index;                        // 5-wire-optic diagnostic voltage
-    
+    tc_tank = TC_FAILED;     // Since we can't read the voltage we call it a invalid probe
+    tc_state = TC_DONE;
+    tc_time = read_time();
+}
+
+/*************************************************************************
+ *  subroutine:      tank_cal_tight()
+ *
+ *  function:   Is the mean of the readings so far known well enough?
+ *              With n readings, deviations d from the first, the variance
+ *              is (n*sum(d^2) - sum(d)^2) / n^2 and two standard errors
+ *              of the mean are under TC_CI_MV when
+ *              4 * (n*sum(d^2) - sum(d)^2) < TC_CI_MV^2 * n^3.
+ *  input:  none
+ *  output: TRUE if no more readings are needed
+ *************************************************************************/
+static char tank_cal_tight(void)
+{
+unsigned long long n, spread;
+
+    if (tc_count >= TC_TRIALS)
+    {
+        return TRUE;
+    }
+    if (tc_count < TC_MIN_TRIALS)
+    {
+        return FALSE;
+    }
+    n = tc_count;
+    spread = (n * tc_dsq) - (unsigned long long)((long long)tc_dsum * tc_dsum);
+    return ((4 * spread) < ((unsigned long long)TC_CI_MV * TC_CI_MV * n * n * n));
+}
+
+/*************************************************************************
+ *  subroutine:      tank_cal_tank()
+ *
+ *  function:   Turn the averaged diagnostic reading into the wet tank
+ *              number (see calc_tank()).  The new table is searched
+ *              binary, it is sorted high to low; the old table comes from
+ *              the EEPROM and is scanned in order as before.
+ *  input:  average diag line reading
+ *  output: the tank number that's wet
+ *************************************************************************/
+static unsigned int tank_cal_tank(unsigned long ch5_volt)
+{
+    unsigned long ch5_volt_oldTable;
+    unsigned int  index;
+    unsigned int  high;
+    unsigned int  mid;
+    unsigned int  tank_number;
+    char          error_found = 0;
+
     // Add offset only for old table
     ch5_volt_oldTable = ch5_volt;
     ch5_volt_oldTable += (unsigned long)pSysDia5->PNOffset;
@@ -806,6 +1233,8 @@ unsigned int calc_tank( void )
     ch5_volt *= (unsigned long)ReferenceVolt;
     ch5_volt /= (unsigned long)1000;
     
+    tank_number = 0;
+
     // New Table
     if(pSysDia5->updatedADCTable == 1) 
     {
@@ -817,13 +1246,22 @@ unsigned int calc_tank( void )
         //printf("LOW VOLTAGE: %d\n", (int)lowVolt);
         compare_volts = lowVolt;
         
-        for (index = 0; index < 17; index++)
+        /* Count of entries at or above lowVolt: the first entry below it */
+        index = 0;
+        high = 17;
+        while (index < high)
         {
-            if (lowVolt <= voltList[index])
+            mid = (index + high) / 2;
+            if (lowVolt <= voltList[mid])
+            {
+                index = mid + 1;
+            }
+            else
             {
-                tank_number++;
+                high = mid;
             }
         }
+        tank_number = index;
         
         if(tank_number > 1 && tank_number < 16) {
             if (lowVolt > ((((voltList[tank_number - 1] - voltList[tank_number]) * 25) / 100) + voltList[tank_number])
@@ -871,6 +1309,98 @@ unsigned int calc_tank( void )
     return(tank_number);
 }
 
+/*************************************************************************
+ *  subroutine:      tank_cal_step()
+ *
+ *  function:
+ *
+ *         1.  TC_SETTLE: wait out TC_SETTLE_TIME, then pulse the probes,
+ *             turn on the precision DIAG drive and take the throw away
+ *             reading
+ *         2.  TC_SAMPLE: take one reading per call, keeping the running
+ *             sum and the sums of the deviations from the first reading
+ *         3.  Stop after TC_TRIALS readings, or sooner (TC_MIN_TRIALS at
+ *             least) once the mean is within TC_CI_MV at 2 sigma, and
+ *             work out the tank number
+ *         4.  TC_DONE: a result not taken within TC_MAX_AGE (check_diag()
+ *             stopped asking) no longer says what is wet; start again
+ *
+ *  input:  none
+ *  output: tc_state after the step (TC_DONE when tank_cal_result() is ready)
+ *************************************************************************/
+unsigned char tank_cal_step(void)
+{
+    long          dev;
+
+    switch (tc_state)
+    {
+        case TC_SETTLE:
+            if (read_time() < tc_time)
+            {
+                break;                            // ensure minimum period
+            }
+            if (slot_locked)
+            {
+                probe_time = slot_next(0);        // sharing the truck, wait for our slot
+                if (read_time() < probe_time)
+                {
+                    break;
+                }
+            }
+            optic_5_pulse();                      // Pulse optic probe to get reading
+            CH_TEST5 = 0;                         // Turn off Ch 5 (DIAG channel)
+            DIAGNOSTIC_EN = 0;                    // Turn on precision DIAG voltage 
+            tc_state = TC_SAMPLE;
+            if (read_ADC() == FAILED)
+            {
+                tank_cal_fail(3);
+                break;
+            }
+            tc_count = 0;
+            tc_sum = 0;
+            tc_dsum = 0;
+            tc_dsq = 0;
+            break;
+
+        case TC_SAMPLE:
+            if (read_ADC() == FAILED)
+            {
+                tank_cal_fail(4);
+                break;
+            }
+            if (tc_count == 0)
+            {
+                tc_first = probe_volt[4];
+            }
+            optic5_table[tc_count] = probe_volt[4];
+            tc_count++;
+            tc_sum += probe_volt[4];
+            dev = (long)probe_volt[4] - (long)tc_first;
+            tc_dsum += dev;
+            tc_dsq += (unsigned long long)(dev * dev);
+            if (tank_cal_tight())
+            {
+                CH_TEST5 = 1;
+                DIAGNOSTIC_EN = 1;
+                tc_tank = tank_cal_tank(tc_sum / tc_count);  // 5-wire-optic diagnostic voltage
+                tc_state = TC_DONE;
+                tc_time = read_time();
+            }
+            break;
+
+        case TC_DONE:
+            if (read_time() > (tc_time + TC_MAX_AGE))
+            {
+                tank_cal_start();                 // Nobody took it; too old now
+            }
+            break;
+
+        default:
+            break;
+    }
+    return tc_state;
+}
+
 
 /*************************************************************************
  *  subroutine:      scully_probe()
@@ -28,6 +28,12 @@
  *  1.5.30  08/10/14  DHP  Changed text as needed to reflect changes in ground type
  *                                        and unit type display
  *  1.6.35  02/07/17  DHP  Updated case 136 to indicate deadman fault rather than only open
+ *  1.6.38  10/19/26  AGT  Added message 29 to report the parallel probe classifier
+ *                          decision, confidence and time; enabled by message 20.
+ *                         Added a binary trace ring; xprintf() records every
+ *                          message number/parameter with a ms stamp before the
+ *                          ModBus-address check so traces survive in ModBus mode.
+ *                         Dropped majver/minver/edtver, set but never printed.
  **********************************************************************************************/
 
 
@@ -106,6 +112,115 @@ static const char * const eeb_message[] = {eeb_message0,
                                     eeb_message6,
                                     eeb_message7};
 
+/************************** Binary Trace Ring *******************************/
+
+/* Each record is 8 bytes: message number, context (0 = main loop, else the
+   interrupt priority it was logged from), mstimer stamp and two parameters.
+   The ring keeps the newest TRACE_MAX records; overwritten records are
+   counted in trace_lost until read out via ModBus. test/tracedec turns the
+   records read out back into the texts below. */
+
+#define TRACE_MAX  64                   /* Must be a power of 2 */
+
+typedef struct
+{
+    unsigned char  id;
+    unsigned char  ctx;
+    unsigned short stamp;
+    unsigned int   arg1;
+    unsigned int   arg2;
+} TRACEREC;
+
+static TRACEREC trace_ring[TRACE_MAX];
+static unsigned char trace_head = 0;      /* Next slot to write */
+static unsigned char trace_cnt = 0;       /* Records not yet read */
+static unsigned int  trace_lost = 0;      /* Records overwritten unread */
+
+/*************************************************************************
+ *  subroutine:      trace_put()
+ *
+ *  function:  Record a message number and two parameters in the trace ring.
+ *             Safe to call from an interrupt; the slot is reserved with the
+ *             CPU priority raised so no formatting is done here.
+ *
+ *  input:  id, arg1, arg2
+ *  output: none
+ *************************************************************************/
+
+void trace_put(unsigned char id, unsigned int arg1, unsigned int arg2)
+{
+TRACEREC *rec;
+unsigned int save_ipl;
+
+    save_ipl = SRbits.IPL;
+    SRbits.IPL = 7;
+    rec = &trace_ring[trace_head];
+    trace_head = (unsigned char)((trace_head + 1) & (TRACE_MAX - 1));
+    if (trace_cnt < TRACE_MAX)
+    {
+        trace_cnt++;
+    }else
+    {
+        trace_lost++;
+    }
+    rec->id = id;
+    rec->ctx = (unsigned char)save_ipl;
+    rec->stamp = mstimer;
+    rec->arg1 = arg1;
+    rec->arg2 = arg2;
+    SRbits.IPL = save_ipl;
+} /* End trace_put() */
+
+/*************************************************************************
+ *  subroutine:      trace_get()
+ *
+ *  function:  Copy up to "max" of the oldest unread trace records into buf
+ *             (big-endian, 8 bytes each) and release them from the ring.
+ *
+ *  input:  buf, max records
+ *  output: number of records copied; *lost gets (and clears) the
+ *          overwritten count
+ *************************************************************************/
+
+unsigned char trace_get(unsigned char *buf, unsigned char max, unsigned int *lost)
+{
+TRACEREC rec;
+unsigned char n;
+unsigned char tail;
+unsigned int save_ipl;
+
+    save_ipl = SRbits.IPL;
+    SRbits.IPL = 7;
+    *lost = trace_lost;
+    trace_lost = 0;
+    SRbits.IPL = save_ipl;
+
+    for (n = 0; n < max; n++)
+    {
+        save_ipl = SRbits.IPL;
+        SRbits.IPL = 7;
+        if (trace_cnt == 0)
+        {
+            SRbits.IPL = save_ipl;
+            break;
+        }
+        tail = (unsigned char)((trace_head - trace_cnt) & (TRACE_MAX - 1));
+        rec = trace_ring[tail];
+        trace_cnt--;
+        SRbits.IPL = save_ipl;
+
+        *buf++ = rec.id;
+        *buf++ = rec.ctx;
+        *buf++ = (unsigned char)(rec.stamp >> 8);
+        *buf++ = (unsigned char)rec.stamp;
+        *buf++ = (unsigned char)(rec.arg1 >> 8);
+        *buf++ = (unsigned char)rec.arg1;
+        *buf++ = (unsigned char)(rec.arg2 >> 8);
+        *buf++ = (unsigned char)rec.arg2;
+    }
+    return n;
+} /* End trace_get() */
+
 /****************************************************************************/
 /****************************************************************************/
 
@@ -167,8 +282,8 @@ static unsigned int act_message = 0;
 static unsigned int toggle = 0;           /* toggle prevents overwrite of a last message */
 static unsigned int print_once = 0;
 unsigned int bit_mask = 0;
-static int majver, minver, edtver;
 
+   trace_put((unsigned char)message_number, parameter1, 0);
    if (modbus_addr != 0)                   /* ASCII only if modbus address 0 */
       return;
 
@@ -209,9 +324,6 @@ static int majver, minver, edtver;
         /********** DEBUG STATES *****************/
         {
         case 0:
-           majver = (updater_rev >>12);
-           minver = (updater_rev >>8) & 0xF;
-           edtver = (updater_rev  & 0x00FF);
            printf("%c", 0x1B);     /* Make sure the below message is printed black */
            printf("[30m");
            printf("\n\r*  Intellitrol");
@@ -360,7 +472,7 @@ static int majver, minver, edtver;
             printf("  MAIN Acquire state\n\r");
             main_message = 0x0000;
             ack_message &= ~(0x000F);
-            ack_message |= 0x0FE0;
+            ack_message |= 0x2FE0;
             toggle = FALSE;
             break;
          case 21:
@@ -405,6 +517,9 @@ static int majver, minver, edtver;
             printf("\n\r  Pulse Detected, Delaying          ");
             break;
          case 29:
+            printf("\n\r   Probe class %s: optic %u%% thermistor %u%% in %ums",
+                   (parameter1 == (unsigned int)THERMIS) ? "Thermistor" : "2 wire Optic",
+                   class_conf[OPTIC2], class_conf[THERMIS], class_ms);
            break;
          case 30:
            break;
@@ -52,6 +52,7 @@
  *                                        so permit is allowed if later tests are successful.
  *                                       Increased Probe Short and Probe Power levels to
  *                                        correctly identify connection of certain devices.
+ * 1.6.38   10/19/26 AGT   Trigger the probe waveform capture when a short is found.
  *
  *****************************************************************************/
 
@@ -500,6 +501,7 @@ int timeout;
       if (shorts_flag & imsk)
       {
         probes_state[i] = P_SHORT;
+        capture_trigger(CAP_TRIG_SHORT);
       }
       else if (open_flag & imsk)
       {
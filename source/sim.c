@@ -24,6 +24,9 @@
  *  1.6.34  10/10/16  DHP  Added increment of service_time to timer_heartbeat().
  *                         Correct display_probe() for counts greater than 8 and
  *                          changed indexing to match ledstate array indexing.
+ *  1.6.38  10/19/26  AGT  Added monotimer (never reset) for time_ms64().
+ *                         Set thresh_stale after the 5-wire probe_type[] fill.
+ *                         set_porte() calls probe_q_resync() on a drive change.
  **********************************************************************************************/
 #include "common.h"
 #define SW_MED_SLOW    3     /* 3/8's second */
@@ -124,6 +127,7 @@ volatile int delay_count;
 
    mstimer++;                 /* milliseconds... */
    freetimer++;               /* bump 1 ms counter */
+   monotimer++;               /* ... and the one nobody resets */
    service_time++;          /* bump servicecounter */
    if (tank_state == T_DRY)
       dry_timer++;            /* bump 1 ms counter if dry */
@@ -358,6 +362,8 @@ void  set_porte( UINT16 port_select )
 
         } /* End switch on probe_try_state */
 
+    if (LATE != port_select)            /* Drive change, so the queued */
+        probe_q_resync();               /*  probe scans are from before */
     PORTE = port_select;                /* Drive selected channels */
 
 } /* end of set_porte */
@@ -483,6 +489,7 @@ unsigned int i;
        {
          probe_type[i]=P_OPTIC5;
        }
+       thresh_stale = TRUE;
     }
     else
     {
@@ -18,11 +18,35 @@
  * -------- ---------  ---      --------------------------------------------
  * 1.5.31  01/14/15  DHP  Replaced lint -e(838) fix with (void) return calls
  *                                     Removed dummy_func() 
+ * 1.6.38  10/19/26  AGT  Page program and sector erase no longer wait for
+ *                          completion; the next access waits instead
+ *                          (SPI_EEPROMWaitReady()). Added DMA block transfers
+ *                          on SPI2 (DMA2 TX / DMA3 RX), a double-buffered
+ *                          CRC-16 read stream and update image staging.
+ *                         Staging resumes from SysParm.UpdSector (sectors
+ *                          completed) rather than searching for an erased
+ *                          page.
  *
  *****************************************************************************/
 #include "common.h"
 #include "spi_mpol.h"
 #include "spi_eeprom.h"
+#include "loader.h"
+
+/* DMA buffers: two pages for the ping-pong read stream (page 0 doubles as
+   the staging page for update image writes), plus the constant byte sent
+   while receiving and the byte the RX channel discards into while sending */
+
+static unsigned char spi_dma_buf[2][SPI_EEPROM_PAGE_SIZE] __attribute__((space(dma)));
+static unsigned char spi_dma_zero __attribute__((space(dma)));
+static unsigned char spi_dma_sink __attribute__((space(dma)));
+
+static unsigned char spi_busy;          /* Program/erase may be in progress */
+
+/* Update image staging state, see spi_stage_write() */
+
+static unsigned char spi_stage_known;   /* spi_stage_next is valid */
+static unsigned long spi_stage_next;    /* Next image offset expected */
 
 /******************************* 3/17/2009 6:27AM ****************************
  * Function: SPI_EEPROMInit
@@ -44,6 +68,127 @@ void SPI_EEPROMInit(void)
     SPI_EEPROM_SCK_TRIS = 0;
     SPI_EEPROM_SDO_TRIS = 0;
     SPI_EEPROM_SDI_TRIS = 1;
+    spi_dma_zero = 0;
+    spi_busy = TRUE;                /* Don't know what it was doing */
+    Init_DMA2();
+    Init_DMA3();
+}
+
+/*****************************************************************************
+ * Function: SPI_EEPROMWaitReady()
+ *
+ * Preconditions: SPI module must be configured to operate with EEPROM.
+ *
+ * Overview: Page program and erase commands return as soon as the command
+ *           is sent; this waits for the part to finish the last one. It
+ *           is called at the start of every access, so the program time
+ *           overlaps whatever the caller does in between.
+ *
+ * Input: None.
+ *
+ * Output: GOOD, or BAD on SPI error.
+ *****************************************************************************/
+int SPI_EEPROMWaitReady(void)
+{
+_SPI_EEPROMStatus_ status;
+
+  if (!spi_busy) return GOOD;
+  do
+  {
+    if (SPI_EEPROMReadStatus(SPI_EEPROM_CMD_RDSR, &status) == BAD) return BAD;
+  } while(status.Bits.BSY);
+  asm volatile("nop");    /* These NOPs are needed for the  */
+  asm volatile("nop");    /* write cycle to complete */
+  asm volatile("nop");    /*  */
+  spi_busy = FALSE;
+  return GOOD;
+}
+
+/*****************************************************************************
+ * spi_cmd_addr: Select the part and send a command plus 24-bit address
+ *****************************************************************************/
+static int spi_cmd_addr(unsigned cmd, unsigned long Address)
+{
+  mSPI_EEPROMCELow();
+
+  if (SPIMPolPut(cmd)) return BAD;
+  (void) mSPIMPolGet();  /* dummy read */
+
+  if (SPIMPolPut(Hi(Address))) return BAD;
+  (void) mSPIMPolGet();  /* dummy read */
+
+  if (SPIMPolPut(Md(Address))) return BAD;
+  (void) mSPIMPolGet();  /* dummy read */
+
+  if (SPIMPolPut(Lo(Address))) return BAD;
+  (void) mSPIMPolGet();  /* dummy read */
+  return GOOD;
+}
+
+/*****************************************************************************
+ * spi_dma_start: Start a DMA transfer of "cnt" bytes on SPI2
+ *
+ * "tx" (DMA RAM) is sent, or zeroes if NULL; received bytes go to "rx"
+ * (DMA RAM), or are discarded if NULL. Both channels are requested by the
+ * SPI2 transfer-done event; the first TX byte is forced. The part must
+ * already be selected and addressed.
+ *****************************************************************************/
+static void spi_dma_start(const unsigned char *tx, unsigned char *rx, unsigned cnt)
+{
+  (void) mSPIMPolGet();             /* Empty the receive buffer */
+  SPISTATbits.SPIROV = 0;
+  IFS1bits.DMA2IF = 0;
+  IFS2bits.DMA3IF = 0;
+
+  if (tx)
+  {
+    DMA2CONbits.AMODE = 0;          /* Post increment through buffer */
+    DMA2STA = (unsigned int)__builtin_dmaoffset(tx);
+  }
+  else
+  {
+    DMA2CONbits.AMODE = 1;          /* Same zero byte every time */
+    DMA2STA = (unsigned int)__builtin_dmaoffset(&spi_dma_zero);
+  }
+  if (rx)
+  {
+    DMA3CONbits.AMODE = 0;
+    DMA3STA = (unsigned int)__builtin_dmaoffset(rx);
+  }
+  else
+  {
+    DMA3CONbits.AMODE = 1;          /* Discard */
+    DMA3STA = (unsigned int)__builtin_dmaoffset(&spi_dma_sink);
+  }
+  DMA2CNT = cnt - 1;
+  DMA3CNT = cnt - 1;
+  DMA3CONbits.CHEN = 1;
+  DMA2CONbits.CHEN = 1;
+  DMA2REQbits.FORCE = 1;            /* First byte; SPI2 events do the rest */
+}
+
+/*****************************************************************************
+ * spi_dma_wait: Wait for the transfer started by spi_dma_start()
+ *
+ * The RX channel finishes last. A page at 10 MHz takes about 210us, so
+ * the loop limit is only there to catch a dead SPI module.
+ *****************************************************************************/
+static int spi_dma_wait(void)
+{
+unsigned long limit;
+
+  for (limit = 0x10000L; !IFS2bits.DMA3IF; limit--)
+  {
+    if (limit == 0)
+    {
+      DMA2CONbits.CHEN = 0;
+      DMA3CONbits.CHEN = 0;
+      return BAD;
+    }
+  }
+  IFS2bits.DMA3IF = 0;
+  IFS1bits.DMA2IF = 0;
+  return GOOD;
 }
 
 /******************************* 3/17/2009 6:28AM ****************************
@@ -60,8 +205,7 @@ void SPI_EEPROMInit(void)
  *****************************************************************************/
 int SPI_EEPROMWriteByte(unsigned long Address, unsigned Data)
 {
-_SPI_EEPROMStatus_ status;
-
+  if (SPI_EEPROMWaitReady()) return BAD;
   if (SPI_EEPROMWriteEnable() == BAD) return BAD;
   mSPI_EEPROMCELow();  /* dummy read */
 
@@ -81,16 +225,7 @@ _SPI_EEPROMStatus_ status;
   (void) mSPIMPolGet();  /* dummy read */
 
   mSPI_EEPROMCEHigh();
-
-  // wait for completion of previous write operation
-  status.Bits.BSY = 1;
-  while(status.Bits.BSY)
-  {
-    if (SPI_EEPROMReadStatus(SPI_EEPROM_CMD_RDSR, &status) == BAD) return BAD;
-  }
-  asm volatile("nop");    /* These NOPs are needed for the  */
-  asm volatile("nop");    /* write cycle to complete */
-  asm volatile("nop");    /*  */
+  spi_busy = TRUE;                  /* Next access waits for completion */
   return GOOD;
 }
 
@@ -110,6 +245,7 @@ int SPI_EEPROMReadByte(unsigned long Address, unsigned char *data, unsigned int
 {
 unsigned int i;
 
+  if (SPI_EEPROMWaitReady()) return BAD;
   mSPI_EEPROMCELow();
 
   if (SPIMPolPut(SPI_EEPROM_CMD_READ)) return BAD;
@@ -147,9 +283,9 @@ unsigned int i;
  *****************************************************************************/
 int SPI_EEPROMPageWriteByte(unsigned long Address, const unsigned char *Data, unsigned int cnt)
 {
-_SPI_EEPROMStatus_ status;
 unsigned int i;
 
+  if (SPI_EEPROMWaitReady()) return BAD;
   if (SPI_EEPROMWriteEnable()) return BAD;
   mSPI_EEPROMCELow();
 
@@ -172,16 +308,7 @@ unsigned int i;
   }
 
   mSPI_EEPROMCEHigh();
-
-  // wait for completion of previous write operation
-  status.Bits.BSY = 1;
-  while(status.Bits.BSY)
-  {
-    if (SPI_EEPROMReadStatus(SPI_EEPROM_CMD_RDSR, &status) == BAD) return BAD;
-  }
-  asm volatile("nop");    /* These NOPs are needed for the  */
-  asm volatile("nop");    /* write cycle to complete */
-  asm volatile("nop");    /*  */
+  spi_busy = TRUE;                  /* Next access waits for completion */
   return GOOD;
 } /* End SPI_EEPROMPageWriteByte() */
 
@@ -308,6 +435,7 @@ int spi_erase(void)
 _SPI_EEPROMStatus_ status;
 unsigned int  temp_data;
 
+  if (SPI_EEPROMWaitReady()) return BAD;
   if (SPI_EEPROMWriteEnable()) return BAD;
   mSPI_EEPROMCELow();
   if (SPIMPolPut(SPI_EEPROM_CMD_CHIP_ERASE)) return BAD;
@@ -351,8 +479,7 @@ unsigned int temp_data;
 
 int spi_erase_sector(unsigned long Address)
 {
-_SPI_EEPROMStatus_ status;
-
+  if (SPI_EEPROMWaitReady()) return BAD;
   if (SPI_EEPROMWriteEnable()) return BAD;
   mSPI_EEPROMCELow();
   if (SPIMPolPut(SPI_EEPROM_CMD_SECTOR_ERASE)) return BAD;
@@ -368,14 +495,319 @@ _SPI_EEPROMStatus_ status;
   (void) mSPIMPolGet();
 
   mSPI_EEPROMCEHigh();
+  spi_busy = TRUE;                  /* Next access waits for completion */
+  return GOOD;
+}
 
-//  status.Bits.BSY = 1;
-  do
+/*****************************************************************************
+ * spi_page_write_dma: Program one whole page from DMA RAM
+ *
+ * Returns once the page is sent; the program time overlaps the caller's
+ * next step (see SPI_EEPROMWaitReady()).
+ *****************************************************************************/
+static int spi_page_write_dma(unsigned long Address, const unsigned char *page)
+{
+  if (SPI_EEPROMWaitReady()) return BAD;
+  if (SPI_EEPROMWriteEnable()) return BAD;
+  if (spi_cmd_addr(SPI_EEPROM_CMD_WRITE, Address)) return BAD;
+  spi_dma_start(page, (unsigned char *)0, SPI_EEPROM_PAGE_SIZE);
+  if (spi_dma_wait())
   {
-    if (SPI_EEPROMReadStatus(SPI_EEPROM_CMD_RDSR, &status) == BAD) return BAD;
-  } while(status.Bits.BSY);
+    mSPI_EEPROMCEHigh();
+    return BAD;
+  }
+  mSPI_EEPROMCEHigh();
+  spi_busy = TRUE;                  /* Next access waits for completion */
+  return GOOD;
+}
+
+/*****************************************************************************
+ * spi_page_read_dma: Read one whole page into DMA RAM
+ *****************************************************************************/
+static int spi_page_read_dma(unsigned long Address, unsigned char *page)
+{
+  if (SPI_EEPROMWaitReady()) return BAD;
+  if (spi_cmd_addr(SPI_EEPROM_CMD_READ, Address)) return BAD;
+  spi_dma_start((const unsigned char *)0, page, SPI_EEPROM_PAGE_SIZE);
+  if (spi_dma_wait())
+  {
+    mSPI_EEPROMCEHigh();
+    return BAD;
+  }
+  mSPI_EEPROMCEHigh();
   return GOOD;
 }
+
+/*****************************************************************************
+ * Function: SPI_EEPROMStreamCRC()
+ *
+ * Preconditions: SPI module must be configured to operate with EEPROM.
+ *
+ * Overview: Calculates the ModBus-style CRC-16 of "len" bytes starting at
+ *           "Address". A single READ command streams the whole range in
+ *           page sized pieces: while DMA fills one buffer the CPU CRC's
+ *           the other, so the SPI time hides behind the CRC time.
+ *
+ * Input: Address, byte count and pointer to the returned CRC.
+ *
+ * Output: GOOD, or BAD on SPI error.
+ *****************************************************************************/
+int SPI_EEPROMStreamCRC(unsigned long Address, unsigned long len, unsigned short *crc)
+{
+unsigned short sum;
+unsigned cnt;
+unsigned next_cnt;
+unsigned char cur;
+
+  sum = INIT_CRC_SEED;
+  if (len)
+  {
+    if (SPI_EEPROMWaitReady()) return BAD;
+    if (spi_cmd_addr(SPI_EEPROM_CMD_READ, Address)) return BAD;
+
+    cnt = (len > SPI_EEPROM_PAGE_SIZE) ? SPI_EEPROM_PAGE_SIZE : (unsigned)len;
+    len -= cnt;
+    cur = 0;
+    spi_dma_start((const unsigned char *)0, spi_dma_buf[0], cnt);
+    for (;;)
+    {
+      if (spi_dma_wait())
+      {
+        mSPI_EEPROMCEHigh();
+        return BAD;
+      }
+      next_cnt = (len > SPI_EEPROM_PAGE_SIZE) ? SPI_EEPROM_PAGE_SIZE : (unsigned)len;
+      len -= next_cnt;
+      if (next_cnt)                 /* Fill the other buffer while ... */
+      {
+        spi_dma_start((const unsigned char *)0, spi_dma_buf[cur ^ 1], next_cnt);
+      }
+      sum = modbus_CRC(spi_dma_buf[cur], cnt, sum); /* ... this one is CRC'd */
+      if (next_cnt == 0)
+      {
+        break;
+      }
+      cur ^= 1;
+      cnt = next_cnt;
+      service_charge();             /* Keep Service LED off */
+    }
+    mSPI_EEPROMCEHigh();
+  }
+  *crc = sum;
+  return GOOD;
+}
+
+/*****************************************************************************
+ * Update image staging
+ *
+ * A new program image is written into the update module, from address 0
+ * up to (not including) L_BYTE_COUNT_ADDR, strictly in order and a window
+ * at a time by spi_stage_write(). Windows are gathered into spi_dma_buf[0]
+ * and each full page is programmed by DMA; a sector is erased when its
+ * first page is programmed. spi_stage_status() reports where the master
+ * should resume after an interrupted transfer. Sectors past the one being
+ * written still hold whatever was there before, so that cannot be found
+ * from the module; instead SysParm.UpdSector records each sector as it is
+ * completed, and after a reset (or a failed program) staging resumes at
+ * the start of the first incomplete sector, which is erased again when
+ * its first page is programmed.
+ * spi_stage_finish() writes the loader's byte count/checksum header and
+ * returns the CRC-16 of the staged image for the master to check.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * spi_stage_open: Make sure the update module is there and set up
+ *****************************************************************************/
+static int spi_stage_open(void)
+{
+static unsigned char opened;
+unsigned long id;
+
+  if (OPTBDPRES)                    /* Option board not present */
+  {
+    opened = FALSE;
+    return SPI_STAGE_NODEV;
+  }
+  if (!opened)
+  {
+    SPIMPolInit();                  /* Initialize the SPI bus */
+    SPI_EEPROMInit();               /* Initialize the SPI eeprom interface */
+    id = SPI_EEPROMReadDeviceID();  /* Fetch SPI memory ID */
+    if ((((id >> 16) & 0xFF) < 0x13) || (((id >> 16) & 0xFF) > 0x14))
+    {
+      return SPI_STAGE_NODEV;
+    }
+    opened = TRUE;
+    spi_stage_known = FALSE;
+  }
+  return SPI_STAGE_OK;
+}
+
+/*****************************************************************************
+ * spi_stage_program: Program the gathered page at "Address"
+ *****************************************************************************/
+static int spi_stage_program(unsigned long Address)
+{
+  if ((Address & (SPI_EEPROM_SECTOR_SIZE - 1)) == 0)
+  {
+    if (spi_erase_sector(Address)) return BAD;
+  }
+  return spi_page_write_dma(Address, spi_dma_buf[0]);
+}
+
+/*****************************************************************************
+ * spi_stage_mark: Record "sectors" complete sectors in SysParm
+ *****************************************************************************/
+static void spi_stage_mark(unsigned char sectors)
+{
+  if (SysParm.UpdSector != sectors)
+  {
+    SysParm.UpdSector = sectors;
+    (void)nvSysParmUpdate();
+  }
+}
+
+/*****************************************************************************
+ * spi_stage_status: Return the image offset the master should send next
+ *****************************************************************************/
+int spi_stage_status(unsigned long *next)
+{
+int sts;
+
+  if ((sts = spi_stage_open()) != SPI_STAGE_OK)
+  {
+    return sts;
+  }
+  if (!spi_stage_known)
+  {
+    spi_stage_next = (unsigned long)SysParm.UpdSector * SPI_EEPROM_SECTOR_SIZE;
+    if (spi_stage_next > L_BYTE_COUNT_ADDR)
+    {
+      spi_stage_next = 0;
+    }
+    spi_stage_known = TRUE;
+  }
+  *next = spi_stage_next;
+  return SPI_STAGE_OK;
+}
+
+/*****************************************************************************
+ * spi_stage_restart: Start a new image from offset 0
+ *****************************************************************************/
+int spi_stage_restart(void)
+{
+int sts;
+
+  if ((sts = spi_stage_open()) != SPI_STAGE_OK)
+  {
+    return sts;
+  }
+  spi_stage_next = 0;
+  spi_stage_known = TRUE;
+  spi_stage_mark(0);
+  return SPI_STAGE_OK;
+}
+
+/*****************************************************************************
+ * spi_stage_write: Append "cnt" image bytes at "offset"
+ *
+ * "offset" must be the spi_stage_status() offset (SPI_STAGE_OFFSET if not).
+ *****************************************************************************/
+int spi_stage_write(unsigned long offset, const unsigned char *data, unsigned cnt)
+{
+unsigned long dummy;
+unsigned fill;
+unsigned take;
+int sts;
+
+  if ((sts = spi_stage_status(&dummy)) != SPI_STAGE_OK)
+  {
+    return sts;
+  }
+  if (offset != spi_stage_next)
+  {
+    return SPI_STAGE_OFFSET;
+  }
+  if ((offset + cnt) > L_BYTE_COUNT_ADDR)
+  {
+    return SPI_STAGE_RANGE;
+  }
+  while (cnt)
+  {
+    fill = (unsigned)(spi_stage_next & SPI_EEPROM_PAGE_MASK);
+    if (fill == 0)
+    {
+      memset(spi_dma_buf[0], 0xFF, SPI_EEPROM_PAGE_SIZE);
+    }
+    take = SPI_EEPROM_PAGE_SIZE - fill;
+    if (take > cnt)
+    {
+      take = cnt;
+    }
+    memcpy(&spi_dma_buf[0][fill], data, take);
+    data += take;
+    cnt -= take;
+    spi_stage_next += take;
+    if ((spi_stage_next & SPI_EEPROM_PAGE_MASK) == 0)
+    {
+      if (spi_stage_program(spi_stage_next - SPI_EEPROM_PAGE_SIZE))
+      {
+        spi_stage_known = FALSE;    /* Back to the last whole sector */
+        return SPI_STAGE_IOERR;
+      }
+      if ((spi_stage_next & (SPI_EEPROM_SECTOR_SIZE - 1)) == 0)
+      {
+        spi_stage_mark((unsigned char)(spi_stage_next / SPI_EEPROM_SECTOR_SIZE));
+      }
+    }
+  }
+  return SPI_STAGE_OK;
+}
+
+/*****************************************************************************
+ * spi_stage_finish: Complete an image of "count" bytes
+ *
+ * "hdr" is the 8 byte loader header (byte count and checksum) written at
+ * L_BYTE_COUNT_ADDR exactly as supplied; the rest of that page (features,
+ * serial number) is preserved. Returns the CRC-16 of the staged image.
+ *****************************************************************************/
+int spi_stage_finish(unsigned long count, const unsigned char *hdr, unsigned short *crc)
+{
+unsigned long dummy;
+int sts;
+
+  if ((sts = spi_stage_status(&dummy)) != SPI_STAGE_OK)
+  {
+    return sts;
+  }
+  if (count != spi_stage_next)
+  {
+    return SPI_STAGE_OFFSET;        /* Haven't got it all */
+  }
+  if (spi_stage_next & SPI_EEPROM_PAGE_MASK) /* Partial last page */
+  {
+    if (spi_stage_program(spi_stage_next & ~(unsigned long)SPI_EEPROM_PAGE_MASK))
+    {
+      spi_stage_known = FALSE;
+      return SPI_STAGE_IOERR;
+    }
+  }
+  if (spi_page_read_dma(L_BYTE_COUNT_ADDR, spi_dma_buf[1]))
+  {
+    return SPI_STAGE_IOERR;
+  }
+  memcpy(spi_dma_buf[1], hdr, 8);
+  if (spi_erase_sector(L_BYTE_COUNT_ADDR)
+      || spi_page_write_dma(L_BYTE_COUNT_ADDR, spi_dma_buf[1]))
+  {
+    return SPI_STAGE_IOERR;
+  }
+  if (SPI_EEPROMStreamCRC(0L, count, crc))
+  {
+    return SPI_STAGE_IOERR;
+  }
+  return SPI_STAGE_OK;
+}
 /************************************************************************
  * EOF
  ************************************************************************/
@@ -31,6 +31,17 @@
  *                          check_unload_time
  *                          check_compartment_count
  *                        for support of super TIM
+ * 1.6.38  10/19/26  AGT  Added the TIM write journal (tim_journal_read/write/
+ *                          flush/reset): TIM_log_info() now stages its updates
+ *                          in a RAM copy of the touched scratchpad pages and
+ *                          writes only changed bytes, one scratchpad cycle per
+ *                          page and one serial number read per flush.
+ *                        Split the bus setup out of tim_block_write() into
+ *                          tim_write_open() for use by the flush.
+ *                        Dropped superTIM_ds_validate()'s unused fault_mask.
+ *                        TIM_log_info() makes room for each pass before
+ *                          staging it, and a failed journal access (timj_sts)
+ *                          drops the log instead of a byte of it.
  *********************************************************************************************/
 #include <ctype.h>
 #include "common.h"
@@ -45,6 +56,29 @@ static unsigned int vol_base_addr;
 static unsigned int write_counter;
 static unsigned int iteration_counter;
 
+/* TIM write journal: RAM copies of the scratchpad pages TIM_log_info()
+   touches, with a bit per byte that differs from what was read.  A full
+   load log touches more pages than fit (27 for 16 compartments), so
+   TIM_log_info() makes room for a pass, at most TIMJ_STEP pages, before
+   staging it.  The first error sticks in timj_sts: nothing more is staged
+   and the flush writes nothing, so no pass is ever half written. */
+#define TIMJ_PAGES    8
+#define TIMJ_STEP     3             /* Most pages one TIM_log_info() pass touches */
+#define TIMJ_FREE     0xFFFF
+#define LOG_FLUSH     0xFF          /* log_data_state: all staged, flush pending */
+
+static unsigned char timj_data[TIMJ_PAGES][DS28EC20_SCRATCHPAD_SIZE];
+static unsigned long timj_dirty[TIMJ_PAGES];
+static unsigned int  timj_page[TIMJ_PAGES] = {TIMJ_FREE, TIMJ_FREE, TIMJ_FREE, TIMJ_FREE,
+                                              TIMJ_FREE, TIMJ_FREE, TIMJ_FREE, TIMJ_FREE};
+static unsigned char timj_used;
+static int timj_sts = MB_OK;
+
+static int tim_write_open(void);
+static int timj_slot(unsigned int address, unsigned char *slot);
+static int timj_room(void);
+static void date_time_buf(unsigned char *buf);
+
 //static unsigned char compartment_count_flagged;
 
 /******************************* 5/20/2009 7:59AM ****************************
@@ -290,16 +324,13 @@ unsigned char E_S;
 }
 
 /*******************************************************************************
-* tim_block_write()
-* This will write a block of data into the TIM
+* tim_write_open()
+* Claim the COMM_ID line, reset the TIM and read its serial number ahead of
+* one or more scratchpad writes.  On success the caller owns the line and
+* must clear TIM from active_comm when done.
 ********************************************************************************/
-int tim_block_write(unsigned char *memory_ptr, unsigned int address, unsigned int count)
+static int tim_write_open(void)
 {
-unsigned int transfer_count;
-unsigned char first_page;
-unsigned char *datum;
-int sts;
-
 // >>> FogBugz 143
   if (active_comm & (INTELLI | GROUNDIODE)) /* COMM_ID aka TXA/RXA in use? */
   {                                           /* Might be by Ground Test */
@@ -322,6 +353,24 @@ int sts;
     active_comm &= ~TIM;                 /* FogBugz 143 COMM_ID line free now */
     return MB_READ_SERIAL_ERROR;
   }
+  return MB_OK;
+}
+
+/*******************************************************************************
+* tim_block_write()
+* This will write a block of data into the TIM
+********************************************************************************/
+int tim_block_write(unsigned char *memory_ptr, unsigned int address, unsigned int count)
+{
+unsigned int transfer_count;
+unsigned char first_page;
+unsigned char *datum;
+int sts;
+
+  if ((sts = tim_write_open()) != MB_OK)
+  {
+    return sts;
+  }
 
   printf("\n\r");
   if (TIM_size < (address + count))  /* Would we exceed the memory? */
@@ -396,6 +445,223 @@ int sts;
   return MB_OK;
 }
 
+/*******************************************************************************
+ * timj_slot()
+ * Find the journal slot holding the scratchpad page of "address", reading the
+ * page from the TIM into a free slot if needed.  When all slots are in use
+ * the journal is flushed first.  A failure is kept in timj_sts.
+ *******************************************************************************/
+static int timj_slot(unsigned int address, unsigned char *slot)
+{
+unsigned int page;
+unsigned char i;
+int sts;
+
+  if (timj_sts != MB_OK)
+  {
+    return timj_sts;
+  }
+  page = address & ~(TIM_scratchpad_size - 1);
+  for (i = 0; i < timj_used; i++)
+  {
+    if (timj_page[i] == page)
+    {
+      *slot = i;
+      return MB_OK;
+    }
+  }
+  if (timj_used >= TIMJ_PAGES)
+  {
+    if ((sts = tim_journal_flush()) != MB_OK)
+    {
+      timj_sts = sts;
+      return sts;
+    }
+  }
+  if (active_comm & (INTELLI | GROUNDIODE)) /* tim_block_read() would skip it */
+  {
+    timj_sts = MB_EXC_BUSY;
+    return timj_sts;
+  }
+  i = timj_used;
+  if ((sts = tim_block_read(timj_data[i], page, TIM_scratchpad_size)) != MB_OK)
+  {
+    timj_sts = sts;
+    return sts;
+  }
+  timj_page[i] = page;
+  timj_dirty[i] = 0;
+  timj_used++;
+  *slot = i;
+  return MB_OK;
+}
+
+/*******************************************************************************
+ * timj_room()
+ * Make room in the journal for one TIM_log_info() pass, flushing it if fewer
+ * than TIMJ_STEP slots are free.
+ *******************************************************************************/
+static int timj_room(void)
+{
+  if ((timj_used + TIMJ_STEP) > TIMJ_PAGES)
+  {
+    return tim_journal_flush();
+  }
+  return MB_OK;
+}
+
+/*******************************************************************************
+ * tim_journal_write()
+ * Stage a block write to the TIM.  Only bytes that differ from the TIM (or
+ * from earlier staged writes) are marked for tim_journal_flush().  A TIM
+ * whose scratchpad does not fit the journal is written directly.
+ *******************************************************************************/
+int tim_journal_write(const unsigned char *memory_ptr, unsigned int address, unsigned int count)
+{
+unsigned int offset;
+unsigned char slot;
+int sts;
+
+  if ((TIM_scratchpad_size == 0) || (TIM_scratchpad_size > DS28EC20_SCRATCHPAD_SIZE))
+  {
+    return tim_block_write((unsigned char *)memory_ptr, address, count);
+  }
+  if (TIM_size < (address + count))  /* Would we exceed the memory? */
+  {
+    timj_sts = MB_EXC_TIM_CMD_ERR;
+    return timj_sts;
+  }
+  while (count--)
+  {
+    if ((sts = timj_slot(address, &slot)) != MB_OK)
+    {
+      return sts;
+    }
+    offset = address & (TIM_scratchpad_size - 1);
+    if (timj_data[slot][offset] != *memory_ptr)
+    {
+      timj_data[slot][offset] = *memory_ptr;
+      timj_dirty[slot] |= ((unsigned long)1 << offset);
+    }
+    memory_ptr++;
+    address++;
+  }
+  return MB_OK;
+}
+
+/*******************************************************************************
+ * tim_journal_read()
+ * Read a block from the TIM as it will be once the journal is flushed.
+ *******************************************************************************/
+int tim_journal_read(unsigned char *memory_ptr, unsigned int address, unsigned int count)
+{
+unsigned char slot;
+int sts;
+
+  if ((TIM_scratchpad_size == 0) || (TIM_scratchpad_size > DS28EC20_SCRATCHPAD_SIZE))
+  {
+    return tim_block_read(memory_ptr, address, count);
+  }
+  if (TIM_size < (address + count))
+  {
+    timj_sts = MB_EXC_MEM_PAR_ERR;
+    return timj_sts;
+  }
+  while (count--)
+  {
+    if ((sts = timj_slot(address, &slot)) != MB_OK)
+    {
+      return sts;
+    }
+    *memory_ptr++ = timj_data[slot][address & (TIM_scratchpad_size - 1)];
+    address++;
+  }
+  return MB_OK;
+}
+
+/*******************************************************************************
+ * tim_journal_flush()
+ * Write every changed page of the journal to the TIM: one serial number read,
+ * then one write/verify/copy scratchpad cycle per page covering its first to
+ * last changed byte.  The journal is emptied unless the line is busy, in
+ * which case it is kept for a later try.  A journal that failed (timj_sts)
+ * is dropped unwritten and the failure returned.
+ *******************************************************************************/
+int tim_journal_flush(void)
+{
+unsigned char i;
+unsigned char first;
+unsigned char last;
+int sts = MB_OK;
+
+  if (timj_sts != MB_OK)
+  {
+    sts = timj_sts;
+    tim_journal_reset();
+    return sts;
+  }
+  for (i = 0; i < timj_used; i++)
+  {
+    if (timj_dirty[i] != 0)
+    {
+      break;
+    }
+  }
+  if (i < timj_used)                      /* Anything to write? */
+  {
+    if ((sts = tim_write_open()) != MB_OK)
+    {
+      if (sts == MB_EXC_BUSY)
+      {
+        return sts;                       /* Keep it, try again later */
+      }
+      tim_journal_reset();
+      return sts;
+    }
+    for (; i < timj_used; i++)
+    {
+      if (timj_dirty[i] == 0)
+      {
+        continue;
+      }
+      for (first = 0; (timj_dirty[i] & ((unsigned long)1 << first)) == 0; first++)
+      {
+      }
+      for (last = (unsigned char)(TIM_scratchpad_size - 1);
+           (timj_dirty[i] & ((unsigned long)1 << last)) == 0; last--)
+      {
+      }
+      sts = dallas_fill(TIM_scratchpad_size, (unsigned int)(last - first + 1),
+                        timj_page[i] + first, &timj_data[i][first]);
+      if (sts != MB_OK)
+      {
+        break;
+      }
+      service_charge();             /* Keep Service LED off */
+    }
+    active_comm &= ~TIM;                 /* FogBugz 143 COMM_ID line free now */
+  }
+  tim_journal_reset();
+  return sts;
+}
+
+/*******************************************************************************
+ * tim_journal_reset()
+ * Discard any staged TIM writes (truck gone or flush done).
+ *******************************************************************************/
+void tim_journal_reset(void)
+{
+unsigned char i;
+
+  for (i = 0; i < TIMJ_PAGES; i++)
+  {
+    timj_page[i] = TIMJ_FREE;
+    timj_dirty[i] = 0;
+  }
+  timj_used = 0;
+  timj_sts = MB_OK;
+}
+
 /*******************************************************************************
  * tim_block_read()
  *******************************************************************************/
@@ -567,17 +833,21 @@ int sts;                /* Status holding */
     
 }
 
+static void date_time_buf(unsigned char *buf)
+{
+    UNIX_to_Greg();
+    buf[0] = (unsigned char)month;
+    buf[1] = (unsigned char)day;
+    buf[2] = (unsigned char)(year - 2000);
+    buf[3] = (unsigned char)hour;
+    buf[4] = (unsigned char)minute;
+}
+
 void log_date_and_time(unsigned int log_address)
 {
-unsigned char write_buf[12],log_year;
+unsigned char write_buf[12];
 
-    UNIX_to_Greg();
-    log_year = (unsigned char)(year - 2000);
-    write_buf[0] = (unsigned char)month;
-    write_buf[1] = (unsigned char)day;
-    write_buf[2] = (unsigned char)log_year;
-    write_buf[3] = (unsigned char)hour;
-    write_buf[4] = (unsigned char)minute;
+    date_time_buf(write_buf);
     tim_block_write(write_buf,log_address,5);
 
 }
@@ -586,6 +856,12 @@ unsigned char write_buf[12],log_year;
  *  subroutine: TIM_log_info
  *
  *  function:   Log info to the TIM on connection.
+ *              Updates are staged in the TIM write journal and
+ *              written with tim_journal_flush() on the last pass,
+ *              or earlier when a pass needs room.  A pass is only
+ *              started with room for it; if the flush making that
+ *              room finds the line busy the pass waits for the next
+ *              call.  A TIM read or write failure drops the log.
  *              For an unload terminal log Intellitrol SN
  *              and date and time
  *              For a load terminal log the Intellitrol SN,
@@ -602,11 +878,25 @@ unsigned char TIM_log_info(void)
 unsigned int ver,i;
 unsigned int type_read_addr,vol_read_addr;
 unsigned char write_buf[12],ret_stat;
+int sts;
 
 
 //    compartment_count_flagged = 0;
     
-    if(SysParm.EnaSftFeatures & ENA_UNLOAD_TERM)    // Unload terminal mode
+    if (active_comm & (INTELLI | GROUNDIODE))  // COMM_ID in use, next call
+    {
+        return(1);
+    }
+    if (log_data_state == LOG_FLUSH)   // Last flush found the line busy
+    {
+        ret_stat = 0;
+    }
+    else if ((sts = timj_room()) != MB_OK)  // No room for this pass
+    {
+        // Busy: same pass next call.  Otherwise the flush dropped the log.
+        return((unsigned char)(sts == MB_EXC_BUSY));
+    }
+    else if(SysParm.EnaSftFeatures & ENA_UNLOAD_TERM)    // Unload terminal mode
     {
         ret_stat = 1;
         switch( log_data_state )
@@ -622,12 +912,13 @@ unsigned char write_buf[12],ret_stat;
                 write_buf[4] = clock_SN[1];
                 write_buf[5] = clock_SN[0];
                 // log the Intellitrol SN
-                tim_block_write(write_buf,UNLOAD_ITROL_SN_ADDR,6);
+                tim_journal_write(write_buf,UNLOAD_ITROL_SN_ADDR,6);
                 service_charge();             /* Keep Service LED off */
         
                 log_time_address = LAST_UNLOAD_DATE_TIME_ADDR;
                 // Log unload date and time
-                log_date_and_time(log_time_address);
+                date_time_buf(write_buf);
+                tim_journal_write(write_buf,log_time_address,5);
                 service_charge();             /* Keep Service LED off */
                 write_counter = 0;
                 log_data_state = 1;
@@ -636,7 +927,7 @@ unsigned char write_buf[12],ret_stat;
             default:
                 type_read_addr = (write_counter * 8) + 0x600;
                 write_buf[0] = write_buf[1] = write_buf[2] = 0;                 
-                tim_block_write(write_buf,type_read_addr,3);
+                tim_journal_write(write_buf,type_read_addr,3);
                 write_counter++;
                 if( write_counter >= number_of_Compartments )
                 {
@@ -661,7 +952,7 @@ unsigned char write_buf[12],ret_stat;
                 ver = (unsigned int)SHELLVER;
                 write_buf[1] = (unsigned char)ver;
                 write_buf[0] = (unsigned char)(ver >> 8);    
-                tim_block_write(write_buf,ITROL_FW_VERSION_ADDR,2);
+                tim_journal_write(write_buf,ITROL_FW_VERSION_ADDR,2);
                 service_charge();             /* Keep Service LED off */
    
                 // Log the Intellitrol SN
@@ -672,25 +963,26 @@ unsigned char write_buf[12],ret_stat;
                 write_buf[3] = clock_SN[2];
                 write_buf[4] = clock_SN[1];
                 write_buf[5] = clock_SN[0];    
-                tim_block_write(write_buf,LOAD_ITROL_SN_ADDR,6);
+                tim_journal_write(write_buf,LOAD_ITROL_SN_ADDR,6);
                 service_charge();             /* Keep Service LED off */
                 log_data_state = 1;
                 break;
  
             case 1:
                 // Update the load history by moving the last load info into the next log slot
-                tim_block_read(last_load_date_time,LAST_LOAD_DATE_TIME_ADDR,5);
-                tim_block_read(&load_history_ptr,LOAD_HISTORY_PRT_ADDR,1);
+                tim_journal_read(last_load_date_time,LAST_LOAD_DATE_TIME_ADDR,5);
+                tim_journal_read(&load_history_ptr,LOAD_HISTORY_PRT_ADDR,1);
                 load_history_ptr++;
                 if( load_history_ptr > 3 )
                 {
                     load_history_ptr = 0;
                 }
-                tim_block_write(&load_history_ptr,LOAD_HISTORY_PRT_ADDR,1);
+                tim_journal_write(&load_history_ptr,LOAD_HISTORY_PRT_ADDR,1);
         
                 log_time_address = LAST_LOAD_DATE_TIME_ADDR;
                 // log the last load date and time
-                log_date_and_time(log_time_address);
+                date_time_buf(write_buf);
+                tim_journal_write(write_buf,log_time_address,5);
                 service_charge();             /* Keep Service LED off */
                 
                 
@@ -706,11 +998,11 @@ unsigned char write_buf[12],ret_stat;
                 if( (iteration_counter % 2) == 0 )
                 {
                     service_charge();             
-                    tim_block_write(last_load_date_time,base_addr + (write_counter * 40),5);
+                    tim_journal_write(last_load_date_time,base_addr + (write_counter * 40),5);
         
                     type_read_addr = (write_counter * 8) + 0x600;
-                    tim_block_read(write_buf,type_read_addr,3);
-                    tim_block_write(write_buf,type_base_addr + (write_counter * 40),3);
+                    tim_journal_read(write_buf,type_read_addr,3);
+                    tim_journal_write(write_buf,type_base_addr + (write_counter * 40),3);
                     service_charge(); 
                     if( SysParm.EnaSftFeatures2 & ENA_AUTO_FUEL_TYPE_WRITE )
                     {
@@ -723,18 +1015,18 @@ unsigned char write_buf[12],ret_stat;
                     {
                         write_buf[0] = write_buf[1] = write_buf[2] = 0;
                     }
-                    tim_block_write(write_buf,type_read_addr,3);
+                    tim_journal_write(write_buf,type_read_addr,3);
                     iteration_counter++;
                 }
                 else
                 {
                     service_charge();             
                     vol_read_addr = (write_counter * 8) + 0x606;
-                    tim_block_read(write_buf,vol_read_addr,2);
-                    tim_block_write(write_buf,vol_base_addr + (write_counter * 40),2);
+                    tim_journal_read(write_buf,vol_read_addr,2);
+                    tim_journal_write(write_buf,vol_base_addr + (write_counter * 40),2);
                     service_charge();             
                     write_buf[0] = write_buf[1] = 0;
-                    tim_block_write(write_buf,vol_read_addr,2);       
+                    tim_journal_write(write_buf,vol_read_addr,2);       
                     iteration_counter++;
                     write_counter++;
                     if( write_counter >= number_of_Compartments )
@@ -746,6 +1038,21 @@ unsigned char write_buf[12],ret_stat;
         }
     }
 
+    if (timj_sts != MB_OK)
+    {
+        tim_journal_reset();              /* A TIM access failed: drop the log */
+        ret_stat = 0;
+    }
+    else if (ret_stat == 0)
+    {
+        // Everything staged, write the changed TIM pages
+        if (tim_journal_flush() == MB_EXC_BUSY)
+        {
+            log_data_state = LOG_FLUSH;
+            ret_stat = 1;                 /* Line busy, finish next pass */
+        }
+    }
+
 return(ret_stat);
 }
 
@@ -765,7 +1072,7 @@ return(ret_stat);
  *************************************************************************/
 char superTIM_ds_validate(void)
 {
-char ret_val,mask,fault_mask;
+char ret_val,mask;
 unsigned int cert_year,cert_month,cert_day,cert_hour,cert_minute,read_addr;
 unsigned char cert_buf[7];
 unixtime cert_time;
@@ -773,7 +1080,6 @@ int i;
 
     ret_val = 0;
     mask = 1;
-    fault_mask = 0;
     cert_ds_fails = 0;
     for( i = 0; i < 5; i++)
     {
@@ -73,6 +73,27 @@
  *           03/17/17      In truck_active() removed handling of deadman changes
  *                          and ensuing flagging for backup processor.  This is
  *                          now handled in permit_bypass().
+ *  1.6.38  10/19/26  AGT  In which_probe_type() the 2-wire window now feeds the
+ *                          optic and thermistor classifiers in parallel
+ *                          (probe_class_check()); the first conclusive one
+ *                          sets acquire_state.  The serial OPTIC2 then THERMIS
+ *                          checks remain as the fallback.  When they decide
+ *                          instead, the window is closed there and then.
+ *                         In truck_idle() arm the T3 arrival watch after a
+ *                          truckless pass and return at once while it is
+ *                          armed, apart from an ARRIVE_POLL re-poll and the
+ *                          once-a-second checks.
+ *                         In truck_idle() discard any staged TIM journal writes.
+ *                         Added the per-connection Session Record: opened on
+ *                          entering ACQUIRE, sampled by session_poll() on
+ *                          each main_activity() pass and written to the
+ *                          EEPROM ring by session_close() in truck_gone().
+ *                         check_channels() uses the hal.h channel drive and
+ *                          T3 macros rather than LATE/PORTE/T3CON.
+ *                         main_activity() runs the departure detector
+ *                          (depart_poll()); truck_gone() stops it.
+ *                         main_activity() steps the 5-wire tank calibration
+ *                          (tank_cal_poll()); truck_gone() drops it.
  ******************************************************************************/
 #include "common.h"
 #include "volts.h"   /* A/D voltage definitions */
@@ -82,6 +103,9 @@
 static const char TRUCK_TESTER_SERIAL_NO[6] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06};
 static void truck_here(char truck);
 static unsigned long acquire_start;
+static void session_open(unsigned long arrive_ms);
+static void session_poll(void);
+static void session_close(void);
 void deadman_init(void);
 
 //static unsigned char TIM_info_logged = 0;
@@ -226,6 +250,7 @@ static void truck_idle(void)
 
 static unsigned idlediag = 0;     /* IDLE diag/etc. timer */
 static unsigned idlediagsec = 0;  /* IDLE diag/etc. timer */
+static unsigned idlepoll = 0;     /* IDLE arrival watch re-poll timer */
 static unsigned long icrc_ptr;    /* IDLE diag/CRC pointer */
 static unsigned icrc_val;         /* IDLE diag/CRC value holder */
 
@@ -236,6 +261,7 @@ unsigned long end_address;
                                   /* F0 Ground Diode HW TRUE */
 int index;
 char status;
+unsigned long arrive_ms;          /* Arrival watch drop to ACQUIRE (+1) */
 char bypass_state;
 char point;
 int tindex;                       /* counter */
@@ -245,6 +271,17 @@ char printed;
   printed = FALSE;
 // >>> FogBugz 136
   // last_routine = 0x40;
+  /* While the T3 scan is watching the channels (arrive_watch()) there is
+     nothing to do here until it sees a drop, the TIM/ground re-poll is
+     due or the once-a-second checks are due; give the time back to the
+     main loop. */
+  if ((arrive_state == ARRIVE_ARMED)
+      && (DeltaMsTimer(idlepoll) < ARRIVE_POLL)
+      && (DeltaMsTimer(idlediag) <= SEC1))
+  {
+    return;
+  }
+  idlepoll = mstimer;
   if ((SysParm.Ena_Debug_Func_1 == 0x10) || (SysParm.Ena_Debug_Func_2 == 0x10)
         || (SysParm.Ena_Debug_Func_3 == 0x10) || (SysParm.Ena_Debug_Func_4 == 0x10))
       debug_pulse(0x10);
@@ -261,6 +298,7 @@ char printed;
   TIM_fault_logged = 0;
   TIM_info_logged = 0;
   log_data_state = 0;
+  tim_journal_reset();          /* Drop TIM writes staged for the old truck */
 //  bad_compartment_count = 0;
   StatusB &= ~STSB_TRUCK;  /* Clear truck valid */
   /* If we have any voltage-related problems, try reinitializing (one might
@@ -737,6 +775,12 @@ char printed;
     idlediag = mstimer;               /* Set for next timer check */
   } /* End periodic IDLE "diagnostic" code */
 
+  if ((status == 0) && (main_state == IDLE))
+  {
+    set_porte (PULSE_TEST);           /* Drive channels (inc. JUMP_START) */
+    arrive_watch();                   /* Let the T3 scan watch for a truck */
+  }
+
   /************************* truck here **********************************/
 
   /* If "status" is TRUE (which is to say non-zero), then something has
@@ -762,7 +806,16 @@ char printed;
   {
     xprintf( 47, DUMMY );          /* Start printing out messages that might have been masked */
     xprintf( 20, DUMMY );             /* ACQUIRE state */
+    arrive_ms = 0;
+    if (arrive_chan != 0)             /* Woken by the arrival watch? */
+    {
+      arrive_ms = (read_time() - arrive_time) + 1;
+      printf("Arrival watch channel %d; %lu ms to ACQUIRE\n\r",
+                (int)arrive_chan, arrive_ms - 1);
+      arrive_chan = 0;
+    }
     set_main_state (ACQUIRE);         /* enter the ACQUIRE mode */
+    session_open (arrive_ms);         /* Start this truck's Session Record */
     // last_routine = 0x40;
     deadman_init();
     reset_bypass();
@@ -1447,6 +1500,138 @@ unsigned int i;
   }
 } /* end of truck_active */
 
+/*************************************************************************
+ *  Per-connection Session Record
+ *
+ *  A session is opened when ACQUIRE is entered and closed (written to the
+ *  EEPROM Session Record ring, see nvSesPut()) by truck_gone().  In between
+ *  session_poll() runs once per main_activity() pass and stamps the first
+ *  time each milestone is seen, counts dry-to-wet flaps and bypasses and
+ *  keeps the main loop pass times.  Stamps use time_ms64() since freetimer
+ *  is restarted on entering ACQUIRE.
+ *
+ *************************************************************************/
+
+static E2SESREC      ses_rec;         /* Session being recorded */
+static unsigned char ses_open;        /* ses_rec in use */
+static unsigned char ses_tank;        /* Last T_DRY/T_WET tank_state seen */
+static unsigned char ses_bypass;      /* STSA_BYPASS seen last pass */
+static unsigned long ses_start;       /* time_ms64() of entering ACQUIRE */
+static unsigned long ses_last;        /* time_ms64() of previous pass */
+static unsigned long ses_loops;       /* main_activity() passes */
+
+/* Milliseconds since ACQUIRE, 1 - 0xFFFF so that 0 means "never" */
+
+static unsigned int session_ms(unsigned long now)
+{
+  now -= ses_start;
+  if (now >= 0xFFFFL)
+  {
+    return (0xFFFF);
+  }
+  return ((unsigned int)now + 1);
+}
+
+static void session_open(unsigned long arrive_ms)
+{
+  memset ((char *)&ses_rec, 0, sizeof(ses_rec));
+  ses_rec.Time = present_time;
+  if (arrive_ms != 0)
+  {
+    ses_rec.Flags = SES_ARRIVE;
+    ses_rec.ArriveMs = (arrive_ms > 0xFFFFL) ? 0xFFFF : (unsigned int)arrive_ms;
+  }
+  ses_start = (unsigned long)time_ms64();
+  ses_last = ses_start;
+  ses_loops = 0;
+  ses_tank = T_INIT;
+  ses_bypass = FALSE;
+  ses_open = TRUE;
+}
+
+static void session_poll(void)
+{
+unsigned long now;
+
+  if (!ses_open)
+  {
+    return;
+  }
+  now = (unsigned long)time_ms64();
+  if ((now - ses_last) > ses_rec.LoopMax)
+  {
+    ses_rec.LoopMax = ((now - ses_last) > 0xFFFFL) ? 0xFFFF
+                                                    : (unsigned int)(now - ses_last);
+  }
+  ses_last = now;
+  ses_loops++;
+
+  if (!(ses_rec.Flags & SES_PROBE)
+       && (acquire_state != IDLE_I) && (acquire_state != GONE_NOW))
+  {
+    ses_rec.Flags |= SES_PROBE;         /* which_probe_type() has decided */
+    ses_rec.Probe = (unsigned char)acquire_state;
+    ses_rec.ProbeMs = session_ms(now);
+  }
+  if (StatusA & STSA_TRK_TALK)
+  {
+    ses_rec.Flags |= SES_TALK;
+  }
+  if (!(ses_rec.Flags & SES_VALID) && (StatusA & STSA_TRK_VALID))
+  {
+    ses_rec.Flags |= SES_VALID;         /* truck_validate() authorized */
+    ses_rec.ValidMs = session_ms(now);
+  }
+  if (!(ses_rec.Flags & SES_PERMIT) && (StatusA & STSA_PERMIT))
+  {
+    ses_rec.Flags |= SES_PERMIT;
+    ses_rec.PermitMs = session_ms(now);
+  }
+  if (StatusA & STSA_BYPASS)
+  {
+    if (!ses_bypass && (ses_rec.Bypass < 0xFF))
+    {
+      ses_rec.Bypass++;
+    }
+    ses_rec.Flags |= SES_BYPASS;
+    ses_bypass = TRUE;
+  }
+  else
+  {
+    ses_bypass = FALSE;
+  }
+  if ((tank_state == T_WET) || (tank_state == T_DRY))
+  {
+    if ((tank_state == T_WET) && (ses_tank == T_DRY) && (ses_rec.Flaps < 0xFFFF))
+    {
+      ses_rec.Flaps++;
+    }
+    ses_tank = (unsigned char)tank_state;
+  }
+}
+
+static void session_close(void)
+{
+unsigned long elapsed;
+
+  if (!ses_open)
+  {
+    return;
+  }
+  session_poll();                       /* Last look before the reset */
+  ses_open = FALSE;
+  elapsed = ses_last - ses_start;
+  ses_rec.Secs = ((elapsed / 1000L) > 0xFFFFL) ? 0xFFFF
+                                               : (unsigned int)(elapsed / 1000L);
+  elapsed /= ses_loops;
+  ses_rec.LoopAvg = (elapsed > 0xFFL) ? 0xFF : (unsigned char)elapsed;
+  if (ses_rec.Flags & SES_TALK)
+  {
+    memcpy (ses_rec.Serial, truck_SN, BYTESERIAL);
+  }
+  (void)nvSesPut (&ses_rec);
+}
+
 /*************************************************************************
  *  subroutine:      truck_gone()
  *
@@ -1476,6 +1661,9 @@ unsigned int i;
       || (SysParm.Ena_Debug_Func_3 == 0x40) || (SysParm.Ena_Debug_Func_4 == 0x40))
      debug_pulse(0x40);
   gone_time = read_time();            /* Mark departure time */
+  session_close();                    /* Record this connection */
+  depart_reset();                     /* Departure detector done */
+  tank_cal_reset();                   /* Drop any tank calibration */
 
   if (main_state == GONE)
      xprintf( 35, DUMMY );
@@ -1486,6 +1674,7 @@ unsigned int i;
 
   acquire_state   = IDLE_I;
   probe_try_state = NO_TYPE;
+  class_window    = CLASS_IDLE;     /* Close any classification window */
   tank_state      = T_INIT;
   truck_state     = UNKNOWN;
   TIM_state       = 0;
@@ -1715,6 +1904,9 @@ void main_activity(void)
 {
 unsigned char chtemp, index;
   // last_routine = 0x48;
+  session_poll();             /* Keep the Session Record up to date */
+  depart_poll();              /* Next step of the departure detector */
+  tank_cal_poll();            /* Next 5-wire tank calibration reading */
   switch (main_state)
   {
     case IDLE:                /* wait in this main state until the voltage */
@@ -1834,6 +2026,12 @@ unsigned char chtemp, index;
  *             THERMAL probes are checked for next. ( A delay of up to 2
  *             minutes may occur before oscillation occurs).
  *
+ *             Once the 2-wire drive is on, the same ADC scans feed the optic
+ *             oscillation, thermistor oscillation and thermistor ramp
+ *             classifiers together (probe_class_check()).  As soon as one
+ *             is conclusive the type is decided, without waiting for the
+ *             optic window to fail before looking for a thermistor.
+ *
  *  input:  none
  *  output: none
  *
@@ -1867,6 +2065,8 @@ unsigned int  result;
     } 
     probe_time     = read_time(); 
     one_try           = TRUE;
+    class_window      = CLASS_IDLE;     /* New 2-wire classification window */
+    class_conf[OPTIC5] = 0;
   }
   if(read_time() > truck_timeout)               /* exceeded 2 minutes */
   {
@@ -1929,7 +2129,20 @@ unsigned int  result;
       }
 // <<< QCCC 53
       two_wire_start();             /* we set the try_state - assure setup right */
-      if(two_wire_optic() != 0)
+      if (class_window == CLASS_IDLE)
+      {
+        probe_class_open();         /* All 2-wire classifiers listen from here */
+      }
+      result = (unsigned int)probe_class_check();
+      if (result == (unsigned int)OPTIC2)
+      {
+        acquire_state = OPTIC_2;
+      }
+      else if (result == (unsigned int)THERMIS)
+      {
+        acquire_state = THERMAL;    /* Warm thermistor, skip the optic wait */
+      }
+      else if(two_wire_optic() != 0)
       {
 // last_routine = 0x49;
         acquire_state = OPTIC_2; /* We might have a 2W */
@@ -1951,7 +2164,11 @@ unsigned int  result;
       case THERMIS:
         two_wire_start();       /* assure setup right */
 // last_routine = 0x49;
-        if(two_wire_thermal() != 0)
+        if (probe_class_check() == THERMIS) /* Ramp may decide before pulses */
+        {
+          acquire_state = THERMAL;
+        }
+        else if(two_wire_thermal() != 0)
         {
           if (acquire_state == IDLE_I)
           {
@@ -1967,6 +2184,11 @@ unsigned int  result;
         break;
     }
   }
+  if ((acquire_state != IDLE_I) && (class_window == CLASS_OPEN))
+  {
+    class_window = CLASS_DONE;      /* Serial tests decided: stop the sampling */
+    class_ms     = (unsigned int)(read_time() - class_start);
+  }
 } /* end of which_probe_type */
 
 /*************************************************************************
@@ -2376,10 +2598,10 @@ unsigned char status, ops_on;
 unsigned char save_JUMP;
 unsigned char save_pulse5;
 
-  save_porte   = LATE;                           /* save the state */
+  save_porte   = HAL_CHAN_DRIVE_GET();           /* save the state */
   save_pulse5 =PULSE5VOLT;              /* save the state */
   save_JUMP = JUMP_START;            /* JUMP_START currently enabled ? */
-  if (T3CONbits.TON)                           /* Turn off T3/ADC if needed */
+  if (HAL_ADC_SCAN_RUNNING())                  /* Turn off T3/ADC if needed */
   {
     ops_on = TRUE;
     ops_ADC( OFF );                  /* Shut OFF the 1 mS interrupt (T3) */
@@ -2389,7 +2611,7 @@ unsigned char save_pulse5;
     ops_on = FALSE;
   }
   JUMP_START = SET;              /* Enable Jump-Start's +20V */
-  PORTE = PULSE_TEST;          /* Drive selected channels */
+  HAL_CHAN_DRIVE_SET(PULSE_TEST); /* Drive selected channels */
   PULSE5VOLT = CLR;              /* Chan 4 normal (10V) drive */
   DelayUS(1000);                         /*  allow ramp up time */
   (void) read_ADC();                    /* discard what may be a stale read */
@@ -2425,7 +2647,7 @@ unsigned char save_pulse5;
   {
     JUMP_START = CLR;                              /* Disable Jump-Start's +20V */
   }  
-  LATE = save_porte;
+  HAL_CHAN_DRIVE_SET(save_porte);
   if(ops_on)
   {
      ops_ADC( ON );                                      /* Turn ON the 1 mS interrupt (T3) */
@@ -21,6 +21,13 @@
  *                         - Enabled receiver
  *         10/09_12  KLL  Added transmitter enable to the UART2PutChar routine
  * 1.6.34  10/10/16  DHP  Renamed communicate_flag to receive_bk_status.
+ * 1.6.38  10/19/26  AGT  Added 38400, 57600 and 115200 baud for UART2, run
+ *                          with BRGH = 1 (4x clock) to hold the rate error
+ *                          under 1%.
+ *                        Added modbus_tx_start() (DMA1 fills the TX FIFO)
+ *                          and modbus_tx_release(); UART2Init() sets up DMA1.
+ *                          An empty response is not started.
+ *                        flush_uart1()/flush_uart2() discard RXREG directly.
  *****************************************************************************/
 
 #include "common.h"
@@ -35,6 +42,9 @@
 #define SCBR4800     (((FCY/16)/4800)-1)
 #define SCBR9600     (((FCY/16)/9600)-1)
 #define SCBR19200    (((FCY/16)/19200)-1)
+#define SCBR38400    (((FCY/4)/38400)-1)      /* BRGH = 1 */
+#define SCBR57600    (((FCY/4)/57600)-1)      /* BRGH = 1 */
+#define SCBR115200   (((FCY/4)/115200)-1)     /* BRGH = 1 */
 
 #if BAUDRATEREG2 > 0xFF
 #error Cannot set up UART2 for the SYSCLK and BAUDRATE.\
@@ -51,8 +61,9 @@ static const UINT16 baudtbl[] =
     SCBR4800,                   /* 05   4800 baud */
     SCBR9600,                   /* 06   9600 baud */
     SCBR19200,                  /* 07  19200 baud */
-    0,                          /* 08  Reserved (7-bit char) */
-    0                           /* 09  Reserved (8-bit char) */
+    SCBR38400,                  /* 08  38400 baud */
+    SCBR57600,                  /* 09  57600 baud */
+    SCBR115200                  /* 10 115200 baud */
 };
 
 static const unsigned bit8tbl[] =
@@ -87,6 +98,10 @@ void UART2Init()
   U2BRG = baud_rate_temp;       /* ModBus/Comm baud rate */
   U2MODE = 0;
   U2STA = 0;
+  if (modbus_baud >= B38400)
+  {
+    U2MODEbits.BRGH = 1;      /* High speed (4x) baud clock */
+  }
 
   U2MODEbits.PDSEL= bit8tbl[modbus_parity];  /* Set up parity none-odd-even */
   U2MODEbits.RTSMD = 1;     /* UxRTS in Simplex mode */
@@ -107,6 +122,7 @@ void UART2Init()
   U2STAbits.UTXEN = 1;
 
   TXEN = 0;                       /* Disable transmit */
+  Init_DMA1();                    /* ModBus response transmit channel */
 }
 
 /*******************************4/23/2008 11:36AM*****************************
@@ -133,6 +149,52 @@ void set_tx2_en(void)
 }
 
 
+/*****************************************************************************
+ * Start sending the ModBus response in modbus_tx_buff. DMA1 moves a byte
+ * into U2TXREG on each UART2 TX request; with UTXISEL = 00 that is when a
+ * byte moves to the shift register, so the FIFO holds about one byte.
+ * _DMA1Interrupt() and then _U2TXInterrupt() finish the frame without any
+ * per-byte CPU work.  An empty response just releases the line.
+ *****************************************************************************/
+void modbus_tx_start(void)
+{
+  if (modbus_tx_len == 0)
+  {
+    modbus_tx_release();
+    return;
+  }
+  modbus_state = (unsigned char)XMITMSG;
+  modbus_tx_time = mstimer;       /* For the stuck transmit check */
+  ledstate[TASCOMM] = PULSE;      /* Note TAS/VIPER comm activity */
+  set_tx2_en();
+  IEC1bits.U2TXIE = 0;            /* UART TX requests go to DMA1 only */
+  U2STAbits.UTXISEL1 = 0;         /* Request whenever the FIFO has room */
+  U2STAbits.UTXISEL0 = 0;
+  DMA1CNT = (unsigned int)(modbus_tx_len - 1);
+  DMA1STA = (unsigned int)__builtin_dmaoffset(modbus_tx_buff);
+  IFS0bits.DMA1IF = 0;
+  DMA1CONbits.CHEN = 1;
+  DMA1REQbits.FORCE = 1;          /* First byte; the FIFO does the rest */
+}
+
+/*****************************************************************************
+ * Response is completely shifted out (or abandoned): drop the line driver
+ * and go back to receiving. Called from _U2TXInterrupt() and the main loop.
+ *****************************************************************************/
+void modbus_tx_release(void)
+{
+  DMA1CONbits.CHEN = 0;
+  IEC1bits.U2TXIE = 0;
+  modbus_state = (unsigned char)RESETMSG;
+  /* DHP  The following Block added to prevent host collisions */
+  U2STAbits.UTXEN = 0;            /* To force Int when set in set_tx2_en() */
+  IFS1bits.U2TXIF = 0;
+  TXEN = 0;                       /* Disable transmit at board level */
+  flush_uart2();                  /* Remove any received characters */
+  IFS1bits.U2RXIF = 0;
+  IEC1bits.U2RXIE = 1;            /* Now ready for receive */
+}
+
 void  UART2PutChar(char Ch)
 {
   if (modbus_addr == 0)                   /* ASCII only if modbus address 0 */
@@ -152,15 +214,13 @@ void  UART2PutChar(char Ch)
 
 void flush_uart2()
 {
-volatile unsigned int key;
 int timeout = 0x7FFF;
 
   while ((U2STAbits.URXDA == 1) && (timeout--))
   {
-    key = U2RXREG;        /* Flushing any errors */
+    (void)U2RXREG;        /* Flushing any errors */
   }
   U2STAbits.OERR = 0;                     /* Clear overflow condition */
-/*lint -e{438, 550}*/ 
 }
 
 /******************************* 11/12/2009 5:53AM ***************************
@@ -200,15 +260,13 @@ void UART1Init()
 
 void flush_uart1()
 {
-volatile unsigned int key;
 int timeout = 0x7FFF;
 
   while ((U1STAbits.URXDA == 1) && (timeout--))
   {
-    key = U1RXREG;
+    (void)U1RXREG;
   }
   U1STAbits.OERR = 0;                     /* Clear overflow condition */
-/*lint -e{438,550}*/ 
 }
 
 void UART1PutChar(const unsigned char Ch)
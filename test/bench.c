@@ -0,0 +1,500 @@
+/*****************************************************************************
+ *
+ *   Project:        Rack Controller
+ *
+ *   Module:         bench.c  (host test build)
+ *
+ *   Description:    Host benchmark of the firmware's hot routines, against
+ *                   a stored baseline.   make -C test bench
+ *
+ *                      build/bench [-w] [-s slack%] baseline
+ *
+ *                   Each routine is run in rounds of a fixed call count,
+ *                   a few rounds in each of PASSES passes over the table;
+ *                   the fastest round gives the time per call (ns/op, on
+ *                   this machine with the host compiler: a check for
+ *                   regressions in the code, not a figure for the chip,
+ *                   which ModBus function 0x62 gives).  The I2C start
+ *                   conditions per call (bus/op) are the simulated bus
+ *                   transactions, and do not depend on the machine.
+ *
+ *                   A routine regresses when its time is more than slack%
+ *                   (default 50) over the baseline's, scaled by how fast
+ *                   the whole run was (machine()), or it makes more bus
+ *                   transactions than the baseline; then the exit status
+ *                   is 1.  One that looks slower is timed RETRIES more
+ *                   times first.  Routines not in the baseline are
+ *                   reported, not judged.  -w writes the baseline from this
+ *                   run instead.
+ *
+ *                   nvTrkFind() runs against the EEPROM model holding
+ *                   BENCH_TRUCKS Truck IDs, in slots and then packed.
+ *                   The modbus_decode() requests are the read functions;
+ *                   the writes change the stored configuration the other
+ *                   routines read, the TIM functions need a TIM on the
+ *                   1-Wire line and 0x5B runs the tank calibration.  Each
+ *                   must come back MB_OK, so that it is the real path
+ *                   timed.
+ *
+ *   Revision History:
+ *   Rev      Date      Who   Description of Change Made
+ *  --------  --------- ---  --------------------------------------------
+ *  1.6.38    10/19/26  AGT  New
+ *
+ *****************************************************************************/
+#include "common.h"
+#include <unistd.h>
+#include <fcntl.h>
+
+#define PASSES        5               /* Over the whole table */
+#define ROUNDS        2               /* Per routine, each pass */
+#define BENCH_TRUCKS  1000
+#define REG_SWEEP     0x500           /* Registers 000-4FF */
+#define MAX_BENCH     64
+#define DEF_SLACK     50
+#define RETRIES       2               /* Re-times of a routine that regressed */
+
+enum { ANY_LIST, SLOTS, PACKED };     /* Truck ID list a routine wants */
+
+typedef struct
+{
+  const char   *name;
+  void        (*run) (unsigned long i);
+  unsigned long calls;                /* Per round */
+  int           list;                 /* SLOTS, PACKED or ANY_LIST */
+  const unsigned char *req;           /* modbus_decode(): the request */
+  unsigned char len;                  /* ... with room for the CRC */
+} BENCH;
+
+typedef struct
+{
+  char   name[32];
+  double ns;                          /* Per call */
+  double bus;
+} RESULT;
+
+static unsigned char buf[64];
+static unsigned int scan[2][MAX_CHAN];
+static int cur_list = ANY_LIST;       /* As the list is now */
+static const unsigned char *cur_req;
+static unsigned char cur_len;
+static MODBSTS cur_sts;               /* Last failed status, else MB_OK */
+static unixtime base_time;
+static volatile unsigned long sink;   /* Keep the results "used" */
+
+/* Test data serial numbers: listed ones are even, unlisted odd */
+
+static void trk_serial (unsigned long v, unsigned char *trk)
+{
+  int i;
+
+  for (i = BYTESERIAL - 1; i > 0; i--, v >>= 8)
+    trk[i] = (unsigned char)v;
+  trk[0] = 0;
+}
+
+static void b_modbus_crc (unsigned long i)
+{
+  buf[0] = (unsigned char)i;
+  sink += modbus_CRC (buf, sizeof buf, INIT_CRC_SEED);
+}
+
+static void b_dallas_crc (unsigned long i)
+{
+  buf[0] = (unsigned char)i;
+  sink += Dallas_CRC8 (buf, 8);
+}
+
+static void b_convert (unsigned long i)
+{
+  convert_to_binary (scan[i & 1]);
+}
+
+static void b_oscillating (unsigned long i)
+{
+  sink += check_all_oscillating ();
+}
+
+/* A fresh look each call, as for a new truck: nvTrkFind() answers
+   from badvipflag once it has looked */
+
+static void b_trk_hit (unsigned long i)
+{
+  unsigned char trk[BYTESERIAL];
+  word index;
+
+  trk_serial (0x1000 + (i % BENCH_TRUCKS) * 2, trk);
+  badvipflag &= ~(BVF_DONE | BVF_UNAUTH);
+  sink += (unsigned long)nvTrkFind (trk, &index);
+}
+
+static void b_trk_miss (unsigned long i)
+{
+  unsigned char trk[BYTESERIAL];
+  word index;
+
+  trk_serial (0x1001 + (i % BENCH_TRUCKS) * 2, trk);
+  badvipflag &= ~(BVF_DONE | BVF_UNAUTH);
+  sink += (unsigned long)nvTrkFind (trk, &index);
+}
+
+static void b_decode (unsigned long i)
+{
+  unsigned char req[MODBUS_MAX_LEN];
+  unsigned char rsp[MODBUS_MAX_LEN];
+  unsigned char olen = 0;
+  MODBSTS sts;
+
+  memcpy (req, cur_req, cur_len);     /* modbus_decode() may not keep it */
+  sts = modbus_decode (cur_len, req, &olen, rsp);
+  if (sts != MB_OK)
+    cur_sts = sts;
+}
+
+static void b_rdreg (unsigned long i)
+{
+  unsigned int value;
+
+  sink += (unsigned long)mbrRdReg ((unsigned int)(i % REG_SWEEP), &value);
+}
+
+static void b_xprintf (unsigned long i)
+{
+  static const unsigned char msg[] = { 4, 12, 27, 40, 62, 81, 110, 133 };
+
+  xprintf (msg[i % sizeof msg], (unsigned int)i);
+}
+
+static void b_greg (unsigned long i)
+{
+  present_time = base_time + (i % 10000) * 86399UL + 1;
+  UNIX_to_Greg ();
+}
+
+/* modbus_decode() requests: address, function, arguments, CRC (not
+   checked here) */
+
+#define REQ(n, ...)                                                        \
+  static const unsigned char n[] = { 1, __VA_ARGS__, 0, 0 }
+
+REQ (rq01, READ_OUTPUT_STATUS, 0, 0, 0, 16);
+REQ (rq02, READ_INPUT_STATUS, 0, 0, 0, 16);
+REQ (rq03, READ_MULTIPLE_REGS, 0x01, 0x00, 0, 16);
+REQ (rq42, READ_SINGLE_VEHICLE, 0, 100);
+REQ (rq47, READ_MULTIPLE_VEHICLES, 0, 100, 0, 8);
+REQ (rq49, READ_TRL_LOG_ELEMENT, 0, 0);
+REQ (rq4a, CRC_MULTIPLE_VEHICLES, 0, 0, 0, 100);
+REQ (rq4c, READ_BYPASS_KEYS, 0, 0, 0, 4);
+REQ (rq4e, READ_EE_BLOCK, E2SYS_PARM, 32);
+REQ (rq5d, GET_CURRENT_ADC_TABLE);
+REQ (rq5e, READ_TRACE_BUFFER, 8);
+REQ (rq61, READ_SESSIONS, 0, 2);
+REQ (rq63, READ_STATUS_BURST);
+REQ (rq64, READ_JOURNAL_SEQ);
+REQ (rq65, READ_JOURNAL, 0, 0);
+REQ (rq66, READ_LOG_QUERY, 0, 0, 0, 0, 0, 0xFF, 0xFF, 2);
+REQ (rq67, READ_SORTED_VEHICLES, 0, 100, 0, 8);
+
+#define DECODE(n, c, l)  { "modbus_decode." #n, b_decode, c, l, rq##n, sizeof rq##n }
+
+static const BENCH bench[] =
+{
+  { "modbus_CRC.64",        b_modbus_crc,  200000 },
+  { "Dallas_CRC8.8",        b_dallas_crc,  2000000 },
+  { "convert_to_binary",    b_convert,     500000 },
+  { "check_all_oscillating", b_oscillating, 20000 },
+  { "nvTrkFind.slots.hit",  b_trk_hit,     1000, SLOTS },
+  { "nvTrkFind.slots.miss", b_trk_miss,    20, SLOTS },
+  DECODE (01, 200000, ANY_LIST),
+  DECODE (02, 200000, ANY_LIST),
+  DECODE (03, 50000, ANY_LIST),
+  DECODE (42, 50000, SLOTS),
+  DECODE (47, 20000, SLOTS),
+  DECODE (49, 2000, ANY_LIST),
+  DECODE (4a, 1000, SLOTS),
+  DECODE (4c, 2000, ANY_LIST),
+  DECODE (4e, 100000, ANY_LIST),
+  DECODE (5d, 200000, ANY_LIST),
+  DECODE (5e, 200000, ANY_LIST),
+  DECODE (61, 200000, ANY_LIST),
+  DECODE (63, 100000, ANY_LIST),
+  DECODE (64, 200000, ANY_LIST),
+  DECODE (65, 200000, ANY_LIST),
+  DECODE (66, 2000, ANY_LIST),
+  { "nvTrkFind.packed.hit", b_trk_hit,     10000, PACKED },
+  { "nvTrkFind.packed.miss", b_trk_miss,   10000, PACKED },
+  DECODE (67, 50000, PACKED),
+  { "mbrRdReg.sweep",       b_rdreg,       REG_SWEEP * 400 },
+  { "xprintf",              b_xprintf,     400000 },
+  { "UNIX_to_Greg",         b_greg,        1000000 },
+};
+
+#define NBENCH  (int)(sizeof bench / sizeof bench[0])
+
+static double now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* The Truck ID list, BENCH_TRUCKS long, in slots (the default) or
+   packed (sorted), written again when a routine wants the other one */
+
+static void fill_list (int list)
+{
+  unsigned char trk[BYTESERIAL];
+  int i, packed = (list == PACKED);
+
+  if (packed)
+    SysParm.EnaSftFeatures2 |= ENA_TIM_PACKED;
+  else
+    SysParm.EnaSftFeatures2 &= ~ENA_TIM_PACKED;
+  HOST_CHECK (nvTrkErase () == 0);
+  HOST_CHECK (nvTrkPacked () == packed);
+  for (i = 0; i < BENCH_TRUCKS; i++)
+  {
+    trk_serial (0x1000 + (unsigned long)i * 2, trk);
+    HOST_CHECK (nvTrkPut (trk, (word)i) == 0);
+  }
+  cur_list = list;
+}
+
+static void setup (void)
+{
+  unsigned int c;
+  int i;
+
+  present_time = 0x50000000UL;
+  host_nv_format ();
+  base_time = present_time;
+  for (i = 0; i < (int)sizeof buf; i++)
+    buf[i] = (unsigned char)((i * 37) + 11);
+
+  /* Eight dry optic probes: every channel swings each scan, and the
+     last SCAN_WIDTH samples all show transitions every other one */
+
+  start_point = 0;
+  for (c = 0; c < MAX_CHAN; c++)
+  {
+    scan[0][c] = 2500;
+    scan[1][c] = 7500;
+    probes_state[c] = P_DRY;
+  }
+  for (i = 0; i < (int)MAX_ARRAY; i++)
+    probe_array[i] = (i & 1) ? 0xFF : 0;
+  probe_index = 0;
+}
+
+/* Rounds of one routine; the fastest so far is kept in r */
+
+static void run (const BENCH *b, RESULT *r)
+{
+  double t;
+  unsigned long i, starts;
+  int k;
+
+  if ((b->list != ANY_LIST) && (b->list != cur_list))
+    fill_list (b->list);
+  cur_req = b->req;
+  cur_len = b->len;
+  cur_sts = MB_OK;
+  for (k = 0; k < ROUNDS; k++)
+  {
+    starts = host_i2c_starts;
+    t = now_ns ();
+    for (i = 0; i < b->calls; i++)
+      b->run (i);
+    t = (now_ns () - t) / b->calls;
+    if ((r->ns == 0) || (t < r->ns))
+      r->ns = t;
+    r->bus = (double)(host_i2c_starts - starts) / b->calls;
+  }
+  if (cur_sts != MB_OK)
+  {
+    fprintf (stderr, "%s: status %02X\n", b->name, (unsigned int)cur_sts);
+    host_fails++;
+  }
+  snprintf (r->name, sizeof r->name, "%s", b->name);
+}
+
+static int load (const char *file, RESULT *base)
+{
+  char line[128];
+  FILE *f;
+  int n = 0;
+
+  f = fopen (file, "r");
+  if (f == NULL)
+    return 0;
+  while ((n < MAX_BENCH) && fgets (line, sizeof line, f))
+  {
+    if ((line[0] == '#')
+        || (sscanf (line, "%31s %lf %lf", base[n].name, &base[n].ns,
+                    &base[n].bus) != 3))
+      continue;
+    n++;
+  }
+  fclose (f);
+  return n;
+}
+
+static int save (const char *file, const RESULT *res)
+{
+  FILE *f;
+  int i;
+
+  f = fopen (file, "w");
+  if (f == NULL)
+    return 0;
+  fprintf (f, "# Host bench baseline (make -C test bench-baseline), gcc %s\n"
+              "# routine                      ns/op     bus/op\n", __VERSION__);
+  for (i = 0; i < NBENCH; i++)
+    fprintf (f, "%-28s %10.1f %10.2f\n", res[i].name, res[i].ns, res[i].bus);
+  return fclose (f) == 0;
+}
+
+static const RESULT *find (const RESULT *base, int nbase, const char *name)
+{
+  int j;
+
+  for (j = 0; j < nbase; j++)
+    if (strcmp (base[j].name, name) == 0)
+      return &base[j];
+  return NULL;
+}
+
+static int cmp_ratio (const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return (x > y) - (x < y);
+}
+
+/* How fast this run was overall: the median of the time ratios to the
+   baseline.  A busy or slower machine slows every routine about alike,
+   so each is judged against this rather than the bare baseline; a
+   change that slows most of them alike shows here and not as a
+   regression. */
+
+static double machine (const RESULT *res, const RESULT *base, int nbase)
+{
+  double ratio[MAX_BENCH];
+  const RESULT *b;
+  int i, n = 0;
+
+  for (i = 0; i < NBENCH; i++)
+    if (((b = find (base, nbase, res[i].name)) != NULL) && (b->ns > 0))
+      ratio[n++] = res[i].ns / b->ns;
+  if (n == 0)
+    return 1.0;
+  qsort (ratio, (size_t)n, sizeof ratio[0], cmp_ratio);
+  return (n & 1) ? ratio[n / 2] : (ratio[n / 2 - 1] + ratio[n / 2]) / 2;
+}
+
+/* The firmware prints: the console goes nowhere while it runs */
+
+static int console = -1;
+
+static void quiet (int on)
+{
+  int null;
+
+  fflush (stdout);
+  if (on)
+  {
+    console = dup (1);
+    null = open ("/dev/null", O_WRONLY);
+    dup2 (null, 1);
+    close (null);
+  }
+  else
+  {
+    dup2 (console, 1);
+    close (console);
+  }
+}
+
+static int slower (const RESULT *r, const RESULT *b, double speed, int slack)
+{
+  return r->ns > b->ns * speed * (100 + slack) / 100;
+}
+
+int main (int argc, char **argv)
+{
+  static RESULT res[MAX_BENCH], base[MAX_BENCH];
+  const RESULT *b;
+  const char *file = NULL, *verdict;
+  double speed;
+  int i, k, nbase, write = 0, slack = DEF_SLACK, bad = 0;
+
+  for (i = 1; i < argc; i++)
+  {
+    if (strcmp (argv[i], "-w") == 0)
+      write = 1;
+    else if ((strcmp (argv[i], "-s") == 0) && (i + 1 < argc))
+      slack = atoi (argv[++i]);
+    else
+      file = argv[i];
+  }
+  if (file == NULL)
+  {
+    fprintf (stderr, "usage: bench [-w] [-s slack%%] baseline\n");
+    return 2;
+  }
+
+  quiet (1);
+  setup ();
+  for (k = 0; k < PASSES; k++)
+    for (i = 0; i < NBENCH; i++)
+      run (&bench[i], &res[i]);
+  quiet (0);
+  if (host_fails)
+    return host_done ("bench");
+
+  if (write)
+  {
+    if (!save (file, res))
+    {
+      perror (file);
+      return 2;
+    }
+    printf ("bench: baseline written to %s\n", file);
+    return 0;
+  }
+
+  /* A routine that looks slower is timed again before it is believed:
+     a burst of other load can outlast all its passes */
+
+  nbase = load (file, base);
+  speed = machine (res, base, nbase);
+  quiet (1);
+  for (i = 0; i < NBENCH; i++)
+    for (k = 0; k < RETRIES; k++)
+      if (((b = find (base, nbase, res[i].name)) != NULL)
+          && slower (&res[i], b, speed, slack))
+        run (&bench[i], &res[i]);
+  quiet (0);
+
+  printf ("%-28s %10s %10s %8s %8s\n", "routine", "ns/op", "base",
+          "bus/op", "base");
+  for (i = 0; i < NBENCH; i++)
+  {
+    b = find (base, nbase, res[i].name);
+    verdict = "";
+    if (b == NULL)
+      verdict = "  (new)";
+    else if (slower (&res[i], b, speed, slack)
+             || (res[i].bus > b->bus + 0.005))
+    {
+      verdict = "  REGRESSED";
+      bad = 1;
+    }
+    printf ("%-28s %10.1f %10.1f %8.2f %8.2f%s\n", res[i].name, res[i].ns,
+            b ? b->ns : 0.0, res[i].bus, b ? b->bus : 0.0, verdict);
+  }
+  printf ("bench: %s (slack %d%%, this machine at %.2f x the baseline's"
+          " time)\n", bad ? "FAIL" : "PASS", slack, speed);
+  return bad;
+}
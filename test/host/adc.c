@@ -0,0 +1,68 @@
+/*****************************************************************************
+ *
+ *   Project:        Rack Controller
+ *
+ *   Module:         adc.c  (host test build)
+ *
+ *   Description:    ADC1 and the DMA0 channel behind it, as init_ADC.c and
+ *                   adc.c drive them.  What each input shows comes from
+ *                   board.c (host_an()).
+ *
+ *                   Scan mode (Init_ADC(): ASAM, CSCNA over AN0-AN7) with
+ *                   ADON and DMA0 enabled converts the eight inputs in
+ *                   8 x 27 TAD, writes them to BufferA[] and ends the
+ *                   one-shot: CHEN off, DMA0IF set.  read_muxADC()'s
+ *                   single conversions (ASAM off) run when the firmware
+ *                   looks at AD1CON1bits with SAMP set, since it polls DONE
+ *                   without letting any time pass.
+ *                   host_adc_singles counts those.
+ *
+ *   Revision History:
+ *   Rev      Date      Who   Description of Change Made
+ *  --------  --------- ---  --------------------------------------------
+ *  1.6.38    10/19/26  AGT  New
+ *
+ *****************************************************************************/
+#define HOST_SFR_C                    /* AD1CON1bits is the plain register */
+#include "common.h"
+
+#define TAD_CYC      11               /* ADCS = 10: TAD is 11 cycles */
+#define CONV_CYC     (27 * TAD_CYC)   /* SAMC 13 + 14 TAD conversion */
+
+extern unsigned int BufferA[];
+
+unsigned long host_adc_singles;       /* read_muxADC() conversions */
+
+static unsigned long scan_acc;        /* Cycles into the current scan */
+
+void host_adc_step (unsigned long cyc)
+{
+  int an;
+
+  if (!AD1CON1bits.ADON || !AD1CON1bits.ASAM || !DMA0CONbits.CHEN)
+  {
+    scan_acc = 0;
+    return;
+  }
+  scan_acc += cyc;
+  if (scan_acc < 8 * CONV_CYC)
+    return;
+  scan_acc = 0;
+  for (an = 0; an < 8; an++)
+    BufferA[an] = host_an (an);
+  DMA0CONbits.CHEN = 0;               /* One-shot block done */
+  IFS0bits.DMA0IF = 1;
+}
+
+volatile AD1CON1BITS *host_ad1con1 (void)
+{
+  if (AD1CON1bits.ADON && AD1CON1bits.SAMP && !AD1CON1bits.ASAM)
+  {
+    ADC1BUF0 = host_an ((int)(AD1CHS0 & 0x1F));
+    host_adc_singles++;
+    AD1CON1bits.SAMP = 0;
+    AD1CON1bits.DONE = 1;
+    host_run_us (CONV_CYC / 20 + 1);
+  }
+  return &AD1CON1bits;
+}
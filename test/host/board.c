@@ -0,0 +1,152 @@
+/*****************************************************************************
+ *
+ *   Project:        Rack Controller
+ *
+ *   Module:         board.c  (host test build)
+ *
+ *   Description:    The analog front end, the relay contacts and the truck
+ *                   on the connector.
+ *
+ *                   host_an() gives the ADC count an input shows, in the
+ *                   scale the firmware reads it in: the eight channels
+ *                   through the 21.6V divider (5.27mV a count), AN0/AN1
+ *                   through the mux (M_RAW and M_THREEX as pod.c scales
+ *                   them, the jumpers 0.805mV a count as read_muxADC()
+ *                   does).  A driven channel sits at +10V, or +20V with
+ *                   Jump-Start on, channel 4 at 4.7V with PULSE5VOLT; an
+ *                   undriven one at 0V, but for channel 5 on the 6.8V
+ *                   diagnostic reference (DIAGNOSTIC_EN low).  The jumpers
+ *                   read ModBus address 1, 9600 baud, no parity.
+ *
+ *                   The truck is 2-wire optic probes on the channels in
+ *                   host_truck_probes: a dry one on a driven channel
+ *                   swings 7.5V/2.5V at 50Hz, a wet one (host_truck_wet)
+ *                   sits at 3V.  The channels in host_truck_therm have
+ *                   dry thermistor probes instead: 7V cold, warming while
+ *                   driven toward 3.5V (time constant THERM_TAU_MS) and
+ *                   cooling again, four times slower, while not.  There
+ *                   is no ground bolt, TIM or deadman (all off in the
+ *                   default EnaFeatures).
+ *
+ *                   The main relay closes with MAIN_ENABLE (the charge
+ *                   pump is not modelled); the backup processor closes its
+ *                   relay along with it.  An open contact shows the
+ *                   half-wave 60Hz line at RA0/RA1, a closed one reads 0.
+ *
+ *   Revision History:
+ *   Rev      Date      Who   Description of Change Made
+ *  --------  --------- ---  --------------------------------------------
+ *  1.6.38    10/19/26  AGT  New
+ *                           Thermistor probes (host_truck_therm).
+ *
+ *****************************************************************************/
+#include "common.h"
+#include "volts.h"
+
+#define OPEN10_MV    9800
+#define OPEN20_MV    19500
+#define PULSE5_MV    4700
+#define DIAG_MV      8100             /* Reference 6848 / 0.845 */
+#define DRY_HI_MV    7500
+#define DRY_LO_MV    2500
+#define WET_MV       3000
+#define DRY_HALF_MS  10               /* 50Hz */
+#define LINE_US      16667            /* 60Hz */
+#define THERM_COLD_MV 7000
+#define THERM_HOT_MV  3500
+#define THERM_TAU_MS  2000.0
+
+unsigned char host_truck_probes;
+unsigned char host_truck_wet;
+unsigned char host_truck_therm;
+
+static double therm_heat[8];          /* 0 cold to 1 fully warmed */
+static unsigned long long therm_us;   /* Heat last brought up to date */
+
+/* Counts from millivolts, on the channel divider and at the ADC pin */
+
+static unsigned int chan_counts (unsigned int mv)
+{
+  mv = (unsigned int)(mv * 100UL / 527);
+  return (mv > 4095) ? 4095 : mv;
+}
+
+static unsigned int pin_counts (unsigned int mv)
+{
+  return (unsigned int)(mv * 1000UL / 805);
+}
+
+static unsigned int chan_mv (int ch)
+{
+  unsigned int bit = 1u << ch;
+  unsigned long ms;
+
+  if (!(LATE & bit))
+    return ((ch == 4) && !DIAGNOSTIC_EN) ? DIAG_MV : 0;
+  if ((ch == 3) && PULSE5VOLT)
+    return PULSE5_MV;
+  if (host_truck_probes & host_truck_therm & bit)
+    return (unsigned int)(THERM_COLD_MV
+                          - (THERM_COLD_MV - THERM_HOT_MV) * therm_heat[ch]);
+  if (host_truck_probes & bit)
+  {
+    if (host_truck_wet & bit)
+      return WET_MV;
+    ms = (unsigned long)(host_now_us () / 1000) + (unsigned long)ch * 3;
+    return ((ms / DRY_HALF_MS) & 1) ? DRY_LO_MV : DRY_HI_MV;
+  }
+  return JUMP_START ? OPEN20_MV : OPEN10_MV;
+}
+
+unsigned int host_an (int an)
+{
+  if ((an >= 2) || (fetch_mux () == M_PROBES))
+    return chan_counts (chan_mv (an));
+  switch (fetch_mux ())
+  {
+    case M_RAW:                       /* 13.5V, read as probe_volt[0] * 2 */
+      return an ? 0 : chan_counts (13500 / 2);
+    case M_THREEX:                    /* 3.8V bias, ATODSCALE * 2 */
+      return 3800 / 2 * 100 / ATODSCALE;
+    case M_GND_7_8:                   /* GND_SENSE, no 100 ohm jumper; 8 bit */
+      return an ? pin_counts (100) : pin_counts (800);
+    case M_PARITY:                    /* Baud 9600 (6); no parity (0) */
+      return an ? pin_counts (1200) : pin_counts (3000);
+    case M_ADDR:                      /* Tens 0; ones 1 */
+      return an ? pin_counts (3000) : pin_counts (2750);
+    default:
+      return 0;
+  }
+}
+
+/* Thermistors warm while driven, cool while not; off the truck they
+   start cold */
+
+static void therm_step (void)
+{
+  double ms = (double)(host_now_us () - therm_us) / 1000;
+  int ch;
+
+  if (ms < 1)
+    return;
+  therm_us = host_now_us ();
+  for (ch = 0; ch < 8; ch++)
+  {
+    if (!(host_truck_probes & host_truck_therm & (1u << ch)))
+      therm_heat[ch] = 0;
+    else if (LATE & (1u << ch))
+      therm_heat[ch] += (1 - therm_heat[ch]) * ms / THERM_TAU_MS;
+    else
+      therm_heat[ch] -= therm_heat[ch] * ms / (4 * THERM_TAU_MS);
+  }
+}
+
+void host_board_step (void)
+{
+  unsigned int line;
+
+  therm_step ();
+  line = (host_now_us () % LINE_US) < (LINE_US / 2);
+  PORTAbits.RA0 = MAIN_ENABLE ? 0 : line;
+  PORTAbits.RA1 = MAIN_ENABLE ? 0 : line;
+}
@@ -0,0 +1,249 @@
+/*****************************************************************************
+ *
+ *   Project:        Rack Controller
+ *
+ *   Module:         clock.c  (host test build)
+ *
+ *   Description:    Virtual clock.  Nothing ticks on its own: each TMR1
+ *                   read, read_time() call or ClrWdt() moves time forward
+ *                   by one microsecond (20 instruction cycles), and
+ *                   DelayUS()/DelayMS() by what they were asked for.
+ *                   Timers 2 to 5 count with their prescalers and periods,
+ *                   set their IFS flags at the period match and take their
+ *                   interrupt when IEC is set, the timer priority is above
+ *                   SR.IPL and no other handler is running.  So
+ *                   Init_Timer2() is what starts freetimer, and
+ *                   SRbits.IPL = 7 really holds the interrupts off.
+ *
+ *                   The board models (adc.c, uart.c, onewire.c, board.c,
+ *                   spi.c) move along with the clock; the DMA and UART
+ *                   interrupts they raise are taken the same way, and
+ *                   host_isr_count[] counts each source's.  A test may
+ *                   set host_ms_hook, called once every millisecond of
+ *                   virtual time, to play its part from there.
+ *
+ *                   TMR1 runs the full width of an int rather than 16
+ *                   bits: DelayUS() and the 1-Wire timing do their
+ *                   wrap-around sums in unsigned int, which is only the
+ *                   register's width on the chip.
+ *
+ *   Revision History:
+ *   Rev      Date      Who   Description of Change Made
+ *  --------  --------- ---  --------------------------------------------
+ *  1.6.38    10/19/26  AGT  New
+ *
+ *****************************************************************************/
+#define HOST_SFR_C                    /* TMR1 is the plain register here */
+#include "common.h"
+
+#define CYC_PER_US   20               /* FCY 20 MHz */
+
+extern void _T2Interrupt (void);
+extern void _T3Interrupt (void);
+extern void _T4Interrupt (void);
+extern void _T5Interrupt (void);
+extern void _DMA0Interrupt (void);
+extern void _DMA1Interrupt (void);
+extern void _U1RXInterrupt (void);
+extern void _U2RXInterrupt (void);
+extern void _U2TXInterrupt (void);
+
+extern unsigned long __real_read_time (void);
+
+void (*host_ms_hook) (void);
+
+static unsigned long long now_cyc;    /* Instruction cycles since start */
+static unsigned long long next_ms;    /* now_cyc of the next host_ms_hook call */
+static unsigned int pre_acc[4];       /* Prescaler remainders, T2..T5 */
+static int in_isr;                    /* A handler is running */
+
+/* Per timer: TxCON, TMRx, PRx; the flag/enable/priority live in
+   different IFS/IEC/IPC words for each, so those are switch-ed below. */
+
+static volatile unsigned int *const tcon[4] = { &T2CON, &T3CON, &T4CON, &T5CON };
+static volatile unsigned int *const tmr[4]  = { &TMR2, &TMR3, &TMR4, &TMR5 };
+static volatile unsigned int *const per[4]  = { &PR2, &PR3, &PR4, &PR5 };
+
+static void tmr_flag (int t)
+{
+  switch (t)
+  {
+    case 0: IFS0bits.T2IF = 1; break;
+    case 1: IFS0bits.T3IF = 1; break;
+    case 2: IFS1bits.T4IF = 1; break;
+    default: IFS1bits.T5IF = 1; break;
+  }
+}
+
+/* Interrupt sources, in the order handlers are listed below (HOST_T2 to
+   HOST_U2TX) */
+
+#define NSRC         HOST_NSRC
+
+unsigned long host_isr_count[NSRC];
+
+/* Priority of the source's interrupt if it is pending and enabled, else 0 */
+
+static int src_pending (int s)
+{
+  switch (s)
+  {
+    case 0: return (IFS0bits.T2IF && IEC0bits.T2IE) ? IPC1bits.T2IP : 0;
+    case 1: return (IFS0bits.T3IF && IEC0bits.T3IE) ? IPC2bits.T3IP : 0;
+    case 2: return (IFS1bits.T4IF && IEC1bits.T4IE) ? IPC6bits.T4IP : 0;
+    case 3: return (IFS1bits.T5IF && IEC1bits.T5IE) ? IPC7bits.T5IP : 0;
+    case 4: return (IFS0bits.DMA0IF && IEC0bits.DMA0IE) ? IPC1bits.DMA0IP : 0;
+    case 5: return (IFS0bits.DMA1IF && IEC0bits.DMA1IE) ? IPC3bits.DMA1IP : 0;
+    case 6: return (IFS0bits.U1RXIF && IEC0bits.U1RXIE) ? IPC2bits.U1RXIP : 0;
+    case 7: return (IFS1bits.U2RXIF && IEC1bits.U2RXIE) ? IPC7bits.U2RXIP : 0;
+    default: return (IFS1bits.U2TXIF && IEC1bits.U2TXIE) ? IPC7bits.U2TXIP : 0;
+  }
+}
+
+static void (*const src_isr[NSRC]) (void) =
+  { _T2Interrupt, _T3Interrupt, _T4Interrupt, _T5Interrupt,
+    _DMA0Interrupt, _DMA1Interrupt, _U1RXInterrupt, _U2RXInterrupt,
+    _U2TXInterrupt };
+
+static void dispatch (void)
+{
+  int s, best, ip, top;
+
+  while (!in_isr)
+  {
+    best = -1;
+    top = SRbits.IPL;
+    for (s = 0; s < NSRC; s++)
+    {
+      ip = src_pending (s);
+      if (ip > top)
+      {
+        top = ip;
+        best = s;
+      }
+    }
+    if (best < 0)
+      return;
+    in_isr = 1;
+    host_isr_count[best]++;
+    src_isr[best] ();
+    in_isr = 0;
+  }
+}
+
+static void advance (unsigned long cyc)
+{
+  static const unsigned int div[4] = { 1, 8, 64, 256 };
+  unsigned long ticks, cnt;
+  unsigned int d;
+  int t;
+
+  now_cyc += cyc;
+  TMR1 += (unsigned int)cyc;          /* Wraps at int width, see above */
+  for (t = 0; t < 4; t++)
+  {
+    if (!(*tcon[t] & 0x8000))         /* TON */
+      continue;
+    d = div[(*tcon[t] >> 4) & 3];     /* TCKPS */
+    pre_acc[t] += cyc;
+    ticks = pre_acc[t] / d;
+    pre_acc[t] %= d;
+    cnt = *tmr[t] + ticks;
+    while (cnt > *per[t])             /* Period match, then roll to 0 */
+    {
+      cnt -= (unsigned long)*per[t] + 1;
+      tmr_flag (t);
+    }
+    *tmr[t] = (unsigned int)cnt;
+  }
+  host_adc_step (cyc);
+  host_uart_step (cyc);
+  host_onewire_step (cyc);
+  host_spi_step (cyc);
+  host_board_step ();
+  if ((now_cyc >= next_ms) && !in_isr) /* Not from inside a handler */
+  {
+    next_ms = now_cyc - now_cyc % (1000 * CYC_PER_US) + 1000 * CYC_PER_US;
+    if (host_ms_hook)
+      host_ms_hook ();
+  }
+  dispatch ();
+}
+
+volatile unsigned int *host_tmr1 (void)
+{
+  advance (CYC_PER_US);
+  return &TMR1;
+}
+
+/* Long waits go in steps well under the shortest timer period, so no
+   period match is passed over between two looks at the flags. */
+
+#define STEP_US      50
+
+void host_run_us (unsigned long us)
+{
+  while (us > STEP_US)
+  {
+    advance (STEP_US * CYC_PER_US);
+    us -= STEP_US;
+  }
+  advance (us * CYC_PER_US);
+}
+
+/* Loops that wait for an interrupt to change something kick the watchdog
+   as they go round; that is where they let time pass. */
+
+void host_clrwdt (void)
+{
+  advance (CYC_PER_US);
+}
+
+/* A model's own time for something the firmware does, in cycles */
+
+void host_run_cyc (unsigned long cyc)
+{
+  advance (cyc);
+}
+
+unsigned long long host_now_us (void)
+{
+  return now_cyc / CYC_PER_US;
+}
+
+/* Linked with --wrap: a read_time() poll loop is what waits out most
+   delays, so each poll is a microsecond. */
+
+unsigned long __wrap_read_time (void)
+{
+  advance (CYC_PER_US);
+  return __real_read_time ();
+}
+
+/* DelayUS()/DelayMS() spin on TMR1 a microsecond per look, which at
+   5ms an EEPROM write makes a format take minutes; the same wait here is
+   taken in host_run_us() steps, interrupts and all. */
+
+void __wrap_DelayUS (unsigned int usperiod)
+{
+  host_run_us (usperiod);
+}
+
+void __wrap_DelayMS (unsigned int msperiod)
+{
+  host_run_us (msperiod * 1000UL);
+}
+
+/* Timer 6/7 as one 32-bit count; the firmware's own readers splice two
+   16-bit halves through an int union, which the LP64 host can't. */
+
+unsigned long __wrap_read_32bit_cycles (void)
+{
+  advance (1);
+  return (unsigned long)(unsigned int)now_cyc;
+}
+
+unsigned long __wrap_read_32bit_realtime (void)
+{
+  return __wrap_read_32bit_cycles () / CYC_PER_US;
+}
@@ -0,0 +1,108 @@
+/*****************************************************************************
+ *
+ *   Project:        Rack Controller
+ *
+ *   Module:         flash.c  (host test build)
+ *
+ *   Description:    Program memory.  24-bit instruction words, two address
+ *                   units apiece, as table reads and the memory.s row
+ *                   erase/program routines see them.  The "code" runs
+ *                   from 0 to host_program_end (what _PROGRAM_END would
+ *                   be) and is a fixed pattern; the rest is erased, so
+ *                   the first check_shell_crc() finds no CRC stored at
+ *                   CHECKSUM_LOW_ADDR and programs it, as a freshly
+ *                   loaded chip does, and every later check passes.
+ *
+ *   Revision History:
+ *   Rev      Date      Who   Description of Change Made
+ *  --------  --------- ---  --------------------------------------------
+ *  1.6.38    10/19/26  AGT  New
+ *
+ *****************************************************************************/
+#include "common.h"
+
+#define FLASH_WORDS   (0x2AC00 / 2)   /* PIC24HJ256: 87552 instructions */
+#define ROW_WORDS     64              /* Program a row ... */
+#define PAGE_WORDS    512             /* ... erase a page */
+#define ERASED        0xFFFFFFUL
+
+unsigned long host_program_end = 0x6000;
+
+static unsigned long flash[FLASH_WORDS];
+static unsigned long latch[ROW_WORDS];
+static unsigned long latch_row;       /* Word address of the latched row */
+static int loaded;
+
+static void load (void)
+{
+  unsigned long i;
+
+  for (i = 0; i < FLASH_WORDS; i++)
+    flash[i] = (i < host_program_end / 2) ? ((i * 0x9E3779UL) >> 4) & ERASED
+                                          : ERASED;
+  for (i = 0; i < ROW_WORDS; i++)
+    latch[i] = ERASED;
+  loaded = 1;
+}
+
+unsigned long host_tbladdress (const void *sym)
+{
+  return host_program_end;            /* Only ever &_PROGRAM_END */
+}
+
+/* Table read: "len" bytes, three to an instruction word, low byte first */
+
+_prog_addressT _memcpy_p2d24 (char *dest, _prog_addressT src, unsigned int len)
+{
+  unsigned long w = src >> 1;
+  unsigned int b = 0;
+
+  if (!loaded)
+    load ();
+  while (len--)
+  {
+    *dest++ = (char)(((w < FLASH_WORDS) ? flash[w] : ERASED) >> (8 * b));
+    if (++b == 3)
+    {
+      b = 0;
+      w++;
+    }
+  }
+  return (_prog_addressT)w << 1;
+}
+
+/* memory.s: NVMCON operations on TBLPAG:offset */
+
+void Erase (unsigned int page, unsigned int offset, unsigned int cmd)
+{
+  unsigned long w, i;
+
+  if (!loaded)
+    load ();
+  w = ((((unsigned long)page << 16) | offset) >> 1) & ~(PAGE_WORDS - 1UL);
+  if (cmd == PM_ROW_ERASE)
+    for (i = 0; (i < PAGE_WORDS) && (w + i < FLASH_WORDS); i++)
+      flash[w + i] = ERASED;
+}
+
+void WriteLatch (unsigned int page, unsigned int offset, unsigned int hi,
+                 unsigned int lo)
+{
+  unsigned long w = (((unsigned long)page << 16) | offset) >> 1;
+
+  latch_row = w & ~(ROW_WORDS - 1UL);
+  latch[w & (ROW_WORDS - 1)] = (((unsigned long)(hi & 0xFF) << 16) | (lo & 0xFFFF));
+}
+
+void WriteMem (unsigned int cmd)
+{
+  unsigned long i;
+
+  if (!loaded)
+    load ();
+  if (cmd == PM_ROW_WRITE)
+    for (i = 0; (i < ROW_WORDS) && (latch_row + i < FLASH_WORDS); i++)
+      flash[latch_row + i] &= latch[i];   /* Programming only clears bits */
+  for (i = 0; i < ROW_WORDS; i++)
+    latch[i] = ERASED;
+}
@@ -0,0 +1,126 @@
+/*****************************************************************************
+ *
+ *   Project:        Rack Controller
+ *
+ *   Module:         host.h
+ *
+ *   Description:    Pre-included (gcc -include) ahead of every firmware
+ *                   file in the host test build.  Maps the XC16 extensions
+ *                   onto plain C and declares the test hooks the host layer
+ *                   provides in place of the chip.
+ *
+ *                   The host is LP64: int is 32 bits and long 64.  The
+ *                   stored records are declared with UINT16/UINT32 (see
+ *                   stdsym.h) and packed to 2 as XC16 lays them out, so
+ *                   their EEPROM images are the chip's; RAM-only state
+ *                   is not, so tests check behaviour there, never sizes.
+ *                   The C library headers are pulled in first so that
+ *                   they keep the host's own layout.
+ *
+ *   Revision History:
+ *   Rev      Date      Who   Description of Change Made
+ *  --------  --------- ---  --------------------------------------------
+ *  1.6.38    10/19/26  AGT  New
+ *
+ *****************************************************************************/
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#define __PIC24HJ256GP210__ 1
+
+#define __attribute__(x)
+#define __builtin_disi(x)
+#define __builtin_nop()
+#define __builtin_tbladdress(f)    host_tbladdress (f)
+#define __builtin_dmaoffset(p)     host_dmaoffset (p)
+#define __builtin_write_OSCCONH(x)
+#define __builtin_write_OSCCONL(x)
+
+extern int _PROGRAM_END;              /* Linker symbol, see stubs.c */
+
+/* Program memory (flash.c): the image ends at host_program_end */
+
+extern unsigned long host_program_end;
+extern unsigned long host_tbladdress (const void *sym);
+
+/* Virtual clock (clock.c).  Time moves only when the firmware looks at
+   it: every TMR1 read, read_time() call or ClrWdt() is one microsecond,
+   and timers 2-5 count along and take their interrupts as the chip would. */
+
+extern volatile unsigned int *host_tmr1 (void);
+extern void host_clrwdt (void);
+extern void host_run_us (unsigned long us);
+extern void host_run_cyc (unsigned long cyc);
+extern unsigned long long host_now_us (void);
+extern void (*host_ms_hook) (void);   /* Called every virtual millisecond */
+
+/* Interrupts taken, by source */
+
+enum { HOST_T2, HOST_T3, HOST_T4, HOST_T5, HOST_DMA0, HOST_DMA1, HOST_U1RX,
+       HOST_U2RX, HOST_U2TX, HOST_NSRC };
+extern unsigned long host_isr_count[HOST_NSRC];
+
+/* Board models, stepped from the clock: ADC1/DMA0 (adc.c), the two UARTs
+   (uart.c), the 1-Wire lines (onewire.c), the SPI update module
+   (spi.c), the analog front end, relays and truck (board.c). */
+
+extern void host_adc_step (unsigned long cyc);
+extern void host_uart_step (unsigned long cyc);
+extern void host_onewire_step (unsigned long cyc);
+extern void host_spi_step (unsigned long cyc);
+extern void host_board_step (void);
+extern unsigned int host_an (int an);
+extern unsigned long host_adc_singles; /* Single (mux) conversions */
+extern unsigned char host_truck_probes; /* Channels with a probe on */
+extern unsigned char host_truck_wet;  /* ... and of those, the wet ones */
+extern unsigned char host_truck_therm; /* ... the thermistors (dry) */
+extern unsigned char host_tim[0xA00]; /* SuperTIM memory (onewire.c) */
+extern int host_tim_on;               /* ... plugged into the truck socket */
+extern unsigned long host_tim_copies; /* Scratchpad copies to its memory */
+extern unsigned long host_tim_slots;  /* Resets and time slots on COMM_ID */
+extern unsigned char host_key[6];     /* Bypass key serial number (onewire.c) */
+extern int host_key_on;               /* ... in the bypass socket */
+extern unsigned long host_key_slots;  /* Resets and time slots on its line */
+extern void host_modbus_send (const unsigned char *msg, int len);
+extern int host_modbus_reply (unsigned char *buf, int max);
+extern unsigned long long host_modbus_rx_us;   /* Request's last character in */
+extern unsigned long long host_modbus_tx_us;   /* DMA1 started the response */
+extern unsigned long long host_modbus_done_us; /* ... its last character out */
+extern unsigned char host_spi_mem[0x100000]; /* Update module flash (spi.c) */
+extern unsigned long host_spi_programs; /* Page programs */
+extern unsigned long host_spi_erases;  /* Sector and chip erases */
+extern unsigned long long host_spi_wait_us; /* RDSR polled while busy */
+extern unsigned int host_dmaoffset (const void *p);
+
+/* I2C bus models (i2c.c): 24FC1025 and MCP23017 on bus 2, DS1371 and
+   PFC8570 on bus 1. */
+
+extern unsigned char host_eeprom[0x20000];
+extern unsigned long host_ee_writes;  /* Completed write cycles */
+extern unsigned long host_ee_limit;   /* Refuse writes from this count on */
+extern unsigned long host_i2c_starts; /* Start conditions, both buses */
+extern unsigned long host_ee_reads;   /* EEPROM read transfers */
+extern unsigned long host_i2c_bytes;  /* Bytes clocked, both buses */
+extern unsigned long host_mcp_starts; /* Starts to the MCP23017 */
+extern unsigned long host_rtc_seconds;
+extern unsigned char host_jumpers;
+extern void host_i2c_reset (void);
+extern void host_nv_format (void);    /* Blank parts, eeFormat(), eeInit() */
+
+/* Test bookkeeping (stubs.c) */
+
+extern int host_fails;
+#define HOST_CHECK(c) \
+   do { if (!(c)) { host_fail(__FILE__, __LINE__, #c); } } while (0)
+extern void host_fail (const char *file, int line, const char *what);
+extern int host_done (const char *name);
+
+#pragma pack(2)
+
+#endif /* HOST_H */
@@ -0,0 +1,299 @@
+/*****************************************************************************
+ *
+ *   Project:        Rack Controller
+ *
+ *   Module:         i2c.c  (host test build)
+ *
+ *   Description:    Stands in for i2c_1.c and i2c_2.c: the same entry
+ *                   points, driving byte-level models of the parts on the
+ *                   two buses instead of the MSSP registers.
+ *
+ *                   Bus 2:  24FC1025 (0xA0, 0xA8 = upper 64K block), two
+ *                           address bytes, writes wrap inside the 128 byte
+ *                           page as on the part.  MCP23017 (0x4A), the
+ *                           jumper inputs read back at register 9.
+ *                   Bus 1:  DS1371 (0xD0), registers 0-3 the seconds count,
+ *                           running with the virtual clock; status (8)
+ *                           reads OSF set, which dallas.c takes as "running".
+ *                           PFC8570 (0xA2), 256 bytes of RAM.
+ *
+ *                   An address nobody answers to is NAK-ed (-1), and so
+ *                   is every EEPROM write once host_ee_writes reaches
+ *                   host_ee_limit, to cut an update off part way.
+ *                   host_i2c_starts counts start conditions, repeated ones
+ *                   too: the bench's bus transaction count.  host_ee_reads
+ *                   counts the EEPROM read transfers among them, and
+ *                   host_i2c_bytes the bytes clocked, address bytes and
+ *                   reads too (nine bit times each on the wire).
+ *                   host_mcp_starts counts the starts addressed to the
+ *                   MCP23017.
+ *
+ *   Revision History:
+ *   Rev      Date      Who   Description of Change Made
+ *  --------  --------- ---  --------------------------------------------
+ *  1.6.38    10/19/26  AGT  New
+ *                           host_mcp_starts.
+ *
+ *****************************************************************************/
+#include "common.h"
+
+#define EE_PAGE      128
+
+unsigned char host_eeprom[0x20000];
+unsigned long host_ee_writes;
+unsigned long host_ee_limit = ~0UL;   /* Writes NAK-ed from this count on */
+unsigned long host_i2c_starts;        /* Transfers begun, both buses */
+unsigned long host_ee_reads;          /* EEPROM read transfers */
+unsigned long host_i2c_bytes;         /* Bytes on the wire, both buses */
+unsigned long host_rtc_seconds;       /* RTC count at virtual time zero */
+unsigned long host_mcp_starts;        /* Of those, to the MCP23017 */
+unsigned char host_jumpers;
+
+static unsigned char mcp_reg[0x20];
+static unsigned char rtc_reg[0x10];
+static unsigned char pfc_ram[0x100];
+
+typedef struct
+{
+  int           addr_next;            /* Next byte is a device address */
+  unsigned char dev;                  /* Device address, R/W bit clear */
+  int           rd;                   /* Read transfer */
+  int           nptr;                 /* Address/pointer bytes still due */
+  unsigned long ptr;
+  int           wrote;                /* Data bytes since the pointer */
+} HOST_BUS;
+
+static HOST_BUS bus[2];
+
+void host_i2c_reset (void)
+{
+  memset (host_eeprom, 0xFF, sizeof host_eeprom);
+  memset (mcp_reg, 0, sizeof mcp_reg);
+  memset (rtc_reg, 0, sizeof rtc_reg);
+  memset (pfc_ram, 0, sizeof pfc_ram);
+  memset (bus, 0, sizeof bus);
+  rtc_reg[8] = 0x80;
+  host_ee_writes = 0;
+  host_ee_limit = ~0UL;
+  host_rtc_seconds = 0;
+  host_jumpers = 0;
+}
+
+static unsigned long rtc_count (void)
+{
+  return host_rtc_seconds + (unsigned long)(host_now_us () / 1000000);
+}
+
+/* Pointer bytes a device expects after its address, 0 if not present */
+
+static int dev_ptr_bytes (int b, unsigned char dev)
+{
+  if (b == 1)
+    return ((dev & 0xF6) == MC24FC1025_DEVICE) ? 2
+         : (dev == MCP23017_DEVICE) ? 1 : 0;
+  return ((dev == DS1371_DEVICE) || (dev == PFC8570_DEVICE)) ? 1 : 0;
+}
+
+static unsigned char dev_read (int b, HOST_BUS *p)
+{
+  unsigned char v;
+
+  if (b == 1)
+  {
+    if (p->dev != MCP23017_DEVICE)
+    {
+      v = host_eeprom[((p->dev & 0x08) ? 0x10000UL : 0) + (p->ptr & 0xFFFF)];
+      p->ptr = (p->ptr + 1) & 0xFFFF;
+      return v;
+    }
+    v = (p->ptr == 9) ? host_jumpers : mcp_reg[p->ptr & 0x1F];
+  }
+  else if (p->dev == DS1371_DEVICE)
+    v = (p->ptr < 4) ? (unsigned char)(rtc_count () >> (8 * p->ptr))
+                     : rtc_reg[p->ptr & 0x0F];
+  else
+    v = pfc_ram[p->ptr & 0xFF];
+  p->ptr = (p->ptr + 1) & 0xFF;
+  return v;
+}
+
+static void dev_write (int b, HOST_BUS *p, unsigned char v)
+{
+  unsigned long c;
+
+  if (b == 1)
+  {
+    if (p->dev != MCP23017_DEVICE)
+    {
+      host_eeprom[((p->dev & 0x08) ? 0x10000UL : 0) + (p->ptr & 0xFFFF)] = v;
+      p->ptr = (p->ptr & ~(unsigned long)(EE_PAGE - 1))
+             | ((p->ptr + 1) & (EE_PAGE - 1));
+      p->wrote++;
+      return;
+    }
+    mcp_reg[p->ptr & 0x1F] = v;
+  }
+  else if (p->dev == DS1371_DEVICE)
+  {
+    if (p->ptr < 4)
+    {
+      c = rtc_count () & 0xFFFFFFFFUL;
+      c &= ~(0xFFUL << (8 * p->ptr));
+      c |= (unsigned long)v << (8 * p->ptr);
+      host_rtc_seconds = c - (unsigned long)(host_now_us () / 1000000);
+    }
+    else
+      rtc_reg[p->ptr & 0x0F] = v;
+  }
+  else
+    pfc_ram[p->ptr & 0xFF] = v;
+  p->ptr = (p->ptr + 1) & 0xFF;
+}
+
+static void bus_start (int b)
+{
+  host_i2c_starts++;
+  bus[b].addr_next = 1;
+}
+
+static void bus_stop (int b)
+{
+  if (bus[b].wrote)
+    host_ee_writes++;                 /* One write cycle per transfer */
+  memset (&bus[b], 0, sizeof bus[b]);
+}
+
+static int bus_put (int b, unsigned char v)
+{
+  HOST_BUS *p = &bus[b];
+  int n;
+
+  (void)host_tmr1 ();                 /* A byte on the wire takes time */
+  host_i2c_bytes++;
+  if (p->addr_next)
+  {
+    n = dev_ptr_bytes (b, (unsigned char)(v & 0xFE));
+    if (!n)
+      return -1;                      /* Nobody home */
+    if ((n == 2) && !(v & 1) && (host_ee_writes >= host_ee_limit))
+      return -1;                      /* "Power failed" before this write */
+    if ((n == 2) && (v & 1))
+      host_ee_reads++;
+    if ((b == 1) && ((v & 0xFE) == MCP23017_DEVICE))
+      host_mcp_starts++;
+    if (!p->rd && ((v & 0xFE) == p->dev) && (v & 1))
+      p->rd = 1;                      /* Restart into a read, keep ptr */
+    else
+    {
+      p->dev = (unsigned char)(v & 0xFE);
+      p->rd = v & 1;
+      p->nptr = p->rd ? 0 : n;
+      p->ptr = 0;
+    }
+    p->addr_next = 0;
+    p->wrote = 0;
+    return 0;
+  }
+  if (p->rd)
+    return -1;
+  if (p->nptr)
+  {
+    p->ptr = (p->ptr << 8) | v;
+    p->nptr--;
+    return 0;
+  }
+  dev_write (b, p, v);
+  return 0;
+}
+
+static int bus_gets (int b, UINT16 length, UINT8 *rdptr)
+{
+  if (!bus[b].rd)
+    return -1;
+  host_i2c_bytes += length;
+  while (length--)
+    *rdptr++ = dev_read (b, &bus[b]);
+  return 0;
+}
+
+/* Bus 1 */
+
+char DataRdyI2C1 (void) { return 1; }
+void OpenI2C1 (UINT16 config1, UINT16 config2) { I2C1CON = config1; I2C1BRG = config2; }
+void StartI2C1 (void) { bus_start (0); }
+void RestartI2C1 (void) { bus_start (0); }
+int StopI2C1 (void) { bus_stop (0); return 0; }
+char MasterWriteI2C1 (UINT8 data_out) { return (char)bus_put (0, data_out); }
+int I2C1_reset (void) { bus_stop (0); return PASSED; }
+
+int MastergetsI2C1 (UINT16 length, UINT8 *rdptr, UINT16 i2c1_data_wait)
+{
+  (void)i2c1_data_wait;
+  return bus_gets (0, length, rdptr);
+}
+
+UINT16 I2C1_write (UINT8 device_addr, UINT8 reg_addr, const UINT8 *data_ptr,
+                   UINT8 length)
+{
+  StartI2C1 ();
+  if (MasterWriteI2C1 (device_addr)) return 0x11;
+  if (MasterWriteI2C1 (reg_addr)) return 0x12;
+  while (length--)
+    if (MasterWriteI2C1 (*data_ptr++)) return 0x14;
+  (void)StopI2C1 ();
+  return 0;
+}
+
+UINT16 I2C1_read (UINT8 device_addr, UINT8 reg_addr, UINT8 *data_ptr,
+                  UINT8 length)
+{
+  StartI2C1 ();
+  if (MasterWriteI2C1 (device_addr)) return 0x16;
+  if (MasterWriteI2C1 (reg_addr)) return 0x17;
+  RestartI2C1 ();
+  if (MasterWriteI2C1 ((UINT8)(device_addr | 1))) return 10;
+  if (MastergetsI2C1 (length, data_ptr, 1000)) return 9;
+  (void)StopI2C1 ();
+  return 0;
+}
+
+/* Bus 2 */
+
+char DataRdyI2C2 (void) { return 1; }
+void OpenI2C2 (UINT16 config1, UINT16 config2) { I2C2CON = config1; I2C2BRG = config2; }
+void StartI2C2 (void) { bus_start (1); }
+void RestartI2C2 (void) { bus_start (1); }
+int StopI2C2 (void) { bus_stop (1); return 0; }
+char MasterWriteI2C2 (UINT8 data_out) { return (char)bus_put (1, data_out); }
+int I2C2_reset (void) { bus_stop (1); return PASSED; }
+
+int MastergetsI2C2 (UINT16 length, UINT8 *rdptr, UINT16 I2C2_data_wait)
+{
+  (void)I2C2_data_wait;
+  return bus_gets (1, length, rdptr);
+}
+
+UINT16 I2C2_write (UINT8 device_addr, UINT8 reg_addr, const UINT8 *data_ptr,
+                   UINT8 length)
+{
+  StartI2C2 ();
+  if (MasterWriteI2C2 (device_addr)) return 0x11;
+  if (MasterWriteI2C2 (reg_addr)) return 0x12;
+  while (length--)
+    if (MasterWriteI2C2 (*data_ptr++)) return 0x14;
+  (void)StopI2C2 ();
+  return 0;
+}
+
+UINT16 I2C2_read (UINT8 device_addr, UINT8 reg_addr, UINT8 *data_ptr,
+                  UINT8 length)
+{
+  StartI2C2 ();
+  if (MasterWriteI2C2 (device_addr)) return 0x16;
+  if (MasterWriteI2C2 (reg_addr)) return 0x17;
+  RestartI2C2 ();
+  if (MasterWriteI2C2 ((UINT8)(device_addr | 1))) return 10;
+  if (MastergetsI2C2 (length, data_ptr, 1000)) return 9;
+  (void)StopI2C2 ();
+  return 0;
+}
@@ -0,0 +1,25 @@
+/*****************************************************************************
+ *
+ *   Project:        Rack Controller
+ *
+ *   Module:         libpic30.h  (host test build)
+ *
+ *   Description:    The few XC16 library entries the firmware calls.
+ *                   Program memory reads as zero on the host (stubs.c).
+ *
+ *   Revision History:
+ *   Rev      Date      Who   Description of Change Made
+ *  --------  --------- ---  --------------------------------------------
+ *  1.6.38    10/19/26  AGT  New
+ *
+ *****************************************************************************/
+#ifndef HOST_LIBPIC30_H
+#define HOST_LIBPIC30_H
+
+typedef unsigned long _prog_addressT;
+
+extern int __C30_UART;
+extern _prog_addressT _memcpy_p2d24 (char *dest, _prog_addressT src,
+                                     unsigned int len);
+
+#endif /* HOST_LIBPIC30_H */
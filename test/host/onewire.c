@@ -0,0 +1,308 @@
+/*****************************************************************************
+ *
+ *   Project:        Rack Controller
+ *
+ *   Module:         onewire.c  (host test build)
+ *
+ *   Description:    The 1-Wire lines as dallas.c bit-bangs them, modelled
+ *                   time slot by time slot.  A device answers a reset
+ *                   pulse (480us low) with a presence pulse, takes each
+ *                   bit from how long the master holds the line low (under
+ *                   15us is a 1), and puts out a 0 by holding the line
+ *                   low for 30us from the fall of a read slot.
+ *
+ *                   The board's DS2401 serial number is on RB15 and
+ *                   answers READ ROM (0x33): family code, serial number
+ *                   and CRC8.  The bypass key socket (driven on RD2, read
+ *                   on RD3) is empty unless host_key_on is set; then it
+ *                   holds a DS1990 whose serial number is host_key[] (as
+ *                   bypass_SN[] reads it), which answers READ ROM too.
+ *                   host_key_slots counts the time slots (resets too) on
+ *                   that line.
+ *
+ *                   The truck socket (COMM_ID: driven on RD0, read on
+ *                   RD1) is empty unless host_tim_on is set; then it
+ *                   holds a SuperTIM, a DS28EC20 whose memory is
+ *                   host_tim[], serial number 00 58 9C 5D 7A 31 as
+ *                   truck_SN[] reads it (the top byte 0, as nvTrkPut()
+ *                   needs).  Besides READ ROM it takes SKIP ROM
+ *                   (0xCC) and then READ MEMORY (0xF0), WRITE SCRATCHPAD
+ *                   (0x0F), READ SCRATCHPAD (0xAA) and COPY SCRATCHPAD
+ *                   (0x55), which copies the scratchpad bytes written into
+ *                   the memory page when TA1, TA2 and E/S match.
+ *                   host_tim_copies counts the copies and
+ *                   host_tim_slots the time slots (resets too) on
+ *                   COMM_ID, the TIM's share of the line.
+ *
+ *                   The line is looked at as the clock moves; a change the
+ *                   firmware makes is taken to be at the start of the
+ *                   step that first sees it, which is when it was made.
+ *
+ *   Revision History:
+ *   Rev      Date      Who   Description of Change Made
+ *  --------  --------- ---  --------------------------------------------
+ *  1.6.38    10/19/26  AGT  New
+ *                           SuperTIM on COMM_ID.
+ *                           Bypass key on READ_BYPASS.
+ *
+ *****************************************************************************/
+#include "common.h"
+#include "tim_utl.h"
+
+#define CYC_PER_US   20
+#define DQ           0x8000           /* RB15 */
+#define TIM_MEM      0xA00            /* DS28EC20_SIZE */
+#define TIM_SP       32               /* DS28EC20_SCRATCHPAD_SIZE */
+
+unsigned char host_tim[TIM_MEM];
+int host_tim_on;
+unsigned long host_tim_copies;
+unsigned long host_tim_slots;
+unsigned char host_key[6];
+int host_key_on;
+unsigned long host_key_slots;
+
+/* Byte level state of a device */
+enum { OW_IDLE, OW_ROMCMD, OW_ROM, OW_FN, OW_TA1, OW_TA2,
+       OW_RDMEM, OW_WRSP, OW_RDSP, OW_CPES };
+
+typedef struct
+{
+  unsigned char serial[6];
+  unsigned char family;
+  int           mem;                  /* Has the DS28EC20 memory */
+  unsigned char rom[8];               /* As sent: family first, CRC8 last */
+  int           state;
+  unsigned int  nbits;                /* Bits of the byte under way */
+  unsigned char in;                   /* Bits the master sent */
+  unsigned char out;                  /* Byte being sent, 0xFF to listen */
+  unsigned int  nbytes;               /* Bytes since the state began */
+  unsigned char fn;                   /* Memory function command */
+  unsigned int  ta;                   /* Target address */
+  unsigned char es;                   /* Ending offset, AA flag */
+  unsigned char sp[TIM_SP];
+  unsigned int  at;                   /* Next memory or scratchpad byte */
+  int           was_low;
+  unsigned long long fall_us;         /* Master pulled the line low */
+  unsigned long long hold_from, hold_to; /* Device holds it low */
+} OW_DEV;
+
+static OW_DEV sn = { { 0x45, 0x23, 0x01, 0xEF, 0xCD, 0xAB }, DS2401_SERIAL_ID, 0 };
+static OW_DEV tim = { { 0x31, 0x7A, 0x5D, 0x9C, 0x58, 0x00 }, DS28EC20, 1 };
+static OW_DEV key = { { 0 }, 0x01, 0 };   /* DS1990 */
+
+static void rom_build (OW_DEV *d)
+{
+  unsigned char tb[8];                /* touchbuf[] order: family at [7] */
+  int i;
+
+  tb[7] = d->family;
+  for (i = 0; i < 6; i++)
+    tb[6 - i] = d->serial[i];
+  tb[0] = Dallas_CRC8 (&tb[1], 7);
+  for (i = 0; i < 8; i++)
+    d->rom[i] = tb[7 - i];
+}
+
+static void enter (OW_DEV *d, int state, unsigned char out)
+{
+  d->state = state;
+  d->nbytes = 0;
+  d->out = out;
+}
+
+/* Scratchpad byte due next on READ SCRATCHPAD: TA1, TA2, E/S, then data */
+
+static unsigned char rdsp_byte (OW_DEV *d)
+{
+  unsigned int n = d->nbytes;
+
+  if (n < 2)
+    return (unsigned char)(d->ta >> (8 * n));
+  if (n == 2)
+    return d->es;
+  return (d->at < TIM_SP) ? d->sp[d->at++] : 0xFF;
+}
+
+/* A byte ended: "b" is what the master sent; set up the next one */
+
+static void byte_done (OW_DEV *d, unsigned char b)
+{
+  unsigned int i, page;
+
+  d->nbytes++;
+  switch (d->state)
+  {
+    case OW_ROMCMD:
+      if (b == 0x33)
+        enter (d, OW_ROM, d->rom[0]);
+      else if ((b == 0xCC) && d->mem)
+        enter (d, OW_FN, 0xFF);
+      else
+        enter (d, OW_IDLE, 0xFF);
+      break;
+    case OW_ROM:
+      if (d->nbytes < 8)
+        d->out = d->rom[d->nbytes];
+      else
+        enter (d, OW_IDLE, 0xFF);
+      break;
+    case OW_FN:
+      d->fn = b;
+      if ((b == 0xF0) || (b == 0x0F) || (b == 0x55))
+        enter (d, OW_TA1, 0xFF);
+      else if (b == 0xAA)
+      {
+        enter (d, OW_RDSP, 0xFF);
+        d->at = d->ta & (TIM_SP - 1);
+        d->out = rdsp_byte (d);
+      }
+      else
+        enter (d, OW_IDLE, 0xFF);
+      break;
+    case OW_TA1:
+      d->at = b;
+      enter (d, OW_TA2, 0xFF);
+      break;
+    case OW_TA2:
+      d->at |= (unsigned int)b << 8;
+      if (d->fn == 0xF0)
+      {
+        enter (d, OW_RDMEM, host_tim[d->at % TIM_MEM]);
+        d->at++;
+      }
+      else if (d->fn == 0x0F)
+      {
+        d->ta = d->at;
+        d->es = (unsigned char)((d->ta - 1) & (TIM_SP - 1));
+        d->at = d->ta & (TIM_SP - 1);
+        enter (d, OW_WRSP, 0xFF);
+      }
+      else
+        enter (d, OW_CPES, 0xFF);
+      break;
+    case OW_RDMEM:
+      d->out = host_tim[d->at % TIM_MEM];
+      d->at++;
+      break;
+    case OW_WRSP:
+      if (d->at < TIM_SP)
+      {
+        d->es = (unsigned char)d->at;
+        d->sp[d->at++] = b;
+      }
+      break;
+    case OW_RDSP:
+      d->out = rdsp_byte (d);
+      break;
+    case OW_CPES:
+      if ((d->at == d->ta) && (b == d->es) && !(d->es & 0x80))
+      {
+        page = d->ta & ~(TIM_SP - 1);
+        for (i = d->ta & (TIM_SP - 1); i <= (d->es & (TIM_SP - 1)); i++)
+          host_tim[(page + i) % TIM_MEM] = d->sp[i];
+        d->es |= 0x80;                /* AA: copied */
+        host_tim_copies++;
+      }
+      enter (d, OW_IDLE, 0xFF);
+      break;
+    default:
+      break;
+  }
+}
+
+/* The master let go after holding the line low "low_us" */
+
+static void released (OW_DEV *d, unsigned long long now, unsigned long long low_us)
+{
+  if (low_us >= 480)
+  {
+    d->hold_from = now + 15;          /* Presence: 15us on, for 120us */
+    d->hold_to = d->hold_from + 120;
+    enter (d, OW_ROMCMD, 0xFF);
+    d->nbits = 0;
+    d->in = 0;
+    return;
+  }
+  if (d->state == OW_IDLE)
+    return;
+  if (low_us < 15)                    /* A write 1 (or read) slot */
+    d->in |= (unsigned char)(1 << d->nbits);
+  if (++d->nbits == 8)
+  {
+    d->nbits = 0;
+    byte_done (d, d->in);
+    d->in = 0;
+  }
+}
+
+/* Step one device: "low" is the master driving its line low; returns
+   whether the line is low */
+
+static int dev_step (OW_DEV *d, int low, unsigned long long at,
+                     unsigned long long now)
+{
+  if (low && !d->was_low)
+  {
+    d->fall_us = at;
+    if ((d->state != OW_IDLE) && !((d->out >> d->nbits) & 1))
+    {
+      d->hold_from = at;
+      d->hold_to = at + 30;
+    }
+  }
+  else if (!low && d->was_low)
+    released (d, at, at - d->fall_us);
+  d->was_low = low;
+  return low || ((now >= d->hold_from) && (now < d->hold_to));
+}
+
+void host_onewire_step (unsigned long cyc)
+{
+  unsigned long long now = host_now_us ();
+  unsigned long long at = now - cyc / CYC_PER_US;   /* Start of this step */
+  unsigned char ser[6];
+  int low, i;
+
+  if (!sn.rom[0])
+  {
+    rom_build (&sn);
+    rom_build (&tim);
+  }
+  if (dev_step (&sn, !(TRISB & DQ) && !(LATB & DQ), at, now))
+    PORTB &= ~DQ;
+  else
+    PORTB |= DQ;
+
+  low = !(TRISD & COMM_ID) && !(LATD & COMM_ID);
+  if (low && !tim.was_low)
+    host_tim_slots++;
+  if (host_tim_on)
+    PORTDbits.RD1 = !dev_step (&tim, low, at, now);
+  else
+  {
+    tim.was_low = low;
+    PORTDbits.RD1 = 1;
+  }
+
+  low = !(TRISD & READ_BYPASS) && !(LATD & READ_BYPASS);
+  if (low && !key.was_low)
+    host_key_slots++;
+  if (host_key_on)
+  {
+    for (i = 0; i < 6; i++)
+      ser[i] = host_key[5 - i];       /* bypass_SN[] order is reversed */
+    if (memcmp (key.serial, ser, sizeof ser) || !key.rom[0])
+    {
+      memcpy (key.serial, ser, sizeof ser);
+      rom_build (&key);               /* A different key went in */
+    }
+    PORTDbits.RD3 = !dev_step (&key, low, at, now);
+  }
+  else
+  {
+    key.was_low = low;
+    key.state = OW_IDLE;
+    PORTDbits.RD3 = 1;
+  }
+}
@@ -0,0 +1,54 @@
+/*****************************************************************************
+ *
+ *   Project:        Rack Controller
+ *
+ *   Module:         p24HJ256GP210.h  (host test build)
+ *
+ *   Description:    Found ahead of h/p24HJ256GP210.h on the host include
+ *                   path.  Takes the real device header, then replaces the
+ *                   two inline-assembly macros and routes TMR1 and ClrWdt()
+ *                   through the virtual clock so DelayUS() and the loops
+ *                   that wait with the watchdog kicked make progress.
+ *                   AD1CON1bits and the UART data registers go through
+ *                   the models (adc.c, uart.c) too: the firmware polls
+ *                   DONE, and writes and reads characters, without letting
+ *                   any time pass.  IFS2bits and PORTGbits go through the
+ *                   SPI module (spi.c), which sees DMA3IF polled and the
+ *                   chip select move that way.
+ *
+ *   Revision History:
+ *   Rev      Date      Who   Description of Change Made
+ *  --------  --------- ---  --------------------------------------------
+ *  1.6.38    10/19/26  AGT  New
+ *
+ *****************************************************************************/
+#ifndef HOST_P24HJ256GP210_H
+#define HOST_P24HJ256GP210_H
+
+#include "../../h/p24HJ256GP210.h"
+
+#undef Nop
+#define Nop()
+#undef ClrWdt
+#define ClrWdt() host_clrwdt ()
+
+extern volatile AD1CON1BITS *host_ad1con1 (void);
+extern volatile unsigned int *host_u1txreg (void);
+extern volatile unsigned int *host_u1rxreg (void);
+extern volatile unsigned int *host_u2txreg (void);
+extern volatile unsigned int *host_u2rxreg (void);
+extern volatile IFS2BITS *host_ifs2 (void);
+extern volatile PORTGBITS *host_portg (void);
+
+#ifndef HOST_SFR_C                    /* sfr.c defines the register itself */
+#define TMR1        (*host_tmr1 ())
+#define AD1CON1bits (*host_ad1con1 ())
+#define U1TXREG     (*host_u1txreg ())
+#define U1RXREG     (*host_u1rxreg ())
+#define U2TXREG     (*host_u2txreg ())
+#define U2RXREG     (*host_u2rxreg ())
+#define IFS2bits    (*host_ifs2 ())
+#define PORTGbits   (*host_portg ())
+#endif
+
+#endif /* HOST_P24HJ256GP210_H */
@@ -0,0 +1,298 @@
+/*****************************************************************************
+ *
+ *   Project:        Rack Controller
+ *
+ *   Module:         spi.c  (host test build)
+ *
+ *   Description:    The update module on SPI2: a W25X80 serial flash
+ *                   (1 MB, 256 byte pages, 4 KB sectors, device ID
+ *                   EF 30 14) selected by RG15.  It takes READ, PAGE
+ *                   PROGRAM, SECTOR and CHIP ERASE, RDSR, WREN/WRDI and
+ *                   the JEDEC ID; a program or erase starts as the chip
+ *                   select goes high with WEL set and keeps BSY up for
+ *                   SPI_PP_US, SPI_SE_US or SPI_CE_US, the W25X80's
+ *                   typical times, during which anything but RDSR is
+ *                   ignored.  Programming only clears bits.
+ *
+ *                   Bytes move at the 10 MHz SCK SPIMPolInit() sets, 16
+ *                   instruction cycles each: SPIMPolPut() (linked with
+ *                   --wrap) exchanges one and leaves the answer in
+ *                   SPI2BUF; DMA2/DMA3, once DMA2REQ.FORCE starts them,
+ *                   move one a byte time as the clock runs, DMA3IF and
+ *                   DMA2IF set after the last.  spi_dma_wait() polls
+ *                   DMA3IF with no time passing, so IFS2bits is routed
+ *                   here (host p24HJ256GP210.h) and each look is a few
+ *                   cycles; PORTGbits is routed too, so no chip select
+ *                   edge goes unseen however quickly it follows the last.
+ *
+ *                   The DMA registers hold __builtin_dmaoffset() of a
+ *                   buffer, a pointer cut to an int here; host_dmaoffset()
+ *                   notes each one so the channels can find the buffer.
+ *
+ *                   host_spi_mem[] is the flash; host_spi_programs and
+ *                   host_spi_erases count the operations and
+ *                   host_spi_wait_us the time the firmware spent polling
+ *                   RDSR while the part was busy.
+ *
+ *   Revision History:
+ *   Rev      Date      Who   Description of Change Made
+ *  --------  --------- ---  --------------------------------------------
+ *  1.6.38    10/19/26  AGT  New
+ *
+ *****************************************************************************/
+#define HOST_SFR_C                    /* IFS2bits and PORTGbits themselves */
+#include "common.h"
+#include "spi_eeprom.h"
+
+#define SPI_SIZE     0x100000UL
+#define BYTE_CYC     16               /* 8 bits at FCY / 2 */
+#define LOOK_CYC     4                /* A turn of a flag poll loop */
+#define SPI_PP_US    1500UL           /* Page program */
+#define SPI_SE_US    150000UL         /* 4 KB sector erase */
+#define SPI_CE_US    10000000UL       /* Chip erase */
+#define NDMABUF      16
+
+unsigned char host_spi_mem[SPI_SIZE];
+unsigned long host_spi_programs;
+unsigned long host_spi_erases;
+unsigned long long host_spi_wait_us;
+
+static int cs_was = 1;                /* Chip select, high = deselected */
+static unsigned char cmd;
+static unsigned long nbytes;          /* Bytes since the select, cmd too */
+static unsigned long addr;
+static int wel;
+static unsigned long long busy_until; /* us */
+static int in_wait;                   /* Firmware is polling BSY */
+static unsigned long long wait_from;
+static unsigned char pp_data[SPI_EEPROM_PAGE_SIZE];
+static unsigned int pp_len;
+static int started;
+
+static const void *dma_buf[NDMABUF];  /* host_dmaoffset() pointers */
+
+static int dma_on;
+static unsigned int dma_n;
+static unsigned long dma_acc;
+
+static void start (void)
+{
+  memset (host_spi_mem, 0xFF, sizeof host_spi_mem);
+  started = 1;
+}
+
+unsigned int host_dmaoffset (const void *p)
+{
+  unsigned int off = (unsigned int)(unsigned long)p;
+  int i;
+
+  for (i = 0; (i < NDMABUF) && dma_buf[i]; i++)
+    if (dma_buf[i] == p)
+      return off;
+  if (i < NDMABUF)
+    dma_buf[i] = p;
+  return off;
+}
+
+static unsigned char *dma_ptr (unsigned int off)
+{
+  int i;
+
+  for (i = 0; (i < NDMABUF) && dma_buf[i]; i++)
+    if ((unsigned int)(unsigned long)dma_buf[i] == off)
+      return (unsigned char *)dma_buf[i];
+  fprintf (stderr, "spi: DMA to an unknown buffer %08X\n", off);
+  exit (2);
+}
+
+static int busy (void)
+{
+  return host_now_us () < busy_until;
+}
+
+/* The chip select went high: finish the command */
+
+static void cmd_end (void)
+{
+  unsigned long a;
+  unsigned int i;
+
+  if (busy () || (nbytes == 0))
+    return;
+  switch (cmd)
+  {
+    case SPI_EEPROM_CMD_WREN:
+      wel = 1;
+      break;
+    case SPI_EEPROM_CMD_WRDI:
+      wel = 0;
+      break;
+    case SPI_EEPROM_CMD_WRITE:
+      if (!wel || (nbytes < 4))
+        break;
+      a = addr & ~(unsigned long)SPI_EEPROM_PAGE_MASK;
+      for (i = 0; i < pp_len; i++)
+        host_spi_mem[(a + ((addr + i) & SPI_EEPROM_PAGE_MASK)) % SPI_SIZE]
+          &= pp_data[i];
+      host_spi_programs++;
+      busy_until = host_now_us () + SPI_PP_US;
+      wel = 0;
+      break;
+    case SPI_EEPROM_CMD_SECTOR_ERASE:
+      if (!wel || (nbytes < 4))
+        break;
+      a = (addr % SPI_SIZE) & ~(unsigned long)(SPI_EEPROM_SECTOR_SIZE - 1);
+      memset (&host_spi_mem[a], 0xFF, SPI_EEPROM_SECTOR_SIZE);
+      host_spi_erases++;
+      busy_until = host_now_us () + SPI_SE_US;
+      wel = 0;
+      break;
+    case SPI_EEPROM_CMD_CHIP_ERASE:
+      if (!wel)
+        break;
+      memset (host_spi_mem, 0xFF, sizeof host_spi_mem);
+      host_spi_erases++;
+      busy_until = host_now_us () + SPI_CE_US;
+      wel = 0;
+      break;
+    default:
+      break;
+  }
+}
+
+static void cs_look (void)
+{
+  int cs = PORTGbits.RG15;
+
+  if (!started)
+    start ();
+  if (cs == cs_was)
+    return;
+  cs_was = cs;
+  if (cs)
+    cmd_end ();
+  else
+    nbytes = 0;
+}
+
+/* One byte each way while selected */
+
+static unsigned char xfer (unsigned char out)
+{
+  unsigned char in = 0xFF;
+  unsigned long n;
+
+  cs_look ();
+  if (cs_was)
+    return 0xFF;                      /* Not selected */
+  n = nbytes++;
+  if (n == 0)
+  {
+    cmd = out;
+    addr = 0;
+    pp_len = 0;
+    return 0xFF;
+  }
+  if (cmd == SPI_EEPROM_CMD_RDSR)
+  {
+    in = (unsigned char)((busy () ? 0x01 : 0) | (wel ? 0x02 : 0));
+    if (busy () && !in_wait)
+    {
+      in_wait = 1;
+      wait_from = host_now_us ();
+    }
+    else if (!busy () && in_wait)
+    {
+      in_wait = 0;
+      host_spi_wait_us += host_now_us () - wait_from;
+    }
+    return in;
+  }
+  if (busy ())
+    return 0xFF;
+  switch (cmd)
+  {
+    case SPI_EEPROM_CMD_DID:
+      in = (n == 1) ? 0xEF : (n == 2) ? 0x30 : (n == 3) ? 0x14 : 0xFF;
+      break;
+    case SPI_EEPROM_CMD_READ:
+    case SPI_EEPROM_CMD_WRITE:
+    case SPI_EEPROM_CMD_SECTOR_ERASE:
+      if (n <= 3)
+      {
+        addr = (addr << 8) | out;
+        break;
+      }
+      if (cmd == SPI_EEPROM_CMD_READ)
+        in = host_spi_mem[addr++ % SPI_SIZE];
+      else if ((cmd == SPI_EEPROM_CMD_WRITE)
+               && (pp_len < SPI_EEPROM_PAGE_SIZE))
+        pp_data[pp_len++] = out;
+      break;
+    default:
+      break;
+  }
+  return in;
+}
+
+unsigned __wrap_SPIMPolPut (unsigned Data)
+{
+  SPI2BUF = xfer ((unsigned char)Data);
+  SPI2STATbits.SPIRBF = 1;
+  host_run_cyc (BYTE_CYC);
+  return GOOD;
+}
+
+volatile IFS2BITS *host_ifs2 (void)
+{
+  host_run_cyc (LOOK_CYC);
+  return &IFS2bits;
+}
+
+volatile PORTGBITS *host_portg (void)
+{
+  cs_look ();
+  return &PORTGbits;
+}
+
+/* DMA2 sends and DMA3 takes what comes back, a byte at a time */
+
+void host_spi_step (unsigned long cyc)
+{
+  unsigned char *p;
+  unsigned char in;
+
+  cs_look ();                         /* A program starts as CS goes up */
+  if (!DMA2CONbits.CHEN)
+  {
+    dma_on = 0;
+    return;
+  }
+  if (!dma_on)
+  {
+    if (!DMA2REQbits.FORCE)
+      return;
+    DMA2REQbits.FORCE = 0;
+    dma_on = 1;
+    dma_n = 0;
+    dma_acc = 0;
+  }
+  for (dma_acc += cyc; dma_on && (dma_acc >= BYTE_CYC); dma_acc -= BYTE_CYC)
+  {
+    p = dma_ptr (DMA2STA);
+    in = xfer (p[DMA2CONbits.AMODE ? 0 : dma_n]);
+    if (DMA3CONbits.CHEN)
+    {
+      p = dma_ptr (DMA3STA);
+      p[DMA3CONbits.AMODE ? 0 : dma_n] = in;
+    }
+    if (dma_n++ == DMA2CNT)
+    {
+      DMA2CONbits.CHEN = 0;           /* One-shot blocks done */
+      DMA3CONbits.CHEN = 0;
+      IFS1bits.DMA2IF = 1;
+      IFS2bits.DMA3IF = 1;
+      dma_on = 0;
+    }
+  }
+}
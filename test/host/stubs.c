@@ -0,0 +1,61 @@
+/*****************************************************************************
+ *
+ *   Project:        Rack Controller
+ *
+ *   Module:         stubs.c  (host test build)
+ *
+ *   Description:    Linker and assembler symbols the C sources lean on,
+ *                   plus the PASS/FAIL bookkeeping the tests share.
+ *
+ *   Revision History:
+ *   Rev      Date      Who   Description of Change Made
+ *  --------  --------- ---  --------------------------------------------
+ *  1.6.38    10/19/26  AGT  New
+ *
+ *****************************************************************************/
+#include "common.h"
+
+char b_date[] = "host";               /* Build date, from the linker script */
+int __C30_UART = 2;
+int _PROGRAM_END;                     /* Address from flash.c */
+
+int host_fails;
+
+/* CPURegisterTest.s: the register march has no meaning off the chip */
+
+int CPU_RegisterTest (void)
+{
+  return 1;                           /* Nonzero is OK */
+}
+
+/* Linked with --wrap: mem_test() marches the RAM at its chip addresses,
+   which here are not ours to write; report it passed as __DEBUG does. */
+
+char __wrap_mem_test (void)
+{
+  return PASSED;
+}
+
+/* eeFormat() reads the clock, so the RTC is set to present_time first:
+   the format's entry is stamped with the time the caller set. */
+
+void host_nv_format (void)
+{
+  host_i2c_reset ();
+  host_rtc_seconds = present_time - (unsigned long)(host_now_us () / 1000000);
+  eeInit ();
+  (void)eeFormat ();
+  eeInit ();
+}
+
+void host_fail (const char *file, int line, const char *what)
+{
+  fprintf (stderr, "%s:%d: FAIL: %s\n", file, line, what);
+  host_fails++;
+}
+
+int host_done (const char *name)
+{
+  fprintf (stderr, "%s: %s\n", name, host_fails ? "FAIL" : "PASS");
+  return host_fails ? 1 : 0;
+}
@@ -0,0 +1,270 @@
+/*****************************************************************************
+ *
+ *   Project:        Rack Controller
+ *
+ *   Module:         uart.c  (host test build)
+ *
+ *   Description:    The two serial lines, a character per 10 bit times at
+ *                   the rate UxBRG/BRGH set.
+ *
+ *                   UART1 has the backup processor on it: each packet
+ *                   send_backup_pkt() sends (length byte first) gets,
+ *                   after BK_TURN_US, an 11 byte answer for the same
+ *                   command with no errors flagged and its Dallas CRC8
+ *                   last (service_bk_msg()); a version answer says 1.6.1.
+ *
+ *                   UART2 is the ModBus line.  host_modbus_send() queues a
+ *                   request (the CRC is added here) to come in a character
+ *                   at a time; the response goes out through DMA1 from
+ *                   modbus_tx_buff[] as modbus_tx_start() sets it up, and
+ *                   TRMT and the UTXISEL = 01 interrupt follow the last
+ *                   character out.  host_modbus_reply() hands back what
+ *                   was sent, in either of those ways.  host_modbus_rx_us
+ *                   is when the request's last character came in,
+ *                   host_modbus_tx_us when DMA1 started on the response
+ *                   and host_modbus_done_us when its last character was
+ *                   out (0 until it is).
+ *
+ *                   The firmware writes UxTXREG and reads UxRXREG without
+ *                   letting any time pass between, so those registers are
+ *                   routed here (host p24HJ256GP210.h): a write is picked up
+ *                   at the next look, a read empties the receive buffer.
+ *
+ *   Revision History:
+ *   Rev      Date      Who   Description of Change Made
+ *  --------  --------- ---  --------------------------------------------
+ *  1.6.38    10/19/26  AGT  New
+ *
+ *****************************************************************************/
+#define HOST_SFR_C                    /* UxTXREG/UxRXREG are the registers */
+#include "common.h"
+
+#define NO_CHAR      0xFFFFFFFFu      /* UxTXREG holds no unsent write */
+#define BK_TURN_US   2000             /* Backup processor's think time */
+#define BK_ANSWER    11
+#define MB_QUEUE     (MODBUS_MAX_LEN + 2)
+
+/* UART1: backup processor */
+
+static unsigned char bk_in[20];
+static unsigned int bk_got;
+static unsigned char bk_out[BK_ANSWER];
+static unsigned int bk_sent, bk_len;
+static unsigned long bk_wait;         /* Cycles to the next answer character */
+
+/* UART2: ModBus */
+
+static unsigned char mb_in[MB_QUEUE];
+static unsigned int mb_in_len, mb_in_next;
+static unsigned long mb_rx_wait;
+static unsigned char mb_out[MB_QUEUE];
+static unsigned int mb_out_len;
+static unsigned int dma_next, dma_count;
+static unsigned long tx_wait;         /* Cycles until the shift register empties */
+static int tx_busy;
+unsigned long long host_modbus_rx_us;
+unsigned long long host_modbus_tx_us;
+unsigned long long host_modbus_done_us;
+
+static int started;
+
+static void start (void)
+{
+  U1TXREG = NO_CHAR;
+  U2TXREG = NO_CHAR;
+  started = 1;
+}
+
+static unsigned long char_cyc (unsigned int brg, unsigned int brgh)
+{
+  return 10UL * (brgh ? 4 : 16) * (brg + 1);
+}
+
+/* A backup packet is in: answer it */
+
+static void bk_packet (void)
+{
+  memset (bk_out, 0, sizeof bk_out);
+  bk_out[0] = BK_ANSWER;
+  bk_out[1] = bk_in[1];
+  if (bk_in[1] == 0x12)               /* BK_MSG_VERSION */
+  {
+    bk_out[2] = 1;
+    bk_out[3] = 0x16;
+  }
+  bk_out[BK_ANSWER - 1] = Dallas_CRC8 (bk_out, BK_ANSWER - 1);
+  bk_len = BK_ANSWER;
+  bk_sent = 0;
+  bk_wait = BK_TURN_US * 20UL;
+}
+
+static void bk_take (void)
+{
+  if (U1TXREG == NO_CHAR)
+    return;
+  if (bk_got < sizeof bk_in)
+    bk_in[bk_got++] = (unsigned char)U1TXREG;
+  U1TXREG = NO_CHAR;
+  if ((bk_got >= 2) && (bk_got >= bk_in[0]))
+  {
+    bk_packet ();
+    bk_got = 0;
+  }
+}
+
+static void mb_take (void)
+{
+  if (U2TXREG == NO_CHAR)
+    return;
+  if (mb_out_len < sizeof mb_out)
+    mb_out[mb_out_len++] = (unsigned char)U2TXREG;
+  U2TXREG = NO_CHAR;
+}
+
+volatile unsigned int *host_u1txreg (void)
+{
+  if (!started)
+    start ();
+  bk_take ();
+  return &U1TXREG;
+}
+
+volatile unsigned int *host_u1rxreg (void)
+{
+  U1STAbits.URXDA = 0;
+  return &U1RXREG;
+}
+
+volatile unsigned int *host_u2txreg (void)
+{
+  if (!started)
+    start ();
+  mb_take ();
+  return &U2TXREG;
+}
+
+volatile unsigned int *host_u2rxreg (void)
+{
+  U2STAbits.URXDA = 0;
+  return &U2RXREG;
+}
+
+void host_modbus_send (const unsigned char *msg, int len)
+{
+  unsigned int crc;
+
+  if (len > MODBUS_MAX_LEN - 2)
+    len = MODBUS_MAX_LEN - 2;
+  memcpy (mb_in, msg, (size_t)len);
+  crc = modbus_CRC (mb_in, (unsigned int)len, INIT_CRC_SEED);
+  mb_in[len] = (unsigned char)(crc & 0xFF);
+  mb_in[len + 1] = (unsigned char)(crc >> 8);
+  mb_in_len = (unsigned int)len + 2;
+  mb_in_next = 0;
+  mb_rx_wait = char_cyc (U2BRG, U2MODEbits.BRGH);
+  mb_out_len = 0;
+  host_modbus_done_us = 0;
+}
+
+int host_modbus_reply (unsigned char *buf, int max)
+{
+  int n;
+
+  if (started)
+    mb_take ();
+  n = ((int)mb_out_len < max) ? (int)mb_out_len : max;
+  memcpy (buf, mb_out, (size_t)n);
+  return n;
+}
+
+static void bk_step (unsigned long cyc)
+{
+  if (started)
+    bk_take ();
+  if (bk_sent >= bk_len)
+    return;
+  if (bk_wait > cyc)
+  {
+    bk_wait -= cyc;
+    return;
+  }
+  if (U1STAbits.URXDA)
+    U1STAbits.OERR = 1;               /* Last one never read */
+  U1RXREG = bk_out[bk_sent++];
+  U1STAbits.URXDA = 1;
+  IFS0bits.U1RXIF = 1;
+  bk_wait = char_cyc (U1BRG, U1MODEbits.BRGH);
+}
+
+static void mb_rx_step (unsigned long cyc)
+{
+  if (mb_in_next >= mb_in_len)
+    return;
+  if (mb_rx_wait > cyc)
+  {
+    mb_rx_wait -= cyc;
+    return;
+  }
+  if (U2STAbits.URXDA)
+    U2STAbits.OERR = 1;
+  U2RXREG = mb_in[mb_in_next++];
+  U2STAbits.URXDA = 1;
+  IFS1bits.U2RXIF = 1;
+  if (mb_in_next == mb_in_len)
+    host_modbus_rx_us = host_now_us ();
+  mb_rx_wait = char_cyc (U2BRG, U2MODEbits.BRGH);
+}
+
+/* DMA1 moves a character into the transmitter each character time; the
+   block done interrupt comes as the last one goes in, TRMT one character
+   later. */
+
+static void mb_tx_step (unsigned long cyc)
+{
+  if (!tx_busy && DMA1CONbits.CHEN && DMA1REQbits.FORCE)
+  {
+    DMA1REQbits.FORCE = 0;
+    tx_busy = 1;
+    dma_next = 0;
+    dma_count = DMA1CNT + 1;
+    tx_wait = 0;
+    host_modbus_tx_us = host_now_us ();
+  }
+  if (!tx_busy)
+  {
+    U2STAbits.TRMT = 1;
+    return;
+  }
+  U2STAbits.TRMT = 0;
+  if (tx_wait > cyc)
+  {
+    tx_wait -= cyc;
+    return;
+  }
+  tx_wait = char_cyc (U2BRG, U2MODEbits.BRGH);
+  if (DMA1CONbits.CHEN && (dma_next < dma_count))
+  {
+    if (mb_out_len < sizeof mb_out)
+      mb_out[mb_out_len++] = modbus_tx_buff[dma_next];
+    if (++dma_next == dma_count)
+    {
+      DMA1CONbits.CHEN = 0;           /* One-shot block done */
+      IFS0bits.DMA1IF = 1;
+    }
+    return;
+  }
+  tx_busy = 0;                        /* Last character is out */
+  U2STAbits.TRMT = 1;
+  host_modbus_done_us = host_now_us ();
+  if (U2STAbits.UTXISEL0 && !U2STAbits.UTXISEL1)
+    IFS1bits.U2TXIF = 1;
+}
+
+void host_uart_step (unsigned long cyc)
+{
+  bk_step (cyc);
+  if (started)
+    mb_take ();
+  mb_rx_step (cyc);
+  mb_tx_step (cyc);
+}
@@ -0,0 +1,196 @@
+/*****************************************************************************
+ *
+ *   t_arrive.c -- IDLE truck arrival, the T3 arrival watch (arrive_watch())
+ *                 against polling the channels on every main loop pass as
+ *                 truck_idle() did before it.  The whole unit runs,
+ *                 fw_main() from power-up as in t_classify; the polling
+ *                 run is the same firmware with arrive_watch() kept from
+ *                 arming, so truck_idle() takes its full path each pass.
+ *
+ *                 Each way the unit is left in IDLE for IDLE_MS and the
+ *                 main loop passes (through mbrJournalScan(), which ends
+ *                 each one) and the time spent in read_ADC() are counted;
+ *                 then a truck is connected NCONN times, at a random
+ *                 point each time, and the milliseconds from the plug to
+ *                 leaving IDLE are taken.  With the watch the unit must
+ *                 still leave IDLE within a scan period and a confirming
+ *                 pass, with nearly all of the polling's read_ADC() time
+ *                 given back to the main loop.
+ *
+ *****************************************************************************/
+#include "common.h"
+#include <stdlib.h>
+
+extern int fw_main (void);
+extern void __real_mbrJournalScan (void);
+extern void __real_arrive_watch (void);
+extern char __real_read_ADC (void);
+
+#define IDLE_MS    10000UL
+#define NCONN      20
+#define WATCH_MS   30UL                /* 8ms scan, ARRIVE_POLL re-poll slack */
+
+typedef enum { S_BOOT, S_SETTLE, S_IDLE, S_WAIT, S_PLUGGED, S_LEAVE,
+               S_DONE } STEP;
+
+static const unsigned long step_limit[] = { 60000, 3000, IDLE_MS + 1000,
+                                            1000, 1000, 40000 };
+
+typedef struct
+{
+  unsigned long passes;               /* Main loop passes in IDLE_MS */
+  unsigned long long adc_us;          /* ... and time in read_ADC() */
+  unsigned long lat[NCONN];           /* Plug to leaving IDLE, ms */
+  unsigned long worst, sum;
+} WAY;
+
+static WAY way[2];                    /* Arrival watch, polling */
+static int polling;
+static STEP step;
+static unsigned long step_ms, wait_ms;
+static unsigned long passes, passes0;
+static unsigned long long adc_us, adc0;
+static int conn;
+
+static void next (STEP s)
+{
+  step = s;
+  step_ms = 0;
+}
+
+static void finish (void)
+{
+  int w;
+
+  printf ("\n%-14s %12s %16s %10s %10s\n", "", "passes/s", "read_ADC ms/s",
+          "mean ms", "worst ms");
+  for (w = 0; w < 2; w++)
+    printf ("%-14s %12lu %16.1f %10.1f %10lu\n",
+            w ? "polling" : "arrival watch",
+            way[w].passes / (IDLE_MS / 1000),
+            (double)way[w].adc_us / IDLE_MS, (double)way[w].sum / NCONN,
+            way[w].worst);
+  fflush (stdout);
+  exit (host_done ("arrive"));
+}
+
+void __wrap_mbrJournalScan (void)
+{
+  __real_mbrJournalScan ();
+  passes++;
+}
+
+void __wrap_arrive_watch (void)
+{
+  if (!polling)
+    __real_arrive_watch ();
+}
+
+char __wrap_read_ADC (void)
+{
+  unsigned long long t0 = host_now_us ();
+  char sts = __real_read_ADC ();
+
+  adc_us += host_now_us () - t0;
+  return sts;
+}
+
+static void script (void)
+{
+  WAY *w = &way[polling];
+
+  step_ms++;
+  switch (step)
+  {
+    case S_BOOT:
+      if (modbus_state != READY)
+        next (S_SETTLE);
+      break;
+
+    case S_SETTLE:
+      if ((step_ms < 2000) || (main_state != IDLE))
+        break;
+      HOST_CHECK (iambroke == 0);
+      HOST_CHECK (arrive_state == (polling ? ARRIVE_OFF : ARRIVE_ARMED));
+      passes0 = passes;
+      adc0 = adc_us;
+      next (S_IDLE);
+      break;
+
+    case S_IDLE:
+      if (step_ms < IDLE_MS)
+        break;
+      HOST_CHECK (main_state == IDLE);
+      w->passes = passes - passes0;
+      w->adc_us = adc_us - adc0;
+      wait_ms = 200 + (unsigned long)(rand () % 300);
+      next (S_WAIT);
+      break;
+
+    case S_WAIT:                      /* A random time into IDLE */
+      if (step_ms < wait_ms)
+        break;
+      host_truck_probes = 0xFF;
+      next (S_PLUGGED);
+      break;
+
+    case S_PLUGGED:
+      if (main_state == IDLE)
+        break;
+      w->lat[conn] = step_ms;
+      w->sum += step_ms;
+      if (step_ms > w->worst)
+        w->worst = step_ms;
+      host_truck_probes = 0;
+      next (S_LEAVE);
+      break;
+
+    case S_LEAVE:
+      if ((main_state != IDLE) || !(StatusA & STSA_IDLE) || (step_ms < 2000))
+        break;
+      if (++conn < NCONN)
+      {
+        wait_ms = 200 + (unsigned long)(rand () % 300);
+        next (S_WAIT);
+        break;
+      }
+      conn = 0;
+      if (!polling)
+      {
+        polling = 1;                  /* Disarm; truck_idle() re-polls */
+        arrive_state = ARRIVE_OFF;
+        next (S_SETTLE);
+        break;
+      }
+      HOST_CHECK (way[0].worst <= WATCH_MS);
+      HOST_CHECK (way[0].passes > way[1].passes);
+      HOST_CHECK (way[0].adc_us * 20 < way[1].adc_us);
+      next (S_DONE);
+      finish ();
+      break;
+
+    default:
+      break;
+  }
+  if ((step < S_DONE) && (step_ms > step_limit[step]))
+  {
+    fprintf (stderr, "%s, connection %d, step %d: no progress in %lu ms"
+             " (state %d, StatusA %04X)\n", polling ? "polling" : "watch",
+             conn, (int)step, step_limit[step], (int)main_state, StatusA);
+    host_fails++;
+    finish ();
+  }
+  if (host_fails)
+    finish ();
+}
+
+int main (void)
+{
+  srand (27);
+  host_i2c_reset ();
+  OSCCONbits.COSC = 3;                /* Primary oscillator with PLL ... */
+  OSCCONbits.LOCK = 1;                /* ... locked */
+  host_ms_hook = script;
+  fw_main ();
+  return 1;                           /* Not reached */
+}
@@ -0,0 +1,326 @@
+/*****************************************************************************
+ *
+ *   t_burst.c -- the status burst (function 0x63, mbrStatusBurst()) against
+ *                the register ranges a TAS otherwise polls for the same
+ *                state, the whole unit running, fw_main() from power-up as
+ *                in t_modbus, with a 2-wire truck on and permitting for a
+ *                couple of seconds, so nothing is changing.
+ *
+ *                The burst is decoded field by field and each field held
+ *                to the register it stands for, read over the line just
+ *                before: 100-10F, 110-11A, 06D-06E and 120.  The layout
+ *                version and length must be STS_BURST_VER and
+ *                STS_BURST_SIZE.
+ *
+ *                Then the bus time: at each baud rate, with the default
+ *                turnaround delay (SysParm.ModBusRespWait) and with none,
+ *                one bay is polled NPOLL times each way, the four ranges
+ *                and the one burst.  A transaction takes from the request
+ *                going out to the last character of the response and
+ *                the t3.5 quiet after it (as t_modbus takes it); the
+ *                table gives the transactions and milliseconds one bay
+ *                takes and the bays a second one line can poll.  The
+ *                burst must be the quicker at every rate.
+ *
+ *****************************************************************************/
+#include "common.h"
+
+extern int fw_main (void);
+
+#define NPOLL      10
+#define T5_NS      3200               /* Timer 5 tick */
+#define NMSG       4                  /* Most transactions a bay takes */
+
+typedef struct
+{
+  unsigned char msg[6];
+  int           len;
+} MSG;
+
+/* Each way of polling a bay, the requests in order */
+
+static const struct
+{
+  const char *name;
+  MSG         msg[NMSG];
+  int         nmsg;
+} way[] =
+{
+  { "ranges", { { { 1, 0x03, 0x01, 0x00, 0x00, 0x10 }, 6 },
+                { { 1, 0x03, 0x01, 0x10, 0x00, 0x0B }, 6 },
+                { { 1, 0x03, 0x00, 0x6D, 0x00, 0x02 }, 6 },
+                { { 1, 0x03, 0x01, 0x20, 0x00, 0x01 }, 6 } }, 4 },
+  { "burst",  { { { 1, READ_STATUS_BURST }, 2 } }, 1 },
+};
+#define NWAY    (int)(sizeof way / sizeof way[0])
+
+static const struct
+{
+  BAUD_RATE     baud;
+  unsigned long bps;
+} rate[] =
+{
+  { B09600,   9600 }, { B19200,  19200 }, { B38400,  38400 },
+  { B115200, 115200 },
+};
+#define NRATE   (int)(sizeof rate / sizeof rate[0])
+
+static const unsigned int wait[] = { 100, 0 };    /* ModBusRespWait, ms */
+#define NWAIT   (int)(sizeof wait / sizeof wait[0])
+
+typedef enum { S_BOOT, S_SETTLE, S_CONNECT, S_HOLD, S_DECODE, S_POLL,
+               S_DONE } STEP;
+
+static const unsigned long step_limit[] = { 60000, 3000, 20000, 3000, 1000,
+                                            1000 };
+
+static STEP step;
+static unsigned long step_ms;
+static int cur, w, k, m, n;           /* Rate, delay, way, request, poll */
+static unsigned long long sent_us;
+static unsigned long long bay_us[NRATE][NWAIT][NWAY];
+static unsigned int reg[0x130];       /* Registers read for the decode */
+
+static void next (STEP s)
+{
+  step = s;
+  step_ms = 0;
+}
+
+static double bay_ms (int r, int v, int x)
+{
+  return (double)bay_us[r][v][x] / NPOLL / 1000;
+}
+
+static void finish (void)
+{
+  int r, v, x;
+
+  printf ("\none bay %8s", "");
+  for (v = 0; v < NWAIT; v++)
+    printf ("   %3u ms turnaround delay     ", wait[v]);
+  printf ("\n%8s %6s", "baud", "");
+  for (v = 0; v < NWAIT; v++)
+    printf (" %5s %10s %7s", "polls", "ms/bay", "bays/s"),
+    printf (" %5s", "");
+  printf ("\n");
+  for (r = 0; r < NRATE; r++)
+    for (x = 0; x < NWAY; x++)
+    {
+      printf ("%8lu %-6s", rate[r].bps, way[x].name);
+      for (v = 0; v < NWAIT; v++)
+        printf (" %5d %10.1f %7.1f %5s", way[x].nmsg, bay_ms (r, v, x),
+                bay_ms (r, v, x) ? 1000 / bay_ms (r, v, x) : 0, "");
+      printf ("\n");
+    }
+  fflush (stdout);
+  exit (host_done ("burst"));
+}
+
+static void set_rate (int r, int v)
+{
+  SysParm.ModBusRespWait = wait[v];
+  SysParm.ModBusBaud = rate[r].baud;
+  modbus_baud_override ();
+  modbus_init ();
+  HOST_CHECK (modbus_baud == rate[r].baud);
+}
+
+static void send (void)
+{
+  host_modbus_send (way[k].msg[m].msg, way[k].msg[m].len);
+  sent_us = host_now_us ();
+}
+
+static int answered (void)
+{
+  return host_modbus_done_us && (modbus_state == READY);
+}
+
+/* The response to the request just sent, checked; its length */
+
+static int reply (unsigned char *r)
+{
+  int len = host_modbus_reply (r, MODBUS_MAX_LEN);
+  const unsigned char *q = way[k].msg[m].msg;
+  int i;
+
+  HOST_CHECK (len >= 5);
+  HOST_CHECK (modbus_CRC (r, (unsigned int)len - 2, INIT_CRC_SEED)
+              == (unsigned int)(r[len - 2] | (r[len - 1] << 8)));
+  HOST_CHECK ((r[0] == 1) && (r[1] == q[1]));
+  if (q[1] == 0x03)
+  {
+    HOST_CHECK (len == 5 + 2 * q[5]);
+    for (i = 0; i < q[5]; i++)
+      reg[((q[2] << 8) | q[3]) + i] = (unsigned int)((r[3 + 2 * i] << 8)
+                                                     | r[4 + 2 * i]);
+  }
+  return len;
+}
+
+static unsigned int be16 (const unsigned char *p)
+{
+  return (unsigned int)((p[0] << 8) | p[1]);
+}
+
+/* The burst, field by field, against the registers just read */
+
+static void decode (const unsigned char *r, int len)
+{
+  const unsigned char *b = &r[2];     /* Address, function, then the data */
+  unsigned long t;
+  int i;
+
+  HOST_CHECK (len == 2 + STS_BURST_SIZE + 2);
+  HOST_CHECK (b[0] == STS_BURST_VER);
+  t = ((unsigned long)be16 (&b[1]) << 16) | be16 (&b[3]);
+  HOST_CHECK (t >= (((unsigned long)reg[0x100] << 16) | reg[0x101]));
+  HOST_CHECK (t <= (((unsigned long)reg[0x100] << 16) | reg[0x101]) + 2);
+  for (i = 0; i < 4; i++)
+    HOST_CHECK (be16 (&b[5 + 2 * i]) == reg[0x104 + i]);
+  HOST_CHECK (be16 (&b[13]) == reg[0x11A]);
+  HOST_CHECK (b[15] == reg[0x108]);
+  HOST_CHECK (b[16] == reg[0x109]);
+  for (i = 0; i < 3; i++)
+    HOST_CHECK (be16 (&b[17 + 2 * i]) == reg[0x10A + i]);
+  for (i = 0; i < 8; i++)
+    HOST_CHECK (be16 (&b[23 + 2 * i]) == reg[0x10D + i]);
+  HOST_CHECK (be16 (&b[39]) == reg[0x115]);
+  HOST_CHECK (b[41] == reg[0x06D]);
+  HOST_CHECK (be16 (&b[43]) == reg[0x06E]);
+  HOST_CHECK (b[45] == ((reg[0x120] == 0xFFFF) ? 0xFF : reg[0x120]));
+  HOST_CHECK (b[15] == ACTIVE);
+  HOST_CHECK (be16 (&b[5]) & STSA_PERMIT);
+  for (i = 0; i < 8; i++)
+    HOST_CHECK (b[23 + i] == P_DRY);
+  printf ("\nburst v%u, %d bytes: StatusA %04X, main %u truck %u,"
+          " probes", b[0], len - 4, be16 (&b[5]), b[15], b[16]);
+  for (i = 0; i < 16; i++)
+    printf (" %u", b[23 + i]);
+  printf (", compartments %u, journal %u/%u\n", b[45], be16 (&b[46]),
+          b[48]);
+}
+
+/* Next request: the next of this bay's, the next poll, way, delay or
+   rate */
+
+static void advance_poll (void)
+{
+  if (++m < way[k].nmsg)
+    return;
+  m = 0;
+  if (++n < NPOLL)
+    return;
+  n = 0;
+  if (++k < NWAY)
+    return;
+  k = 0;
+  if (++w == NWAIT)
+  {
+    w = 0;
+    HOST_CHECK (bay_us[cur][0][1] < bay_us[cur][0][0]);
+    HOST_CHECK (bay_us[cur][NWAIT - 1][1] < bay_us[cur][NWAIT - 1][0]);
+    if (++cur == NRATE)
+    {
+      next (S_DONE);
+      finish ();
+    }
+  }
+  set_rate (cur, w);
+}
+
+static void script (void)
+{
+  unsigned char r[MODBUS_MAX_LEN];
+  unsigned long long t35;
+  int len;
+
+  step_ms++;
+  switch (step)
+  {
+    case S_BOOT:
+      if (modbus_state != READY)
+        next (S_SETTLE);
+      break;
+
+    case S_SETTLE:
+      if ((step_ms < 2000) || (main_state != IDLE))
+        break;
+      HOST_CHECK (iambroke == 0);
+      host_truck_probes = 0xFF;
+      next (S_CONNECT);
+      break;
+
+    case S_CONNECT:
+      if ((main_state != ACTIVE) || !(StatusA & STSA_PERMIT))
+        break;
+      next (S_HOLD);
+      break;
+
+    case S_HOLD:                      /* Probe states settled */
+      if (step_ms < 2000)
+        break;
+      k = m = 0;                      /* The ranges, then the burst */
+      send ();
+      next (S_DECODE);
+      break;
+
+    case S_DECODE:
+      if (!answered ())
+        break;
+      len = reply (r);
+      if (k == 0)
+      {
+        if (++m == way[0].nmsg)
+        {
+          k = 1;
+          m = 0;
+        }
+      }
+      else
+      {
+        decode (r, len);
+        k = m = 0;
+        set_rate (cur, w);
+        next (S_POLL);
+      }
+      send ();
+      break;
+
+    case S_POLL:
+      if (!answered ())
+        break;
+      (void)reply (r);
+      t35 = (unsigned long long)modbus_eom_time * T5_NS / 1000;
+      bay_us[cur][w][k] += host_modbus_done_us - sent_us + t35;
+      advance_poll ();
+      send ();
+      next (S_POLL);
+      break;
+
+    default:
+      break;
+  }
+  if ((step < S_DONE) && (step_ms > step_limit[step]))
+  {
+    fprintf (stderr, "%lu baud, %u ms delay, %s request %d, step %d: no"
+             " progress in %lu ms (modbus_state %d)\n", rate[cur].bps,
+             wait[w], way[k].name, m, (int)step, step_limit[step],
+             (int)modbus_state);
+    host_fails++;
+    finish ();
+  }
+  if (host_fails)
+    finish ();
+}
+
+int main (void)
+{
+  host_i2c_reset ();
+  OSCCONbits.COSC = 3;                /* Primary oscillator with PLL ... */
+  OSCCONbits.LOCK = 1;                /* ... locked */
+  host_ms_hook = script;
+  fw_main ();
+  return 1;                           /* Not reached */
+}
@@ -0,0 +1,85 @@
+/*****************************************************************************
+ *
+ *   t_calendar.c -- time_tick() calendar stepping against gmtime(), and
+ *                   the TIME_SYNC_SECS re-read of the DS1371 count.
+ *
+ *****************************************************************************/
+#include "common.h"
+#include <time.h>
+
+static int same_as_libc (void)
+{
+  struct tm tm;
+  time_t t = (time_t)present_time;
+
+  gmtime_r (&t, &tm);
+  return (second == tm.tm_sec) && (minute == tm.tm_min)
+      && (hour == tm.tm_hour) && (day == tm.tm_mday)
+      && (month == tm.tm_mon + 1) && (year == (unsigned)tm.tm_year + 1900);
+}
+
+/* Step one second at a time from (y,m,d,h,mi) for n seconds, checking
+   every step; the calendar is converted once at the start only. */
+
+static void step_from (unsigned y, unsigned m, unsigned d, unsigned h,
+                       unsigned mi, unsigned long n)
+{
+  present_time = Greg_to_UNIX (y, m, d, h, mi);
+  HOST_CHECK (present_time != 0);
+  UNIX_to_Greg ();
+  HOST_CHECK (same_as_libc ());
+  while (n--)
+  {
+    time_tick ();
+    if (!same_as_libc ())
+    {
+      fprintf (stderr, "stepped to %lu: %u-%02u-%02u %02u:%02u:%02u\n",
+               present_time, year, month, day, hour, minute, second);
+      HOST_CHECK (same_as_libc ());
+      return;
+    }
+  }
+}
+
+int main (void)
+{
+  unsigned long s, t0;
+
+  host_i2c_reset ();                  /* RTC reads 0: too old to adopt */
+
+  step_from (2023, 12, 31, 23, 58, 240);
+  step_from (2024, 2, 28, 23, 59, 86400 + 120);   /* Through the 29th */
+  step_from (2025, 2, 28, 23, 59, 120);
+  step_from (2000, 2, 28, 23, 59, 86400 + 120);
+  step_from (2038, 1, 19, 3, 13, 120);            /* Past 2^31 */
+  step_from (2099, 12, 31, 23, 59, 60);
+
+  /* Four years, one leap cycle, second by second; check each minute */
+  present_time = Greg_to_UNIX (2027, 1, 1, 0, 0);
+  UNIX_to_Greg ();
+  for (s = 0; s < 1461UL * 86400; s++)
+  {
+    time_tick ();
+    if (second == 0 && !same_as_libc ())
+    {
+      HOST_CHECK (same_as_libc ());
+      break;
+    }
+  }
+
+  /* The RTC count replaces the tick count within TIME_SYNC_SECS, and the
+     calendar follows the jump instead of stepping */
+  t0 = Greg_to_UNIX (2026, 10, 19, 12, 0);
+  present_time = t0;
+  UNIX_to_Greg ();
+  host_rtc_seconds = t0 + 3600 - (unsigned long)(host_now_us () / 1000000);
+  for (s = 0; (s < TIME_SYNC_SECS) && (present_time < t0 + 3600); s++)
+    time_tick ();
+  HOST_CHECK (s < TIME_SYNC_SECS);
+  HOST_CHECK (present_time - t0 - 3600 < 2);     /* Jumped, not stepped */
+  UNIX_to_Greg ();
+  HOST_CHECK (same_as_libc ());
+  HOST_CHECK (hour == 13);
+
+  return host_done ("calendar");
+}
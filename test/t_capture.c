@@ -0,0 +1,148 @@
+/*****************************************************************************
+ *
+ *   t_capture.c -- probe waveform capture: the ring around a trigger and
+ *                  the capture_read() delta encoding, decoded back and
+ *                  compared scan for scan, across buffer splits.
+ *
+ *****************************************************************************/
+#include "common.h"
+#include <stdlib.h>
+
+#define SCANS   200                   /* Fed in; the ring keeps CAP_DEPTH */
+
+static unsigned int wave[SCANS][MAX_CHAN];
+
+static void make_wave (void)
+{
+  int s, c, v;
+
+  srand (7);
+  for (c = 0; c < MAX_CHAN; c++)
+  {
+    v = 2048;
+    for (s = 0; s < SCANS; s++)
+    {
+      switch (rand () % 8)
+      {
+        case 0:  v = rand () & 0xFFF; break;           /* Absolute jump */
+        case 1:  v += 63; break;                       /* Edges of a delta */
+        case 2:  v -= 64; break;
+        case 3:  v += 64; break;                       /* Just outside */
+        default: v += (rand () % 21) - 10; break;
+      }
+      v &= 0xFFF;
+      wave[s][c] = (unsigned int)v;
+    }
+  }
+}
+
+/* Decode n bytes onto out[], continuing from *last; returns scans */
+
+static int decode (const unsigned char *buf, int n, unsigned int *out,
+                   unsigned int *last)
+{
+  int i = 0, k = 0;
+  int d;
+
+  while (i < n)
+  {
+    if (buf[i] & 0x80)
+    {
+      d = buf[i] & 0x7F;
+      if (d & 0x40)
+        d -= 0x80;
+      *last = (unsigned int)((int)*last + d);
+      i++;
+    }
+    else
+    {
+      *last = ((unsigned int)buf[i] << 8) | buf[i + 1];
+      i += 2;
+    }
+    out[k++] = *last;
+  }
+  return k;
+}
+
+/* Read one channel back in max-byte pieces, resuming at the next scan */
+
+static void read_back (unsigned char chan, unsigned char max,
+                       unsigned int *out, int *scans)
+{
+  unsigned char buf[128];
+  unsigned char n, cnt, start = 0;
+  unsigned int last = 0;
+
+  *scans = 0;
+  for (;;)
+  {
+    n = capture_read (chan, start, buf, max, &cnt);
+    if (!n)
+      break;
+    HOST_CHECK (n <= max);
+    HOST_CHECK ((buf[0] & 0x80) == 0);  /* Each piece starts absolute */
+    HOST_CHECK (decode (buf, n, out + *scans, &last) == cnt);
+    *scans += cnt;
+    start = (unsigned char)(start + cnt);
+  }
+}
+
+int main (void)
+{
+  unsigned char st[7];
+  unsigned int out[CAP_DEPTH + 8];
+  int s, c, scans, trig;
+  static const unsigned char sizes[] = { 2, 3, 13, 64, 120 };
+  unsigned int k;
+
+  make_wave ();
+  start_point = 0;
+  arrive_state = ARRIVE_SEEN;         /* Keep the probe queue out of it */
+
+  capture_arm (CAP_TRIG_WET);
+  capture_trigger (CAP_TRIG_ECHO);    /* Not in the mask: ignored */
+  trig = SCANS - CAP_POST;
+  for (s = 0; s < SCANS; s++)
+  {
+    if (s == trig)
+    {
+      capture_trigger (CAP_TRIG_WET);
+      HOST_CHECK (capture_status (st) == 7);
+      HOST_CHECK (st[0] == CAP_POSTTRIG);
+    }
+    memcpy (result_ptr, wave[s], sizeof wave[s]);
+    dma_result_flag = 1;
+    read_probes ();
+  }
+
+  (void)capture_status (st);
+  HOST_CHECK (st[0] == CAP_HELD);
+  HOST_CHECK (st[2] == CAP_TRIG_WET);
+  HOST_CHECK (st[3] == CAP_DEPTH);
+
+  for (k = 0; k < sizeof sizes; k++)
+    for (c = 0; c < MAX_CHAN; c++)
+    {
+      memset (out, 0, sizeof out);
+      read_back ((unsigned char)c, sizes[k], out, &scans);
+      HOST_CHECK (scans == CAP_DEPTH);
+      for (s = 0; s < CAP_DEPTH; s++)
+        if (out[s] != wave[SCANS - CAP_DEPTH + s][c])
+        {
+          fprintf (stderr, "chan %d scan %d max %u: %u, want %u\n", c, s,
+                   sizes[k], out[s], wave[SCANS - CAP_DEPTH + s][c]);
+          HOST_CHECK (0);
+          break;
+        }
+    }
+
+  /* Held means held: more scans don't move it, a re-arm drops it */
+  dma_result_flag = 1;
+  read_probes ();
+  HOST_CHECK (capture_read (0, 0, (unsigned char *)out, 2, st) == 2);
+  HOST_CHECK (((unsigned char *)out)[1] == (wave[SCANS - CAP_DEPTH][0] & 0xFF));
+  capture_arm (0);
+  HOST_CHECK (capture_read (0, 0, (unsigned char *)out, 2, st) == 0);
+
+  return host_done ("capture");
+}
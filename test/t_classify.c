@@ -0,0 +1,159 @@
+/*****************************************************************************
+ *
+ *   t_classify.c -- 2-wire probe classification, the parallel classifiers
+ *                   (probe_class_check()) against the serial OPTIC2 then
+ *                   THERMIS sequence alone.  The whole unit runs, fw_main()
+ *                   from power-up as in t_scenario; each truck below is
+ *                   connected twice, once as the firmware is and once with
+ *                   the classification window shut the moment it opens
+ *                   (the serial tests only), and disconnected again.
+ *
+ *                   For each the type decided and the time from entering
+ *                   ACQUIRE to the decision are read back from the
+ *                   connection's Session Record (Probe, ProbeMs).  Both
+ *                   ways must decide the type the truck has; the parallel
+ *                   one no later than the serial one give or take a scan
+ *                   period; and the window must not be left open once
+ *                   the type is decided, whichever way it was.
+ *
+ *****************************************************************************/
+#include "common.h"
+
+extern int fw_main (void);
+
+typedef struct
+{
+  const char   *name;
+  unsigned char probes, wet, therm;
+  ACQUIRE_STATE want;
+} TRUCK;
+
+static const TRUCK truck[] =
+{
+  { "8 optic, dry",          0xFF, 0x00, 0x00, OPTIC_2 },
+  { "6 optic, dry",          0xFC, 0x00, 0x00, OPTIC_2 },
+  { "8 optic, 2 wet",        0xFF, 0x30, 0x00, OPTIC_2 },
+  { "6 thermistor",          0xFC, 0x00, 0xFC, THERMAL },
+  { "8 thermistor",          0xFF, 0x00, 0xFF, THERMAL },
+};
+#define NTRUCK  (int)(sizeof truck / sizeof truck[0])
+
+#define SLACK_MS  50                  /* Parallel may be this much later */
+
+typedef enum { S_BOOT, S_SETTLE, S_CONNECT, S_LEAVE, S_DONE } STEP;
+
+static const unsigned long step_limit[] = { 60000, 3000, 30000, 40000 };
+
+static STEP step;
+static unsigned long step_ms;
+static int cur, serial;               /* Truck, and the serial run of it */
+static unsigned long took[NTRUCK][2];
+static ACQUIRE_STATE got[NTRUCK][2];
+static int open_after;                /* Window open after the decision */
+
+static void next (STEP s)
+{
+  step = s;
+  step_ms = 0;
+}
+
+static void finish (void)
+{
+  int i;
+
+  printf ("\n%-18s %10s %10s %10s %10s\n", "truck", "parallel", "ms",
+          "serial", "ms");
+  for (i = 0; i < NTRUCK; i++)
+    printf ("%-18s %10s %10lu %10s %10lu\n", truck[i].name,
+            (got[i][0] == OPTIC_2) ? "optic" : (got[i][0] == THERMAL) ? "thermistor" : "-",
+            took[i][0],
+            (got[i][1] == OPTIC_2) ? "optic" : (got[i][1] == THERMAL) ? "thermistor" : "-",
+            took[i][1]);
+  fflush (stdout);
+  exit (host_done ("classify"));
+}
+
+static void script (void)
+{
+  E2SESREC rec;
+
+  step_ms++;
+  if (serial && (class_window == CLASS_OPEN))
+    class_window = CLASS_DONE;        /* Serial tests only */
+  switch (step)
+  {
+    case S_BOOT:
+      if (modbus_state != READY)
+        next (S_SETTLE);
+      break;
+
+    case S_SETTLE:
+      if ((step_ms < 2000) || (main_state != IDLE))
+        break;
+      HOST_CHECK (iambroke == 0);
+      host_truck_probes = truck[cur].probes;
+      host_truck_wet = truck[cur].wet;
+      host_truck_therm = truck[cur].therm;
+      next (S_CONNECT);
+      break;
+
+    case S_CONNECT:
+      if (main_state != ACTIVE)
+        break;
+      open_after += (class_window == CLASS_OPEN);
+      host_truck_probes = 0;
+      host_truck_wet = 0;
+      host_truck_therm = 0;
+      next (S_LEAVE);
+      break;
+
+    case S_LEAVE:
+      if ((main_state != IDLE) || !(StatusA & STSA_IDLE))
+        break;
+      HOST_CHECK (nvSesGet (0, &rec) == 0);
+      HOST_CHECK (rec.Flags & SES_PROBE);
+      took[cur][serial] = rec.ProbeMs;
+      got[cur][serial] = (ACQUIRE_STATE)rec.Probe;
+      if (serial)
+        cur++;
+      serial = !serial;
+      if (cur == NTRUCK)
+      {
+        for (cur = 0; cur < NTRUCK; cur++)
+        {
+          HOST_CHECK (got[cur][0] == truck[cur].want);
+          HOST_CHECK (got[cur][1] == truck[cur].want);
+          HOST_CHECK (took[cur][0] <= took[cur][1] + SLACK_MS);
+        }
+        HOST_CHECK (open_after == 0);
+        next (S_DONE);
+        finish ();
+      }
+      next (S_SETTLE);
+      break;
+
+    default:
+      break;
+  }
+  if ((step < S_DONE) && (step_ms > step_limit[step]))
+  {
+    fprintf (stderr, "truck %d%s, step %d: no progress in %lu ms (state %d,"
+             " acquire %d, StatusA %04X)\n", cur, serial ? " serial" : "",
+             (int)step, step_limit[step], (int)main_state,
+             (int)acquire_state, StatusA);
+    host_fails++;
+    finish ();
+  }
+  if (host_fails)
+    finish ();
+}
+
+int main (void)
+{
+  host_i2c_reset ();
+  OSCCONbits.COSC = 3;                /* Primary oscillator with PLL ... */
+  OSCCONbits.LOCK = 1;                /* ... locked */
+  host_ms_hook = script;
+  fw_main ();
+  return 1;                           /* Not reached */
+}
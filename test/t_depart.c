@@ -0,0 +1,274 @@
+/*****************************************************************************
+ *
+ *   t_depart.c -- the departure detector (depart_poll(), com_two.c)
+ *                 replayed against recorded channel traces, the whole unit
+ *                 running, fw_main() from power-up as in t_scenario.
+ *
+ *                 Each trace starts with a truck of eight dry 2-wire
+ *                 optic probes connected and permitting, then plays its
+ *                 events on the board model (which probes are on the
+ *                 connector, which of them are wet) at their times:
+ *
+ *                   disconnect  the truck goes
+ *                   wet, gone   probe 5 wet (permit dropped), then it goes
+ *                   flaky plug  the plug drops out for 40 to 300 ms at a
+ *                               time, and stays
+ *                   splash      probes go wet for 100 ms to 2 s, and the
+ *                               truck stays
+ *
+ *                 A trace whose truck goes must bring the unit back to
+ *                 IDLE, and the times from the plug coming out to GONE
+ *                 and to IDLE are taken, with depart_latency (register
+ *                 8E) alongside; one whose truck stays must never see
+ *                 IDLE (a false gone).  The longest main loop pass while
+ *                 ACTIVE (passes end in mbrJournalScan()) is taken as
+ *                 well; GONE's own logging is not the detector's.
+ *
+ *                 All traces are run twice: with the default threshold
+ *                 (SysParm.DepartThresh 0, DEPART_THRESH), which asks for
+ *                 every piece of evidence the blocking check_truck_gone()
+ *                 took, and with DEP_LOW, enough without the smart probe
+ *                 short test.  Neither may call a staying truck gone, and
+ *                 no pass may hold the main loop for the 10 ms settle
+ *                 the old check_truck_gone() spent in DelayMS().
+ *
+ *****************************************************************************/
+#include "common.h"
+
+extern int fw_main (void);
+extern void __real_mbrJournalScan (void);
+
+#define DEP_LOW    (DEP_W_OPEN + DEP_W_GROUND + DEP_W_TIM + DEP_W_RAIL)
+#define GONE_MS    5000UL              /* A departure must be seen within */
+#define PASS_MS    10UL                /* The old settle alone */
+
+typedef struct
+{
+  unsigned long ms;                   /* From the permit */
+  unsigned char probes;               /* On the connector */
+  unsigned char wet;                  /* ... of those, wet */
+} EVENT;
+
+typedef struct
+{
+  const char  *name;
+  int          gone;                  /* The truck leaves at the last event */
+  unsigned long end_ms;               /* Trace length after the last event */
+  const EVENT *ev;
+  int          nev;
+} TRACE;
+
+static const EVENT ev_gone[] = { { 500, 0x00, 0x00 } };
+static const EVENT ev_wet_gone[] =
+{
+  { 500, 0xFF, 0x10 }, { 3500, 0x00, 0x00 },
+};
+static const EVENT ev_flaky[] =
+{
+  { 1000, 0x00, 0 }, { 1080, 0xFF, 0 }, { 2500, 0x00, 0 }, { 2650, 0xFF, 0 },
+  { 4000, 0x00, 0 }, { 4300, 0xFF, 0 }, { 6000, 0x00, 0 }, { 6040, 0xFF, 0 },
+  { 6200, 0x00, 0 }, { 6400, 0xFF, 0 }, { 9000, 0x00, 0 }, { 9250, 0xFF, 0 },
+};
+static const EVENT ev_splash[] =
+{
+  { 1000, 0xFF, 0x10 }, { 1100, 0xFF, 0x00 }, { 2000, 0xFF, 0x30 },
+  { 2300, 0xFF, 0x00 }, { 4000, 0xFF, 0x80 }, { 6000, 0xFF, 0x00 },
+  { 8000, 0xFF, 0x04 }, { 8500, 0xFF, 0x00 },
+};
+
+#define N(a)  (int)(sizeof a / sizeof a[0])
+
+static const TRACE trace[] =
+{
+  { "disconnect", 1, GONE_MS, ev_gone, N(ev_gone) },
+  { "wet, gone", 1, GONE_MS, ev_wet_gone, N(ev_wet_gone) },
+  { "flaky plug", 0, 10000, ev_flaky, N(ev_flaky) },
+  { "splash", 0, 10000, ev_splash, N(ev_splash) },
+};
+#define NTRACE  N(trace)
+
+static const unsigned char thresh[] = { 0, DEP_LOW };
+#define NTHRESH N(thresh)
+
+typedef struct
+{
+  unsigned long gone_ms;              /* Plug out to GONE */
+  unsigned long detect_ms;            /* ... and to IDLE */
+  unsigned int  latency;              /* depart_latency then */
+  unsigned long false_gone;
+  unsigned long long worst_us;        /* Longest main loop pass */
+} RESULT;
+
+static RESULT res[NTHRESH][NTRACE];
+
+typedef enum { S_BOOT, S_SETTLE, S_CONNECT, S_REPLAY, S_GONE, S_STAY,
+               S_DONE } STEP;
+
+static const unsigned long step_limit[] = { 60000, 3000, 20000, 60000,
+                                            GONE_MS, 60000 };
+
+static STEP step;
+static unsigned long step_ms;
+static int th, tr, ev;
+static unsigned long long pass_us, worst_us;  /* Pass under way, longest */
+
+static void next (STEP s)
+{
+  step = s;
+  step_ms = 0;
+}
+
+static void finish (void)
+{
+  int t, k;
+
+  printf ("\n%-12s %6s %10s %10s %11s %11s %14s\n", "trace", "thresh",
+          "GONE ms", "IDLE ms", "latency ms", "false gone", "worst pass ms");
+  for (t = 0; t < NTHRESH; t++)
+    for (k = 0; k < NTRACE; k++)
+      printf ("%-12s %6u %10lu %10lu %11u %11lu %14.2f\n", trace[k].name,
+              thresh[t] ? thresh[t] : DEPART_THRESH, res[t][k].gone_ms,
+              res[t][k].detect_ms, res[t][k].latency, res[t][k].false_gone,
+              (double)res[t][k].worst_us / 1000);
+  fflush (stdout);
+  exit (host_done ("depart"));
+}
+
+void __wrap_mbrJournalScan (void)
+{
+  unsigned long long now;
+
+  __real_mbrJournalScan ();
+  now = host_now_us ();
+  if (pass_us && (main_state == ACTIVE) && (now - pass_us > worst_us))
+    worst_us = now - pass_us;
+  pass_us = now;
+}
+
+static int permitted (void)
+{
+  return MAIN_ENABLE && (MainRelaySt == RELAY_CLOSED)
+         && (StatusA & STSA_PERMIT);
+}
+
+static void play (const EVENT *e)
+{
+  host_truck_probes = e->probes;
+  host_truck_wet = e->wet;
+}
+
+static void script (void)
+{
+  const TRACE *t = &trace[tr];
+  RESULT *r = &res[th][tr];
+
+  step_ms++;
+  switch (step)
+  {
+    case S_BOOT:
+      if (modbus_state != READY)
+        next (S_SETTLE);
+      break;
+
+    case S_SETTLE:
+      if ((step_ms < 2000) || (main_state != IDLE) || !(StatusA & STSA_IDLE))
+        break;
+      HOST_CHECK (iambroke == 0);
+      SysParm.DepartThresh = thresh[th];
+      host_truck_probes = 0xFF;
+      host_truck_wet = 0;
+      next (S_CONNECT);
+      break;
+
+    case S_CONNECT:
+      if ((main_state != ACTIVE) || !permitted ())
+        break;
+      ev = 0;
+      worst_us = 0;
+      pass_us = 0;
+      next (S_REPLAY);
+      break;
+
+    case S_REPLAY:
+      if ((main_state == IDLE) && !t->gone)
+      {
+        r->false_gone++;              /* Called gone while it stays */
+        next (S_DONE);
+        break;
+      }
+      if (step_ms < t->ev[ev].ms)
+        break;
+      play (&t->ev[ev]);
+      if (++ev < t->nev)
+        break;
+      next (t->gone ? S_GONE : S_STAY);
+      break;
+
+    case S_GONE:
+      if ((main_state != ACTIVE) && !r->gone_ms)
+        r->gone_ms = step_ms;
+      if (main_state != IDLE)
+        break;
+      r->detect_ms = step_ms;
+      r->latency = depart_latency;
+      r->worst_us = worst_us;
+      next (S_DONE);
+      break;
+
+    case S_STAY:
+      if (main_state == IDLE)
+        r->false_gone++;
+      if ((step_ms < t->end_ms) && (main_state != IDLE))
+        break;
+      r->worst_us = worst_us;
+      host_truck_probes = 0;          /* Now it goes */
+      host_truck_wet = 0;
+      next (S_DONE);
+      break;
+
+    case S_DONE:                      /* Back to IDLE for the next */
+      if (main_state != IDLE)
+        break;
+      if (++tr == NTRACE)
+      {
+        tr = 0;
+        if (++th == NTHRESH)
+        {
+          for (th = 0; th < NTHRESH; th++)
+            for (tr = 0; tr < NTRACE; tr++)
+            {
+              HOST_CHECK (res[th][tr].false_gone == 0);
+              HOST_CHECK (res[th][tr].worst_us < PASS_MS * 1000);
+              if (trace[tr].gone)
+                HOST_CHECK (res[th][tr].gone_ms > 0);
+            }
+          finish ();
+        }
+      }
+      next (S_SETTLE);
+      break;
+
+    default:
+      break;
+  }
+  if ((step < S_DONE) && (step_ms > step_limit[step]))
+  {
+    fprintf (stderr, "%s, thresh %u, step %d: no progress in %lu ms"
+             " (state %d, StatusA %04X)\n", t->name, thresh[th], (int)step,
+             step_limit[step], (int)main_state, StatusA);
+    host_fails++;
+    finish ();
+  }
+  if (host_fails)
+    finish ();
+}
+
+int main (void)
+{
+  host_i2c_reset ();
+  OSCCONbits.COSC = 3;                /* Primary oscillator with PLL ... */
+  OSCCONbits.LOCK = 1;                /* ... locked */
+  host_ms_hook = script;
+  fw_main ();
+  return 1;                           /* Not reached */
+}
@@ -0,0 +1,220 @@
+/*****************************************************************************
+ *
+ *   t_evlog.c -- Event Log ring with its RAM copies (ev_recent[], ev_type[]):
+ *                the same run of Put/Merge/Repeat, with now and then a
+ *                write refused and a TAS read, is done once straight
+ *                through and once with nvLogInit() (a reboot) before every
+ *                event.  The EEPROM must come out the same, past a wrap of
+ *                the ring, and nvLogType()/nvLogAtTime() must agree with
+ *                what is in EEPROM.
+ *
+ *                The straight run also counts its I2C transfers against
+ *                those the log made before the RAM copies: one EEPROM read
+ *                of the newest record per merge, and one per record a
+ *                repeat looks at, worked out here from the EEPROM as it is
+ *                before each event.  The copies must only go back to the
+ *                EEPROM after a refused write, and save transfers overall.
+ *
+ *****************************************************************************/
+#include "common.h"
+#include <stdlib.h>
+
+#define EVENTS  4000
+
+typedef struct
+{
+  unsigned char op;                   /* 0 put, 1 merge, 2 repeat, 3 TAS read */
+  unsigned char fail;                 /* Refuse the EEPROM writes */
+  char type, sub;
+  char info[22];
+  unsigned int deltat;
+  unsigned int step;                  /* Seconds since the one before */
+} EVENT;
+
+static EVENT ev[EVENTS];
+static unsigned char warm[E2LOGCNT * sizeof (E2LOGREC)];
+
+static unsigned long ops_starts;      /* I2C starts making the events */
+static unsigned long ops_reads;       /*  of which EEPROM read transfers */
+static unsigned long old_reads;       /* Record reads without RAM copies */
+static unsigned long fails;           /* Events with writes refused */
+
+static void make_events (void)
+{
+  int i;
+
+  srand (27);
+  for (i = 0; i < EVENTS; i++)
+  {
+    ev[i].op = (unsigned char)((rand () % 20) ? rand () % 3 : 3);
+    ev[i].fail = (rand () % 50) == 0;
+    ev[i].type = (char)(1 + (rand () % 3));
+    ev[i].sub = (char)(1 << (rand () % 3));
+    memset (ev[i].info, 0, sizeof ev[i].info);
+    ev[i].info[rand () % 22] = (char)(rand () & 1);
+    ev[i].deltat = (unsigned int)(rand () % 60);
+    ev[i].step = 1 + (unsigned int)(rand () % 20);
+  }
+}
+
+static const unsigned char *record (unsigned int i)
+{
+  return &host_eeprom[LOG_BASE + i * sizeof (E2LOGREC)];
+}
+
+static unsigned long stamp (unsigned int i)
+{
+  const unsigned char *p = record (i) + 4;
+
+  return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16)
+         | ((unsigned long)p[2] << 8) | p[3];
+}
+
+/* Records nvLogMerge()/nvLogRepeat() read from EEPROM for event "e" when
+   every record they looked at was an EEPROM read */
+
+static unsigned int old_fetches (const EVENT *e)
+{
+  unsigned int i, n, lasti;
+
+  if (e->op == 1)
+    return 1;                         /* The newest record */
+  if (e->op != 2)
+    return 0;
+  lasti = evIndex;
+  for (n = 0, i = 8; i > 0; i--)
+  {
+    lasti = (lasti ? lasti : evMax) - 1;
+    if (lasti == evLastRead)
+      break;
+    n++;
+    if ((record (lasti)[0] == (unsigned char)e->type)
+        && (record (lasti)[1] == (unsigned char)e->sub)
+        && (stamp (lasti) + e->deltat > present_time))
+      break;
+  }
+  return n;
+}
+
+static void run (int reboot)
+{
+  unsigned long starts, reads;
+  unsigned int last = 0;
+  int i;
+
+  present_time = 0x50000000UL;        /* Also stamps the format's entry */
+  host_nv_format ();
+  for (i = 0; i < EVENTS; i++)
+  {
+    present_time += ev[i].step;
+    if (reboot)
+    {
+      last = evLastRead;
+      nvLogInit ();
+      evLastRead = last;
+    }
+    if (ev[i].fail)
+    {
+      host_ee_limit = host_ee_writes;
+      fails++;
+    }
+    old_reads += old_fetches (&ev[i]);
+    starts = host_i2c_starts;
+    reads = host_ee_reads;
+    switch (ev[i].op)
+    {
+      case 0:
+        nvLogPut (ev[i].type, ev[i].sub, ev[i].info);
+        break;
+      case 1:
+        nvLogMerge (ev[i].type, ev[i].sub, ev[i].info, ev[i].deltat);
+        break;
+      case 2:
+        nvLogRepeat (ev[i].type, ev[i].sub, ev[i].info, ev[i].deltat);
+        break;
+      default:
+        evLastRead = evIndex ? evIndex - 1 : evMax - 1;
+        break;
+    }
+    ops_starts += host_i2c_starts - starts;
+    ops_reads += host_ee_reads - reads;
+    host_ee_limit = ~0UL;
+  }
+}
+
+/* nvLogType() and nvLogAtTime() against a plain look at the EEPROM */
+
+static void check_queries (void)
+{
+  unsigned long when;
+  unsigned int i, k, want;
+
+  for (i = 0; i < evMax; i++)
+    if (nvLogType (i) != ((stamp (i) == 0xFFFFFFFFUL) ? 0xFF
+                          : host_eeprom[LOG_BASE + i * sizeof (E2LOGREC)]))
+    {
+      fprintf (stderr, "type of %u\n", i);
+      HOST_CHECK (0);
+      break;
+    }
+  for (k = 0; k < 300; k++)
+  {
+    when = stamp (evIndex) + (unsigned long)(rand () % (EVENTS * 12)) - 1000;
+    want = 0xFFFF;
+    for (i = 0; i < evMax; i++)
+      if ((stamp ((evIndex + i) % evMax) != 0xFFFFFFFFUL)
+          && (stamp ((evIndex + i) % evMax) >= when))
+      {
+        want = (evIndex + i) % evMax;
+        break;
+      }
+    if (nvLogAtTime (when) != want)
+    {
+      fprintf (stderr, "at time %lx: %u, want %u\n", when,
+               nvLogAtTime (when), want);
+      HOST_CHECK (0);
+      break;
+    }
+  }
+}
+
+int main (void)
+{
+  E2LOGREC rec;
+  unsigned long per_read, xfers, now_reads, old_starts;
+  unsigned int index;
+
+  make_events ();
+  run (0);
+  HOST_CHECK (evMax == E2LOGCNT);
+
+  /* I2C starts and EEPROM read transfers in one record read, as the old
+     code made them */
+  per_read = host_i2c_starts;
+  xfers = host_ee_reads;
+  HOST_CHECK (eeReadBlock (LOG_BASE, (unsigned char *)&rec, sizeof rec) == 0);
+  per_read = host_i2c_starts - per_read;
+  xfers = host_ee_reads - xfers;
+  now_reads = ops_reads / xfers;
+  old_starts = ops_starts + (old_reads - now_reads) * per_read;
+  printf ("evlog: %lu I2C starts for %d events, %lu without the RAM copies"
+          " (%lu record reads, %lu now)\n", ops_starts, EVENTS, old_starts,
+          old_reads, now_reads);
+  HOST_CHECK (ops_reads % xfers == 0);
+  HOST_CHECK (now_reads <= fails);    /* Only a refused write re-reads */
+  HOST_CHECK (old_reads > (unsigned long)EVENTS / 2);
+  HOST_CHECK (ops_starts < old_starts);
+  memcpy (warm, &host_eeprom[LOG_BASE], sizeof warm);
+  index = evIndex;
+  HOST_CHECK (stamp (evIndex) != 0xFFFFFFFFUL);   /* Wrapped */
+  check_queries ();
+  nvLogInit ();
+  HOST_CHECK (evIndex == index);
+  check_queries ();
+
+  run (1);
+  HOST_CHECK (evIndex == index);
+  HOST_CHECK (memcmp (warm, &host_eeprom[LOG_BASE], sizeof warm) == 0);
+
+  return host_done ("evlog");
+}
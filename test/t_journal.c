@@ -0,0 +1,388 @@
+/*****************************************************************************
+ *
+ *   t_journal.c -- the change journal from a ModBus master's side, across
+ *                  power cycles.  The whole unit runs, fw_main() from
+ *                  power-up as in t_scenario, while a truck comes and
+ *                  goes, a probe goes wet and dry, and the power is cut
+ *                  part way through.  The master reads the status burst
+ *                  (function 0x63) once, then only the changes since
+ *                  (0x65), applied to its copy of the burst; it reads the
+ *                  burst again only when a reply says to (overflow, or a
+ *                  new boot epoch).  Every so often it reads the burst
+ *                  as well just to check: whenever that burst is at the
+ *                  same sequence and epoch as its copy, the two must be
+ *                  the same but for the time.
+ *
+ *                  Each power up runs in a child process (fork()), so the
+ *                  firmware's RAM starts out as it does on the chip; the
+ *                  EEPROM, the RTC and the master carry over in shared
+ *                  memory.  The power is off for a different time each
+ *                  cycle.  Every power up must take a new epoch, and after
+ *                  the first (which formats the EEPROM) none may write
+ *                  the System NV block (SysParm and its journal) on its
+ *                  way to the main loop; the EEPROM writes it does make
+ *                  (its "Reset" event log entry) are printed.
+ *
+ *****************************************************************************/
+#include "common.h"
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern int fw_main (void);
+
+#define BOOTS      5
+#define POLL_MS    20                 /* Master poll period */
+#define AUDIT_MS   700                /* ... and a burst to check, this often */
+#define REPLY_MS   200                /* No reply: ask again */
+
+/* Power off before each power up (s), and when to cut it again (ms of
+   truck script), the last one not at all */
+
+static const unsigned long off_s[BOOTS] = { 0, 2, 75, 200, 9 };
+static const unsigned long cut_ms[BOOTS] = { 9500, 4200, 14000, 2500, 0 };
+
+typedef struct                        /* Survives the power cuts */
+{
+  unsigned char eeprom[sizeof host_eeprom];
+  unsigned long rtc;                  /* RTC count at power off */
+  int           boot;
+  int           fails;
+  /* Master */
+  unsigned char copy[STS_BURST_SIZE]; /* Its copy of the burst */
+  int           valid;
+  unsigned int  seq;
+  unsigned char epoch;
+  /* Per power up */
+  unsigned char epochs[BOOTS];
+  unsigned long boot_writes[BOOTS];   /* EEPROM writes, power up to IDLE */
+  int           sysnv_kept[BOOTS];    /* ... none of them to System NV */
+  unsigned long bursts[BOOTS], reads[BOOTS], records[BOOTS], audits[BOOTS];
+  unsigned long retries[BOOTS];
+} KEPT;
+
+static KEPT *k;
+
+/* Unit side */
+
+typedef enum { S_BOOT, S_SETTLE, S_CONNECT, S_WET, S_DRY, S_LEAVE } STEP;
+
+static STEP step;
+static unsigned long step_ms, script_ms;
+
+/* Master side */
+
+enum { M_IDLE, M_BURST, M_AUDIT, M_READ };
+
+static int m_state;
+static unsigned long m_ms, m_audit;
+static unsigned char m_msg[4];
+static int m_len;
+
+static void power_cut (void)
+{
+  memcpy (k->eeprom, host_eeprom, sizeof host_eeprom);
+  k->rtc = host_rtc_seconds + (unsigned long)(host_now_us () / 1000000);
+  k->fails += host_fails;
+  fflush (stdout);
+  _exit (0);
+}
+
+/* A record of the journal applied to the copy of the burst */
+
+static void put16 (unsigned char *p, unsigned int v)
+{
+  p[0] = (unsigned char)(v >> 8);
+  p[1] = (unsigned char)v;
+}
+
+static void apply (unsigned char tag, unsigned int v)
+{
+  unsigned char *c = k->copy;
+
+  switch (tag)
+  {
+    case JRN_STATUSA:   put16 (&c[5], v ? v : STSA_IDLE); break;
+    case JRN_STATUSB:   put16 (&c[7], v); break;
+    case JRN_STATUSO:   put16 (&c[9], v); break;
+    case JRN_STATUSP:   put16 (&c[11], v); break;
+    case JRN_NONPERMIT: put16 (&c[13], v); break;
+    case JRN_MAIN:      c[15] = (unsigned char)v; break;
+    case JRN_TRUCK:     c[16] = (unsigned char)v; break;
+    case JRN_BYPASS:    put16 (&c[39], v); break;
+    case JRN_GROUND:    c[41] = (unsigned char)v; break;
+    case JRN_DEADMAN:   c[42] = (unsigned char)v; break;
+    case JRN_VIP:       put16 (&c[43], v); break;
+    case JRN_COMPART:   c[45] = (unsigned char)v; break;
+    default:
+      if ((tag >= JRN_SERIAL) && (tag < JRN_SERIAL + 3))
+        put16 (&c[17 + 2 * (tag - JRN_SERIAL)], v);
+      else if ((tag >= JRN_PROBE) && (tag < JRN_PROBE + 16))
+        c[23 + tag - JRN_PROBE] = (unsigned char)v;
+      break;                          /* Fault, jumpers, clock: not in it */
+  }
+}
+
+static void ask (int state, const unsigned char *msg, int len)
+{
+  memcpy (m_msg, msg, (size_t)len);
+  m_len = len;
+  host_modbus_send (msg, len);
+  m_state = state;
+  m_ms = 0;
+}
+
+static void poll (void)
+{
+  static const unsigned char burst[] = { 1, READ_STATUS_BURST };
+  unsigned char msg[4];
+
+  if (!k->valid)
+    ask (M_BURST, burst, 2);
+  else if (m_audit >= AUDIT_MS)
+  {
+    m_audit = 0;
+    ask (M_AUDIT, burst, 2);
+  }
+  else
+  {
+    msg[0] = 1;
+    msg[1] = READ_JOURNAL;
+    msg[2] = (unsigned char)(k->seq >> 8);
+    msg[3] = (unsigned char)k->seq;
+    ask (M_READ, msg, 4);
+  }
+}
+
+/* The burst in "r" (reply data) */
+
+static void got_burst (const unsigned char *r, int n)
+{
+  unsigned int seq = ((unsigned int)r[46] << 8) | r[47];
+
+  HOST_CHECK ((n == STS_BURST_SIZE) && (r[0] == STS_BURST_VER));
+  if (m_state == M_BURST)
+  {
+    memcpy (k->copy, r, STS_BURST_SIZE);
+    k->seq = seq;
+    k->epoch = r[48];
+    k->valid = 1;
+    k->bursts[k->boot]++;
+    return;
+  }
+  if ((seq != k->seq) || (r[48] != k->epoch))
+    return;                           /* Changes to come; check next time */
+  HOST_CHECK (r[0] == k->copy[0]);
+  HOST_CHECK (!memcmp (&r[5], &k->copy[5], STS_BURST_SIZE - 5));
+  if (memcmp (&r[5], &k->copy[5], STS_BURST_SIZE - 5))
+  {
+    int i;
+
+    for (i = 5; i < STS_BURST_SIZE; i++)
+      if (r[i] != k->copy[i])
+        fprintf (stderr, "  burst byte %d is %02X, copy has %02X\n", i, r[i],
+                 k->copy[i]);
+  }
+  k->audits[k->boot]++;
+}
+
+/* Changes since k->seq in "r": returns whether there are more */
+
+static int got_changes (const unsigned char *r, int n)
+{
+  const unsigned char *rec;
+  unsigned int seq;
+  int i;
+
+  HOST_CHECK ((n >= 5) && (n == 5 + r[4] * JRN_MB_SIZE));
+  k->reads[k->boot]++;
+  if ((r[2] != k->epoch) || (r[3] & JRN_OVERFLOW))
+  {
+    k->valid = 0;                     /* Start over from a burst */
+    return 1;
+  }
+  for (i = 0; i < r[4]; i++)
+  {
+    rec = &r[5 + i * JRN_MB_SIZE];
+    seq = ((unsigned int)rec[0] << 8) | rec[1];
+    HOST_CHECK (seq == ((k->seq + 1) & 0xFFFF));
+    apply (rec[2], ((unsigned int)rec[5] << 8) | rec[6]);
+    k->seq = seq;
+    k->records[k->boot]++;
+  }
+  put16 (&k->copy[46], k->seq);
+  k->copy[48] = k->epoch;
+  return (r[3] & JRN_MORE) != 0;
+}
+
+static void master (void)
+{
+  unsigned char reply[MODBUS_MAX_LEN];
+  int n, more = 0;
+
+  m_ms++;
+  m_audit++;
+  if (m_state == M_IDLE)
+  {
+    if ((m_ms >= POLL_MS) && (modbus_state != READY))
+      poll ();
+    return;
+  }
+  n = host_modbus_reply (reply, sizeof reply);
+  if ((n < 4) || (modbus_CRC (reply, (unsigned int)(n - 2), INIT_CRC_SEED)
+                  != (unsigned int)(reply[n - 2] | (reply[n - 1] << 8))))
+  {
+    if (m_ms >= REPLY_MS)
+    {
+      k->retries[k->boot]++;
+      ask (m_state, m_msg, m_len);
+    }
+    return;
+  }
+  HOST_CHECK ((reply[0] == 1) && (reply[1] == m_msg[1]));
+  if (m_state == M_READ)
+    more = got_changes (&reply[2], n - 4);
+  else
+    got_burst (&reply[2], n - 4);
+  m_state = M_IDLE;
+  m_ms = more ? POLL_MS : 0;
+}
+
+static void next (STEP s)
+{
+  step = s;
+  step_ms = 0;
+}
+
+static void script (void)
+{
+  step_ms++;
+  if (step > S_BOOT)
+  {
+    master ();
+    script_ms++;
+    if (cut_ms[k->boot] && (script_ms >= cut_ms[k->boot]))
+      power_cut ();
+  }
+  switch (step)
+  {
+    case S_BOOT:
+      if ((modbus_state == READY) || (main_state != IDLE))
+        break;
+      k->boot_writes[k->boot] = host_ee_writes;
+      k->sysnv_kept[k->boot] = !memcmp (&host_eeprom[SYS_BASE],
+                                        &k->eeprom[SYS_BASE], SES_BASE - SYS_BASE);
+      k->epochs[k->boot] = mbrJournalEpoch ();
+      next (S_SETTLE);
+      break;
+
+    case S_SETTLE:
+      if (step_ms < 1000)
+        break;
+      HOST_CHECK (iambroke == 0);
+      host_truck_probes = 0xFF;
+      next (S_CONNECT);
+      break;
+
+    case S_CONNECT:
+      if ((main_state == ACTIVE) && (step_ms > 1500))
+      {
+        host_truck_wet = 0x10;
+        next (S_WET);
+      }
+      break;
+
+    case S_WET:
+      if (step_ms > 1500)
+      {
+        host_truck_wet = 0;
+        next (S_DRY);
+      }
+      break;
+
+    case S_DRY:
+      if (step_ms > 2000)
+      {
+        host_truck_probes = 0;
+        next (S_LEAVE);
+      }
+      break;
+
+    case S_LEAVE:
+      if ((main_state == IDLE) && (step_ms > 3000))
+      {
+        if (cut_ms[k->boot] == 0)
+        {
+          k->fails += host_fails;
+          fflush (stdout);
+          _exit (0);
+        }
+        next (S_SETTLE);
+      }
+      break;
+  }
+  if (step_ms > 60000)
+  {
+    fprintf (stderr, "boot %d, step %d: no progress (state %d, StatusA %04X,"
+             " iambroke %04X)\n", k->boot, (int)step, (int)main_state,
+             StatusA, iambroke);
+    host_fails++;
+    power_cut ();
+  }
+}
+
+static void power_up (void)
+{
+  host_i2c_reset ();
+  if (k->boot)
+    memcpy (host_eeprom, k->eeprom, sizeof host_eeprom);
+  host_rtc_seconds = k->rtc + off_s[k->boot];
+  host_ee_writes = 0;
+  OSCCONbits.COSC = 3;                /* Primary oscillator with PLL ... */
+  OSCCONbits.LOCK = 1;                /* ... locked */
+  host_ms_hook = script;
+  fw_main ();
+}
+
+int main (void)
+{
+  pid_t pid;
+  int b, status;
+
+  k = mmap (NULL, sizeof *k, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+            -1, 0);
+  if (k == MAP_FAILED)
+  {
+    perror ("mmap");
+    return 1;
+  }
+  memset (k, 0, sizeof *k);
+  k->rtc = 1792368000UL;              /* 10/19/26 00:00 */
+  fflush (stdout);
+  for (k->boot = 0; k->boot < BOOTS; k->boot++)
+  {
+    if ((pid = fork ()) == 0)
+    {
+      power_up ();
+      _exit (1);                      /* Not reached */
+    }
+    HOST_CHECK ((pid > 0) && (waitpid (pid, &status, 0) == pid));
+    HOST_CHECK (WIFEXITED (status) && (WEXITSTATUS (status) == 0));
+  }
+  host_fails += k->fails;
+
+  printf ("boot  off s  epoch  EE writes  bursts  reads  records  checked  retries\n");
+  for (b = 0; b < BOOTS; b++)
+  {
+    printf ("%4d %6lu %6u %10lu %7lu %6lu %8lu %8lu %8lu\n", b, off_s[b],
+            k->epochs[b], k->boot_writes[b], k->bursts[b], k->reads[b],
+            k->records[b], k->audits[b], k->retries[b]);
+    HOST_CHECK (k->bursts[b] >= 1);
+    HOST_CHECK (k->audits[b] >= 1);
+    if (b == 0)
+      continue;
+    HOST_CHECK (k->epochs[b] != k->epochs[b - 1]);
+    HOST_CHECK (k->sysnv_kept[b]);
+  }
+  return host_done ("journal");
+}
@@ -0,0 +1,190 @@
+/*****************************************************************************
+ *
+ *   t_jumpers.c -- the J5 enable jumpers on the MCP23017 (i2c.c) and the
+ *                  ModBus line jumpers behind the analog mux, with the
+ *                  whole unit running, fw_main() from power-up as in
+ *                  t_classify.
+ *
+ *                  For a minute of IDLE the starts addressed to the
+ *                  expander are counted against what reading it on every
+ *                  main loop pass came to (the passes are counted through
+ *                  mbrJournalScan(), which ends each one, times the starts
+ *                  one fetch_jumpers() makes).  The 1 Hz refresh may make
+ *                  one fetch a second and no more.
+ *
+ *                  The get_modbus_xxx() readings must come from RAM after
+ *                  power up, no read_muxADC() conversion, and agree with
+ *                  what init_variables() took.
+ *
+ *                  Then a jumper is moved: jumper_now must show it, and
+ *                  jumper_seq move, within the refresh period, with
+ *                  JUMPER_CHANGE raised and an EVJUMPERS event logged
+ *                  saying what it was and what it is.
+ *
+ *****************************************************************************/
+#include "common.h"
+#include "evlog.h"
+
+extern int fw_main (void);
+extern void __real_mbrJournalScan (void);
+
+#define IDLE_MS    60000UL
+#define BOUND_MS   1100UL              /* Refresh period and a pass or two */
+
+typedef enum { S_BOOT, S_SETTLE, S_IDLE, S_MOVED, S_DONE } STEP;
+
+static const unsigned long step_limit[] = { 60000, 3000, IDLE_MS + 1000, BOUND_MS };
+
+static STEP step;
+static unsigned long step_ms;
+static unsigned long passes;          /* Main loop passes */
+static unsigned long mcp0, passes0;   /* At the start of the minute */
+static unsigned long per_fetch;       /* Starts one fetch_jumpers() makes */
+static unsigned long singles;         /* Mux conversions by get_modbus_xxx() */
+static int probe;                     /* Measure at the end of the next pass */
+static unsigned int seq0, was;
+
+static void next (STEP s)
+{
+  step = s;
+  step_ms = 0;
+}
+
+static void finish (void)
+{
+  unsigned long now = host_mcp_starts - mcp0;
+  unsigned long before = (passes - passes0) * per_fetch;
+
+  printf ("\nMCP23017 starts per minute IDLE: %lu, at one read a pass %lu"
+          " (%lu passes, %lu starts a read)\n", now, before,
+          passes - passes0, per_fetch);
+  printf ("mux conversions by get_modbus_xxx() after power up: %lu\n",
+          singles);
+  fflush (stdout);
+  exit (host_done ("jumpers"));
+}
+
+/* Between main loop passes, where the buses are free */
+
+void __wrap_mbrJournalScan (void)
+{
+  unsigned long s;
+
+  __real_mbrJournalScan ();
+  passes++;
+  if (!probe)
+    return;
+  probe = 0;
+  s = host_mcp_starts;
+  (void)fetch_jumpers ();
+  per_fetch = host_mcp_starts - s;
+  mcp0 += per_fetch;                  /* Not the firmware's */
+
+  s = host_adc_singles;
+  HOST_CHECK (get_modbus_addr () == modbus_addr);
+  HOST_CHECK (get_modbus_baud () == B09600);
+  HOST_CHECK (get_modbus_parity () == modbus_parity);
+  HOST_CHECK (get_modbus_csize () == modbus_csize);
+  singles = host_adc_singles - s;
+  HOST_CHECK (singles == 0);
+}
+
+/* The newest EVJUMPERS record in the Event Log, 0 if none */
+
+static int last_event (EVI_JUMPERS *info)
+{
+  const E2LOGREC *rec;
+  unsigned long newest = 0;
+  int i, found = 0;
+
+  for (i = 0; i < E2LOGCNT; i++)
+  {
+    rec = (const E2LOGREC *)&host_eeprom[LOG_BASE + i * sizeof (E2LOGREC)];
+    if ((rec->Type == EVJUMPERS) && (rec->Time >= newest))
+    {
+      newest = rec->Time;
+      memset (info, 0, sizeof *info);
+      memcpy (info, rec->Info, sizeof rec->Info);
+      found = 1;
+    }
+  }
+  return found;
+}
+
+static void script (void)
+{
+  EVI_JUMPERS info;
+  unsigned long mcp;
+
+  step_ms++;
+  switch (step)
+  {
+    case S_BOOT:
+      if (modbus_state != READY)
+        next (S_SETTLE);
+      break;
+
+    case S_SETTLE:
+      if ((step_ms < 2000) || (main_state != IDLE))
+        break;
+      HOST_CHECK (iambroke == 0);
+      HOST_CHECK (!last_event (&info));
+      mcp0 = host_mcp_starts;
+      passes0 = passes;
+      probe = 1;
+      next (S_IDLE);
+      break;
+
+    case S_IDLE:
+      if (step_ms < IDLE_MS)
+        break;
+      HOST_CHECK (main_state == IDLE);
+      HOST_CHECK (per_fetch > 0);
+      mcp = host_mcp_starts - mcp0;
+      HOST_CHECK (mcp <= (IDLE_MS / 1000 + 1) * per_fetch);
+      HOST_CHECK (mcp >= (IDLE_MS / 1000 - 1) * per_fetch);
+      HOST_CHECK (mcp * 100 < (passes - passes0) * per_fetch);
+      seq0 = jumper_seq;
+      was = jumper_now;
+      host_jumpers = ENA_VIP_NEW;
+      next (S_MOVED);
+      break;
+
+    case S_MOVED:
+      if (jumper_seq == seq0)
+        break;
+      HOST_CHECK (step_ms <= BOUND_MS);
+      HOST_CHECK ((jumper_now & 0xFF) == ENA_VIP);
+      HOST_CHECK (iambroke & JUMPER_CHANGE);
+      HOST_CHECK (last_event (&info));
+      HOST_CHECK (info.Was == was);
+      HOST_CHECK (info.Now == jumper_now);
+      HOST_CHECK (info.Latched == enable_jumpers);
+      next (S_DONE);
+      finish ();
+      break;
+
+    default:
+      break;
+  }
+  if ((step < S_DONE) && (step_ms > step_limit[step]))
+  {
+    fprintf (stderr, "step %d: no progress in %lu ms (state %d, iambroke"
+             " %04X)\n", (int)step, step_limit[step], (int)main_state,
+             iambroke);
+    host_fails++;
+    finish ();
+  }
+  if (host_fails)
+    finish ();
+}
+
+int main (void)
+{
+  host_i2c_reset ();
+  OSCCONbits.COSC = 3;                /* Primary oscillator with PLL ... */
+  OSCCONbits.LOCK = 1;                /* ... locked */
+  host_ms_hook = script;
+  fw_main ();
+  return 1;                           /* Not reached */
+}
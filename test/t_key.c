@@ -0,0 +1,275 @@
+/*****************************************************************************
+ *
+ *   t_key.c -- Bypass Key store RAM copy and hash: after random puts,
+ *              deletes and erases (duplicates and hash collisions among
+ *              them), nvKeyFind() and nvKeyEmpty() must answer what a
+ *              search of the EEPROM would, before and after nvKeyInit(),
+ *              and a slot whose CRC goes bad must drop out.
+ *
+ *              Then keys in the socket (the DS1990 model in onewire.c),
+ *              read_bypass() polled as the main loop does: with the store
+ *              full, thousands of different keys, a quarter of them in
+ *              the store, are put in and taken out again, held for
+ *              anything from one poll to several and out for 0.3 to 1s;
+ *              one in ten follows the last after only a tenth of a second
+ *              and is held long enough for the BYPASS_REREAD read.  Each
+ *              must be read as itself and be known or not as the store
+ *              says, the socket must read empty once it is, and no EEPROM
+ *              is read for any of it.
+ *
+ *              Last, the bus time an idle unit spends on the socket each
+ *              second is printed and checked: 1-Wire time (the time spent
+ *              in read_bypass()) and I2C time at 400 kHz (nine bit times
+ *              a byte, two a start), with the socket empty, with a key
+ *              held, and with the key held but read in full every poll
+ *              as before the presence gating.
+ *
+ *****************************************************************************/
+#include "common.h"
+#include <stdlib.h>
+
+#define POOL    60
+#define OPS     5000
+#define NKEYS   3000                  /* Keys put in the socket */
+#define IDLE_S  20                    /* Seconds of each bus time run */
+#define SCL_HZ  400000.0
+
+static unsigned char pool[POOL][BYTESERIAL];
+static word slots;
+
+static const unsigned char *slot_of (word i)
+{
+  return &host_eeprom[KEY_BASE + i * sizeof (E2KEYREC)];
+}
+
+static int slot_good (word i)
+{
+  UINT16 crc;
+
+  memcpy (&crc, slot_of (i) + BYTESERIAL, sizeof crc);
+  return modbus_CRC ((unsigned char *)slot_of (i), BYTESERIAL, INIT_CRC_SEED) == crc;
+}
+
+/* Reference answers: the old EEPROM searches */
+
+static int ref_find (const unsigned char *key)
+{
+  word i;
+
+  for (i = 0; i < slots; i++)
+    if ((memcmp (slot_of (i), key, BYTESERIAL) == 0) && slot_good (i))
+      return i;
+  return -1;
+}
+
+static int ref_empty (void)
+{
+  static const unsigned char ff[sizeof (E2KEYREC)] =
+    { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+  word i;
+
+  for (i = 0; i < slots; i++)
+    if (memcmp (slot_of (i), ff, sizeof ff) == 0)
+      return i;
+  return -1;
+}
+
+static void check (int op)
+{
+  word index;
+  int k, want, got;
+
+  for (k = 0; k < POOL; k++)
+  {
+    want = ref_find (pool[k]);
+    got = (nvKeyFind (pool[k], &index) == 0) ? (int)index : -1;
+    if (got != want)
+    {
+      fprintf (stderr, "op %d key %d: found %d, want %d\n", op, k, got, want);
+      HOST_CHECK (0);
+      return;
+    }
+  }
+  want = ref_empty ();
+  got = (nvKeyEmpty (&index) == 0) ? (int)index : -1;
+  if (got != want)
+  {
+    fprintf (stderr, "op %d: empty %d, want %d\n", op, got, want);
+    HOST_CHECK (0);
+  }
+}
+
+/* Keys in the socket */
+
+static unsigned char store[E2KEYCNT][BYTESERIAL];
+
+static void run_ms (unsigned long ms)
+{
+  while (ms--)
+  {
+    (void)read_bypass (TRUE);         /* Once a main loop pass */
+    host_run_us (1000);
+  }
+}
+
+static void socket (void)
+{
+  unsigned char want[BYTESERIAL];
+  unsigned long reads = host_ee_reads;
+  word index;
+  int n, i, known, quick = 0, misread = 0, misknown = 0, stuck = 0, nknown = 0;
+
+  HOST_CHECK (nvKeyErase () == 0);
+  for (n = 0; n < E2KEYCNT; n++)
+  {
+    for (i = 0; i < BYTESERIAL; i++)
+      store[n][i] = (unsigned char)rand ();
+    HOST_CHECK (nvKeyPut (store[n], (word)n) == 0);
+  }
+  Init_Timer2 ();                     /* The 1 ms read_time() tick */
+  TRISD &= ~READ_BYPASS;
+  BYPASS_BIT = 1;
+  reads = host_ee_reads;
+
+  for (n = 0; n < NKEYS; n++)
+  {
+    known = (rand () % 4) == 0;
+    if (known)
+      memcpy (want, store[rand () % E2KEYCNT], BYTESERIAL);
+    else
+      for (i = 0; i < BYTESERIAL; i++)
+        want[i] = (unsigned char)rand ();
+    nknown += known;
+    memcpy (host_key, want, BYTESERIAL);
+    host_key_on = 1;
+    if (quick)                        /* Caught by the BYPASS_REREAD read */
+      run_ms (5000);
+    else
+      run_ms (600 + (unsigned long)(rand () % 2400));
+    if (!(bystatus & BYS_KEYPRESENT) || memcmp (bypass_SN, want, BYTESERIAL))
+      misread++;
+    else if ((nvKeyFind (bypass_SN, &index) == 0) != known)
+      misknown++;
+    host_key_on = 0;
+    quick = (rand () % 10) == 0;
+    run_ms (quick ? 100 : 300 + (unsigned long)(rand () % 700));
+    if ((bystatus & BYS_KEYPRESENT) && (rand () % 2))
+    {
+      run_ms (600);                   /* Out past a poll: must read empty */
+      stuck += (bystatus & BYS_KEYPRESENT) != 0;
+    }
+  }
+  printf ("%d keys in the socket (%d in the store of %d): %d misread,"
+          " %d misknown, %d not seen go; %lu EEPROM reads\n", NKEYS,
+          nknown, E2KEYCNT, misread, misknown, stuck, host_ee_reads - reads);
+  HOST_CHECK (misread == 0);
+  HOST_CHECK (misknown == 0);
+  HOST_CHECK (stuck == 0);
+  HOST_CHECK (host_ee_reads == reads);
+}
+
+/* Bus time per second of an idle unit: "how" 0 is read_bypass(), 1 the
+   full read every poll; returns the 1-Wire ms per second */
+
+static double bus_time (const char *name, int key, int how)
+{
+  unsigned long starts = host_i2c_starts, bytes = host_i2c_bytes;
+  unsigned long slots = host_key_slots;
+  unsigned long long t, in = 0;
+  unsigned long n;
+  word index;
+  int ms;
+
+  host_key_on = key;
+  memcpy (host_key, store[3], BYTESERIAL);
+  run_ms (2000);                      /* Settle: key read */
+  starts = host_i2c_starts;
+  bytes = host_i2c_bytes;
+  slots = host_key_slots;
+  for (ms = 0; ms < IDLE_S * 1000; ms++)
+  {
+    t = host_now_us ();
+    n = host_key_slots;
+    if (how == 0)
+      (void)read_bypass (TRUE);
+    else if ((ms % 500) == 0)         /* Read in full, then looked up */
+    {
+      if (Read_Bypass_SN ())
+        (void)nvKeyFind (bypass_SN, &index);
+    }
+    if (host_key_slots != n)          /* Calls that used the line */
+      in += host_now_us () - t;
+    host_run_us (1000);
+  }
+  printf ("  %-24s %10.2f %10.1f %10.3f\n", name, (double)in / 1000 / IDLE_S,
+          (double)(host_key_slots - slots) / IDLE_S,
+          ((double)(host_i2c_bytes - bytes) * 9
+           + (double)(host_i2c_starts - starts) * 2) / SCL_HZ * 1000 / IDLE_S);
+  host_key_on = 0;
+  run_ms (1000);
+  return (double)in / 1000 / IDLE_S;
+}
+
+int main (void)
+{
+  word index, size, base;
+  double empty, held, full;
+  int k, op;
+
+  host_nv_format ();
+  HOST_CHECK (eeMapPartition (EEP_KEY, &size, &base) == 0);
+  slots = size / sizeof (E2KEYREC);
+  HOST_CHECK (slots == E2KEYCNT);
+
+  /* Half the pool collides with the other half: the hash treats key[0]
+     and key[3] alike */
+  srand (30);
+  for (k = 0; k < POOL / 2; k++)
+  {
+    for (index = 0; index < BYTESERIAL; index++)
+      pool[k][index] = (unsigned char)rand ();
+    memcpy (pool[k + POOL / 2], pool[k], BYTESERIAL);
+    pool[k + POOL / 2][0] = pool[k][3];
+    pool[k + POOL / 2][3] = pool[k][0];
+  }
+
+  check (-1);
+  for (op = 0; (op < OPS) && !host_fails; op++)
+  {
+    switch (rand () % 10)
+    {
+      case 0: case 1: case 2:             /* Where nvKeyEmpty() says */
+        if (nvKeyEmpty (&index) == 0)
+          HOST_CHECK (nvKeyPut (pool[rand () % POOL], index) == 0);
+        break;
+      case 3: case 4:                     /* Anywhere, duplicates too */
+        HOST_CHECK (nvKeyPut (pool[rand () % POOL], (word)(rand () % slots)) == 0);
+        break;
+      case 5: case 6: case 7:
+        HOST_CHECK (nvKeyDelete ((word)(rand () % slots)) == 0);
+        break;
+      case 8:                             /* Bad CRC in a slot, then boot */
+        host_eeprom[KEY_BASE + (rand () % slots) * sizeof (E2KEYREC)
+                    + BYTESERIAL] ^= 0x5A;
+        nvKeyInit ();
+        break;
+      default:
+        if ((rand () % 50) == 0)
+          HOST_CHECK (nvKeyErase () == 0);
+        else
+          nvKeyInit ();
+        break;
+    }
+    check (op);
+  }
+
+  socket ();
+  printf ("\nBus time per idle second     1-Wire ms      slots     I2C ms\n");
+  empty = bus_time ("socket empty", 0, 0);
+  held = bus_time ("key held", 1, 0);
+  full = bus_time ("key held, read in full", 1, 1);
+  HOST_CHECK (held < full / 2);
+  HOST_CHECK (empty <= held);
+
+  return host_done ("key");
+}
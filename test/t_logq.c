@@ -0,0 +1,394 @@
+/*****************************************************************************
+ *
+ *   t_logq.c -- reading the Event Log over ModBus: the filtered query
+ *               (function 0x66, mbcLogQuery()) against a record a request
+ *               (function 0x49, mbcRdTrlLog()) and the master filtering,
+ *               the whole unit running, fw_main() from power-up as in
+ *               t_modbus, at 19200 baud with no turnaround delay.
+ *
+ *               Between two main loop passes (mbrJournalScan()) every
+ *               slot of the log is filled with a valid record, in time
+ *               order and wrapped, the newest at NEWEST; the Types are a
+ *               seeded random mix, about one in five a bypass and one in
+ *               fifty a hardware error.  nvLogInit() then takes it up as
+ *               at start-up.
+ *
+ *               The old way reads every entry with 0x49, oldest first,
+ *               once; a filter's cost is then that of the entries it
+ *               would have had to read: all of them for a Type filter,
+ *               and for a time filter those from the first one due,
+ *               given the master for nothing.  The new way asks 0x66 for
+ *               all, bypasses, hardware errors and the newest tenth by
+ *               time, following the cursor to the end.  Every record
+ *               either way must be the one in EEPROM, and 0x66 must give
+ *               exactly the entries the filter takes, oldest first.
+ *
+ *               Per filter, the requests, the line time (request out to
+ *               the response's last character and t3.5, as t_modbus
+ *               takes it) and the EEPROM read transfers (host_ee_reads,
+ *               one a byte as eeReadBlock() reads) are printed.  The query must take fewer requests and
+ *               less time for every filter, and no more EEPROM reads
+ *               (than the old way's and the time search's, for the time
+ *               filter); fewer for a Type filter.
+ *
+ *****************************************************************************/
+#include "common.h"
+#include "evlog.h"
+#include <stdlib.h>
+
+extern int fw_main (void);
+extern void __real_mbrJournalScan (void);
+
+#define NEWEST     (E2LOGCNT / 3)     /* Newest entry, the log has wrapped */
+#define T0         0x58000000UL       /* The oldest entry's time */
+#define T5_NS      3200               /* Timer 5 tick */
+#define QMAX       2                  /* Records a query, LOGQ_MAX */
+#define SEARCH     (11 * sizeof (unixtime))  /* nvLogAtTime(): 11 Times */
+
+typedef struct
+{
+  const char  *name;
+  unsigned char mode;                 /* 0 Types only, 1 from a time */
+  unsigned int mask;
+} FILTER;
+
+static const FILTER filter[] =
+{
+  { "all",      0, 0xFFFF },
+  { "bypass",   0, 1 << EVBYPASS },
+  { "hdw err",  0, 1 << EVHDWERR },
+  { "newest",   1, 0xFFFF },
+};
+#define NFILTER (int)(sizeof filter / sizeof filter[0])
+
+typedef struct
+{
+  unsigned long records;
+  unsigned long requests[2];          /* Old way, query */
+  unsigned long long us[2];
+  unsigned long reads[2];
+} RESULT;
+
+static RESULT res[NFILTER];
+
+typedef enum { S_BOOT, S_SETTLE, S_FILL, S_OLD, S_QUERY, S_DONE } STEP;
+
+static const unsigned long step_limit[] = { 60000, 3000, 2000, 1000, 1000 };
+
+static STEP step;
+static unsigned long step_ms;
+static int fill_now, filled;
+static unsigned int pos;              /* Old way, from the oldest */
+static int f;                         /* Filter being queried */
+static unsigned long since;           /* Time the last filter starts at */
+static unsigned int since_pos;
+static unsigned int want[E2LOGCNT];   /* Entries the filter takes */
+static unsigned int nwant, ngot;
+static unsigned long long sent_us, t35_us;
+static unsigned long reads0;
+static unsigned long long old_us[E2LOGCNT];  /* Per entry, by position */
+static unsigned long old_reads[E2LOGCNT];
+
+static void next (STEP s)
+{
+  step = s;
+  step_ms = 0;
+}
+
+static void finish (void)
+{
+  int k;
+
+  printf ("\n%d entries, 19200 baud, no delay   %26s %26s\n", evMax,
+          "one a request (0x49)", "query (0x66)");
+  printf ("%-8s %8s", "filter", "records");
+  for (k = 0; k < 2; k++)
+    printf (" %8s %8s %8s", "requests", "s", "EE reads");
+  printf ("\n");
+  for (k = 0; k < NFILTER; k++)
+    printf ("%-8s %8lu %8lu %8.2f %8lu %8lu %8.2f %8lu\n", filter[k].name,
+            res[k].records, res[k].requests[0], (double)res[k].us[0] / 1e6,
+            res[k].reads[0], res[k].requests[1], (double)res[k].us[1] / 1e6,
+            res[k].reads[1]);
+  fflush (stdout);
+  exit (host_done ("logq"));
+}
+
+static unsigned int at (unsigned int p)        /* Entry at a position */
+{
+  return (unsigned int)((evIndex + p) % evMax);
+}
+
+static const unsigned char *record (unsigned int i)
+{
+  return &host_eeprom[LOG_BASE + i * sizeof (E2LOGREC)];
+}
+
+static unsigned long stamp (unsigned int i)
+{
+  const unsigned char *p = record (i) + 4;
+
+  return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16)
+         | ((unsigned long)p[2] << 8) | p[3];
+}
+
+/* Every slot a valid record, oldest at NEWEST + 1 */
+
+static void fill (void)
+{
+  E2LOGREC rec;
+  unsigned long t = T0;
+  unsigned int p, i, k;
+  int r;
+
+  srand (45);
+  for (p = 0; p < evMax; p++)
+  {
+    r = rand () % 100;
+    memset (&rec, 0, sizeof rec);
+    rec.Type = (char)((r < 20) ? EVBYPASS : (r < 22) ? EVHDWERR
+                      : (r < 60) ? EVIMPACT : (r < 80) ? EVJUMPERS
+                      : (r < 90) ? EVOLTERR : EVIMAINTENANCE);
+    rec.Subtype = (char)(rand () & 0x0F);
+    t += 1 + (unsigned long)(rand () % 600);
+    rec.Time = long_swap (t);
+    for (k = 0; k < sizeof rec.Info; k++)
+      rec.Info[k] = (char)rand ();
+    rec.CRC = modbus_CRC ((unsigned char *)&rec + E2LOGCRCOFS,
+                          (sizeof rec - E2LOGCRCOFS) - 2, INIT_CRC_SEED);
+    i = (NEWEST + 1 + p) % evMax;
+    memcpy (&host_eeprom[LOG_BASE + i * sizeof rec], &rec, sizeof rec);
+  }
+  nvLogInit ();
+}
+
+void __wrap_mbrJournalScan (void)
+{
+  __real_mbrJournalScan ();
+  if (fill_now)
+  {
+    fill_now = 0;
+    fill ();
+    filled = 1;
+  }
+}
+
+static int answered (void)
+{
+  return host_modbus_done_us && (modbus_state == READY);
+}
+
+static void send (const unsigned char *msg, int len)
+{
+  host_modbus_send (msg, len);
+  sent_us = host_now_us ();
+  reads0 = host_ee_reads;
+}
+
+/* The response, checked; its length */
+
+static int reply (unsigned char *r, unsigned char fn)
+{
+  int len = host_modbus_reply (r, MODBUS_MAX_LEN);
+
+  HOST_CHECK (len >= 5);
+  HOST_CHECK (modbus_CRC (r, (unsigned int)len - 2, INIT_CRC_SEED)
+              == (unsigned int)(r[len - 2] | (r[len - 1] << 8)));
+  HOST_CHECK ((r[0] == 1) && (r[1] == fn));
+  return len;
+}
+
+static unsigned long long took (void)
+{
+  return host_modbus_done_us - sent_us + t35_us;
+}
+
+static void read_one (void)
+{
+  unsigned char msg[4];
+  unsigned int i = at (pos);
+
+  msg[0] = 1;
+  msg[1] = READ_TRL_LOG_ELEMENT;
+  msg[2] = (unsigned char)(i >> 8);
+  msg[3] = (unsigned char)i;
+  send (msg, sizeof msg);
+}
+
+static void query (unsigned char mode, unsigned long start)
+{
+  unsigned char msg[10];
+
+  msg[0] = 1;
+  msg[1] = READ_LOG_QUERY;
+  msg[2] = mode;
+  msg[3] = (unsigned char)(start >> 24);
+  msg[4] = (unsigned char)(start >> 16);
+  msg[5] = (unsigned char)(start >> 8);
+  msg[6] = (unsigned char)start;
+  msg[7] = (unsigned char)(filter[f].mask >> 8);
+  msg[8] = (unsigned char)filter[f].mask;
+  msg[9] = QMAX;
+  send (msg, sizeof msg);
+  res[f].requests[1]++;
+}
+
+/* What filter "f" takes, and what the old way pays for it */
+
+static void start_filter (void)
+{
+  const FILTER *q = &filter[f];
+  RESULT *r = &res[f];
+  unsigned int p, i, from;
+
+  from = q->mode ? since_pos : 0;
+  nwant = ngot = 0;
+  for (p = from; p < evMax; p++)
+  {
+    i = at (p);
+    r->requests[0]++;
+    r->us[0] += old_us[p];
+    r->reads[0] += old_reads[p];
+    if ((q->mask == 0xFFFF) || (q->mask & (1 << record (i)[0])))
+      want[nwant++] = i;
+  }
+  r->records = nwant;
+  query (q->mode, q->mode ? since : evIndex);
+}
+
+static void got_query (const unsigned char *r, int len)
+{
+  unsigned int count = r[2], cursor = (unsigned int)((r[3] << 8) | r[4]);
+  unsigned int k, i;
+  const unsigned char *p = &r[5];
+
+  HOST_CHECK (count <= QMAX);
+  HOST_CHECK (len == 5 + (int)count * (2 + (int)sizeof (E2LOGREC)) + 2);
+  for (k = 0; (k < count) && !host_fails; k++, p += 2 + sizeof (E2LOGREC))
+  {
+    i = (unsigned int)((p[0] << 8) | p[1]);
+    HOST_CHECK (ngot < nwant);
+    HOST_CHECK (i == want[ngot]);
+    HOST_CHECK (!memcmp (&p[2], record (i), sizeof (E2LOGREC)));
+    ngot++;
+  }
+  res[f].us[1] += took ();
+  res[f].reads[1] += host_ee_reads - reads0;
+  if (cursor != 0xFFFF)
+  {
+    HOST_CHECK (cursor < evMax);
+    query (0, cursor);
+    return;
+  }
+  HOST_CHECK (ngot == nwant);
+  if (++f < NFILTER)
+  {
+    start_filter ();
+    return;
+  }
+  for (k = 0; k < NFILTER; k++)
+  {
+    HOST_CHECK (res[k].requests[1] < res[k].requests[0]);
+    HOST_CHECK (res[k].us[1] < res[k].us[0]);
+    HOST_CHECK (res[k].reads[1]
+                <= res[k].reads[0] + (filter[k].mode ? SEARCH : 0));
+    if (filter[k].mask != 0xFFFF)
+      HOST_CHECK (res[k].reads[1] < res[k].reads[0]);
+  }
+  next (S_DONE);
+  finish ();
+}
+
+static void script (void)
+{
+  unsigned char r[MODBUS_MAX_LEN];
+  int len;
+
+  step_ms++;
+  switch (step)
+  {
+    case S_BOOT:
+      if (modbus_state != READY)
+        next (S_SETTLE);
+      break;
+
+    case S_SETTLE:
+      if ((step_ms < 2000) || (main_state != IDLE))
+        break;
+      HOST_CHECK (iambroke == 0);
+      HOST_CHECK (evMax == E2LOGCNT);
+      SysParm.ModBusRespWait = 0;
+      SysParm.ModBusBaud = B19200;
+      modbus_baud_override ();
+      modbus_init ();
+      HOST_CHECK (modbus_baud == B19200);
+      t35_us = (unsigned long long)modbus_eom_time * T5_NS / 1000;
+      fill_now = 1;
+      next (S_FILL);
+      break;
+
+    case S_FILL:
+      if (!filled)
+        break;
+      HOST_CHECK (evIndex == NEWEST + 1);
+      since_pos = evMax - evMax / 10;
+      since = stamp (at (since_pos));
+      pos = 0;
+      read_one ();
+      next (S_OLD);
+      break;
+
+    case S_OLD:
+      if (!answered ())
+        break;
+      len = reply (r, READ_TRL_LOG_ELEMENT);
+      HOST_CHECK (len == 6 + (int)sizeof (E2LOGREC) + 2);
+      HOST_CHECK ((unsigned int)((r[2] << 8) | r[3]) == at (pos));
+      HOST_CHECK ((r[4] == 0) && (r[5] == sizeof (E2LOGREC)));
+      HOST_CHECK (!memcmp (&r[6], record (at (pos)), sizeof (E2LOGREC)));
+      old_us[pos] = took ();
+      old_reads[pos] = host_ee_reads - reads0;
+      if (++pos < evMax)
+      {
+        read_one ();
+        next (S_OLD);
+        break;
+      }
+      f = 0;
+      start_filter ();
+      next (S_QUERY);
+      break;
+
+    case S_QUERY:
+      if (!answered ())
+        break;
+      HOST_CHECK (evIndex == NEWEST + 1);       /* Nothing logged since */
+      len = reply (r, READ_LOG_QUERY);
+      got_query (r, len);
+      next (S_QUERY);
+      break;
+
+    default:
+      break;
+  }
+  if ((step < S_DONE) && (step_ms > step_limit[step]))
+  {
+    fprintf (stderr, "%s, entry %u, step %d: no progress in %lu ms"
+             " (modbus_state %d)\n", filter[f].name, pos, (int)step,
+             step_limit[step], (int)modbus_state);
+    host_fails++;
+    finish ();
+  }
+  if (host_fails)
+    finish ();
+}
+
+int main (void)
+{
+  host_i2c_reset ();
+  OSCCONbits.COSC = 3;                /* Primary oscillator with PLL ... */
+  OSCCONbits.LOCK = 1;                /* ... locked */
+  host_ms_hook = script;
+  fw_main ();
+  return 1;                           /* Not reached */
+}
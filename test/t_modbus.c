@@ -0,0 +1,280 @@
+/*****************************************************************************
+ *
+ *   t_modbus.c -- ModBus throughput on one unit's line at each baud rate,
+ *                 the master polling it back to back through the UART2
+ *                 model (uart.c).  The whole unit runs, fw_main() from
+ *                 power-up as in t_scenario, on the jumpers' 9600 baud;
+ *                 then each rate is set as the SysParm baud override and
+ *                 taken up as at start-up (modbus_baud_override(),
+ *                 modbus_init()).
+ *
+ *                 At each rate the master sends NPOLL of each poll below
+ *                 and checks the answer, first with the unit holding its
+ *                 response for the default turnaround delay
+ *                 (SysParm.ModBusRespWait, 100 ms) and then with none,
+ *                 where the line and the main loop are all there is to
+ *                 it.  A poll takes from the request going out to the
+ *                 last character of the response, and the line must then
+ *                 be quiet for t3.5 (the firmware's own modbus_eom_time)
+ *                 before the next request; that gives the frames a second
+ *                 one unit can answer.  No frame may be lost or refused,
+ *                 and with no delay every rate must beat the one below
+ *                 it.
+ *
+ *                 With no delay the interrupts each frame takes are
+ *                 counted by source (host_isr_count[]), with the time from
+ *                 the request's last character to DMA1 starting on the
+ *                 response and from the response's last character to
+ *                 modbus_tx_release() giving the line back.  Sending must
+ *                 take one DMA1 and one U2TX interrupt whatever its
+ *                 length, receiving no more than one per character, and
+ *                 the line must be given back within a character time.
+ *
+ *****************************************************************************/
+#include "common.h"
+
+extern int fw_main (void);
+extern void __real_modbus_tx_release (void);
+
+typedef struct
+{
+  const char   *name;
+  unsigned char msg[6];
+  int           reply;                /* Length of the response */
+} POLL;
+
+static const POLL poll[] =
+{
+  { "StatusA",     { 1, 0x03, 0x01, 0x04, 0x00, 0x01 },  7 },
+  { "100-10F",     { 1, 0x03, 0x01, 0x00, 0x00, 0x10 }, 37 },
+};
+#define NKIND   (int)(sizeof poll / sizeof poll[0])
+
+static const struct
+{
+  BAUD_RATE     baud;
+  unsigned long bps;
+} rate[] =
+{
+  { B09600,   9600 }, { B19200,  19200 }, { B38400,  38400 },
+  { B57600,  57600 }, { B115200, 115200 },
+};
+#define NRATE   (int)(sizeof rate / sizeof rate[0])
+
+static const unsigned int wait[] = { 100, 0 };    /* ModBusRespWait, ms */
+#define NWAIT   (int)(sizeof wait / sizeof wait[0])
+
+#define NPOLL   50
+#define T5_NS   3200                  /* Timer 5 tick */
+
+typedef enum { S_BOOT, S_SETTLE, S_POLL, S_DONE } STEP;
+
+static const unsigned long step_limit[] = { 60000, 3000, 1000 };
+
+static STEP step;
+static unsigned long step_ms;
+static int cur, w, kind, n;
+static unsigned long long sent_us;
+static unsigned long long busy_us[NRATE][NWAIT][NKIND];  /* Polls, t3.5 gaps */
+static unsigned long errs0;
+static unsigned long isr0[HOST_NSRC];
+static unsigned long long release_us;
+
+/* Per rate and poll, with no turnaround delay */
+
+static const int src[] = { HOST_U2RX, HOST_T5, HOST_DMA1, HOST_U2TX };
+static const char *const src_name[] = { "U2RX", "T5", "DMA1", "U2TX" };
+#define NSHOW   (int)(sizeof src / sizeof src[0])
+
+static unsigned long ints[NRATE][NKIND][HOST_NSRC];
+static unsigned long long reply_us[NRATE][NKIND];  /* Request in to DMA1 */
+static unsigned long long free_us[NRATE][NKIND];   /* Last out to release */
+
+static void next (STEP s)
+{
+  step = s;
+  step_ms = 0;
+}
+
+static double per_sec (int r, int v, int k)
+{
+  return busy_us[r][v][k] ? 1e6 * NPOLL / (double)busy_us[r][v][k] : 0;
+}
+
+static void finish (void)
+{
+  int r, v, k;
+
+  printf ("\nframes/s %8s", "");
+  for (v = 0; v < NWAIT; v++)
+    printf ("  %3u ms turnaround delay    ", wait[v]);
+  printf ("\n%8s %8s", "baud", "");
+  for (v = 0; v < NWAIT; v++)
+    for (k = 0; k < NKIND; k++)
+      printf (" %14s", poll[k].name);
+  printf ("\n");
+  for (r = 0; r < NRATE; r++)
+  {
+    printf ("%8lu %8s", rate[r].bps, "");
+    for (v = 0; v < NWAIT; v++)
+      for (k = 0; k < NKIND; k++)
+        printf (" %14.1f", per_sec (r, v, k));
+    printf ("\n");
+  }
+
+  printf ("\nno delay, interrupts a frame\n%17s", "");
+  for (k = 0; k < NSHOW; k++)
+    printf (" %6s", src_name[k]);
+  printf (" %12s %12s\n", "to DMA1 ms", "release us");
+  for (r = 0; r < NRATE; r++)
+    for (v = 0; v < NKIND; v++)
+    {
+      printf ("%8lu %-8s", rate[r].bps, poll[v].name);
+      for (k = 0; k < NSHOW; k++)
+        printf (" %6.2f", (double)ints[r][v][src[k]] / NPOLL);
+      printf (" %12.2f %12.1f\n", (double)reply_us[r][v] / NPOLL / 1000,
+              (double)free_us[r][v] / NPOLL);
+    }
+  fflush (stdout);
+  exit (host_done ("modbus"));
+}
+
+/* Take up rate "r" as at start-up, turnaround delay "v" */
+
+static void set_rate (int r, int v)
+{
+  SysParm.ModBusRespWait = wait[v];
+  SysParm.ModBusBaud = rate[r].baud;
+  modbus_baud_override ();
+  modbus_init ();
+  HOST_CHECK (modbus_baud == rate[r].baud);
+}
+
+static void send (void)
+{
+  host_modbus_send (poll[kind].msg, sizeof poll[kind].msg);
+  sent_us = host_now_us ();
+  memcpy (isr0, host_isr_count, sizeof isr0);
+  release_us = 0;
+}
+
+void __wrap_modbus_tx_release (void)
+{
+  release_us = host_now_us ();
+  __real_modbus_tx_release ();
+}
+
+/* One character time at the rate in use, us */
+
+static unsigned long char_us (void)
+{
+  return 11000000UL / rate[cur].bps;
+}
+
+/* The response to the poll just sent is all out: check it and send the
+   next, or move to the next rate */
+
+static void answered (void)
+{
+  unsigned char reply[MODBUS_MAX_LEN];
+  int len = host_modbus_reply (reply, sizeof reply);
+  unsigned long long t35 = (unsigned long long)modbus_eom_time * T5_NS / 1000;
+  int s;
+
+  HOST_CHECK (len == poll[kind].reply);
+  HOST_CHECK ((reply[0] == 1) && (reply[1] == 0x03));
+  HOST_CHECK (modbus_CRC (reply, (unsigned int)len - 2, INIT_CRC_SEED)
+              == (unsigned int)(reply[len - 2] | (reply[len - 1] << 8)));
+  busy_us[cur][w][kind] += host_modbus_done_us - sent_us + t35;
+  HOST_CHECK (release_us >= host_modbus_done_us);
+  HOST_CHECK (release_us - host_modbus_done_us <= char_us ());
+  if (wait[w] == 0)
+  {
+    for (s = 0; s < HOST_NSRC; s++)
+      ints[cur][kind][s] += host_isr_count[s] - isr0[s];
+    HOST_CHECK (host_isr_count[HOST_DMA1] - isr0[HOST_DMA1] == 1);
+    HOST_CHECK (host_isr_count[HOST_U2TX] - isr0[HOST_U2TX] == 1);
+    HOST_CHECK (host_isr_count[HOST_U2RX] - isr0[HOST_U2RX]
+                <= sizeof poll[kind].msg + 2);
+    reply_us[cur][kind] += host_modbus_tx_us - host_modbus_rx_us;
+    free_us[cur][kind] += release_us - host_modbus_done_us;
+  }
+  if (++n == NPOLL)
+  {
+    n = 0;
+    if (++kind == NKIND)
+    {
+      kind = 0;
+      HOST_CHECK (modbus_Recv_err == errs0);
+      if (++w == NWAIT)
+      {
+        w = 0;
+        for (kind = 0; (cur > 0) && (kind < NKIND); kind++)
+          HOST_CHECK (per_sec (cur, NWAIT - 1, kind)
+                      > per_sec (cur - 1, NWAIT - 1, kind));
+        kind = 0;
+        if (++cur == NRATE)
+        {
+          next (S_DONE);
+          finish ();
+        }
+      }
+      set_rate (cur, w);
+    }
+  }
+  send ();
+  next (S_POLL);
+}
+
+static void script (void)
+{
+  step_ms++;
+  switch (step)
+  {
+    case S_BOOT:
+      if (modbus_state != READY)
+        next (S_SETTLE);
+      break;
+
+    case S_SETTLE:
+      if ((step_ms < 2000) || (main_state != IDLE))
+        break;
+      HOST_CHECK (iambroke == 0);
+      HOST_CHECK (modbus_baud == B09600);
+      errs0 = modbus_Recv_err;
+      HOST_CHECK (SysParm.ModBusRespWait == wait[0]);
+      set_rate (cur, w);
+      send ();
+      next (S_POLL);
+      break;
+
+    case S_POLL:
+      if (host_modbus_done_us && (modbus_state == READY))
+        answered ();
+      break;
+
+    default:
+      break;
+  }
+  if ((step < S_DONE) && (step_ms > step_limit[step]))
+  {
+    fprintf (stderr, "%lu baud, %u ms delay, %s poll %d, step %d: no progress"
+             " in %lu ms (modbus_state %d)\n", rate[cur].bps, wait[w],
+             poll[kind].name, n, (int)step, step_limit[step],
+             (int)modbus_state);
+    host_fails++;
+    finish ();
+  }
+  if (host_fails)
+    finish ();
+}
+
+int main (void)
+{
+  host_i2c_reset ();
+  OSCCONbits.COSC = 3;                /* Primary oscillator with PLL ... */
+  OSCCONbits.LOCK = 1;                /* ... locked */
+  host_ms_hook = script;
+  fw_main ();
+  return 1;                           /* Not reached */
+}
@@ -0,0 +1,193 @@
+/*****************************************************************************
+ *
+ *   t_probeq.c -- the T3 probe scan queue: read_probes() (interrupt side)
+ *                 queues, probe_drain() (main loop) converts.  The binary
+ *                 conversions that come out are compared with the same
+ *                 scans converted one at a time, with the queue's rules
+ *                 for a full queue and probe_q_resync() applied by hand:
+ *                 the scans before the gap are dropped and the first one
+ *                 after it is only the new baseline.
+ *
+ *****************************************************************************/
+#include "common.h"
+#include <stdlib.h>
+
+#define SCANS   20000
+
+static unsigned int wave[SCANS][MAX_CHAN];
+static unsigned char drain_after[SCANS];  /* probe_drain() after this scan */
+static unsigned char resync_at[SCANS];    /* probe_q_resync() before it */
+
+/* Conversion results, one per converted scan: probe_array[] entry and
+   the probe_pulse level after it */
+
+typedef struct
+{
+  unsigned int scan;
+  unsigned int array;
+  unsigned int pulse;
+} RESULT;
+
+static RESULT want[SCANS], got[SCANS];
+static int nwant, ngot;
+
+static void make_input (void)
+{
+  int s, c, v[MAX_CHAN], stall = 0;
+
+  srand (50);
+  for (c = 0; c < MAX_CHAN; c++)
+    v[c] = 4000;
+  for (s = 0; s < SCANS; s++)
+  {
+    for (c = 0; c < MAX_CHAN; c++)
+    {
+      if ((rand () % 16) == 0)              /* Probe flips */
+        v[c] = (v[c] > 4500) ? 3000 + (rand () % 1000) : 5000 + (rand () % 3000);
+      wave[s][c] = (unsigned int)(v[c] + (rand () % 41) - 20);
+    }
+    if (stall)
+      stall--;
+    else if ((rand () % 300) == 0)
+      stall = PROBE_Q_SIZE + (rand () % 20); /* A long main loop pass */
+    drain_after[s] = !stall && ((rand () % 6) == 0);
+    resync_at[s] = (rand () % 700) == 0;
+  }
+}
+
+static void reset_state (void)
+{
+  memset (old_probe_volt, 0, sizeof old_probe_volt);
+  memset (probe_array, 0, sizeof probe_array);
+  probe_index = 0;
+  probe_pulse = 0;
+  probe_drain ();                         /* Empty the queue */
+  probe_q_lost = 0;
+  probe_q_peak = 0;
+}
+
+static void note (RESULT *r, int *n, unsigned int scan)
+{
+  r[*n].scan = scan;
+  r[*n].array = probe_array[(probe_index + MAX_ARRAY - 1) % MAX_ARRAY];
+  r[*n].pulse = probe_pulse;
+  (*n)++;
+}
+
+/* One scan at a time, the queue kept by hand */
+
+static void run_model (unsigned int *lost)
+{
+  int pend[PROBE_Q_SIZE], npend = 0, cut = -1, sync = 1;
+  int s, i, k;
+
+  reset_state ();
+  *lost = 0;
+  for (s = 0; s < SCANS; s++)
+  {
+    if (resync_at[s])
+      cut = npend;
+    if (npend == PROBE_Q_SIZE - 1)          /* Full: drop, start over */
+    {
+      (*lost)++;
+      cut = npend;
+    }
+    else
+      pend[npend++] = s;
+    if (!drain_after[s])
+      continue;
+    k = 0;
+    if (cut >= 0)
+    {
+      k = cut;
+      cut = -1;
+      sync = 1;
+    }
+    for (i = k; i < npend; i++)
+    {
+      if (sync)
+      {
+        memcpy (old_probe_volt, wave[pend[i]], sizeof wave[0]);
+        sync = 0;
+      }
+      convert_to_binary (wave[pend[i]]);
+      note (want, &nwant, (unsigned int)pend[i]);
+    }
+    npend = 0;
+  }
+}
+
+/* The real thing: read_probes() and probe_drain() */
+
+static void run_queue (void)
+{
+  unsigned int before;
+  int s, k, first = 0;
+
+  reset_state ();
+  probe_q_resync ();                        /* Start from a baseline */
+  for (s = 0; s < SCANS; s++)
+  {
+    if (resync_at[s])
+      probe_q_resync ();
+    memcpy (result_ptr, wave[s], sizeof wave[s]);
+    for (k = 0; k < MAX_CHAN; k++)          /* read_probes() scales by 5.27 */
+      result_ptr[k] = (wave[s][k] * 100 + 526) / 527;
+    dma_result_flag = 1;
+    read_probes ();
+    if (!drain_after[s])
+      continue;
+    before = probe_index;
+    probe_drain ();
+    for (k = (int)((probe_index + MAX_ARRAY - before) % MAX_ARRAY); k > 0; k--)
+    {
+      got[ngot].array = probe_array[(probe_index + MAX_ARRAY - k) % MAX_ARRAY];
+      got[ngot].pulse = probe_pulse;        /* Only the last is checked */
+      got[ngot].scan = (unsigned int)first++;
+      ngot++;
+    }
+  }
+}
+
+int main (void)
+{
+  unsigned int lost;
+  int i, j;
+
+  make_input ();
+  arrive_state = ARRIVE_OFF;
+  start_point = 0;
+  class_window = 0;
+  SysParm.ADCTmaxNV = 3800;
+  SysParm.ADCOmaxNV = 4500;
+  SysParm.ADCTHstNV = 100;
+  probe_try_state = OPTIC2;
+  for (i = 0; i < MAX_CHAN; i++)
+    probes_state[i] = P_WET;                /* No retyping */
+
+  /* read_probes() converts the raw counts to millivolts; feed the model
+     what that conversion gives back */
+  for (i = 0; i < SCANS; i++)
+    for (j = 0; j < MAX_CHAN; j++)
+      wave[i][j] = (unsigned int)(((unsigned long)((wave[i][j] * 100 + 526) / 527)
+                                   * 527) / 100);
+
+  run_model (&lost);
+  run_queue ();
+
+  HOST_CHECK (lost > 0);
+  HOST_CHECK (probe_q_lost == lost);
+  HOST_CHECK (probe_q_peak == PROBE_Q_SIZE - 1);
+  HOST_CHECK (ngot == nwant);
+  for (i = 0; (i < ngot) && (i < nwant); i++)
+    if (got[i].array != want[i].array)
+    {
+      fprintf (stderr, "result %d (scan %u): array %x, want %x\n", i,
+               want[i].scan, got[i].array, want[i].array);
+      HOST_CHECK (0);
+      break;
+    }
+  HOST_CHECK (probe_pulse == want[nwant - 1].pulse);
+
+  return host_done ("probeq");
+}
@@ -0,0 +1,385 @@
+/*****************************************************************************
+ *
+ *   t_pulsebus.c -- two to four units sharing one truck's 5-wire optic
+ *                   probe chain, each running active_5wire() (optic5.c),
+ *                   with the pulse slots and as it was before them: a
+ *                   pulse every 95 ms, 15 ms later when the line is busy,
+ *                   and a pass shortened 15 then 25 ms after a miss.
+ *
+ *                   The firmware's state is all global, so each unit is
+ *                   a process forked after the NV format, and the chain
+ *                   is in shared memory.  A unit's set_porte(OPTIC_PULSE)
+ *                   puts a pulse on it; a read_ADC() waits until every
+ *                   other unit's clock has caught up with its own and then
+ *                   shows channel 5 high while an echo is on the line.  A
+ *                   pulse the chain takes echoes ECHO_US later for
+ *                   WIDTH_US; one within BUSY_US of the last it took is a
+ *                   collision, and is lost.
+ *
+ *                   The units connect STAGGER_MS apart, each with its own
+ *                   serial number, and then run main loop passes of 1 to
+ *                   4 ms (PASS_US, drawn afresh each pass, so no two keep
+ *                   step).  A unit that calls three misses in a row wet
+ *                   (DIAG) is counted a spurious WET and put back.
+ *
+ *                   From the last unit's connect plus SETTLE_MS to the end
+ *                   each unit's pulses are taken: samples (taken by the
+ *                   chain and echoed), collisions, false echoes (lost, but
+ *                   an echo seen all the same: another unit's), and WETs.
+ *                   A unit only slots once it has seen another's echo, so
+ *                   some runs never lock and match back-off pulse for
+ *                   pulse.  Over all the runs the slots must collide no
+ *                   more often than back-off and call no more WETs, and
+ *                   the slowest slotted unit must sample at RATE_PCT of
+ *                   the slowest backing off or better.
+ *
+ *****************************************************************************/
+#include "common.h"
+#include "volts.h"
+#include <stdlib.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char __real_read_ADC (void);
+extern void __real_set_porte (UINT16 port_select);
+
+#define MAXU       4                  /* Units on the chain */
+#define MAXP       4096               /* Pulses a run */
+#define RUN_MS     30000UL            /* Each run, from the first connect */
+#define STAGGER_MS 700UL              /* Between connects (and up to 300 more) */
+#define SETTLE_MS  3000UL             /* Last connect to the measurement */
+#define PASS_US    1000               /* Shortest main loop pass ... */
+#define PASS_VAR   3000               /* ... plus up to this, per unit */
+#define PASS_JIT   500                /* ... and pass to pass */
+#define ECHO_US    1000               /* Pulse start to echo */
+#define WIDTH_US   2000               /* Echo */
+#define BUSY_US    8000               /* Chain busy after a pulse it takes */
+#define BACK_US    500000ULL          /* Pulses a look goes back over */
+#define HIGH_MV    6000               /* Channel 5, an echo on the line */
+#define RATE_PCT   95                 /* Slotted sample rate against back-off */
+
+typedef struct
+{
+  unsigned long long start;           /* Bus time, us */
+  int unit;
+  int loop;                           /* Fired by a main loop pass */
+  int echoed;                         /* ... and the unit saw its echo */
+  volatile int ready;
+} SHOT;
+
+typedef struct
+{
+  volatile unsigned long long clock[MAXU];
+  unsigned long long connect[MAXU];   /* Setup over */
+  unsigned long wets[MAXU];
+  int npulse;
+  SHOT pulse[MAXP];
+} CHAIN;
+
+typedef struct
+{
+  unsigned long fired, samples, collided, false_echo, wets;
+} UNIT;
+
+static const char *const scheme[] = { "back-off", "slots" };
+#define NSCHEME 2
+
+static CHAIN *bus;
+static int me = -1;                   /* This process's unit, -1 the parent */
+static int units;
+static unsigned long long t0;         /* host_now_us() at the fork */
+static int last;                      /* Pulse just fired, -1 none */
+static UNIT res[NSCHEME][MAXU + 1][MAXU];
+static unsigned long long window[NSCHEME][MAXU + 1];
+
+static unsigned long long bus_us (void)
+{
+  return host_now_us () - t0;
+}
+
+static void publish (void)
+{
+  if (me >= 0)
+  {
+    __sync_synchronize ();
+    bus->clock[me] = bus_us ();
+  }
+}
+
+/* Every other unit up to time "t" */
+
+static void lockstep (unsigned long long t)
+{
+  int u;
+
+  for (u = 0; u < units; u++)
+    while ((u != me) && (bus->clock[u] < t))
+      sched_yield ();
+  __sync_synchronize ();
+}
+
+static int by_start (const void *a, const void *b)
+{
+  const SHOT *p = a, *q = b;
+
+  if (p->start != q->start)
+    return (p->start < q->start) ? -1 : 1;
+  return p->unit - q->unit;
+}
+
+/* Of "n" pulses in time order, which the chain takes */
+
+static void take (const SHOT *p, int n, char *taken)
+{
+  unsigned long long free_at = 0;
+  int i;
+
+  for (i = 0; i < n; i++)
+  {
+    taken[i] = (p[i].start >= free_at);
+    if (taken[i])
+      free_at = p[i].start + BUSY_US;
+  }
+}
+
+/* Is an echo on the line at "t" */
+
+static int echo_at (unsigned long long t)
+{
+  SHOT p[64];
+  char taken[64];
+  int i, n = 0;
+
+  for (i = bus->npulse - 1; (i >= 0) && (n < 64); i--)
+  {
+    if (!bus->pulse[i].ready || (bus->pulse[i].start > t))
+      continue;
+    if (bus->pulse[i].start + BACK_US < t)
+      break;
+    p[n++] = bus->pulse[i];
+  }
+  qsort (p, (size_t)n, sizeof p[0], by_start);
+  take (p, n, taken);
+  for (i = 0; i < n; i++)
+    if (taken[i] && (t >= p[i].start + ECHO_US)
+        && (t < p[i].start + ECHO_US + WIDTH_US))
+      return 1;
+  return 0;
+}
+
+char __wrap_read_ADC (void)
+{
+  char sts = __real_read_ADC ();
+  unsigned long long t;
+
+  if (me >= 0)
+  {
+    t = bus_us ();
+    publish ();
+    lockstep (t);
+    probe_volt[5] = echo_at (t) ? HIGH_MV : 0;
+  }
+  return sts;
+}
+
+/* Init_Timer4() sets the pulse going as well as optic_5_fire(): one
+   pulse a microsecond */
+
+void __wrap_set_porte (UINT16 port_select)
+{
+  static unsigned long long fired_us = ~0ULL;
+  int i;
+
+  if ((me >= 0) && (port_select == OPTIC_PULSE) && (bus_us () != fired_us))
+  {
+    fired_us = bus_us ();
+    i = __sync_fetch_and_add (&bus->npulse, 1);
+    if (i < MAXP)
+    {
+      bus->pulse[i].start = bus_us ();
+      bus->pulse[i].unit = me;
+      __sync_synchronize ();
+      bus->pulse[i].ready = 1;
+      last = i;
+    }
+  }
+  __real_set_porte (port_select);
+}
+
+/* active_5wire() as it was before the slots, its pulse path */
+
+static void old_active_5wire (void)
+{
+  if (probe_time >= read_time ())
+    return;
+  probe_time = read_time () + SLOT_FRAME;
+  switch (optic5_state)
+  {
+    case NO5_TEST:
+    case PULSED:
+    case ECHOED:
+      optic5_state = PULSED;
+      optic_5_pulse ();
+      if (check_echo () != 0)
+      {
+        optic5_state = ECHOED;
+        tank_state = T_DRY;
+        wet_pass_count = 0;
+      }
+      else if (++wet_pass_count > 2)
+      {
+        optic5_state = DIAG;
+        tank_state = T_WET;
+      }
+      else if (wet_pass_count == 1)
+        probe_time -= 15;
+      else
+        probe_time -= 25;
+      break;
+
+    default:
+      break;
+  }
+}
+
+static void unit (int u, int s)
+{
+  unsigned long long end = RUN_MS * 1000ULL;
+  unsigned long pass;
+  int i;
+
+  me = u;
+  host_ms_hook = publish;             /* Let the others on between looks */
+  srand (48 + 7 * (unsigned)u + 31 * (unsigned)units);
+  for (i = 0; i < BYTESERIAL; i++)
+    Intellitrol_SN[i] = (unsigned char)(0x10 * (u + 1) + i);
+  host_run_us ((u * STAGGER_MS + (unsigned long)(rand () % 300)) * 1000UL);
+  pass = PASS_US + (unsigned long)(rand () % PASS_VAR);
+  optic_5_setup ();
+  bus->connect[u] = bus_us ();
+  while (bus_us () < end)
+  {
+    host_run_us (pass + (unsigned long)(rand () % PASS_JIT));
+    last = -1;
+    if (s)
+      active_5wire ();
+    else
+      old_active_5wire ();
+    if (last >= 0)
+    {
+      bus->pulse[last].loop = 1;
+      bus->pulse[last].echoed = (optic5_state == ECHOED);
+    }
+    if (optic5_state == DIAG)         /* Three misses: called wet */
+    {
+      bus->wets[u]++;
+      optic5_state = PULSED;
+      wet_pass_count = 0;
+      tank_state = T_DRY;
+    }
+  }
+  bus->clock[u] = ~0ULL;              /* Out of the way */
+  exit (host_fails != 0);
+}
+
+static void run (int s, int n)
+{
+  static char taken[MAXP];
+  unsigned long long from = 0;
+  pid_t pid[MAXU];
+  int u, i, st;
+
+  memset (bus, 0, sizeof *bus);
+  units = n;
+  t0 = host_now_us ();
+  fflush (stdout);
+  for (u = 0; u < n; u++)
+  {
+    pid[u] = fork ();
+    if (pid[u] == 0)
+      unit (u, s);
+    HOST_CHECK (pid[u] > 0);
+  }
+  for (u = 0; u < n; u++)
+  {
+    HOST_CHECK (waitpid (pid[u], &st, 0) == pid[u]);
+    HOST_CHECK (WIFEXITED (st) && (WEXITSTATUS (st) == 0));
+    if (bus->connect[u] > from)
+      from = bus->connect[u];
+  }
+  HOST_CHECK (bus->npulse < MAXP);
+  from += SETTLE_MS * 1000ULL;
+  window[s][n] = RUN_MS * 1000ULL - from;
+  qsort (bus->pulse, (size_t)bus->npulse, sizeof bus->pulse[0], by_start);
+  take (bus->pulse, bus->npulse, taken);
+  for (i = 0; i < bus->npulse; i++)
+  {
+    SHOT *p = &bus->pulse[i];
+    UNIT *r = &res[s][n][p->unit];
+
+    if (!p->loop || (p->start < from))
+      continue;
+    r->fired++;
+    if (taken[i] && p->echoed)
+      r->samples++;
+    if (!taken[i])
+    {
+      r->collided++;
+      if (p->echoed)
+        r->false_echo++;
+    }
+  }
+  for (u = 0; u < n; u++)
+    res[s][n][u].wets = bus->wets[u];
+}
+
+int main (void)
+{
+  unsigned long coll[NSCHEME] = { 0 }, wets[NSCHEME] = { 0 };
+  double rate, worst[NSCHEME];
+  int s, n, u;
+
+  bus = mmap (NULL, sizeof *bus, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  HOST_CHECK (bus != MAP_FAILED);
+  host_nv_format ();
+  Init_ADC ();
+  Init_Timer2 ();                     /* The 1 ms read_time() tick */
+  for (n = 2; (n <= MAXU) && !host_fails; n++)
+    for (s = 0; (s < NSCHEME) && !host_fails; s++)
+      run (s, n);
+  if (host_fails)
+    return host_done ("pulsebus");
+
+  printf ("\n%5s %-9s %4s %7s %8s %9s %10s %6s %5s\n", "units", "scheme",
+          "unit", "pulses", "samples", "samples/s", "collisions", "false",
+          "WETs");
+  for (n = 2; n <= MAXU; n++)
+  {
+    for (s = 0; s < NSCHEME; s++)
+    {
+      worst[s] = 1e9;
+      for (u = 0; u < n; u++)
+      {
+        UNIT *r = &res[s][n][u];
+
+        rate = r->samples * 1e6 / window[s][n];
+        if (rate < worst[s])
+          worst[s] = rate;
+        coll[s] += r->collided;
+        wets[s] += r->wets;
+        printf ("%5d %-9s %4d %7lu %8lu %9.2f %10lu %6lu %5lu\n", n,
+                scheme[s], u, r->fired, r->samples, rate, r->collided,
+                r->false_echo, r->wets);
+      }
+    }
+    HOST_CHECK (worst[1] * 100 >= worst[0] * RATE_PCT);
+  }
+  printf ("%-15s %10lu %10lu\n%-15s %10lu %10lu\n", "collisions o/s",
+          coll[0], coll[1], "WETs o/s", wets[0], wets[1]);
+  HOST_CHECK (coll[1] <= coll[0]);
+  HOST_CHECK (wets[1] <= wets[0]);
+  return host_done ("pulsebus");
+}
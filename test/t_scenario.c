@@ -0,0 +1,149 @@
+/*****************************************************************************
+ *
+ *   t_scenario.c -- the whole unit, fw_main() from power-up, against the
+ *                   board models: boot through the diagnostics to IDLE
+ *                   with nothing broken, a truck of eight dry 2-wire
+ *                   optic probes connects and gets its permit (main
+ *                   relay closed, StatusA permit bit also read over
+ *                   ModBus), probe 5 goes wet and the permit is dropped,
+ *                   the truck disconnects and the unit is back in IDLE.
+ *
+ *                   The script runs from host_ms_hook, one look a
+ *                   millisecond of virtual time; each step has a time
+ *                   limit, and fw_main() never returns, so the test
+ *                   ends with exit() from there.
+ *
+ *****************************************************************************/
+#include "common.h"
+
+extern int fw_main (void);
+
+typedef enum
+{
+  S_BOOT,                             /* Power-up to the main loop */
+  S_SETTLE,                           /* IDLE, nothing wrong, for a while */
+  S_CONNECT,                          /* Truck on: wait for the permit */
+  S_QUERY,                            /* ModBus: StatusA */
+  S_OVERFILL,                         /* Probe 5 wet: permit dropped */
+  S_DISCONNECT,                       /* Truck off: back to IDLE */
+  S_DONE
+} STEP;
+
+static const char *const step_name[] =
+  { "boot", "settle", "connect", "query", "overfill", "disconnect" };
+static const unsigned long step_limit[] =   /* ms */
+  { 60000, 2000, 20000, 1000, 5000, 30000 };
+
+static STEP step;
+static unsigned long step_ms;         /* Time in this step */
+
+static void next (STEP s)
+{
+  step = s;
+  step_ms = 0;
+}
+
+static void finish (void)
+{
+  fflush (stdout);
+  exit (host_done ("scenario"));
+}
+
+static int permitted (void)
+{
+  return MAIN_ENABLE && (MainRelaySt == RELAY_CLOSED)
+         && (StatusA & STSA_PERMIT);
+}
+
+static void script (void)
+{
+  static const unsigned char status_a[] = { 1, 0x03, 0x01, 0x04, 0x00, 0x01 };
+  unsigned char reply[MODBUS_MAX_LEN];
+  int n;
+
+  step_ms++;
+  switch (step)
+  {
+    case S_BOOT:
+      if (modbus_state != READY)      /* Only the main loop moves it on */
+        next (S_SETTLE);
+      break;
+
+    case S_SETTLE:
+      HOST_CHECK (main_state == IDLE);
+      HOST_CHECK (!MAIN_ENABLE);
+      if (step_ms < 1000)
+        break;
+      HOST_CHECK (iambroke == 0);
+      HOST_CHECK (!(StatusA & STSA_FAULT));
+      HOST_CHECK (modbus_addr == 1);
+      host_truck_probes = 0xFF;
+      next (S_CONNECT);
+      break;
+
+    case S_CONNECT:
+      if ((main_state == ACTIVE) && permitted ())
+      {
+        host_modbus_send (status_a, sizeof status_a);
+        next (S_QUERY);
+      }
+      break;
+
+    case S_QUERY:
+      n = host_modbus_reply (reply, sizeof reply);
+      if (n < 7)
+        break;
+      HOST_CHECK (n == 7);
+      HOST_CHECK ((reply[0] == 1) && (reply[1] == 0x03) && (reply[2] == 2));
+      HOST_CHECK (modbus_CRC (reply, 5, INIT_CRC_SEED)
+                  == (unsigned int)(reply[5] | (reply[6] << 8)));
+      HOST_CHECK (((reply[3] << 8) | reply[4]) & STSA_PERMIT);
+      host_truck_wet = 0x10;
+      next (S_OVERFILL);
+      break;
+
+    case S_OVERFILL:
+      HOST_CHECK (main_state == ACTIVE);
+      if (!MAIN_ENABLE && (probes_state[4] == P_WET)
+          && !(StatusA & STSA_PERMIT))
+      {
+        host_truck_probes = 0;
+        host_truck_wet = 0;
+        next (S_DISCONNECT);
+      }
+      break;
+
+    case S_DISCONNECT:
+      HOST_CHECK (!MAIN_ENABLE);
+      if ((main_state == IDLE) && (StatusA & STSA_IDLE))
+      {
+        HOST_CHECK (iambroke == 0);
+        next (S_DONE);
+        finish ();
+      }
+      break;
+
+    default:
+      break;
+  }
+  if ((step < S_DONE) && (step_ms > step_limit[step]))
+  {
+    fprintf (stderr, "step %s: no progress in %lu ms (state %d, StatusA %04X,"
+             " iambroke %04X)\n", step_name[step], step_limit[step],
+             (int)main_state, StatusA, iambroke);
+    host_fails++;
+    finish ();
+  }
+  if (host_fails)
+    finish ();
+}
+
+int main (void)
+{
+  host_i2c_reset ();
+  OSCCONbits.COSC = 3;                /* Primary oscillator with PLL ... */
+  OSCCONbits.LOCK = 1;                /* ... locked */
+  host_ms_hook = script;
+  fw_main ();
+  return 1;                           /* Not reached */
+}
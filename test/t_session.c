@@ -0,0 +1,418 @@
+/*****************************************************************************
+ *
+ *   t_session.c -- Session Record ring: nvSesGet() returns the newest
+ *                  records newest first, around and past the end of the
+ *                  ring, after a reboot (nvSesInit()), after a refused
+ *                  write and a torn newest record, and across the sequence
+ *                  number wrap (0xFFFE to 0, 0xFFFF marks an erased slot).
+ *
+ *                  Then the whole unit runs, fw_main() from power-up as in
+ *                  t_classify, VIP enabled and the truck's TIM in the
+ *                  local list, and the trucks below are connected one
+ *                  after another, some of them with a probe going wet and
+ *                  dry again while permitted.  The script notes when it
+ *                  sees each phase (ACQUIRE entered, probe type decided,
+ *                  TIM read, truck authorized, permit, dry to wet) and
+ *                  the record each connection leaves must say the same:
+ *                  the flags, the type, the flaps, the serial number, the
+ *                  times from ACQUIRE to within a main loop pass, the
+ *                  arrival time and the seconds connected.
+ *
+ *****************************************************************************/
+#include "common.h"
+#include <stdlib.h>
+
+extern int fw_main (void);
+
+#define MAXSES  200
+
+static E2SESREC ses[MAXSES];          /* Everything written, oldest first */
+static int nses;
+
+static void put (void)
+{
+  E2SESREC rec;
+
+  memset (&rec, 0, sizeof rec);
+  rec.Time = 0x50000000UL + (UINT32)nses * 60;
+  rec.Serial[5] = (char)nses;
+  rec.Secs = (UINT16)(rand () & 0xFFFF);
+  rec.Flaps = (UINT16)nses;
+  HOST_CHECK (nvSesPut (&rec) == 0);
+  ses[nses++] = rec;
+}
+
+/* nvSesGet() against the newest of ses[], "held" of them in the ring */
+
+static void check (int held, const char *when)
+{
+  E2SESREC rec;
+  int back;
+
+  for (back = 0; back < held; back++)
+    if ((nvSesGet ((unsigned int)back, &rec) != 0)
+        || memcmp (&rec, &ses[nses - 1 - back], sizeof rec))
+    {
+      fprintf (stderr, "%s, %d written: back %d wrong\n", when, nses, back);
+      HOST_CHECK (0);
+      return;
+    }
+  if (nvSesGet ((unsigned int)held, &rec) == 0)
+  {
+    fprintf (stderr, "%s, %d written: more than %d held\n", when, nses, held);
+    HOST_CHECK (0);
+  }
+}
+
+static int held (void)
+{
+  return (nses < E2SESCNT) ? nses : E2SESCNT;
+}
+
+/* Scripted connections */
+
+typedef struct
+{
+  const char   *name;
+  int           vip;                  /* VIP authorization on */
+  int           tim;                  /* TIM plugged in */
+  unsigned char probes;               /* Channels with an optic probe */
+  int           flaps;                /* Wet and dry again while permitted */
+} CONN;
+
+static const CONN conn[] =
+{
+  { "8 optic, TIM",           1, 1, 0xFF, 2 },
+  { "8 optic, no TIM",        1, 0, 0xFF, 0 },
+  { "8 optic, no TIM, no VIP", 0, 0, 0xFF, 1 },
+  { "8 optic, TIM, no VIP",   0, 1, 0xFF, 0 },
+};
+#define NCONN  (int)(sizeof conn / sizeof conn[0])
+
+/* The DS28EC20 on COMM_ID (onewire.c) as truck_SN[] reads it */
+static const unsigned char tim_sn[BYTESERIAL] = { 0x00, 0x58, 0x9C, 0x5D, 0x7A, 0x31 };
+
+typedef enum { D_BOOT, D_SETTLE, D_ARRIVE, D_PERMIT, D_WET, D_DRY, D_LEAVE,
+               D_DONE } DSTEP;
+
+static const unsigned long dstep_limit[] = { 60000, 3000, 5000, 30000, 5000,
+                                              10000, 40000 };
+
+static DSTEP dstep;
+static unsigned long dstep_ms;
+static int cur, flaps_left;
+static unsigned long plug_ms;         /* Truck on to ACQUIRE */
+static unsigned long ses_ms;          /* Since ACQUIRE was seen */
+static unsigned long off_ms;          /* ... to the truck going off */
+static unsigned long seen[6];         /* ses_ms each phase was first seen */
+static unsigned char seen_flags;
+static unsigned int seen_flaps;
+static unsigned long seen_time;       /* present_time at ACQUIRE */
+static int last_tank;
+
+enum { P_PROBE, P_VALID, P_PERMIT };
+
+static void dnext (DSTEP s)
+{
+  dstep = s;
+  dstep_ms = 0;
+}
+
+static void dfinish (void)
+{
+  fflush (stdout);
+  exit (host_done ("session"));
+}
+
+/* Note the phases as the script sees them, a look a millisecond */
+
+static void watch (void)
+{
+  ses_ms++;
+  if (!(seen_flags & SES_PROBE)
+      && (truck_state == OPTIC_TWO))
+  {
+    seen_flags |= SES_PROBE;
+    seen[P_PROBE] = ses_ms;
+  }
+  if (StatusA & STSA_TRK_TALK)
+    seen_flags |= SES_TALK;
+  if (!(seen_flags & SES_VALID) && (StatusA & STSA_TRK_VALID))
+  {
+    seen_flags |= SES_VALID;
+    seen[P_VALID] = ses_ms;
+  }
+  if (!(seen_flags & SES_PERMIT) && (StatusA & STSA_PERMIT))
+  {
+    seen_flags |= SES_PERMIT;
+    seen[P_PERMIT] = ses_ms;
+  }
+  if ((tank_state == T_WET) || (tank_state == T_DRY))
+  {
+    if ((tank_state == T_WET) && (last_tank == T_DRY))
+      seen_flaps++;
+    last_tank = tank_state;
+  }
+}
+
+/* A recorded time against the script's: the record's is one more
+   (0 is "never") and taken on a main_activity() pass, so either may be
+   up to a pass and a look late */
+
+static int near (unsigned int ms, unsigned long want, unsigned int pass)
+{
+  unsigned long rec = ms, was = want + 1;
+
+  return (ms != 0) && (rec + pass + 2 >= was) && (rec <= was + pass + 2);
+}
+
+static void check_record (void)
+{
+  const CONN *c = &conn[cur];
+  E2SESREC rec;
+  unsigned char zero[BYTESERIAL];
+
+  HOST_CHECK (nvSesGet (0, &rec) == 0);
+  printf ("%-23s flags %02X type %d  arrive %4u  probe %5u  valid %5u"
+          "  permit %5u  flaps %u  secs %u  loop max %u\n", c->name,
+          rec.Flags, rec.Probe, rec.ArriveMs, rec.ProbeMs, rec.ValidMs,
+          rec.PermitMs, rec.Flaps, rec.Secs, rec.LoopMax);
+  HOST_CHECK ((rec.Flags & ~SES_ARRIVE) == seen_flags);
+  HOST_CHECK (rec.Flags & SES_PROBE);
+  HOST_CHECK (rec.Probe == OPTIC_2);
+  HOST_CHECK (near (rec.ProbeMs, seen[P_PROBE], rec.LoopMax));
+  if (seen_flags & SES_VALID)
+    HOST_CHECK (near (rec.ValidMs, seen[P_VALID], rec.LoopMax));
+  else
+    HOST_CHECK (rec.ValidMs == 0);
+  if (seen_flags & SES_PERMIT)
+  {
+    HOST_CHECK (near (rec.PermitMs, seen[P_PERMIT], rec.LoopMax));
+    HOST_CHECK (rec.PermitMs >= rec.ProbeMs);
+    if (c->vip)
+      HOST_CHECK (rec.PermitMs >= rec.ValidMs);
+  }
+  else
+    HOST_CHECK (rec.PermitMs == 0);
+  /* With VIP on, the permit comes with the TIM and only with it */
+  HOST_CHECK ((seen_flags & SES_PERMIT) || !c->tim || !c->vip);
+  HOST_CHECK (!(seen_flags & SES_PERMIT) || c->tim || !c->vip);
+  /* Pulling the truck off reads wet before it reads gone */
+  HOST_CHECK (rec.Flaps == seen_flaps);
+  HOST_CHECK ((rec.Flaps >= c->flaps) && (rec.Flaps <= c->flaps + 1));
+  memset (zero, 0, sizeof zero);
+  HOST_CHECK (!(c->tim && c->vip) || (seen_flags & SES_TALK));
+  HOST_CHECK (memcmp (rec.Serial, (seen_flags & SES_TALK) ? tim_sn : zero,
+                      BYTESERIAL) == 0);
+  if (rec.Flags & SES_ARRIVE)
+    HOST_CHECK ((rec.ArriveMs >= 1) && (rec.ArriveMs <= plug_ms + 1));
+  HOST_CHECK ((rec.Time >= seen_time - 1) && (rec.Time <= seen_time + 1));
+  HOST_CHECK ((unsigned long)rec.Secs * 1000 <= ses_ms);
+  HOST_CHECK ((unsigned long)rec.Secs * 1000 + 1000 >= off_ms);
+  HOST_CHECK (rec.LoopAvg <= rec.LoopMax);
+}
+
+static void truck_off (void)
+{
+  host_truck_probes = 0;
+  host_truck_wet = 0;
+  host_tim_on = 0;
+}
+
+static void script (void)
+{
+  const CONN *c = &conn[cur];
+
+  dstep_ms++;
+  if ((dstep > D_ARRIVE) && (dstep < D_DONE))
+    watch ();
+  switch (dstep)
+  {
+    case D_BOOT:
+      if (modbus_state != READY)
+        dnext (D_SETTLE);
+      break;
+
+    case D_SETTLE:
+      if ((dstep_ms < 2000) || (main_state != IDLE))
+        break;
+      HOST_CHECK (iambroke == 0);
+      if (c->vip)                     /* RAM only, as TAS sets it */
+        SysParm.EnaFeatures |= ENA_VIP;
+      else
+        SysParm.EnaFeatures &= ~ENA_VIP;
+      host_truck_probes = c->probes;
+      host_tim_on = c->tim;
+      dnext (D_ARRIVE);
+      break;
+
+    case D_ARRIVE:
+      if (main_state == IDLE)
+        break;
+      plug_ms = dstep_ms;
+      ses_ms = 0;
+      memset (seen, 0, sizeof seen);
+      seen_flags = 0;
+      seen_flaps = 0;
+      seen_time = present_time;
+      last_tank = T_INIT;
+      flaps_left = c->flaps;
+      watch ();
+      dnext (D_PERMIT);
+      break;
+
+    case D_PERMIT:
+      if (c->tim || !c->vip)
+      {
+        if (!(StatusA & STSA_PERMIT) || (dstep_ms < 2000))
+          break;
+      }
+      else if (dstep_ms < 8000)       /* Not coming: no TIM to authorize */
+        break;
+      if (flaps_left)
+      {
+        host_truck_wet = 0x10;
+        dnext (D_WET);
+      }
+      else
+      {
+        truck_off ();
+        off_ms = ses_ms;
+        dnext (D_LEAVE);
+      }
+      break;
+
+    case D_WET:
+      if (StatusA & STSA_PERMIT)
+        break;
+      host_truck_wet = 0;
+      flaps_left--;
+      dnext (D_DRY);
+      break;
+
+    case D_DRY:
+      if (!(StatusA & STSA_PERMIT))
+        break;
+      dnext (D_PERMIT);
+      break;
+
+    case D_LEAVE:
+      if ((main_state != IDLE) || !(StatusA & STSA_IDLE))
+        break;
+      check_record ();
+      if (++cur == NCONN)
+      {
+        dnext (D_DONE);
+        dfinish ();
+      }
+      dnext (D_SETTLE);
+      break;
+
+    default:
+      break;
+  }
+  if ((dstep < D_DONE) && (dstep_ms > dstep_limit[dstep]))
+  {
+    fprintf (stderr, "%s, step %d: no progress in %lu ms (state %d,"
+             " acquire %d, StatusA %04X, badvipflag %04X)\n", c->name,
+             (int)dstep, dstep_limit[dstep], (int)main_state,
+             (int)acquire_state, StatusA, badvipflag); 
+    host_fails++;
+    dfinish ();
+  }
+  if (host_fails)
+    dfinish ();
+}
+
+/* Format, allow VIP, put the TIM in the list and power up */
+
+static void drive (void)
+{
+  unsigned char sn[BYTESERIAL];
+
+  host_nv_format ();
+  SysParm.EnaPassword |= ENA_VIP;
+  HOST_CHECK (nvSysParmUpdate () == 0);
+  memcpy (sn, tim_sn, sizeof sn);
+  HOST_CHECK (nvTrkPut (sn, 0) == 0);
+  host_jumpers = ENA_VIP_NEW;
+  OSCCONbits.COSC = 3;                /* Primary oscillator with PLL ... */
+  OSCCONbits.LOCK = 1;                /* ... locked */
+  host_ms_hook = script;
+  fw_main ();
+}
+
+int main (void)
+{
+  E2SESREC rec;
+  unsigned char *slot;
+  int i;
+
+  host_nv_format ();
+  srand (42);
+  check (0, "formatted");
+
+  for (i = 0; i < E2SESCNT + 13; i++)
+  {
+    put ();
+    check (held (), "put");
+  }
+  nvSesInit ();
+  check (held (), "reboot");
+
+  host_ee_limit = host_ee_writes;     /* Refused: nothing changes */
+  memset (&rec, 0, sizeof rec);
+  HOST_CHECK (nvSesPut (&rec) != 0);
+  host_ee_limit = ~0UL;
+  check (held (), "refused write");
+
+  /* Newest record torn: the one before it is the newest after boot, and
+     the next record goes in the torn one's slot */
+  for (i = 0; i < E2SESCNT; i++)
+  {
+    slot = &host_eeprom[SES_BASE + i * sizeof (E2SESREC)];
+    if (memcmp (slot, &ses[nses - 1], sizeof (E2SESREC)) == 0)
+      break;
+  }
+  HOST_CHECK (i < E2SESCNT);
+  slot[sizeof (E2SESREC) - 1] ^= 0x01;
+  nses--;
+  nvSesInit ();
+  check (E2SESCNT - 1, "torn");
+  put ();
+  HOST_CHECK (memcmp (slot, &ses[nses - 1], sizeof (E2SESREC)) == 0);
+  check (E2SESCNT, "after torn");    /* Whole ring good again */
+
+  /* Sequence number wrap: a ring whose newest record is 0xFFF8, in the
+     middle */
+  memset (&host_eeprom[SES_BASE], 0xFF, E2SESSIZ);
+  nses = 0;
+  for (i = 0; i < 10; i++)
+  {
+    memset (&rec, 0, sizeof rec);
+    rec.Seq = (UINT16)(0xFFF8 - 9 + i);
+    rec.Flaps = (UINT16)i;
+    rec.CRC = modbus_CRC ((unsigned char *)&rec, sizeof rec - 2, INIT_CRC_SEED);
+    memcpy (&host_eeprom[SES_BASE + (7 + i) * sizeof rec], &rec, sizeof rec);
+    ses[nses++] = rec;
+  }
+  nvSesInit ();
+  check (nses, "before wrap");
+  for (i = 0; i < 2 * E2SESCNT; i++)
+  {
+    put ();
+    check (held (), "wrap");
+    if (ses[nses - 1].Seq < 4)
+    {
+      nvSesInit ();                   /* Boot just past the wrap */
+      check (held (), "reboot at wrap");
+    }
+  }
+  for (i = 1; i < nses; i++)
+    HOST_CHECK (ses[i].Seq == ((ses[i - 1].Seq == 0xFFFE) ? 0 : ses[i - 1].Seq + 1));
+  if (host_fails)
+    return host_done ("session");
+
+  drive ();
+  return 1;                           /* Not reached */
+}
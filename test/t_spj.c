@@ -0,0 +1,117 @@
+/*****************************************************************************
+ *
+ *   t_spj.c -- SysParm journal: random SysParm changes written with
+ *              nvSysParmUpdate() come back from a reboot (eeInit()) through
+ *              many compactions, and an update cut off after any EEPROM
+ *              write comes back as all of the old or all of the new
+ *              SysParm, with the journal still usable after it.
+ *
+ *****************************************************************************/
+#include "common.h"
+#include <stddef.h>
+#include <stdlib.h>
+
+#define UPDATES 2000
+#define CUTS    80                    /* Updates cut off at every write */
+
+static SysParmNV want;
+static unsigned char snap[0x20000];
+
+/* A few random bytes of SysParm, not its CRC and not DM_Max_Open (a zero
+   there is put back to the default at boot) */
+
+static void change (void)
+{
+  unsigned char *p = (unsigned char *)&SysParm;
+  unsigned int n, ofs;
+
+  for (n = 1 + (unsigned int)(rand () % 6); n > 0; n--)
+  {
+    do
+      ofs = (unsigned int)(rand () % (sizeof (SysParmNV) - 2));
+    while ((ofs >= offsetof (SysParmNV, DM_Max_Open))
+           && (ofs < offsetof (SysParmNV, DM_Max_Open) + sizeof SysParm.DM_Max_Open));
+    p[ofs] = (unsigned char)rand ();
+  }
+}
+
+static int same (const SysParmNV *a, const SysParmNV *b)
+{
+  return memcmp (a, b, sizeof (SysParmNV) - 2) == 0;
+}
+
+int main (void)
+{
+  SysParmNV old;
+  unsigned long w0, cut, done, most = 0;
+  unsigned int comp = 0;
+  char sts;
+  int u;
+
+  host_nv_format ();
+  srand (46);
+
+  /* Straight updates, with a reboot now and then */
+  for (u = 0; u < UPDATES; u++)
+  {
+    w0 = host_ee_writes;
+    change ();
+    HOST_CHECK (nvSysParmUpdate () == 0);
+    comp += (host_ee_writes - w0) > 2;  /* Snapshot, header, SysParm block */
+    memcpy (&want, &SysParm, sizeof want);
+    if ((rand () % 10) == 0)
+    {
+      eeInit ();
+      if (!same (&SysParm, &want))
+      {
+        fprintf (stderr, "update %d: SysParm differs after reboot\n", u);
+        HOST_CHECK (0);
+        break;
+      }
+    }
+  }
+  HOST_CHECK (comp > 20);
+  HOST_CHECK (EE_status == 0);
+
+  /* The same, each update cut off after 0, 1, 2 ... writes */
+  for (u = 0; u < CUTS; u++)
+  {
+    eeInit ();
+    memcpy (&old, &SysParm, sizeof old);
+    change ();
+    memcpy (&want, &SysParm, sizeof want);
+    memcpy (snap, host_eeprom, sizeof snap);
+    for (cut = 0; ; cut++)
+    {
+      memcpy (host_eeprom, snap, sizeof snap);
+      eeInit ();
+      memcpy (&SysParm, &want, sizeof want);
+      w0 = host_ee_writes;
+      host_ee_limit = w0 + cut;
+      sts = nvSysParmUpdate ();
+      done = host_ee_writes - w0;
+      host_ee_limit = ~0UL;
+      eeInit ();
+      if (!same (&SysParm, &old) && !same (&SysParm, &want))
+      {
+        fprintf (stderr, "update %d cut after %lu writes: neither old nor new\n",
+                 u, cut);
+        HOST_CHECK (0);
+        break;
+      }
+      memcpy (&SysParm, &want, sizeof want); /* Try again, must take */
+      HOST_CHECK (nvSysParmUpdate () == 0);
+      eeInit ();
+      HOST_CHECK (same (&SysParm, &want));
+      if ((sts == 0) && (done < cut))
+        break;                        /* Not cut off at all */
+    }
+    if (cut > most)
+      most = cut;
+    if (host_fails)
+      break;
+  }
+  HOST_CHECK (most > 4);              /* Some of them were compactions */
+
+  return host_done ("spj");
+}
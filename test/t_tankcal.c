@@ -0,0 +1,322 @@
+/*****************************************************************************
+ *
+ *   t_tankcal.c -- the 5-wire tank calibration (tank_cal_start() and
+ *                  tank_cal_step(), optic5.c), a diag line reading a main
+ *                  loop pass, against calc_tank() as it was before: a
+ *                  30 ms DelayMS(), the pulse, a throw-away reading and
+ *                  ten back to back, averaged, and a scan of voltList[].
+ *
+ *                  read_ADC() converts as usual and then, while the diag
+ *                  line is driven (CH_TEST5 low), shows the readings of a
+ *                  synthetic echo in probe_volt[4]: a level drawn across
+ *                  the tables, with Gaussian noise of each sigma[], the
+ *                  last also with one reading in ten a SPIKE_MV spike.
+ *                  Every trial is taken both ways on the same readings,
+ *                  with the new table (voltList[]) and the old (SysDia5
+ *                  WetVolts[]).
+ *
+ *                  The tank and CH5_HIGH_RESISTANCE must be what the old
+ *                  sums give on the readings the engine used.  They must
+ *                  be the old calc_tank()'s on its ten unless the engine
+ *                  finished early and the two means are within
+ *                  2 * TC_CI_MV, or the engine's mean is the nearer the
+ *                  level (a spike it never read).  With no noise every
+ *                  trial must agree.  How often each way gets the level's
+ *                  own tank is printed alongside.
+ *
+ *                  The old calc_tank() held the main loop from the settle
+ *                  to the result; a step may only take its reading.  The
+ *                  time a step spends outside read_ADC() and the
+ *                  maintenance log entry, bar the one that pulses, must
+ *                  be no more than its read_time() looks (LOOK_US), and
+ *                  no step may take as long as the old call.
+ *
+ *****************************************************************************/
+#include "common.h"
+#include "volts.h"
+#include <math.h>
+#include <stdlib.h>
+
+extern char __real_read_ADC (void);
+extern void __real_logmaintenanceerr (void);
+
+#define TRIALS     400                /* A noise level and table */
+#define NREAD      11                 /* Throw-away, ten */
+#define PASS_US    1000               /* Main loop pass */
+#define OLD_TRIALS 10
+#define SPIKE_MV   400
+#define LOOK_US    2                  /* read_time() looks, 1 us each (clock.c) */
+
+static const double sigma[] = { 0, 2, 5, 10, 25, 10 };
+#define NSIGMA  (int)(sizeof sigma / sizeof sigma[0])
+#define SPIKY   (NSIGMA - 1)          /* The last one with spikes */
+
+static const unsigned long voltList[17] =
+{
+  6840, 6630, 6380, 6000, 5690, 5385, 5130, 4890, 4660, 4470, 4270, 4105,
+  3950, 3795, 3675, 3550, 3440
+};
+
+typedef struct
+{
+  unsigned long agree, early, reads;
+  unsigned long right[2];             /* Tank of the level itself: old, engine */
+  unsigned long long us[2];           /* Start to result: old, engine */
+  unsigned long long held_us;         /* Longest old calc_tank() */
+  unsigned long long worst_us;        /* Longest engine step */
+  unsigned long long pulse_us;        /* ... the one that pulses */
+  unsigned long long wait_us;         /* Longest wait in any other */
+} RESULT;
+
+static RESULT res[2][NSIGMA];         /* Old table, new table */
+
+static unsigned int reading[NREAD];
+static unsigned long level;          /* Noiseless, mV */
+static int feed;                      /* Next reading to show, -1 none */
+static unsigned long long adc_us, log_us;
+
+char __wrap_read_ADC (void)
+{
+  unsigned long long t = host_now_us ();
+  char sts = __real_read_ADC ();
+
+  if ((feed >= 0) && (feed < NREAD) && !CH_TEST5)   /* Diag line driven */
+  {
+    probe_volt[4] = reading[feed++];
+    probe_volt[5] = 0;                /* No foreign pulse */
+  }
+  adc_us += host_now_us () - t;
+  return sts;
+}
+
+void __wrap_logmaintenanceerr (void)
+{
+  unsigned long long t = host_now_us ();
+
+  __real_logmaintenanceerr ();
+  log_us += host_now_us () - t;
+}
+
+static double gauss (void)
+{
+  double u = (rand () + 1.0) / (RAND_MAX + 2.0);
+  double v = (rand () + 1.0) / (RAND_MAX + 2.0);
+
+  return sqrt (-2 * log (u)) * cos (2 * M_PI * v);
+}
+
+static void make_readings (int s)
+{
+  double v;
+  int i;
+
+  level = 3300 + (unsigned long)(rand () % 3700);
+  for (i = 0; i < NREAD; i++)
+  {
+    v = (double)level + sigma[s] * gauss ();
+    if ((s == SPIKY) && (rand () % 10 == 0))
+      v += (rand () & 1) ? SPIKE_MV : -SPIKE_MV;
+    reading[i] = (v < 0) ? 0 : (unsigned int)(v + 0.5);
+  }
+}
+
+/* calc_tank()'s sums as they were, on the mean of the readings it took,
+   less the maintenance log entry */
+
+static unsigned int ref_tank (unsigned long ch5_volt)
+{
+  unsigned long ch5_volt_oldTable;
+  unsigned long index;
+  unsigned int  tank_number = 0;
+  char          error_found = 0;
+
+  StatusA &= ~CH5_HIGH_RESISTANCE;
+  ch5_volt_oldTable = ch5_volt;
+  ch5_volt_oldTable += (unsigned long)pSysDia5->PNOffset;
+  ch5_volt_oldTable *= (unsigned long)ReferenceVolt;
+  ch5_volt_oldTable /= (unsigned long)1000;
+  ch5_volt *= (unsigned long)ReferenceVolt;
+  ch5_volt /= (unsigned long)1000;
+  if (pSysDia5->updatedADCTable == 1)
+  {
+    if (ch5_volt < lowVolt)
+      lowVolt = ch5_volt;
+    compare_volts = lowVolt;
+    for (index = 0; index < 17; index++)
+      if (lowVolt <= voltList[index])
+        tank_number++;
+    if ((tank_number > 1) && (tank_number < 16))
+      if ((lowVolt > ((((voltList[tank_number - 1] - voltList[tank_number])
+                        * 25) / 100) + voltList[tank_number]))
+          || ((lowVolt >= voltList[tank_number])
+              && (lowVolt < (voltList[tank_number] + 5UL))))
+        StatusA |= CH5_HIGH_RESISTANCE;
+  }
+  else
+  {
+    lowVolt = 9999;
+    compare_volts = ch5_volt_oldTable;
+    for (index = 0; index < 16; index++)
+    {
+      tank_number++;
+      if (ch5_volt_oldTable > pSysDia5->WetVolts[index])
+      {
+        error_found = 1;
+        break;
+      }
+    }
+    if (error_found == 0)
+      tank_number++;
+  }
+  return tank_number;
+}
+
+static unsigned long mean (int first, int n)
+{
+  unsigned long sum = 0;
+  int i;
+
+  for (i = first; i < first + n; i++)
+    sum += reading[i];
+  return sum / (unsigned long)n;
+}
+
+/* The old calc_tank(): the settle, the pulse, the readings, all in one */
+
+static unsigned int old_calc_tank (void)
+{
+  int i;
+
+  DelayMS (30);
+  optic_5_pulse ();
+  CH_TEST5 = 0;
+  DIAGNOSTIC_EN = 0;
+  for (i = 0; i <= OLD_TRIALS; i++)
+    (void)read_ADC ();
+  CH_TEST5 = 1;
+  DIAGNOSTIC_EN = 1;
+  return ref_tank (mean (1, OLD_TRIALS));
+}
+
+static void trial (int table, int s)
+{
+  RESULT *r = &res[table][s];
+  unsigned long long t0, t, a0, l0, step_us, other;
+  unsigned int old_tank, new_tank, ref, truth;
+  unsigned int old_flag, new_flag;
+  unsigned char was, now;
+  unsigned long m_old, m_new;
+  int n;
+
+  make_readings (s);
+
+  lowVolt = 9999;
+  feed = 0;
+  t0 = host_now_us ();
+  old_tank = old_calc_tank ();
+  t = host_now_us () - t0;
+  r->us[0] += t;
+  if (t > r->held_us)
+    r->held_us = t;
+  old_flag = StatusA & CH5_HIGH_RESISTANCE;
+  HOST_CHECK (feed == NREAD);
+
+  lowVolt = 9999;
+  feed = 0;
+  t0 = host_now_us ();
+  tank_cal_start ();
+  do
+  {
+    host_run_us (PASS_US);            /* The rest of the main loop pass */
+    was = tank_cal_driving () ? TC_SAMPLE : TC_SETTLE;
+    a0 = adc_us;
+    l0 = log_us;
+    t = host_now_us ();
+    now = tank_cal_step ();
+    step_us = host_now_us () - t;
+    other = step_us - (adc_us - a0) - (log_us - l0);
+    if (step_us > r->worst_us)
+      r->worst_us = step_us;
+    if ((was == TC_SETTLE) && (now != TC_SETTLE))
+    {
+      if (step_us > r->pulse_us)      /* The pulse */
+        r->pulse_us = step_us;
+    }
+    else if (other > r->wait_us)
+      r->wait_us = other;
+  } while ((now != TC_DONE) && !host_fails);
+  r->us[1] += host_now_us () - t0;
+  new_tank = tank_cal_result ();
+  new_flag = StatusA & CH5_HIGH_RESISTANCE;
+  n = feed - 1;                       /* Readings averaged */
+  HOST_CHECK ((n >= TC_MIN_TRIALS) && (n <= TC_TRIALS));
+  r->reads += (unsigned long)n;
+  if (n < TC_TRIALS)
+    r->early++;
+
+  m_new = mean (1, n);
+  m_old = mean (1, OLD_TRIALS);
+  lowVolt = 9999;
+  ref = ref_tank (m_new);
+  HOST_CHECK (new_tank == ref);       /* The same sum on its readings */
+  HOST_CHECK (new_flag == (StatusA & CH5_HIGH_RESISTANCE));
+  lowVolt = 9999;
+  truth = ref_tank (level);
+  r->right[0] += (old_tank == truth);
+  r->right[1] += (new_tank == truth);
+  if ((new_tank == old_tank) && (new_flag == old_flag))
+    r->agree++;
+  else
+  {
+    HOST_CHECK (n < TC_TRIALS);
+    HOST_CHECK ((labs ((long)m_new - (long)m_old) <= 2 * TC_CI_MV)
+                || (labs ((long)m_new - (long)level)
+                    <= labs ((long)m_old - (long)level)));
+    HOST_CHECK (sigma[s] > 0);
+  }
+}
+
+int main (void)
+{
+  int table, s, i;
+
+  srand (47);
+  host_nv_format ();
+  Init_ADC ();
+  Init_Timer2 ();                     /* The 1 ms read_time() tick */
+  CH_TEST5 = 1;                       /* Ch 5 drive as at rest */
+  DIAGNOSTIC_EN = 1;
+  ReferenceVolt = 1000;               /* 1.000 V */
+  feed = -1;
+  for (table = 0; table < 2; table++)
+  {
+    pSysDia5->updatedADCTable = (UINT16)table;
+    for (s = 0; s < NSIGMA; s++)
+      for (i = 0; (i < TRIALS) && !host_fails; i++)
+        trial (table, s);
+  }
+
+  printf ("\n%-9s %7s %8s %13s %6s %6s %9s %11s %9s %9s %8s\n", "table",
+          "sigma", "agree %", "right % o/e", "early", "reads", "held ms", "elapsed o/e", "step ms",
+          "pulse ms", "wait us");
+  for (table = 0; table < 2; table++)
+    for (s = 0; s < NSIGMA; s++)
+    {
+      RESULT *r = &res[table][s];
+
+      printf ("%-9s %5.0f%s %8.2f %6.2f %6.2f %6lu %6.2f %9.1f %5.1f %5.1f %9.2f %9.2f"
+              " %8llu\n", table ? "voltList" : "WetVolts", sigma[s],
+              (s == SPIKY) ? " +" : "  ", 100.0 * r->agree / TRIALS,
+              100.0 * r->right[0] / TRIALS, 100.0 * r->right[1] / TRIALS,
+              r->early,
+              (double)r->reads / TRIALS, (double)r->held_us / 1000,
+              (double)r->us[0] / TRIALS / 1000,
+              (double)r->us[1] / TRIALS / 1000, (double)r->worst_us / 1000,
+              (double)r->pulse_us / 1000, r->wait_us);
+      HOST_CHECK (r->wait_us <= LOOK_US);
+      HOST_CHECK (r->worst_us < r->held_us);
+      if (sigma[s] == 0)
+        HOST_CHECK (r->agree == TRIALS);
+    }
+  return host_done ("tankcal");
+}
@@ -0,0 +1,179 @@
+/*****************************************************************************
+ *
+ *   t_thresh.c -- convert_to_binary() from the thr_hi[]/thr_lo[] tables
+ *                 (thresh_build()) against the per-channel threshold logic
+ *                 it replaced, scan for scan, while the probe try state,
+ *                 the SysParm thresholds and the probe types change under
+ *                 it.
+ *
+ *****************************************************************************/
+#include "common.h"
+#include "volts.h"
+#include <stdlib.h>
+
+#define SCANS   200000
+
+/* The routine as it was before the tables, on its own copy of the state */
+
+static unsigned int r_pulse, r_array[MAX_ARRAY], r_index, r_therm;
+static unsigned int r_old[MAX_CHAN], r_high_3[MAX_CHAN], r_high_8[MAX_CHAN];
+static PROBE_TYPE r_type[MAX_CHAN];
+
+static void ref_convert (const unsigned int *volt)
+{
+  unsigned int level = 0, therm = 0, index, test_volt, imsk;
+
+  for (index = start_point; index < MAX_CHAN; index++)
+  {
+    if ((probe_try_state == THERMIS) && ((r_type[index] == P_NO_TYPE) ||
+                                         (r_type[index] == P_THERMIS)))
+      test_volt = SysParm.ADCTmaxNV;
+    else
+      test_volt = SysParm.ADCOmaxNV;
+    imsk = 1u << index;
+    if (volt[index] > test_volt)
+      r_pulse |= imsk;
+    else
+      r_pulse &= ~imsk;
+    if ((volt[index] > test_volt)
+        && (r_old[index] <= (unsigned int)(test_volt - SysParm.ADCTHstNV)))
+    {
+      level |= imsk;
+      if (probes_state[index] == P_DRY)
+      {
+        if (volt[index] > ADC6V)
+        {
+          if (r_high_8[index]++ >= 3)
+          {
+            therm |= imsk;
+            r_type[index] = P_OPTIC2;
+            r_high_3[index] = 0;
+            r_high_8[index] = 3;
+          }
+        }
+        else if ((r_type[index] == P_NO_TYPE) || (r_type[index] == P_THERMIS))
+        {
+          if (r_high_3[index]++ >= 4)
+          {
+            r_type[index] = P_THERMIS;
+            r_high_3[index] = 4;
+          }
+        }
+      }
+    }
+    else if ((volt[index] < (unsigned int)(test_volt - SysParm.ADCTHstNV))
+             && (r_old[index] >= test_volt))
+      level |= imsk;
+    r_old[index] = volt[index];
+  }
+  r_therm |= therm;
+  r_array[r_index++] = level;
+  if (r_index >= MAX_ARRAY)
+    r_index = 0;
+}
+
+/* A level near one of the thresholds, or anywhere */
+
+static unsigned int pick_volt (void)
+{
+  static const UINT16 *const near[] =
+    { &SysParm.ADCTmaxNV, &SysParm.ADCOmaxNV };
+  unsigned int v;
+
+  switch (rand () % 4)
+  {
+    case 0:  return (unsigned int)(rand () % 11000);
+    case 1:  return ADC6V - 200 + (unsigned int)(rand () % 400);
+    default:
+      v = *near[rand () & 1];
+      return v - 2 * SysParm.ADCTHstNV + (unsigned int)(rand () % (4 * SysParm.ADCTHstNV + 1));
+  }
+}
+
+int main (void)
+{
+  unsigned int scan[MAX_CHAN];
+  unsigned int chans, i;
+  long s;
+
+  srand (38);
+  SysParm.ADCTmaxNV = 3800;
+  SysParm.ADCOmaxNV = 4500;
+  SysParm.ADCTHstNV = 100;
+  probe_try_state = THERMIS;
+  class_window = 0;
+  dry_once = TRUE;                    /* Leave the drive alone */
+  start_point = 0;
+  for (i = 0; i < MAX_CHAN; i++)
+  {
+    probes_state[i] = P_DRY;
+    probe_type[i] = r_type[i] = P_NO_TYPE;
+    old_probe_volt[i] = r_old[i] = 0;
+    high_3[i] = high_8[i] = r_high_3[i] = r_high_8[i] = 0;
+  }
+  probe_pulse = r_pulse = 0;
+  probe_index = r_index = 0;
+  act_therm_mask = r_therm = 0;
+  thresh_stale = TRUE;
+
+  for (s = 0; s < SCANS; s++)
+  {
+    switch (rand () % 400)            /* Now and then, change the rules */
+    {
+      case 0:
+        probe_try_state = (PROBE_TRY_STATE)(rand () % 4);
+        break;
+      case 1:
+        SysParm.ADCTmaxNV = 3000 + (unsigned int)(rand () % 1500);
+        break;
+      case 2:
+        SysParm.ADCOmaxNV = 4000 + (unsigned int)(rand () % 1500);
+        break;
+      case 3:
+        SysParm.ADCTHstNV = 20 + (unsigned int)(rand () % 300);
+        break;
+      case 4:                         /* As unknown_probes() etc. do */
+        i = (unsigned int)(rand () % MAX_CHAN);
+        probe_type[i] = r_type[i] = (PROBE_TYPE)(rand () % 5);
+        thresh_stale = TRUE;
+        break;
+      case 5:
+        i = (unsigned int)(rand () % MAX_CHAN);
+        probes_state[i] = (rand () & 1) ? P_DRY : P_WET;
+        break;
+      case 6:
+        start_point = (rand () & 1) ? 2 : 0;
+        break;
+      case 7:
+        for (i = 0; i < MAX_CHAN; i++)
+          high_3[i] = high_8[i] = r_high_3[i] = r_high_8[i] = 0;
+        break;
+    }
+    for (i = 0; i < MAX_CHAN; i++)
+      scan[i] = pick_volt ();
+
+    convert_to_binary (scan);
+    ref_convert (scan);
+
+    chans = ((1u << MAX_CHAN) - 1) & ~((1u << start_point) - 1);
+    if (((probe_pulse ^ r_pulse) & chans) || (probe_index != r_index)
+        || (probe_array[(r_index + MAX_ARRAY - 1) % MAX_ARRAY]
+            != r_array[(r_index + MAX_ARRAY - 1) % MAX_ARRAY])
+        || (act_therm_mask != r_therm)
+        || memcmp (probe_type, r_type, sizeof r_type)
+        || memcmp (high_3, r_high_3, sizeof r_high_3)
+        || memcmp (high_8, r_high_8, sizeof r_high_8)
+        || memcmp (old_probe_volt, r_old, sizeof r_old))
+    {
+      fprintf (stderr, "scan %ld: pulse %x/%x array %x/%x therm %x/%x\n", s,
+               probe_pulse & chans, r_pulse & chans,
+               probe_array[(r_index + MAX_ARRAY - 1) % MAX_ARRAY],
+               r_array[(r_index + MAX_ARRAY - 1) % MAX_ARRAY],
+               act_therm_mask, r_therm);
+      HOST_CHECK (0);
+      break;
+    }
+  }
+
+  return host_done ("thresh");
+}
@@ -0,0 +1,349 @@
+/*****************************************************************************
+ *
+ *   t_tim.c -- packed Truck ID format: sorted insert/remove against a
+ *              reference list, reload at boot, the ModBus slot functions
+ *              by sorted position, and recovery from an update cut off
+ *              after every possible EEPROM write.
+ *
+ *****************************************************************************/
+#include "common.h"
+#include <stdlib.h>
+
+#define MAXIDS  3000
+
+static unsigned long long ref[MAXIDS];
+static int nref;
+
+static int cmp (const void *a, const void *b)
+{
+  unsigned long long x = *(const unsigned long long *)a;
+  unsigned long long y = *(const unsigned long long *)b;
+
+  return (x > y) - (x < y);
+}
+
+static void to_trk (unsigned long long v, unsigned char *trk)
+{
+  int i;
+
+  for (i = BYTESERIAL - 1; i > 0; i--, v >>= 8)
+    trk[i] = (unsigned char)v;
+  trk[0] = 0;
+}
+
+static unsigned long long from_trk (const unsigned char *trk)
+{
+  unsigned long long v = 0;
+  int i;
+
+  for (i = 1; i < BYTESERIAL; i++)
+    v = (v << 8) | trk[i];
+  return v;
+}
+
+static int in_ref (unsigned long long v)
+{
+  return bsearch (&v, ref, (size_t)nref, sizeof ref[0], cmp) != NULL;
+}
+
+static void add (unsigned long long v)
+{
+  unsigned char trk[BYTESERIAL];
+  word pos;
+
+  if (in_ref (v))
+    return;
+  to_trk (v, trk);
+  HOST_CHECK (nvTrkPut (trk, (word)nref) == 0);   /* Past the end: add */
+  ref[nref++] = v;
+  qsort (ref, (size_t)nref, sizeof ref[0], cmp);
+  HOST_CHECK (nvTrkRank (trk, &pos) == 0);
+  HOST_CHECK (ref[pos] == v);
+}
+
+/* Whole list, in order, matches the reference; each one ranks where it is */
+
+static int same_as_ref (void)
+{
+  unsigned char trk[BYTESERIAL];
+  word i, pos;
+
+  for (i = 0; i < nref; i++)
+  {
+    if ((nvTrkGet (trk, i) != 0) || (from_trk (trk) != ref[i]))
+      return 0;
+    if ((nvTrkRank (trk, &pos) != 0) || (pos != i))
+      return 0;
+  }
+  return (nvTrkGet (trk, (word)nref) == 0) && (from_trk (trk) == 0);
+}
+
+/* One ModBus request (address, function, arguments, unchecked CRC) */
+
+static unsigned char rsp[MODBUS_MAX_LEN];
+
+static int decode (unsigned char *req, int len)
+{
+  unsigned char olen = 0;
+
+  return (modbus_decode ((unsigned char)len, req, &olen, rsp) == MB_OK)
+         && (olen > 2);
+}
+
+static unsigned int rsp_int (int at)
+{
+  return ((unsigned int)rsp[at] << 8) | rsp[at + 1];
+}
+
+static void ref_remove (int pos)
+{
+  memmove (&ref[pos], &ref[pos + 1], (size_t)(nref - pos - 1) * sizeof ref[0]);
+  nref--;
+}
+
+static void ref_add (unsigned long long v)
+{
+  if (in_ref (v))
+    return;
+  ref[nref++] = v;
+  qsort (ref, (size_t)nref, sizeof ref[0], cmp);
+}
+
+/* The slot functions address the sorted list by position: 0x42/0x47/0x67
+   read it, 0x4A CRCs it, and 0x41/0x46 replace the Truck IDs at the given
+   positions (the new ones sorting to wherever they belong) */
+
+static void slot_functions (void)
+{
+  unsigned char req[64], trk[BYTESERIAL];
+  unsigned long long nv[3];
+  unsigned int crc;
+  int i, k, at;
+
+  at = nref / 2;
+  req[0] = 1; req[1] = READ_SINGLE_VEHICLE;
+  req[2] = (unsigned char)(at >> 8); req[3] = (unsigned char)at;
+  HOST_CHECK (decode (req, 6));
+  HOST_CHECK ((rsp_int (2) == (unsigned int)at) && (from_trk (&rsp[4]) == ref[at]));
+
+  for (k = 0; k < 2; k++)
+  {
+    req[1] = k ? READ_SORTED_VEHICLES : READ_MULTIPLE_VEHICLES;
+    req[4] = 0; req[5] = 8;
+    HOST_CHECK (decode (req, 8));
+    for (i = 0; i < 8; i++)
+      HOST_CHECK (from_trk (&rsp[6 + i * BYTESERIAL]) == ref[at + i]);
+  }
+
+  req[1] = CRC_MULTIPLE_VEHICLES;
+  req[2] = 0; req[3] = 0; req[4] = 0; req[5] = 100;
+  HOST_CHECK (decode (req, 8));
+  for (crc = INIT_CRC_SEED, i = 0; i < 100; i++)
+  {
+    to_trk (ref[i], trk);
+    crc = modbus_CRC (trk, BYTESERIAL, crc);
+  }
+  HOST_CHECK (rsp_int (6) == crc);
+
+  /* 0x41: replace, with one that sorts to the far end; then erase */
+  req[1] = WRITE_SINGLE_VEHICLE;
+  req[2] = (unsigned char)(at >> 8); req[3] = (unsigned char)at;
+  to_trk (ref[nref - 1] + 5, &req[4]);
+  HOST_CHECK (decode (req, 12));
+  HOST_CHECK ((rsp_int (2) == (unsigned int)at) && (from_trk (&rsp[4]) == ref[nref - 1] + 5));
+  ref_remove (at);
+  ref_add (ref[nref - 1] + 5);
+  HOST_CHECK (same_as_ref ());
+  memset (&req[4], 0xFF, BYTESERIAL);
+  HOST_CHECK (decode (req, 12));
+  ref_remove (at);
+  HOST_CHECK (same_as_ref ());
+
+  /* 0x46: three positions from "at", with one already listed elsewhere */
+  req[1] = WRITE_MULTIPLE_VEHICLES;
+  req[4] = 0; req[5] = 3;
+  nv[0] = ref[nref - 1] + 100;
+  nv[1] = ref[0];
+  nv[2] = ref[at] + 1;
+  for (i = 0; i < 3; i++)
+    to_trk (nv[i], &req[6 + i * BYTESERIAL]);
+  HOST_CHECK (decode (req, 26));
+  HOST_CHECK ((rsp_int (2) == (unsigned int)at) && (rsp_int (4) == 3));
+  for (i = 0; i < 3; i++)
+    ref_remove (at);
+  for (i = 0; i < 3; i++)
+    ref_add (nv[i]);
+  HOST_CHECK (same_as_ref ());
+}
+
+/* After a cut-off update and the repair at boot: sorted, no duplicates,
+   nothing lost but "out" (being removed), nothing new but "in" (being
+   added) */
+
+static int repaired_ok (unsigned long long in, unsigned long long out)
+{
+  unsigned char trk[BYTESERIAL];
+  unsigned long long v, prev = 0;
+  word i;
+  int seen = 0;
+
+  for (i = 0; (nvTrkGet (trk, i) == 0) && ((v = from_trk (trk)) != 0); i++)
+  {
+    if (i && (v <= prev))
+      return 0;
+    if (!in_ref (v) && (v != in))
+      return 0;
+    seen += in_ref (v) && (v != out);
+    prev = v;
+  }
+  return seen == nref - in_ref (out);  /* Past the end reads all zero */
+}
+
+/* Run one update cut off after 0, 1, 2 ... EEPROM writes, from the same
+   start (snap) each time, until it runs to the end.  After the repair at
+   boot the list must be whole: insert "in" if non-zero, else remove the
+   Truck ID at sorted position "pos". */
+
+static unsigned char snap[0x20000];
+
+static int blocks_used (void)
+{
+  unsigned char c;
+  int p, n = 0;
+
+  for (p = 0; p < TPK_BLOCKS; p++)
+  {
+    c = host_eeprom[TIM_BASE + TPK_DIROFF + p];
+    n += (c != 0) && (c <= TPK_BLKMAX);
+  }
+  return n;
+}
+
+static void cut_each (unsigned long long in, word pos)
+{
+  unsigned char trk[BYTESERIAL];
+  unsigned long cut;
+  char sts;
+
+  for (cut = 0; ; cut++)
+  {
+    memcpy (host_eeprom, snap, sizeof snap);
+    nvTrkInit ();
+    host_ee_limit = host_ee_writes + cut;
+    to_trk (in, trk);
+    sts = in ? nvTrkPut (trk, (word)nref) : nvTrkDelete (pos);
+    host_ee_limit = ~0UL;
+    nvTrkInit ();
+    if (!repaired_ok (in, in ? 0 : ref[pos]))
+    {
+      fprintf (stderr, "%s cut after %lu writes\n", in ? "insert" : "remove",
+               cut);
+      HOST_CHECK (0);
+      break;
+    }
+    if (sts == 0)                     /* Ran to the end */
+      break;
+  }
+  HOST_CHECK (cut > 4);               /* More than a plain update */
+  memcpy (host_eeprom, snap, sizeof snap);
+  nvTrkInit ();
+}
+
+int main (void)
+{
+  unsigned char trk[BYTESERIAL];
+  unsigned long long base, v;
+  unsigned long w0;
+  int used, split, moved;
+  word pos;
+  int i, k;
+
+  host_nv_format ();
+  SysParm.EnaSftFeatures2 |= ENA_TIM_PACKED;
+  HOST_CHECK (nvTrkErase () == 0);
+  HOST_CHECK (nvTrkPacked ());
+
+  srand (34);
+  for (k = 0; k < 20; k++)                        /* Clustered fleets */
+  {
+    base = ((unsigned long long)rand () << 16) ^ (unsigned long long)rand ();
+    base &= 0xFFFFFFFFFFULL;
+    for (i = 0; i < 60; i++)
+      add (base + (unsigned long long)i * (1 + (rand () % 3)));
+  }
+  for (i = 0; i < 600; i++)                       /* Spread out */
+    add ((((unsigned long long)rand () << 20) ^ (unsigned long long)rand ())
+         & 0xFFFFFFFFFFULL);
+  HOST_CHECK (same_as_ref ());
+
+  /* Remove a third, by sorted position */
+  for (i = 0; i < nref / 3; i++)
+  {
+    pos = (word)(rand () % nref);
+    HOST_CHECK (nvTrkDelete (pos) == 0);
+    ref_remove (pos);
+  }
+  HOST_CHECK (same_as_ref ());
+  to_trk (ref[0] + 1, trk);
+  if (!in_ref (ref[0] + 1))
+    HOST_CHECK (nvTrkRank (trk, &pos) != 0);
+
+  nvTrkInit ();                                   /* Boot: directory reload */
+  HOST_CHECK (nvTrkPacked ());
+  HOST_CHECK (same_as_ref ());
+
+  /* A map that doesn't list each block once is rebuilt from the blocks */
+  memcpy (&host_eeprom[TIM_BASE + TPK_MAPOFF + 2],
+          &host_eeprom[TIM_BASE + TPK_MAPOFF], 2);
+  nvTrkInit ();
+  HOST_CHECK (same_as_ref ());
+  HOST_CHECK (host_eeprom[TIM_BASE + TPK_DIRTY] == 0);
+
+  slot_functions ();
+
+  /* Fill the first block and go on until it splits, cutting each insert
+     that is more than a plain update off after each write, then do the
+     same for the remove that empties it.  A plain update is four writes:
+     flag, block, directory, flag.  Before a split, Truck IDs are handed
+     on to the next block (one more block write).  A split writes two
+     blocks and the map entries above them, however many blocks follow,
+     as the blocks themselves don't move: at most flag, 2 blocks, 4
+     directory pages, 8 map pages, flag. */
+  HOST_CHECK (nref > 1000);
+  for (v = ref[0] - 1, moved = 0; ; v--)
+  {
+    memcpy (snap, host_eeprom, sizeof snap);
+    w0 = host_ee_writes;
+    used = blocks_used ();
+    to_trk (v, trk);
+    HOST_CHECK (nvTrkPut (trk, (word)nref) == 0);
+    if (host_ee_writes - w0 > 4)
+    {
+      HOST_CHECK (host_ee_writes - w0 <= 1 + 2 + 4 + 8 + 1);
+      split = blocks_used () > used;
+      HOST_CHECK (split || (host_ee_writes - w0 == 5));
+      cut_each (v, 0);
+      HOST_CHECK (same_as_ref ());
+      if (split)
+        break;
+      moved++;
+      HOST_CHECK (nvTrkPut (trk, (word)nref) == 0);
+    }
+    memmove (&ref[1], &ref[0], (size_t)nref++ * sizeof ref[0]);
+    ref[0] = v;
+  }
+  HOST_CHECK (moved > 0);
+  for (;;)                                        /* Empty it again */
+  {
+    memcpy (snap, host_eeprom, sizeof snap);
+    w0 = host_ee_writes;
+    HOST_CHECK (nvTrkDelete (0) == 0);
+    if (host_ee_writes - w0 > 4)
+      break;
+    memmove (&ref[0], &ref[1], (size_t)--nref * sizeof ref[0]);
+  }
+  cut_each (0, 0);
+  HOST_CHECK (same_as_ref ());
+
+  return host_done ("tim");
+}
@@ -0,0 +1,181 @@
+/*****************************************************************************
+ *
+ *   t_timconv.c -- timconv round trip: a slot format list with erased
+ *                  slots in between is converted to packed, checked
+ *                  against the set it was made from, converted back and
+ *                  listed again.  Lists that don't fit the new format are
+ *                  refused without writing anything.
+ *
+ *****************************************************************************/
+#include "common.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+#define NIDS    3000
+
+static unsigned long long set[NIDS];
+static char dir[256], path[512], cmd[2048];
+
+static const char *in_dir (const char *name)
+{
+  snprintf (path, sizeof path, "%s/%s", dir, name);
+  return path;
+}
+
+static int cmp (const void *a, const void *b)
+{
+  unsigned long long x = *(const unsigned long long *)a;
+  unsigned long long y = *(const unsigned long long *)b;
+
+  return (x > y) - (x < y);
+}
+
+static void to_trk (unsigned long long v, unsigned char *trk)
+{
+  int i;
+
+  for (i = BYTESERIAL - 1; i > 0; i--, v >>= 8)
+    trk[i] = (unsigned char)v;
+  trk[0] = 0;
+}
+
+static unsigned long long from_trk (const unsigned char *trk)
+{
+  unsigned long long v = 0;
+  int i;
+
+  for (i = 1; i < BYTESERIAL; i++)
+    v = (v << 8) | trk[i];
+  return v;
+}
+
+static unsigned long long rnd40 (void)
+{
+  return ((((unsigned long long)rand () << 31) ^ (unsigned long long)rand ())
+          & 0xFFFFFFFFFFULL);
+}
+
+static void save (const char *name)
+{
+  FILE *f = fopen (in_dir (name), "wb");
+
+  HOST_CHECK (f != NULL);
+  HOST_CHECK (fwrite (&host_eeprom[TIM_BASE], 1, E2TIMSIZ, f) == E2TIMSIZ);
+  fclose (f);
+}
+
+static void restore (const char *name)
+{
+  FILE *f = fopen (in_dir (name), "rb");
+
+  HOST_CHECK (f != NULL);
+  HOST_CHECK (fread (&host_eeprom[TIM_BASE], 1, E2TIMSIZ, f) == E2TIMSIZ);
+  fclose (f);
+  nvTrkInit ();
+}
+
+static int timconv (const char *args)
+{
+  int sts;
+
+  snprintf (cmd, sizeof cmd, "cd %s && ./timconv %s 2> /dev/null", dir, args);
+  sts = system (cmd);
+  return WIFEXITED (sts) ? WEXITSTATUS (sts) : -1;
+}
+
+/* Every Truck ID of set[] is found and nothing else is listed */
+
+static int holds_set (void)
+{
+  unsigned char trk[BYTESERIAL];
+  word index;
+  unsigned int i, n = 0;
+
+  for (i = 0; i < NIDS; i++)
+  {
+    to_trk (set[i], trk);
+    badvipflag &= ~(BVF_DONE | BVF_UNAUTH);
+    if (nvTrkFind (trk, &index) != 0)
+      return 0;
+  }
+  for (i = 0; i < E2TIMCNT; i++)
+    n += (nvTrkGet (trk, (word)i) == 0) && (from_trk (trk) != 0);
+  return n == NIDS;
+}
+
+static void big_list (const char *name, int n)
+{
+  FILE *f = fopen (in_dir (name), "w");
+
+  HOST_CHECK (f != NULL);
+  while (n--)
+    fprintf (f, "%012llX\n", rnd40 ());
+  fclose (f);
+}
+
+int main (int argc, char **argv)
+{
+  unsigned char trk[BYTESERIAL];
+  char *slash;
+  int i, k;
+
+  snprintf (dir, sizeof dir, "%s", argv[0]);
+  slash = strrchr (dir, '/');
+  if (slash)
+    *slash = 0;
+  else
+    strcpy (dir, ".");
+
+  srand (1025);
+  host_nv_format ();
+  SysParm.EnaSftFeatures2 &= ~ENA_TIM_PACKED;
+  HOST_CHECK (nvTrkErase () == 0);
+  HOST_CHECK (!nvTrkPacked ());
+
+  /* Half fleets, half spread, one slot in five left erased */
+  for (i = 0; i < NIDS; i++)
+    if ((i >= NIDS / 2) || ((i % 60) == 0))
+      set[i] = rnd40 ();
+    else
+      set[i] = set[i - 1] + 1 + (unsigned long long)(rand () % 3);
+  for (i = 0, k = 0; i < NIDS; k++)
+    if (rand () % 5)
+    {
+      to_trk (set[i++], trk);
+      HOST_CHECK (nvTrkPut (trk, (word)k) == 0);
+    }
+  qsort (set, NIDS, sizeof set[0], cmp);
+  for (i = 1; i < NIDS; i++)
+    HOST_CHECK (set[i] != set[i - 1]);
+  HOST_CHECK (holds_set ());
+  save ("tim_slots.bin");
+
+  HOST_CHECK (timconv ("-p tim_slots.bin tim_packed.bin") == 0);
+  restore ("tim_packed.bin");
+  HOST_CHECK (nvTrkPacked ());
+  for (i = 0; i < NIDS; i++)                      /* In sorted order */
+    HOST_CHECK ((nvTrkGet (trk, (word)i) == 0) && (from_trk (trk) == set[i]));
+  HOST_CHECK (holds_set ());
+
+  HOST_CHECK (timconv ("-s tim_packed.bin tim_back.bin") == 0);
+  restore ("tim_back.bin");
+  HOST_CHECK (!nvTrkPacked ());
+  HOST_CHECK (holds_set ());
+  HOST_CHECK (timconv ("-l tim_slots.bin > tim_a.txt") == 0);
+  HOST_CHECK (timconv ("-l tim_back.bin > tim_b.txt") == 0);
+  snprintf (cmd, sizeof cmd, "cmp -s %s/tim_a.txt %s/tim_b.txt"
+            " && test $(wc -l < %s/tim_a.txt) -eq %d", dir, dir, dir, NIDS);
+  HOST_CHECK (system (cmd) == 0);
+
+  /* Too many for the format: refused, nothing written */
+  big_list ("tim_big.txt", 12000);
+  unlink (in_dir ("tim_none.bin"));
+  HOST_CHECK (timconv ("-p tim_big.txt tim_none.bin") == 2);
+  HOST_CHECK (access (in_dir ("tim_none.bin"), F_OK) != 0);
+  big_list ("tim_big.txt", E2TIMCNT + 1);
+  HOST_CHECK (timconv ("-s tim_big.txt tim_none.bin") == 2);
+  HOST_CHECK (access (in_dir ("tim_none.bin"), F_OK) != 0);
+  HOST_CHECK (timconv ("-p tim_big.txt tim_packed.bin") == 0);
+
+  return host_done ("timconv");
+}
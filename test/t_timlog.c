@@ -0,0 +1,229 @@
+/*****************************************************************************
+ *
+ *   t_timlog.c -- SuperTIM connection log (TIM_log_info()) through the
+ *                 write journal, against the DS28EC20 time slot model on
+ *                 COMM_ID (onewire.c).  A load log of 16 compartments
+ *                 touches far more scratchpad pages than the journal
+ *                 holds; every pass is run once with the line busy
+ *                 first, which is when the early flush used to drop the
+ *                 byte it was making room for.  The TIM must come out
+ *                 as the log is worked out here, byte for byte, for load
+ *                 and unload logs of 1 to 16 compartments, past a wrap
+ *                 of the load history.  A TIM pulled part way through
+ *                 drops the log and leaves no pass half written.
+ *
+ *                 The copy scratchpad cycles and the COMM_ID time per
+ *                 log are printed.
+ *
+ *****************************************************************************/
+#include "common.h"
+#include "tim_utl.h"
+#include "version.h"
+#include <stdlib.h>
+
+#define TIMSIZE  0xA00
+#define SLACK    16                   /* Calls a pulled TIM may still take */
+
+static unsigned char want[TIMSIZE];
+
+static void tim_image (int ncpt)
+{
+  int i;
+
+  for (i = 0; i < TIMSIZE; i++)
+    host_tim[i] = (unsigned char)rand ();
+  host_tim[NUMBER_OF_COMPARTMENTS_ADDR] = (unsigned char)ncpt;
+  host_tim[LOAD_HISTORY_PRT_ADDR] = (unsigned char)(rand () % 4);
+}
+
+static void date_time (unsigned char *buf)
+{
+  UNIX_to_Greg ();
+  buf[0] = (unsigned char)month;
+  buf[1] = (unsigned char)day;
+  buf[2] = (unsigned char)(year - 2000);
+  buf[3] = (unsigned char)hour;
+  buf[4] = (unsigned char)minute;
+}
+
+/* want[] = host_tim[] after the log */
+
+static void expect (int unload)
+{
+  unsigned int ncpt, n, ptr, base;
+  unsigned char now[5], last[5];
+
+  memcpy (want, host_tim, TIMSIZE);
+  ncpt = want[NUMBER_OF_COMPARTMENTS_ADDR];
+  date_time (now);
+  for (n = 0; n < 6; n++)
+    want[(unload ? UNLOAD_ITROL_SN_ADDR : LOAD_ITROL_SN_ADDR) + n] = clock_SN[5 - n];
+  if (unload)
+  {
+    memcpy (&want[LAST_UNLOAD_DATE_TIME_ADDR], now, 5);
+    for (n = 0; n < (ncpt ? ncpt : 1); n++)
+      memset (&want[0x600 + 8 * n], 0, 3);
+    return;
+  }
+  want[ITROL_FW_VERSION_ADDR] = (unsigned char)(SHELLVER >> 8);
+  want[ITROL_FW_VERSION_ADDR + 1] = (unsigned char)SHELLVER;
+  memcpy (last, &want[LAST_LOAD_DATE_TIME_ADDR], 5);
+  ptr = (want[LOAD_HISTORY_PRT_ADDR] + 1U) & 0xFF;
+  if (ptr > 3)
+    ptr = 0;
+  want[LOAD_HISTORY_PRT_ADDR] = (unsigned char)ptr;
+  memcpy (&want[LAST_LOAD_DATE_TIME_ADDR], now, 5);
+  for (n = 0; n < (ncpt ? ncpt : 1); n++)
+  {
+    base = ptr * 10 + 0x6C4 + n * 40;
+    memcpy (&want[base], last, 5);
+    memcpy (&want[base + 5], &want[0x600 + 8 * n], 3);
+    memcpy (&want[base + 8], &want[0x606 + 8 * n], 2);
+    memset (&want[0x600 + 8 * n], 0, 3);
+    memset (&want[0x606 + 8 * n], 0, 2);
+  }
+}
+
+/* Plug the TIM in and read its serial number, as Read_Truck_SN() does */
+
+static void connect (void)
+{
+  host_tim_on = 1;
+  active_comm = 0;
+  TRISD &= ~COMM_ID;
+  COMM_ID_BIT = 1;
+  HOST_CHECK (Read_Dallas_SN (COMM_ID));
+  HOST_CHECK (TIM_size == DS28EC20_SIZE);
+  log_data_state = 0;
+  tim_journal_reset ();
+}
+
+/* Run TIM_log_info() to the end, each pass tried first with the line
+   busy; returns the calls made */
+
+static int run_log (int busy_first)
+{
+  int calls = 0;
+  unsigned char sts;
+
+  do
+  {
+    if (busy_first)
+    {
+      active_comm |= INTELLI;
+      HOST_CHECK (TIM_log_info () == 1);
+      active_comm &= ~INTELLI;
+      calls++;
+    }
+    sts = TIM_log_info ();
+    calls++;
+  } while (sts && (calls < 1000));
+  HOST_CHECK (calls < 1000);
+  return calls;
+}
+
+static void one_log (int unload, int ncpt, int busy_first)
+{
+  unsigned long copies = host_tim_copies, slots = host_tim_slots;
+  unsigned long long t0;
+  int calls;
+
+  if (unload)
+    SysParm.EnaSftFeatures |= ENA_UNLOAD_TERM;
+  else
+    SysParm.EnaSftFeatures &= ~ENA_UNLOAD_TERM;
+  tim_image (ncpt);
+  connect ();
+  expect (unload);
+  t0 = host_now_us ();
+  calls = run_log (busy_first);
+  HOST_CHECK (memcmp (host_tim, want, TIMSIZE) == 0);
+  if (memcmp (host_tim, want, TIMSIZE) != 0)
+  {
+    int i;
+
+    for (i = 0; i < TIMSIZE; i++)
+      if (host_tim[i] != want[i])
+        printf ("  %s %d cpt: 0x%03X is %02X, want %02X\n",
+                unload ? "unload" : "load", ncpt, i, host_tim[i], want[i]);
+  }
+  if ((ncpt == 16) || (ncpt == 8))
+    printf ("%s log, %2d compartments%s: %3d calls, %3lu page copies,"
+            " %6lu time slots, %5.0f ms on COMM_ID\n",
+            unload ? "unload" : "load  ", ncpt, busy_first ? ", busy" : "      ",
+            calls, host_tim_copies - copies, host_tim_slots - slots,
+            (double)(host_now_us () - t0) / 1000);
+}
+
+/* "n" bytes at "a" are all as logged or all as they were */
+
+static int all_or_none (const unsigned char *before, unsigned int a, int n)
+{
+  return !memcmp (&host_tim[a], &want[a], (size_t)n) ? 1
+       : !memcmp (&host_tim[a], &before[a], (size_t)n) ? 0 : -1;
+}
+
+/* The TIM goes after "after" calls: the log stops within a few more and
+   each compartment's two passes have landed whole or not at all */
+
+static void pulled (int after)
+{
+  unsigned char before[TIMSIZE];
+  unsigned int base;
+  int calls = 0, i, a, b, whole = 0;
+  unsigned char sts;
+
+  SysParm.EnaSftFeatures &= ~ENA_UNLOAD_TERM;
+  tim_image (16);
+  connect ();
+  memcpy (before, host_tim, TIMSIZE);
+  expect (0);
+  do
+  {
+    if (calls == after)
+      host_tim_on = 0;
+    sts = TIM_log_info ();
+    calls++;
+  } while (sts && (calls < 1000));
+  HOST_CHECK (calls <= after + SLACK);
+
+  for (i = 0; i < 16; i++)
+  {
+    base = want[LOAD_HISTORY_PRT_ADDR] * 10 + 0x6C4 + i * 40;
+    a = all_or_none (before, base, 8);          /* Date and type pass */
+    HOST_CHECK ((a >= 0) && (a == all_or_none (before, 0x600 + 8 * i, 3)));
+    b = all_or_none (before, base + 8, 2);      /* Volume pass */
+    HOST_CHECK ((b >= 0) && (b == all_or_none (before, 0x606 + 8 * i, 2)));
+    whole += (a == 1) && (b == 1);
+  }
+  HOST_CHECK (whole < 16);
+
+  /* The journal is clean for the next truck */
+  tim_image (3);
+  connect ();
+  expect (0);
+  run_log (0);
+  HOST_CHECK (memcmp (host_tim, want, TIMSIZE) == 0);
+}
+
+int main (void)
+{
+  int n, k;
+
+  srand (31);
+  host_nv_format ();
+  present_time = 1792368000UL;        /* 10/19/26 00:00 */
+  for (n = 0; n < BYTESERIAL; n++)
+    clock_SN[n] = (unsigned char)(0x11 * (n + 1));
+  SysParm.EnaSftFeatures2 &= ~ENA_AUTO_FUEL_TYPE_WRITE;
+
+  for (n = 1; n <= 16; n++)
+    for (k = 0; k < 4; k++)
+      one_log (k & 1, n, k >> 1);
+  for (k = 0; k < 5; k++)             /* Past a history wrap */
+    one_log (0, 16, 0);
+  for (n = 2; n < 30; n += 3)
+    pulled (n);
+  host_tim_on = 0;
+  return host_done ("timlog");
+}
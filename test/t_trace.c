@@ -0,0 +1,169 @@
+/*****************************************************************************
+ *
+ *   t_trace.c -- binary trace ring round trip: xprintf() messages are
+ *                printed to a console file and logged, the ring is read
+ *                out with ModBus function 0x5E, and tracedec must turn
+ *                the responses back into the same console text.  Then the
+ *                ring is overrun and must hand back the newest records
+ *                with the overwritten ones counted.
+ *
+ *****************************************************************************/
+#include "common.h"
+#include <unistd.h>
+#include <fcntl.h>
+
+#define CALLS   4000
+
+/* Message numbers the firmware uses */
+
+static const unsigned char used[] =
+{
+    0,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  14,  15,  16,
+   17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  32,  34,
+   35,  36,  37,  38,  40,  42,  44,  45,  46,  47,  48,  49,  50,  51,  52,
+   53,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,
+   68,  69,  70,  71,  72,  73,  74,  75,  76,  77,  78,  79,  80,  81,  82,
+   83,  84,  85,  86,  87,  88,  89, 100, 101, 108, 109, 110, 111, 112, 113,
+  114, 115, 116, 117, 118, 119, 122, 126, 127, 128, 129, 131, 132, 133, 134,
+  135, 136, 137, 140, 141, 144, 145, 156, 157, 158, 159, 162, 163, 170, 178,
+  179, 216, 217
+};
+
+static char dir[256], path[512];
+
+static const char *in_dir (const char *name)
+{
+  snprintf (path, sizeof path, "%s/%s", dir, name);
+  return path;
+}
+
+/* Read the ring out with 0x5E until it is empty, a response per line.
+   Returns the records read; *lost gets the first response's lost count. */
+
+static int drain (FILE *hex, unsigned char *ids, unsigned int *lost)
+{
+  unsigned char req[5] = { 1, READ_TRACE_BUFFER, 8, 0, 0 };
+  unsigned char rsp[MODBUS_MAX_LEN];
+  unsigned char olen;
+  int i, total = 0;
+
+  for (;;)
+  {
+    olen = 0;
+    HOST_CHECK (modbus_decode (sizeof req, req, &olen, rsp) == 0);
+    if ((olen < 5) || (rsp[2] == 0))
+      return total;
+    if (lost && (total == 0))
+      *lost = ((unsigned int)rsp[3] << 8) | rsp[4];
+    for (i = 0; i < olen; i++)
+      fprintf (hex, "%02X ", rsp[i]);
+    fprintf (hex, "\n");
+    for (i = 0; ids && (i < rsp[2]); i++)
+      ids[total + i] = rsp[5 + i * 8];
+    total += rsp[2];
+  }
+}
+
+/* The console as tracedec should give it back: less what was printed
+   with plain printf() and so never logged.  Here that could only be a
+   failed 1-Wire read of the clock serial number, in Print_Crnt_Time();
+   the DS2401 model answers, but the text is taken out if it shows. */
+
+static const char unlogged[] =
+  "\n\rError 0 Reading the Intellitrol Serial Number DS2401\n\r";
+
+static int same_text (const char *con, const char *dec)
+{
+  static char a[1 << 20], b[1 << 20];
+  FILE *f;
+  size_t na, nb, k;
+  char *p;
+
+  if (!(f = fopen (con, "rb")))
+    return 0;
+  na = fread (a, 1, sizeof a - 1, f);
+  fclose (f);
+  if (!(f = fopen (dec, "rb")))
+    return 0;
+  nb = fread (b, 1, sizeof b - 1, f);
+  fclose (f);
+  a[na] = b[nb] = 0;
+  k = sizeof unlogged - 1;
+  while ((p = strstr (a, unlogged)) != NULL)
+  {
+    memmove (p, p + k, na - (size_t)(p - a) - k + 1);
+    na -= k;
+  }
+  return (na == nb) && (memcmp (a, b, na) == 0);
+}
+
+int main (int argc, char **argv)
+{
+  static char cmd[2048];
+  unsigned char ids[100], sent[100];
+  unsigned int lost;
+  FILE *hex;
+  int out, con, i, n, since = 0;
+  char *slash;
+
+  snprintf (dir, sizeof dir, "%s", argv[0]);
+  slash = strrchr (dir, '/');
+  if (slash)
+    *slash = 0;
+  else
+    strcpy (dir, ".");
+
+  srand (29);
+  modbus_addr = 0;
+  hex = fopen (in_dir ("trace.hex"), "w");
+  HOST_CHECK (hex != NULL);
+
+  /* Console and trace of the same run */
+  fflush (stdout);
+  out = dup (1);
+  con = open (in_dir ("trace.con"), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  dup2 (con, 1);
+  for (i = 0; i < CALLS; i++)
+  {
+    mstimer += (unsigned int)(rand () % 40);
+    xprintf (used[rand () % sizeof used], (unsigned int)(rand () % 4));
+    if (((rand () % 8) == 0) || (++since >= 48)) /* Well inside 64 */
+    {
+      fflush (stdout);
+      drain (hex, NULL, NULL);
+      since = 0;
+    }
+  }
+  fflush (stdout);
+  drain (hex, NULL, NULL);
+  fflush (stdout);
+  dup2 (out, 1);
+  close (con);
+  fclose (hex);
+
+  snprintf (cmd, sizeof cmd, "%s/tracedec -t < %s/trace.hex > %s/trace.dec",
+            dir, dir, dir);
+  HOST_CHECK (system (cmd) == 0);
+  snprintf (cmd, sizeof cmd, "%s/trace.dec", dir);
+  HOST_CHECK (same_text (in_dir ("trace.con"), cmd));
+
+  /* Overrun: the newest 64 come back, the rest counted lost */
+  modbus_addr = 1;                    /* Trace only */
+  for (i = 0; i < 100; i++)
+  {
+    sent[i] = used[rand () % sizeof used];
+    xprintf (sent[i], 0);
+  }
+  hex = fopen (in_dir ("trace_lost.hex"), "w");
+  lost = 0;
+  n = drain (hex, ids, &lost);
+  fclose (hex);
+  HOST_CHECK (n == 64);
+  HOST_CHECK (lost == 100 - 64);
+  HOST_CHECK (memcmp (ids, &sent[100 - 64], 64) == 0);
+  snprintf (cmd, sizeof cmd, "%s/tracedec < %s/trace_lost.hex | grep -q '^-- 36 records lost --$'",
+            dir, dir);
+  HOST_CHECK (system (cmd) == 0);
+
+  return host_done ("trace");
+}
@@ -0,0 +1,325 @@
+/*****************************************************************************
+ *
+ *   t_update.c -- staging a new program image in the SPI update module
+ *                 (spi.c, a W25X80) over ModBus function 0x60, the whole
+ *                 unit running, fw_main() from power-up as in t_modbus,
+ *                 at 115200 baud with no turnaround delay.
+ *
+ *                 The master restarts the image and sends all IMAGE_LEN
+ *                 bytes of a seeded random image, UPD_WINDOW bytes a
+ *                 write at the offset each response gives, then the
+ *                 loader header with Finish.  Once along the way it sends
+ *                 a write at the wrong offset, which must be refused
+ *                 (illegal address) and put right by asking for status.
+ *                 The CRC Finish returns must be the image's; the module
+ *                 must hold the image and the header, with the rest of
+ *                 the header page (features, serial number) as it was;
+ *                 and every page must have been programmed, and every
+ *                 sector erased, once.  A page program must be over
+ *                 while the next window is on the line, so the firmware
+ *                 waits on the part for the sector erases alone, and the
+ *                 update must take no more than the line and those
+ *                 waits.
+ *
+ *                 Printed: the update time from Restart to the Finish
+ *                 response, the frames and image bytes a second it comes
+ *                 to, what the line alone takes for the same frames, the
+ *                 time the firmware spent polling RDSR for a program or
+ *                 erase to end, and the Finish by itself (last page,
+ *                 header page, CRC read back).  CPU time is not virtual
+ *                 time on the host, so the CRC and copies count for
+ *                 nothing here: the figures are the line and the flash.
+ *
+ *****************************************************************************/
+#include "common.h"
+#include "loader.h"
+#include "spi_eeprom.h"
+#include <stdlib.h>
+
+extern int fw_main (void);
+
+#define IMAGE_LEN  (L_BYTE_COUNT_ADDR - 100)  /* Last page a partial one */
+#define UPD_WINDOW 64
+#define BAD_AT     (IMAGE_LEN / 3)    /* The wrong offset goes after this */
+#define T5_NS      3200               /* Timer 5 tick */
+#define CHAR_US    (11000000.0 / 115200)
+#define SE_US      150000ULL          /* Sector erase, spi.c */
+
+typedef enum { S_BOOT, S_SETTLE, S_RESTART, S_WRITE, S_WRONG, S_STATUS,
+               S_FINISH, S_DONE } STEP;
+
+static const unsigned long step_limit[] = { 60000, 3000, 1000, 1000, 1000,
+                                            1000, 5000 };
+
+static unsigned char image[IMAGE_LEN];
+static const unsigned char hdr[8] = { 0x9C, 0xFF, 0x03, 0x00,
+                                      0x5A, 0xA5, 0x12, 0x34 };
+static unsigned char page0[SPI_EEPROM_PAGE_SIZE]; /* Header page, before */
+
+static STEP step;
+static unsigned long step_ms;
+static unsigned long offset;          /* Next image byte to send */
+static int wrong_sent;
+static unsigned long frames;
+static unsigned long chars;           /* Requests and responses */
+static unsigned long long t35_us;     /* Quiet line between frames */
+static unsigned long long start_us, fin_us, done_us;
+static unsigned long long wait0;
+static unsigned long progs0, erases0;
+
+static void next (STEP s)
+{
+  step = s;
+  step_ms = 0;
+}
+
+static void finish (void)
+{
+  double s = (double)(done_us - start_us) / 1e6;
+
+  if (s > 0)
+  {
+    printf ("\nimage of %u bytes, %u a write, 115200 baud, no delay\n",
+            IMAGE_LEN, UPD_WINDOW);
+    printf ("%-24s %10.2f s\n", "update time", s);
+    printf ("%-24s %10lu\n", "frames", frames);
+    printf ("%-24s %10.1f\n", "frames/s", frames / s);
+    printf ("%-24s %10.0f\n", "image bytes/s", IMAGE_LEN / s);
+    printf ("%-24s %10.2f s\n", "line alone",
+            (chars * CHAR_US + (double)frames * t35_us) / 1e6);
+    printf ("%-24s %10.2f s\n", "RDSR polled while busy",
+            (double)(host_spi_wait_us - wait0) / 1e6);
+    printf ("%-24s %10.1f ms\n", "finish",
+            (double)(done_us - fin_us) / 1000);
+    printf ("%-24s %10lu %lu\n", "programs, erases",
+            host_spi_programs - progs0, host_spi_erases - erases0);
+  }
+  fflush (stdout);
+  exit (host_done ("update"));
+}
+
+/* Send operation "op" with the offset or count "at" (ops 2 and 3) and
+   "n" bytes of "data" */
+
+static void send (unsigned char op, unsigned long at,
+                  const unsigned char *data, int n)
+{
+  unsigned char msg[MODBUS_MAX_LEN];
+  int len = 0;
+
+  msg[len++] = 1;
+  msg[len++] = UPDATE_IMAGE;
+  msg[len++] = op;
+  if (op >= 2)
+  {
+    msg[len++] = (unsigned char)(at >> 24);
+    msg[len++] = (unsigned char)(at >> 16);
+    msg[len++] = (unsigned char)(at >> 8);
+    msg[len++] = (unsigned char)at;
+  }
+  memcpy (&msg[len], data, (size_t)n);
+  len += n;
+  host_modbus_send (msg, len);
+  frames++;
+  chars += (unsigned long)len + 2;
+}
+
+/* modbus_CRC() takes an unsigned short count, so a page at a time */
+
+static unsigned int image_crc (void)
+{
+  unsigned int crc = INIT_CRC_SEED;
+  unsigned long at, n;
+
+  for (at = 0; at < IMAGE_LEN; at += n)
+  {
+    n = (IMAGE_LEN - at > SPI_EEPROM_PAGE_SIZE) ? SPI_EEPROM_PAGE_SIZE
+                                                : IMAGE_LEN - at;
+    crc = modbus_CRC (&image[at], (unsigned int)n, crc);
+  }
+  return crc;
+}
+
+static int answered (void)
+{
+  return host_modbus_done_us && (modbus_state == READY);
+}
+
+/* The response to "op": returns the next offset, checks the CRC Finish
+   gives; an exception response gives its code in "exc" */
+
+static unsigned long response (unsigned char op, int *exc)
+{
+  unsigned char r[MODBUS_MAX_LEN];
+  int len = host_modbus_reply (r, sizeof r);
+
+  chars += (unsigned long)len;
+  *exc = 0;
+  HOST_CHECK (len >= 5);
+  HOST_CHECK (modbus_CRC (r, (unsigned int)len - 2, INIT_CRC_SEED)
+              == (unsigned int)(r[len - 2] | (r[len - 1] << 8)));
+  HOST_CHECK (r[0] == 1);
+  if (r[1] == (UPDATE_IMAGE | 0x80))
+  {
+    *exc = r[2];
+    return 0;
+  }
+  HOST_CHECK (r[1] == UPDATE_IMAGE);
+  HOST_CHECK (r[2] == op);
+  HOST_CHECK (len == ((op == 3) ? 11 : 9));
+  if (op == 3)
+    HOST_CHECK ((unsigned int)((r[7] << 8) | r[8]) == image_crc ());
+  return ((unsigned long)r[3] << 24) | ((unsigned long)r[4] << 16)
+         | ((unsigned long)r[5] << 8) | r[6];
+}
+
+static void write_next (void)
+{
+  unsigned long n = IMAGE_LEN - offset;
+
+  if (n > UPD_WINDOW)
+    n = UPD_WINDOW;
+  send (2, offset, &image[offset], (int)n);
+  next (S_WRITE);
+}
+
+static void script (void)
+{
+  unsigned long at;
+  int exc;
+
+  step_ms++;
+  switch (step)
+  {
+    case S_BOOT:
+      if (modbus_state != READY)
+        next (S_SETTLE);
+      break;
+
+    case S_SETTLE:
+      if ((step_ms < 2000) || (main_state != IDLE))
+        break;
+      HOST_CHECK (iambroke == 0);
+      SysParm.ModBusRespWait = 0;
+      SysParm.ModBusBaud = B115200;
+      modbus_baud_override ();
+      modbus_init ();
+      HOST_CHECK (modbus_baud == B115200);
+      t35_us = (unsigned long long)modbus_eom_time * T5_NS / 1000;
+      for (at = 8; at < SPI_EEPROM_PAGE_SIZE; at++)    /* Features etc. */
+        host_spi_mem[L_BYTE_COUNT_ADDR + at] = (unsigned char)(at * 7);
+      memcpy (page0, &host_spi_mem[L_BYTE_COUNT_ADDR], sizeof page0);
+      wait0 = host_spi_wait_us;
+      progs0 = host_spi_programs;
+      erases0 = host_spi_erases;
+      start_us = host_now_us ();
+      send (1, 0, NULL, 0);
+      next (S_RESTART);
+      break;
+
+    case S_RESTART:
+      if (!answered ())
+        break;
+      HOST_CHECK (response (1, &exc) == 0);
+      HOST_CHECK (exc == 0);
+      HOST_CHECK (SysParm.UpdSector == 0);
+      write_next ();
+      break;
+
+    case S_WRITE:
+      if (!answered ())
+        break;
+      at = response (2, &exc);
+      HOST_CHECK (exc == 0);
+      HOST_CHECK (at == offset + ((IMAGE_LEN - offset > UPD_WINDOW)
+                                  ? UPD_WINDOW : IMAGE_LEN - offset));
+      offset = at;
+      if (!wrong_sent && (offset > BAD_AT))
+      {
+        wrong_sent = 1;               /* As if a response had been lost */
+        send (2, offset - UPD_WINDOW, &image[offset - UPD_WINDOW],
+              UPD_WINDOW);
+        next (S_WRONG);
+      }
+      else if (offset < IMAGE_LEN)
+        write_next ();
+      else
+      {
+        fin_us = host_now_us ();
+        send (3, IMAGE_LEN, hdr, sizeof hdr);
+        next (S_FINISH);
+      }
+      break;
+
+    case S_WRONG:
+      if (!answered ())
+        break;
+      (void)response (2, &exc);
+      HOST_CHECK (exc == MB_EXC_ILL_ADDR);
+      send (0, 0, NULL, 0);
+      next (S_STATUS);
+      break;
+
+    case S_STATUS:
+      if (!answered ())
+        break;
+      HOST_CHECK (response (0, &exc) == offset);
+      HOST_CHECK (exc == 0);
+      write_next ();
+      break;
+
+    case S_FINISH:
+      if (!answered ())
+        break;
+      done_us = host_modbus_done_us;
+      HOST_CHECK (response (3, &exc) == IMAGE_LEN);
+      HOST_CHECK (exc == 0);
+      HOST_CHECK (!memcmp (host_spi_mem, image, IMAGE_LEN));
+      HOST_CHECK (!memcmp (&host_spi_mem[L_BYTE_COUNT_ADDR], hdr, sizeof hdr));
+      HOST_CHECK (!memcmp (&host_spi_mem[L_BYTE_COUNT_ADDR + 8], &page0[8],
+                           sizeof page0 - 8));
+      HOST_CHECK (host_spi_programs - progs0
+                  == (IMAGE_LEN + SPI_EEPROM_PAGE_SIZE - 1)
+                     / SPI_EEPROM_PAGE_SIZE + 1);
+      HOST_CHECK (host_spi_erases - erases0
+                  == (IMAGE_LEN + SPI_EEPROM_SECTOR_SIZE - 1)
+                     / SPI_EEPROM_SECTOR_SIZE + 1);
+      HOST_CHECK (SysParm.UpdSector == IMAGE_LEN / SPI_EEPROM_SECTOR_SIZE);
+      HOST_CHECK (host_spi_wait_us - wait0            /* Programs hidden */
+                  < (host_spi_erases - erases0) * SE_US + 50000);
+      HOST_CHECK ((done_us - start_us) * 100          /* Line and flash */
+                  < ((unsigned long long)(chars * CHAR_US) + frames * t35_us
+                     + host_spi_wait_us - wait0) * 105);
+      next (S_DONE);
+      finish ();
+      break;
+
+    default:
+      break;
+  }
+  if ((step < S_DONE) && (step_ms > step_limit[step]))
+  {
+    fprintf (stderr, "offset %lu, step %d: no progress in %lu ms"
+             " (modbus_state %d)\n", offset, (int)step, step_limit[step],
+             (int)modbus_state);
+    host_fails++;
+    finish ();
+  }
+  if (host_fails)
+    finish ();
+}
+
+int main (void)
+{
+  unsigned long i;
+
+  srand (35);
+  for (i = 0; i < IMAGE_LEN; i++)
+    image[i] = (unsigned char)rand ();
+  host_i2c_reset ();
+  OSCCONbits.COSC = 3;                /* Primary oscillator with PLL ... */
+  OSCCONbits.LOCK = 1;                /* ... locked */
+  host_ms_hook = script;
+  fw_main ();
+  return 1;                           /* Not reached */
+}
@@ -0,0 +1,366 @@
+/*****************************************************************************
+ *
+ *   Project:        Rack Controller
+ *
+ *   Module:         timconv.c  (host test build)
+ *
+ *   Description:    Truck ID list conversion between the slot and the
+ *                   packed (sorted) formats, and a capacity and lookup
+ *                   benchmark of the two.
+ *
+ *                      build/timconv -p in out    convert to packed
+ *                      build/timconv -s in out    convert to slots
+ *                      build/timconv -l in        list the Truck IDs
+ *                      build/timconv -b           benchmark
+ *
+ *                   "in" is either an image of the TIM partition (the
+ *                   E2TIMSIZ bytes from TIM_BASE, in either format) or a
+ *                   text list, one serial number per line in hex as -l
+ *                   prints it (the six bytes of a Truck ID, MSB zero).
+ *                   "out" is an image.  The conversion is the firmware's
+ *                   own: the list is erased in the new format and the
+ *                   Truck IDs entered with nvTrkPut() in sorted order, so
+ *                   that the packed blocks are filled.  A list that does
+ *                   not fit the new format (more than E2TIMCNT slots, or
+ *                   more than the packed blocks hold) is refused: nothing
+ *                   is written and the exit status is 2.
+ *
+ *                   On a unit the list is read out with function 0x47 and
+ *                   written back, in the order -l prints it, with 0x46 at
+ *                   the index past the end; a -p run on the list first
+ *                   says whether it fits.
+ *
+ *                   -b fills the packed format with consecutive, fleet
+ *                   (clustered) and spread serial numbers, loaded in order
+ *                   and in random order, until an insert is refused, and
+ *                   times nvTrkFind() hits and misses in both formats with
+ *                   the largest list both hold.  Lookup time on the unit
+ *                   is the EEPROM traffic: the bytes clocked at 400 kHz,
+ *                   nine bit times each, plus a start and a stop per
+ *                   transfer.
+ *
+ *   Revision History:
+ *   Rev      Date      Who   Description of Change Made
+ *  --------  --------- ---  --------------------------------------------
+ *  1.6.38    10/19/26  AGT  New
+ *
+ *****************************************************************************/
+#include "common.h"
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define MAXIDS    40000
+#define SCL_HZ    400000.0
+#define LOOKUPS   200
+
+static unsigned long long ids[MAXIDS];
+static int nids;
+static FILE *out;                     /* stdout; the firmware's goes nowhere */
+
+static int cmp (const void *a, const void *b)
+{
+  unsigned long long x = *(const unsigned long long *)a;
+  unsigned long long y = *(const unsigned long long *)b;
+
+  return (x > y) - (x < y);
+}
+
+static void to_trk (unsigned long long v, unsigned char *trk)
+{
+  int i;
+
+  for (i = BYTESERIAL - 1; i > 0; i--, v >>= 8)
+    trk[i] = (unsigned char)v;
+  trk[0] = 0;
+}
+
+static unsigned long long from_trk (const unsigned char *trk)
+{
+  unsigned long long v = 0;
+  int i;
+
+  for (i = 1; i < BYTESERIAL; i++)
+    v = (v << 8) | trk[i];
+  return v;
+}
+
+/* Sort and drop duplicates (and zero, the "empty" Truck ID) */
+
+static void sort_ids (void)
+{
+  int i, n = 0;
+
+  qsort (ids, (size_t)nids, sizeof ids[0], cmp);
+  for (i = 0; i < nids; i++)
+    if (ids[i] && ((n == 0) || (ids[i] != ids[n - 1])))
+      ids[n++] = ids[i];
+  nids = n;
+}
+
+/* An empty list in the given format */
+
+static void erase_as (int packed)
+{
+  if (packed)
+    SysParm.EnaSftFeatures2 |= ENA_TIM_PACKED;
+  else
+    SysParm.EnaSftFeatures2 &= ~ENA_TIM_PACKED;
+  HOST_CHECK (nvTrkErase () == 0);
+  HOST_CHECK ((nvTrkPacked () != 0) == (packed != 0));
+}
+
+/* The Truck IDs in the partition now, either format */
+
+static void read_list (void)
+{
+  unsigned char trk[BYTESERIAL];
+  unsigned int i, max;
+
+  nids = 0;
+  max = nvTrkPacked () ? MAXIDS : E2TIMCNT;
+  for (i = 0; i < max; i++)
+  {
+    if (nvTrkGet (trk, (word)i) != 0)
+      continue;
+    if (from_trk (trk) != 0)
+      ids[nids++] = from_trk (trk);
+    else if (nvTrkPacked ())
+      break;                          /* Past the end */
+  }
+}
+
+/* Enter ids[] in order; returns how many went in before one was refused */
+
+static int load_list (void)
+{
+  unsigned char trk[BYTESERIAL];
+  int i;
+
+  for (i = 0; i < nids; i++)
+  {
+    if (!nvTrkPacked () && (i >= E2TIMCNT))
+      break;
+    to_trk (ids[i], trk);
+    if (nvTrkPut (trk, (word)i) != 0)
+      break;
+  }
+  return i;
+}
+
+static int read_input (const char *file)
+{
+  static unsigned char img[E2TIMSIZ + 1];
+  char line[128];
+  size_t n;
+  FILE *f;
+
+  if ((f = fopen (file, "rb")) == NULL)
+  {
+    perror (file);
+    return -1;
+  }
+  n = fread (img, 1, sizeof img, f);
+  nids = 0;
+  if (n == E2TIMSIZ)                  /* Partition image */
+  {
+    memcpy (&host_eeprom[TIM_BASE], img, E2TIMSIZ);
+    nvTrkInit ();
+    read_list ();
+  }
+  else                                /* Text list */
+  {
+    rewind (f);
+    while ((nids < MAXIDS) && fgets (line, sizeof line, f))
+      if (line[0] != '#')
+        ids[nids++] = strtoull (line, NULL, 16) & 0xFFFFFFFFFFULL;
+  }
+  fclose (f);
+  sort_ids ();
+  return 0;
+}
+
+static int convert (int packed, const char *in, const char *to)
+{
+  FILE *f;
+  int n;
+
+  if (read_input (in))
+    return 1;
+  erase_as (packed);
+  n = load_list ();
+  if (n < nids)
+  {
+    fprintf (stderr, "timconv: %d Truck IDs, only %d fit the %s format;"
+             " nothing written\n", nids, n, packed ? "packed" : "slot");
+    return 2;
+  }
+  if (((f = fopen (to, "wb")) == NULL)
+      || (fwrite (&host_eeprom[TIM_BASE], 1, E2TIMSIZ, f) != E2TIMSIZ)
+      || fclose (f))
+  {
+    perror (to);
+    return 1;
+  }
+  fprintf (out, "%d Truck IDs, %s format\n", nids, packed ? "packed" : "slot");
+  return 0;
+}
+
+/* -b: capacity and lookup */
+
+static unsigned long long rnd40 (void)
+{
+  return ((((unsigned long long)rand () << 31) ^ (unsigned long long)rand ())
+          & 0xFFFFFFFFFFULL);
+}
+
+static void make_set (int kind, int n)
+{
+  unsigned long long base = 0;
+
+  nids = 0;
+  while (nids < n)
+  {
+    if (kind == 0)                    /* Consecutive */
+    {
+      ids[nids] = 0x100000ULL + (unsigned long long)nids;
+      nids++;
+    }
+    else if (kind == 1)               /* Fleets of 60, steps of 1 - 3 */
+    {
+      if ((nids % 60) == 0)
+        base = rnd40 ();
+      base += 1 + (unsigned long long)(rand () % 3);
+      ids[nids++] = base;
+    }
+    else                              /* Spread over the whole range */
+      ids[nids++] = rnd40 ();
+    if (nids == n)
+      sort_ids ();                    /* Could have made duplicates */
+  }
+}
+
+static void shuffle (void)
+{
+  unsigned long long t;
+  int i, k;
+
+  for (i = nids - 1; i > 0; i--)
+  {
+    k = rand () % (i + 1);
+    t = ids[i];
+    ids[i] = ids[k];
+    ids[k] = t;
+  }
+}
+
+static double now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* A serial number not in (sorted) ids[] */
+
+static unsigned long long unlisted (void)
+{
+  unsigned long long v;
+
+  do
+    v = rnd40 ();
+  while ((v == 0) || bsearch (&v, ids, (size_t)nids, sizeof ids[0], cmp));
+  return v;
+}
+
+/* Lookups of Truck IDs listed (hit) or not: I2C starts and bytes, bus
+   time at 400 kHz and host time, per lookup */
+
+static void lookup (const char *name, int hit)
+{
+  unsigned char trk[BYTESERIAL];
+  unsigned long starts, bytes;
+  word index;
+  double t;
+  int i, found = 0;
+
+  starts = host_i2c_starts;
+  bytes = host_i2c_bytes;
+  t = now_ns ();
+  for (i = 0; i < LOOKUPS; i++)
+  {
+    to_trk (hit ? ids[rand () % nids] : unlisted (), trk);
+    badvipflag &= ~(BVF_DONE | BVF_UNAUTH);
+    found += (nvTrkFind (trk, &index) == 0);
+  }
+  t = (now_ns () - t) / LOOKUPS;
+  starts = host_i2c_starts - starts;
+  bytes = host_i2c_bytes - bytes;
+  HOST_CHECK (found == (hit ? LOOKUPS : 0));
+  fprintf (out, "  %-18s %10.1f %10.1f %10.2f %10.1f\n", name,
+          (double)starts / LOOKUPS, (double)bytes / LOOKUPS,
+          ((double)bytes * 9 + (double)starts * 2) / SCL_HZ * 1000 / LOOKUPS,
+          t / 1000);
+}
+
+static int bench (void)
+{
+  static const char *const kind[] = { "consecutive", "fleets of 60", "spread" };
+  int k, n, order, cap[3][2];
+
+  srand (1025);
+  for (k = 0; k < 3; k++)
+    for (order = 0; order < 2; order++)
+    {
+      make_set (k, MAXIDS);
+      if (order)
+        shuffle ();
+      erase_as (TRUE);
+      cap[k][order] = load_list ();
+    }
+
+  fprintf (out, "Capacity, Truck IDs     in order     random order\n");
+  for (k = 0; k < 3; k++)
+    fprintf (out, "  %-18s %10d %14d\n", kind[k], cap[k][0], cap[k][1]);
+  fprintf (out, "  %-18s %10d %14d\n", "slots (any)", E2TIMCNT, E2TIMCNT);
+
+  n = E2TIMCNT;
+  fprintf (out, "\nLookup, %d spread    I2C starts     bytes    bus ms    host us\n", n);
+  make_set (2, n);
+  erase_as (FALSE);
+  HOST_CHECK (load_list () == n);
+  lookup ("slots, hit", 1);
+  lookup ("slots, miss", 0);
+  erase_as (TRUE);
+  HOST_CHECK (load_list () == n);
+  lookup ("packed, hit", 1);
+  lookup ("packed, miss", 0);
+  return host_fails ? 1 : 0;
+}
+
+int main (int argc, char **argv)
+{
+  char opt = (argc > 1) && (argv[1][0] == '-') ? argv[1][1] : 0;
+  int i;
+
+  fflush (stdout);
+  out = fdopen (dup (1), "w");
+  dup2 (open ("/dev/null", O_WRONLY), 1);
+  host_nv_format ();
+  if ((opt == 'b') && (argc == 2))
+    return bench ();
+  if (((opt == 'p') || (opt == 's')) && (argc == 4))
+    return convert (opt == 'p', argv[2], argv[3]);
+  if ((opt == 'l') && (argc == 3))
+  {
+    if (read_input (argv[2]))
+      return 1;
+    for (i = 0; i < nids; i++)
+      fprintf (out, "%012llX\n", ids[i]);
+    return 0;
+  }
+  fprintf (stderr, "usage: timconv -p|-s in out | -l in | -b\n");
+  return 1;
+}
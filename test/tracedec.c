@@ -0,0 +1,192 @@
+/*****************************************************************************
+ *
+ *   Project:        Rack Controller
+ *
+ *   Module:         tracedec.c  (host test build)
+ *
+ *   Description:    Binary trace decoder.  Reads ModBus function 0x5E
+ *                   responses (as sent, address byte first, CRC optional),
+ *                   one per line in hex, and prints each trace record with
+ *                   the debug text the unit would have printed for it.
+ *
+ *                      build/tracedec [-t] < responses.hex
+ *
+ *                   The text comes from the firmware's own xprintf(), so
+ *                   it is the printout.c message table itself.  The
+ *                   records are replayed in order, oldest first, because
+ *                   xprintf() prints some messages only once until another
+ *                   message re-arms them.  Messages that print the time or
+ *                   the clock status (Print_Crnt_Time(), report_clock())
+ *                   logged those parts as records of their own; those two
+ *                   are linked (--wrap) to print the records that follow
+ *                   instead of reading this machine's clock.  Texts that
+ *                   show other firmware state (not logged) show the
+ *                   decoder's, not the unit's, and plain printf() output
+ *                   (not through xprintf()) was never logged.
+ *
+ *                   -t prints the texts only, as the console would have
+ *                   shown them; else each record is preceded by a line with
+ *                   its ms stamp, context (interrupt priority, 0 = main
+ *                   loop), message number and parameters, and records lost
+ *                   to overwrite are marked.
+ *
+ *   Revision History:
+ *   Rev      Date      Who   Description of Change Made
+ *  --------  --------- ---  --------------------------------------------
+ *  1.6.38    10/19/26  AGT  New
+ *
+ *****************************************************************************/
+#include "common.h"
+
+#define TRACE_RECSIZ  8               /* See mbcRdTrace() */
+#define MAXREC        100000
+
+typedef struct
+{
+  unsigned char  id;
+  unsigned char  ctx;
+  unsigned int   stamp;
+  unsigned int   arg1;
+  unsigned int   arg2;
+  unsigned int   lost;                /* Lost just before this one */
+} DECREC;
+
+static DECREC rec[MAXREC];
+static int nrec, next;
+
+/* Print the records that follow, up to "max" of them, while they are one
+   of the "n" message numbers in "ids" */
+
+static void replay_nested (const unsigned char *ids, int n, int max)
+{
+  int i;
+
+  while ((max-- > 0) && (next < nrec))
+  {
+    for (i = 0; (i < n) && (ids[i] != rec[next].id); i++)
+      ;
+    if (i == n)
+      return;
+    next++;
+    xprintf (rec[next - 1].id, rec[next - 1].arg1);
+  }
+}
+
+/* Read_Clock()'s family code error if any, then month, day, year, hour,
+   minute, second */
+
+void __wrap_Print_Crnt_Time (void)
+{
+  static const unsigned char err[] = { 158 };
+  static const unsigned char ids[] = { 52, 53, 54 };
+
+  replay_nested (err, sizeof err, 1);
+  replay_nested (ids, sizeof ids, 6);
+}
+
+/* Clock status, then "OK" and the serial number if it was */
+
+void __wrap_report_clock (void)
+{
+  static const unsigned char sts[] = { 59 };
+  static const unsigned char ok[] = { 58 };
+  static const unsigned char sn[] = { 55 };
+
+  replay_nested (sts, sizeof sts, 1);
+  if ((next < nrec) && (rec[next].id == ok[0]))
+  {
+    replay_nested (ok, sizeof ok, 1);
+    replay_nested (sn, sizeof sn, BYTESERIAL);
+  }
+}
+
+static int hexval (int c)
+{
+  if ((c >= '0') && (c <= '9'))
+    return c - '0';
+  c = tolower (c);
+  return ((c >= 'a') && (c <= 'f')) ? c - 'a' + 10 : -1;
+}
+
+/* One response line: address, 0x5E, count, lost (2), records */
+
+static int parse (const char *line, int lineno)
+{
+  unsigned char b[256];
+  unsigned int lost;
+  int n = 0, hi, lo, i, count;
+  const unsigned char *p;
+
+  while (*line)
+  {
+    if ((hi = hexval (*line)) < 0)
+    {
+      line++;
+      continue;
+    }
+    if ((lo = hexval (line[1])) < 0)
+      break;
+    if (n < (int)sizeof b)
+      b[n++] = (unsigned char)((hi << 4) | lo);
+    line += 2;
+  }
+  if (n == 0)
+    return 0;
+  if ((n < 5) || (b[1] != READ_TRACE_BUFFER))
+  {
+    fprintf (stderr, "line %d: not a 0x5E response\n", lineno);
+    return -1;
+  }
+  count = b[2];
+  lost = ((unsigned int)b[3] << 8) | b[4];
+  if (n < 5 + count * TRACE_RECSIZ)
+  {
+    fprintf (stderr, "line %d: %d records, %d bytes\n", lineno, count, n);
+    return -1;
+  }
+  for (i = 0; (i < count) && (nrec < MAXREC); i++)
+  {
+    p = &b[5 + i * TRACE_RECSIZ];
+    rec[nrec].id = p[0];
+    rec[nrec].ctx = p[1];
+    rec[nrec].stamp = ((unsigned int)p[2] << 8) | p[3];
+    rec[nrec].arg1 = ((unsigned int)p[4] << 8) | p[5];
+    rec[nrec].arg2 = ((unsigned int)p[6] << 8) | p[7];
+    rec[nrec].lost = i ? 0 : lost;
+    nrec++;
+  }
+  return 0;
+}
+
+int main (int argc, char **argv)
+{
+  static char line[1024];
+  int texts, lineno = 0;
+  DECREC *r;
+
+  texts = (argc > 1) && (strcmp (argv[1], "-t") == 0);
+  while (fgets (line, sizeof line, stdin))
+  {
+    lineno++;
+    if ((line[0] != '#') && (parse (line, lineno) != 0))
+      return 1;
+  }
+
+  modbus_addr = 0;                    /* xprintf() prints only then */
+  next = 0;
+  while (next < nrec)
+  {
+    r = &rec[next++];
+    if (!texts)
+    {
+      if (r->lost)
+        printf ("\n-- %u records lost --", r->lost);
+      printf ("\n[%5u ms  ipl %u  #%u  %u, %u]\n", r->stamp, r->ctx, r->id,
+              r->arg1, r->arg2);
+    }
+    xprintf (r->id, r->arg1);
+  }
+  if (!texts)
+    printf ("\n");
+  return 0;
+}